@@ -0,0 +1,321 @@
+/****************************************************************************
+ * dbf.hpp
+ ****************************************************************************
+ * C++17 interface to libdbf
+ *
+ ****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#ifndef __LIBDBF_HPP__
+#define __LIBDBF_HPP__
+
+#include <charconv>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "libdbf.h"
+
+/*! \file dbf.hpp
+	\brief C++17 interface to libdbf
+
+	dbf::table owns an opened file and closes it when it goes out of
+	scope. Its records can be iterated with a range based for loop; every
+	record is a view of a buffer owned by the loop, so fields are returned
+	as std::string_view without copying:
+
+	\code
+	dbf::table t("customer.dbf");
+	int amount = t.column("AMOUNT");
+	for (auto rec : t.records()) {
+		if (!rec.deleted())
+			total += rec.get<double>(amount);
+	}
+	\endcode
+
+	A view is only valid until the loop advances to the next record.
+	All functions of the C interface can be used with \ref dbf::table::get.
+*/
+
+namespace dbf {
+
+/*! \class error
+	\brief thrown if a file cannot be opened or a field cannot be converted
+*/
+class error : public std::runtime_error {
+public:
+	explicit error(const std::string &what) : std::runtime_error(what) {}
+};
+
+class table;
+
+namespace detail {
+
+/* Position and width of a column within a record */
+struct column_info {
+	std::string_view name;
+	char type;
+	int offset;
+	int width;
+};
+
+inline std::string_view trim(std::string_view s)
+{
+	while (!s.empty() && s.front() == ' ')
+		s.remove_prefix(1);
+	while (!s.empty() && s.back() == ' ')
+		s.remove_suffix(1);
+	return s;
+}
+
+} // namespace detail
+
+/*! \class record
+	\brief view of a single record
+*/
+class record {
+public:
+	record(const char *data, const std::vector<detail::column_info> *columns) noexcept
+		: data_(data), columns_(columns) {}
+
+	/*! true if the record is marked as deleted */
+	bool deleted() const noexcept { return data_[0] == '*'; }
+
+	/*! raw contents of a field, including the padding */
+	std::string_view field(int column) const
+	{
+		const detail::column_info &c = columns_->at(column);
+		return std::string_view(data_ + c.offset, c.width);
+	}
+
+	/*! contents of a field without leading and trailing blanks */
+	std::string_view text(int column) const { return detail::trim(field(column)); }
+
+	/*! the raw record including the deletion flag */
+	const char *data() const noexcept { return data_; }
+
+	/*! Converts a field to T, which can be std::string_view (trimmed),
+		std::string (trimmed), bool or any arithmetic type. Blank fields
+		give T(). */
+	template <typename T>
+	T get(int column) const
+	{
+		std::string_view s = text(column);
+
+		if constexpr (std::is_same_v<T, std::string_view>) {
+			return s;
+		} else if constexpr (std::is_same_v<T, std::string>) {
+			return std::string(s);
+		} else if constexpr (std::is_same_v<T, bool>) {
+			return !s.empty() && (s[0] == 'T' || s[0] == 't' || s[0] == 'Y' || s[0] == 'y');
+		} else if constexpr (std::is_integral_v<T>) {
+			T value{};
+			if (s.empty())
+				return value;
+			if (s[0] == '+')
+				s.remove_prefix(1);
+			auto res = std::from_chars(s.data(), s.data() + s.size(), value);
+			/* decimals of numeric fields are cut off */
+			if (res.ec != std::errc() || (res.ptr != s.data() + s.size() && *res.ptr != '.'))
+				throw error("dbf: not an integer: " + std::string(s));
+			return value;
+		} else if constexpr (std::is_floating_point_v<T>) {
+			char buf[256];
+			char *end;
+			if (s.empty())
+				return T();
+			if (s.size() >= sizeof(buf))
+				throw error("dbf: field too long");
+			s.copy(buf, s.size());
+			buf[s.size()] = '\0';
+			T value = static_cast<T>(std::strtod(buf, &end));
+			if (end != buf + s.size())
+				throw error("dbf: not a number: " + std::string(s));
+			return value;
+		} else {
+			static_assert(std::is_same_v<T, void>, "dbf::record::get: unsupported type");
+		}
+	}
+
+private:
+	const char *data_;
+	const std::vector<detail::column_info> *columns_;
+};
+
+/*! \class record_range
+	\brief input range over the records of a table, see \ref dbf::table::records
+*/
+class record_range {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = record;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = record;
+
+		iterator() noexcept : range_(nullptr) {}
+		explicit iterator(record_range *range) : range_(range) { advance(); }
+
+		record operator*() const noexcept { return record(range_->buf_.data(), range_->columns_); }
+		iterator &operator++() { advance(); return *this; }
+		void operator++(int) { advance(); }
+		bool operator==(const iterator &other) const noexcept { return range_ == other.range_; }
+		bool operator!=(const iterator &other) const noexcept { return range_ != other.range_; }
+
+	private:
+		void advance()
+		{
+			if (range_ && 0 > dbf_ReadRecord(range_->p_dbf_, range_->buf_.data(), (int) range_->buf_.size()))
+				range_ = nullptr;
+		}
+		record_range *range_;
+	};
+
+	record_range(P_DBF *p_dbf, const std::vector<detail::column_info> *columns, int record_length)
+		: p_dbf_(p_dbf), columns_(columns), buf_(record_length) {}
+
+	/*! starts reading at the first record */
+	iterator begin()
+	{
+		dbf_SetRecordOffset(p_dbf_, 1);
+		return iterator(this);
+	}
+	iterator end() noexcept { return iterator(); }
+
+private:
+	P_DBF *p_dbf_;
+	const std::vector<detail::column_info> *columns_;
+	std::vector<char> buf_;
+};
+
+/*! \class table
+	\brief move-only owner of an opened dbf file
+*/
+class table {
+public:
+	table() noexcept : p_dbf_(nullptr) {}
+
+	/*! opens file with \ref dbf_OpenFlags, throws dbf::error on failure */
+	explicit table(const char *file, int flags = 0) : p_dbf_(dbf_OpenFlags(file, flags))
+	{
+		if (!p_dbf_)
+			throw error(std::string("dbf: cannot open ") + file);
+		load_columns();
+	}
+	explicit table(const std::string &file, int flags = 0) : table(file.c_str(), flags) {}
+
+	/*! takes ownership of a handle of the C interface */
+	explicit table(P_DBF *p_dbf) : p_dbf_(p_dbf)
+	{
+		if (p_dbf_)
+			load_columns();
+	}
+
+	~table() { close(); }
+
+	table(const table &) = delete;
+	table &operator=(const table &) = delete;
+
+	table(table &&other) noexcept
+		: p_dbf_(std::exchange(other.p_dbf_, nullptr)), columns_(std::move(other.columns_)) {}
+
+	table &operator=(table &&other) noexcept
+	{
+		if (this != &other) {
+			close();
+			p_dbf_ = std::exchange(other.p_dbf_, nullptr);
+			columns_ = std::move(other.columns_);
+		}
+		return *this;
+	}
+
+	/*! closes the file, returns the result of \ref dbf_Close */
+	int close() noexcept
+	{
+		int ret = 0;
+		if (p_dbf_)
+			ret = dbf_Close(std::exchange(p_dbf_, nullptr));
+		columns_.clear();
+		return ret;
+	}
+
+	/*! the handle for functions of the C interface */
+	P_DBF *get() const noexcept { return p_dbf_; }
+	/*! gives up ownership of the handle */
+	P_DBF *release() noexcept
+	{
+		columns_.clear();
+		return std::exchange(p_dbf_, nullptr);
+	}
+	explicit operator bool() const noexcept { return p_dbf_ != nullptr; }
+
+	/*! number of records, see \ref dbf_NumRows */
+	std::size_t rows() const
+	{
+		int n = dbf_NumRows(p_dbf_);
+		return n > 0 ? n : 0;
+	}
+	/*! number of columns */
+	int columns() const noexcept { return (int) columns_.size(); }
+	/*! length of a record including the deletion flag */
+	int record_length() const { return dbf_RecordLength(p_dbf_); }
+
+	/*! number of the column called name or -1 */
+	int column(std::string_view name) const noexcept
+	{
+		for (std::size_t i = 0; i < columns_.size(); i++) {
+			if (columns_[i].name == name)
+				return (int) i;
+		}
+		return -1;
+	}
+	std::string_view column_name(int column) const { return columns_.at(column).name; }
+	char column_type(int column) const { return columns_.at(column).type; }
+	int column_size(int column) const { return columns_.at(column).width; }
+	int column_decimals(int column) const { return dbf_ColumnDecimals(p_dbf_, column); }
+
+	/*! all records from the first one */
+	record_range records() { return record_range(p_dbf_, &columns_, record_length()); }
+
+	/*! view of a record read into buf by a function of the C interface */
+	record view(const char *buf) const noexcept { return record(buf, &columns_); }
+
+private:
+	void load_columns()
+	{
+		int offset = 1;
+		int n = dbf_NumCols(p_dbf_);
+
+		columns_.reserve(n > 0 ? n : 0);
+		for (int i = 0; i < n; i++) {
+			detail::column_info c;
+			c.name = dbf_ColumnName(p_dbf_, i);
+			c.type = dbf_ColumnType(p_dbf_, i);
+			c.offset = offset;
+			c.width = dbf_ColumnSize(p_dbf_, i);
+			offset += c.width;
+			columns_.push_back(c);
+		}
+	}
+
+	P_DBF *p_dbf_;
+	std::vector<detail::column_info> columns_;
+};
+
+} // namespace dbf
+
+#endif
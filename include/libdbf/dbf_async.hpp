@@ -0,0 +1,251 @@
+/****************************************************************************
+ * dbf_async.hpp
+ ****************************************************************************
+ * C++20 coroutine interface for scanning tables from an event loop
+ *
+ ****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#ifndef __LIBDBF_ASYNC_HPP__
+#define __LIBDBF_ASYNC_HPP__
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "dbf.hpp"
+
+/*! \file dbf_async.hpp
+	\brief scanning tables from coroutines
+
+	\ref dbf::async_scan returns a stream of record batches. Awaiting the
+	next batch hands the positional read (\ref dbf_ReadRecords) to a
+	\ref dbf::thread_pool, so the thread running the event loop never
+	blocks on the disk and can interleave scans of many tables with
+	network I/O:
+
+	\code
+	dbf::thread_pool pool(4);
+
+	task serve(dbf::table &t)
+	{
+		auto scan = dbf::async_scan(t, pool, 4096, [](std::coroutine_handle<> h) {
+			loop.post(h);      // resume on the event loop thread
+		});
+		while (auto batch = co_await scan.next()) {
+			for (std::size_t i = 0; i < batch->size(); i++)
+				send((*batch)[i]);
+		}
+	}
+	\endcode
+
+	Without a resume function the coroutine continues on the pool thread
+	that finished the read. A batch is valid until next() is awaited
+	again. Only one next() of a stream may be pending at a time, but any
+	number of streams can be active on the same or different tables.
+	Streams of the same compressed table take turns reading, see
+	\ref dbf_ReadRecords. A stream may be moved or destroyed while a read
+	is pending; the read finishes on its own state.
+*/
+
+namespace dbf {
+
+/*! \class thread_pool
+	\brief fixed number of threads running submitted jobs in order
+*/
+class thread_pool {
+public:
+	explicit thread_pool(unsigned threads = std::thread::hardware_concurrency())
+	{
+		if (threads == 0)
+			threads = 1;
+		for (unsigned i = 0; i < threads; i++)
+			threads_.emplace_back([this] { run(); });
+	}
+
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cond_.notify_all();
+		for (auto &t : threads_)
+			t.join();
+	}
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+
+	void submit(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			jobs_.push_back(std::move(job));
+		}
+		cond_.notify_one();
+	}
+
+private:
+	void run()
+	{
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cond_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+				if (jobs_.empty())
+					return;
+				job = std::move(jobs_.front());
+				jobs_.pop_front();
+			}
+			job();
+		}
+	}
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<std::function<void()>> jobs_;
+	std::vector<std::thread> threads_;
+	bool stop_ = false;
+};
+
+/*! \class record_batch
+	\brief view of consecutive records read by \ref dbf::record_stream
+*/
+class record_batch {
+public:
+	record_batch(const table *t, const char *data, std::uint32_t first, std::size_t n, int record_length) noexcept
+		: table_(t), data_(data), first_(first), size_(n), record_length_(record_length) {}
+
+	/*! number of the first record in the batch, counting from 0 */
+	std::uint32_t first() const noexcept { return first_; }
+	std::size_t size() const noexcept { return size_; }
+	bool empty() const noexcept { return size_ == 0; }
+	record operator[](std::size_t i) const noexcept { return table_->view(data_ + i * record_length_); }
+
+private:
+	const table *table_;
+	const char *data_;
+	std::uint32_t first_;
+	std::size_t size_;
+	int record_length_;
+};
+
+/*! \class record_stream
+	\brief asynchronous stream of record batches, see \ref dbf::async_scan
+*/
+class record_stream {
+public:
+	using resume_fn = std::function<void(std::coroutine_handle<>)>;
+
+private:
+	struct state;
+
+public:
+	record_stream(table &t, thread_pool &pool, std::size_t batch_records, resume_fn resume)
+		: state_(std::make_shared<state>(t, pool, batch_records, std::move(resume))) {}
+
+	class next_awaitable {
+	public:
+		explicit next_awaitable(std::shared_ptr<state> s) noexcept : s_(std::move(s)) {}
+
+		bool await_ready() const noexcept { return s_->done_; }
+
+		void await_suspend(std::coroutine_handle<> h)
+		{
+			/* the job owns the state, so moving the stream meanwhile is fine */
+			std::shared_ptr<state> s = s_;
+			s->pool_->submit([s, h] {
+				s->read();
+				if (s->resume_)
+					s->resume_(h);
+				else
+					h.resume();
+			});
+		}
+
+		/*! the next batch or std::nullopt at the end of the table */
+		std::optional<record_batch> await_resume()
+		{
+			if (s_->failed_)
+				throw error("dbf: reading records failed");
+			if (s_->done_)
+				return std::nullopt;
+			return record_batch(s_->table_, s_->buf_.data(), s_->first_, s_->count_, s_->record_length_);
+		}
+
+	private:
+		std::shared_ptr<state> s_;
+	};
+
+	/*! reads the next batch on the thread pool */
+	next_awaitable next() noexcept { return next_awaitable(state_); }
+
+private:
+	/* everything a pending read touches, kept at a fixed address */
+	struct state {
+		state(table &t, thread_pool &pool, std::size_t batch_records, resume_fn resume)
+			: table_(&t), pool_(&pool), resume_(std::move(resume)),
+			  record_length_(t.record_length()),
+			  batch_records_(batch_records ? batch_records : 1),
+			  buf_(batch_records_ * record_length_) {}
+
+		/* runs on a pool thread */
+		void read() noexcept
+		{
+			int n;
+
+			first_ = next_;
+			n = dbf_ReadRecords(table_->get(), first_, (std::uint32_t) batch_records_, buf_.data());
+			if (n < 0) {
+				failed_ = done_ = true;
+			} else if (n == 0) {
+				done_ = true;
+			}
+			count_ = n > 0 ? n : 0;
+			next_ = first_ + count_;
+		}
+
+		table *table_;
+		thread_pool *pool_;
+		resume_fn resume_;
+		int record_length_;
+		std::size_t batch_records_;
+		std::vector<char> buf_;
+		std::uint32_t first_ = 0;
+		std::uint32_t next_ = 0;
+		std::size_t count_ = 0;
+		bool done_ = false;
+		bool failed_ = false;
+	};
+
+	std::shared_ptr<state> state_;
+};
+
+/*! Scans all records of \a t in batches of \a batch_records. The reads
+	run on \a pool; \a resume is called with the waiting coroutine when a
+	batch is ready and should schedule it on the event loop. */
+inline record_stream async_scan(table &t, thread_pool &pool, std::size_t batch_records = 1024,
+	record_stream::resume_fn resume = nullptr)
+{
+	return record_stream(t, pool, batch_records, std::move(resume));
+}
+
+} // namespace dbf
+
+#endif
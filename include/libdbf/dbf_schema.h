@@ -0,0 +1,211 @@
+/****************************************************************************
+ * dbf_schema.h
+ ****************************************************************************
+ * Record structures for tables with a layout known at compile time
+ *
+ ****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#ifndef __LIBDBF_SCHEMA_H__
+#define __LIBDBF_SCHEMA_H__
+
+#include <stddef.h>
+#include <string.h>
+#include "libdbf.h"
+
+/*! \file dbf_schema.h
+	\brief record structures for tables with a fixed layout
+
+	If the layout of a table is known when the programme is compiled, its
+	columns can be listed once with name, type, length and decimals:
+
+	\code
+	#define CUSTOMER(F) \
+		F(NAME,   'C', 20, 0) \
+		F(AMOUNT, 'N', 10, 2) \
+		F(ACTIVE, 'L',  1, 0)
+
+	DBF_DEFINE_SCHEMA(customer, CUSTOMER)
+	\endcode
+
+	This defines struct customer with the deletion flag and one character
+	array per column, laid out exactly like a record in the file, and the
+	functions
+
+	- int customer_check(P_DBF *p_dbf), returns 0 if the opened table has
+	  exactly these columns and -1 otherwise,
+	- P_DBF *customer_open(const char *file), opens the file with
+	  \ref dbf_Open and checks its layout once,
+	- const struct customer *customer_record(const char *record), views a
+	  record read with \ref dbf_ReadRecord or \ref dbf_FetchRecords.
+
+	Offsets and widths of all fields are constants, so accessing them
+	needs neither \ref dbf_ColumnAddress nor a switch on the type:
+
+	\code
+	const struct customer *c = customer_record(record);
+	long amount = DBF_GET_LONG(c, AMOUNT);
+	\endcode
+*/
+
+#if defined(__cplusplus) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#define DBF_SCHEMA_INLINE static inline
+#elif defined(__GNUC__)
+#define DBF_SCHEMA_INLINE static __inline__
+#else
+#define DBF_SCHEMA_INLINE static
+#endif
+
+/* Expansions of the column list */
+#define DBF_SCHEMA_MEMBER(name, type, len, dec) char name[len];
+#define DBF_SCHEMA_LENGTH(name, type, len, dec) + (len)
+#define DBF_SCHEMA_COUNT(name, type, len, dec) + 1
+#define DBF_SCHEMA_CHECK(name, type, len, dec) \
+	if (strcmp(dbf_ColumnName(p_dbf, column), #name) \
+	 || dbf_ColumnType(p_dbf, column) != (type) \
+	 || dbf_ColumnSize(p_dbf, column) != (len) \
+	 || dbf_ColumnDecimals(p_dbf, column) != (dec)) { \
+		return -1; \
+	} \
+	column++;
+
+/*! \def DBF_DEFINE_SCHEMA
+	Defines the record structure and functions for the column list FIELDS,
+	see \ref dbf_schema.h
+*/
+#define DBF_DEFINE_SCHEMA(schema, FIELDS) \
+	struct schema { \
+		char deleted; \
+		FIELDS(DBF_SCHEMA_MEMBER) \
+	}; \
+	/* character arrays are never padded */ \
+	typedef char schema##_size_check[sizeof(struct schema) == 1 FIELDS(DBF_SCHEMA_LENGTH) ? 1 : -1]; \
+	DBF_SCHEMA_INLINE int schema##_check(P_DBF *p_dbf) \
+	{ \
+		int column = 0; \
+		if (dbf_NumCols(p_dbf) != 0 FIELDS(DBF_SCHEMA_COUNT) \
+		 || dbf_RecordLength(p_dbf) != (int) sizeof(struct schema)) { \
+			return -1; \
+		} \
+		FIELDS(DBF_SCHEMA_CHECK) \
+		return 0; \
+	} \
+	DBF_SCHEMA_INLINE P_DBF *schema##_open(const char *file) \
+	{ \
+		P_DBF *p_dbf = dbf_Open(file); \
+		if (p_dbf != NULL && 0 > schema##_check(p_dbf)) { \
+			dbf_Close(p_dbf); \
+			return NULL; \
+		} \
+		return p_dbf; \
+	} \
+	DBF_SCHEMA_INLINE const struct schema *schema##_record(const char *record) \
+	{ \
+		return (const struct schema *) record; \
+	}
+
+/*! \def DBF_FIELD_OFFSET Offset of a field within the record */
+#define DBF_FIELD_OFFSET(schema, name) offsetof(struct schema, name)
+/*! \def DBF_FIELD_WIDTH Length of a field */
+#define DBF_FIELD_WIDTH(rec, name) sizeof((rec)->name)
+/*! \def DBF_IS_DELETED True if the record is marked as deleted */
+#define DBF_IS_DELETED(rec) ((rec)->deleted == '*')
+/*! \def DBF_GET_LONG Value of a numeric field without decimals */
+#define DBF_GET_LONG(rec, name) dbf_SchemaLong((rec)->name, sizeof((rec)->name))
+/*! \def DBF_GET_DOUBLE Value of a numeric field */
+#define DBF_GET_DOUBLE(rec, name) dbf_SchemaDouble((rec)->name, sizeof((rec)->name))
+/*! \def DBF_GET_BOOL Value of a logical field, 1 for T, t, Y and y */
+#define DBF_GET_BOOL(rec, name) dbf_SchemaBool((rec)->name[0])
+/*! \def DBF_GET_STRING Copies a character field without trailing blanks
+	into buf, which must hold \ref DBF_FIELD_WIDTH + 1 bytes */
+#define DBF_GET_STRING(rec, name, buf) dbf_SchemaString((buf), (rec)->name, sizeof((rec)->name))
+
+/* dbf_SchemaLong() {{{
+ * Parses a right aligned integer, width is a constant at all call sites
+ */
+DBF_SCHEMA_INLINE long dbf_SchemaLong(const char *p, size_t width)
+{
+	size_t i = 0;
+	long value = 0;
+	int negative = 0;
+
+	while (i < width && p[i] == ' ')
+		i++;
+	if (i < width && (p[i] == '-' || p[i] == '+'))
+		negative = p[i++] == '-';
+	for (; i < width && p[i] >= '0' && p[i] <= '9'; i++)
+		value = 10 * value + (p[i] - '0');
+
+	return negative ? -value : value;
+}
+/* }}} */
+
+/* dbf_SchemaDouble() {{{
+ * Parses a numeric field. Fields of type N have at most 19 digits, which
+ * are collected exactly in an unsigned long long, but a double only holds
+ * about 15.9 significant decimal digits, so wider values are rounded.
+ */
+DBF_SCHEMA_INLINE double dbf_SchemaDouble(const char *p, size_t width)
+{
+	size_t i = 0;
+	unsigned long long mantissa = 0;
+	double scale = 1.0;
+	int negative = 0, point = 0;
+
+	while (i < width && p[i] == ' ')
+		i++;
+	if (i < width && (p[i] == '-' || p[i] == '+'))
+		negative = p[i++] == '-';
+	for (; i < width; i++) {
+		if (p[i] >= '0' && p[i] <= '9') {
+			mantissa = 10 * mantissa + (p[i] - '0');
+			if (point)
+				scale *= 10.0;
+		} else if (p[i] == '.' && !point) {
+			point = 1;
+		} else {
+			break;
+		}
+	}
+
+	return (negative ? -(double) mantissa : (double) mantissa) / scale;
+}
+/* }}} */
+
+/* dbf_SchemaBool() {{{
+ */
+DBF_SCHEMA_INLINE int dbf_SchemaBool(char c)
+{
+	return c == 'T' || c == 't' || c == 'Y' || c == 'y';
+}
+/* }}} */
+
+/* dbf_SchemaString() {{{
+ */
+DBF_SCHEMA_INLINE char *dbf_SchemaString(char *buf, const char *p, size_t width)
+{
+	while (width > 0 && p[width - 1] == ' ')
+		width--;
+	memcpy(buf, p, width);
+	buf[width] = '\0';
+	return buf;
+}
+/* }}} */
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
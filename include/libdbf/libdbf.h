@@ -17,8 +17,15 @@
  * $Id: libdbf.h,v 1.6 2006/04/14 12:25:30 rollinhand Exp $
  ****************************************************************************/
 
+#ifndef __LIBDBF_H__
+#define __LIBDBF_H__
+
 #include <sys/types.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*! \file libdbf.h
 	\brief provides access to libdbf.
 
@@ -79,6 +86,49 @@
 /*! \def VisualFoxPro Code for Visual FoxPro without memo fields */
 #define VisualFoxPro 0x30
 
+/*! \def DBF_OPEN_METADATA Only read the header, see \ref dbf_OpenFlags */
+#define DBF_OPEN_METADATA 0x0001
+/*! \def DBF_OPEN_RDWR Open for reading and writing, see \ref dbf_OpenFlags */
+#define DBF_OPEN_RDWR 0x0002
+/*! \def DBF_OPEN_MMAP Access the records through a memory map, see \ref dbf_OpenFlags */
+#define DBF_OPEN_MMAP 0x0004
+
+//@{
+/** Changes reported by \ref dbf_Refresh and \ref dbf_ResumeCheckpoint */
+/*! \def DBF_CHANGE_NONE the table is unchanged */
+#define DBF_CHANGE_NONE 0x0000
+/*! \def DBF_CHANGE_APPENDED records were appended */
+#define DBF_CHANGE_APPENDED 0x0001
+/*! \def DBF_CHANGE_UPDATED the date of the last update changed but no record was added */
+#define DBF_CHANGE_UPDATED 0x0002
+/*! \def DBF_CHANGE_REWRITTEN the table was rewritten, all records must be read again */
+#define DBF_CHANGE_REWRITTEN 0x0004
+/*! \def DBF_CHANGE_LAYOUT the fields changed, the file must be opened again */
+#define DBF_CHANGE_LAYOUT 0x0008
+/*! \def DBF_CHANGE_REMOVED the file was deleted or renamed, only passed to a \ref DBF_FOLLOW_CALLBACK */
+#define DBF_CHANGE_REMOVED 0x0010
+//@}
+
+//@{
+/** Lock schemes for \ref dbf_SetLockScheme */
+/*! \def DBF_LOCK_NONE no locking (default) */
+#define DBF_LOCK_NONE 0
+/*! \def DBF_LOCK_FOXPRO lock offsets used by FoxPro */
+#define DBF_LOCK_FOXPRO 1
+/*! \def DBF_LOCK_CLIPPER lock offsets used by Clipper and dBASE III */
+#define DBF_LOCK_CLIPPER 2
+//@}
+
+//@{
+/** Lock modes */
+/*! \def DBF_LOCK_SHARED shared lock for reading */
+#define DBF_LOCK_SHARED 0x0000
+/*! \def DBF_LOCK_EXCLUSIVE exclusive lock for writing */
+#define DBF_LOCK_EXCLUSIVE 0x0001
+/*! \def DBF_LOCK_WAIT wait until the lock can be taken */
+#define DBF_LOCK_WAIT 0x0002
+//@}
+
 /*! \brief Object handle for dBASE file
 
   A pointer of type P_DBF is used by all functions except for \ref dbf_Open
@@ -94,6 +144,223 @@ typedef struct _P_DBF P_DBF;
 typedef struct _DB_FIELD DB_FIELD;
 #define SIZE_OF_DB_FIELD 32
 
+/*! \brief Statistics collected for an object handle
+
+  Filled by \ref dbf_GetStats. The counters are only maintained if
+	libdbf was configured with --enable-stats.
+*/
+typedef struct {
+	/*! bytes read from the dbf file */
+	unsigned long long bytes_read;
+	/*! bytes written into the dbf file */
+	unsigned long long bytes_written;
+	/*! number of read system calls */
+	unsigned long long reads;
+	/*! number of write system calls */
+	unsigned long long writes;
+	/*! number of lseek system calls */
+	unsigned long long seeks;
+	/*! number of records handed out to the caller */
+	unsigned long long records_decoded;
+	/*! number of times the header was written */
+	unsigned long long header_writes;
+	/*! cache lookups which could be answered from memory */
+	unsigned long long cache_hits;
+	/*! cache lookups which required file access */
+	unsigned long long cache_misses;
+	/*! nanoseconds spent in system calls */
+	unsigned long long io_nsec;
+	/*! nanoseconds spent in parsing header and field data */
+	unsigned long long decode_nsec;
+	/*! blocks of records skipped by \ref dbf_ScanRange */
+	unsigned long long blocks_skipped;
+} DBF_STATS;
+
+/*! \brief State of a table as seen by the last read
+
+  Filled by \ref dbf_GetCheckpoint. The structure contains no pointers
+	and can be stored on disk to resume reading a table after reopening it
+	with \ref dbf_ResumeCheckpoint.
+*/
+typedef struct {
+	/*! number of records */
+	u_int32_t records;
+	/*! date of last update as stored in the header */
+	unsigned char last_update[3];
+	/*! number of bytes in the header */
+	u_int16_t header_length;
+	/*! number of bytes in the record */
+	u_int16_t record_length;
+	/*! hash of the field descriptors */
+	u_int32_t layout;
+} DBF_CHECKPOINT;
+
+/*! \brief Set of tables followed with \ref dbf_FollowCreate */
+typedef struct _DBF_FOLLOW DBF_FOLLOW;
+
+/*! \brief Function called by \ref dbf_FollowDispatch
+
+  Receives the table, n new records starting with record number
+	\a first (counting from 0) and the DBF_CHANGE_* flags. The records
+	are only valid until the callback returns. If the table changed
+	without new records, \a records is NULL and \a n is 0.
+*/
+typedef void (*DBF_FOLLOW_CALLBACK)(P_DBF *p_dbf, const char *records, u_int32_t first, u_int32_t n, int change, void *data);
+
+/*! \brief Files with the same layout opened with \ref dbf_DatasetOpen */
+typedef struct _DBF_DATASET DBF_DATASET;
+
+/*! \brief Function called by \ref dbf_DatasetScan
+
+  Receives the opened file number \a file of the dataset and n records
+	starting with record number \a first (counting from 0) of that file.
+	The callback is called from several threads at once, but never for
+	the same file. The records are only valid until the callback returns.
+	Any value but 0 stops the scan.
+*/
+typedef int (*DBF_DATASET_CALLBACK)(P_DBF *p_dbf, int file, const char *records, u_int32_t first, u_int32_t n, void *data);
+
+/*! \struct DBF_AGGREGATE
+	\brief Aggregates of a column computed by \ref dbf_Aggregate
+*/
+typedef struct {
+	/*! number of records with a value, blank fields are not counted */
+	u_int64_t count;
+	double sum;
+	double min;
+	double max;
+	/*! sum / count, 0 if there is no value */
+	double mean;
+} DBF_AGGREGATE;
+
+/*! \struct DBF_GROUP
+	\brief Group of records computed by \ref dbf_Aggregate
+*/
+typedef struct {
+	/*! raw contents of the group-by field, not terminated, or NULL */
+	const char *key;
+	/*! number of records in the group */
+	u_int64_t records;
+	/*! one entry for every aggregated column */
+	DBF_AGGREGATE *columns;
+} DBF_GROUP;
+
+/*! \brief Zone map of a table read with \ref dbf_ZoneMapOpen */
+typedef struct _DBF_ZONEMAP DBF_ZONEMAP;
+
+/*! \brief Function called by \ref dbf_ScanRange for every matching record
+
+  Receives the record and its number, counting from 0. The record is
+	only valid until the callback returns. Any value but 0 stops the scan.
+*/
+typedef int (*DBF_RECORD_CALLBACK)(P_DBF *p_dbf, const char *record, u_int32_t recno, void *data);
+
+/*! \def DBF_SORT_DESCENDING sort a column from the largest to the smallest value */
+#define DBF_SORT_DESCENDING 0x0001
+
+/*! \struct DBF_SORT_KEY
+	\brief Column to sort by, see \ref dbf_Sort
+*/
+typedef struct {
+	/*! the number of the column */
+	int column;
+	/*! 0 or DBF_SORT_DESCENDING */
+	int flags;
+} DBF_SORT_KEY;
+
+/*! \def DBF_JOIN_TRIM ignore leading and trailing blanks of the key fields */
+#define DBF_JOIN_TRIM 0x0001
+/*! \def DBF_JOIN_NOCASE compare the letters a to z of the key fields regardless of case */
+#define DBF_JOIN_NOCASE 0x0002
+
+/*! \def DBF_JOIN_LEFT column of the left table, see \ref DBF_JOIN_COLUMN */
+#define DBF_JOIN_LEFT 0
+/*! \def DBF_JOIN_RIGHT column of the right table, see \ref DBF_JOIN_COLUMN */
+#define DBF_JOIN_RIGHT 1
+
+/*! \struct DBF_JOIN_PAIR
+	\brief Numbers of two matching records found by \ref dbf_Join
+*/
+typedef struct {
+	/*! the record of the left table, counting from 0 */
+	u_int32_t left;
+	/*! the record of the right table, counting from 0 */
+	u_int32_t right;
+} DBF_JOIN_PAIR;
+
+/*! \struct DBF_JOIN_COLUMN
+	\brief Column of the table written by \ref dbf_JoinTable
+*/
+typedef struct {
+	/*! DBF_JOIN_LEFT or DBF_JOIN_RIGHT */
+	int table;
+	/*! the number of the column in that table */
+	int column;
+	/*! the name in the new file, up to 10 characters, or NULL for the
+	 *  name of the column in its table */
+	const char *name;
+} DBF_JOIN_COLUMN;
+
+/*! \struct DBF_DICTIONARY
+	\brief Dictionary encoded column filled by \ref dbf_DecodeDictionary
+*/
+typedef struct {
+	/*! the number of the column */
+	int column;
+	/*! number of distinct values */
+	u_int32_t numvalues;
+	/*! the distinct values without trailing blanks and NUL bytes, in the
+	 *  order they first occur, each terminated by a NUL byte */
+	char **values;
+	/*! the length of every value, which tells values holding NUL bytes apart */
+	int *lengths;
+	/*! number of codes, one for every record */
+	u_int32_t numcodes;
+	/*! the index into \a values for every record, -1 for deleted records */
+	int32_t *codes;
+} DBF_DICTIONARY;
+
+/*! \def DBF_VERIFY_FIELDS check the contents of every field against its type */
+#define DBF_VERIFY_FIELDS 0x0001
+
+//@{
+/** Problems found by \ref dbf_Verify */
+/** record length or header length do not agree with the field descriptors */
+#define DBF_PROBLEM_HEADER 0x0001
+/** the number of records in the header differs from the records in the file */
+#define DBF_PROBLEM_COUNT 0x0002
+/** the file ends with a partial record or is shorter than its header */
+#define DBF_PROBLEM_SIZE 0x0004
+/** a batch was interrupted */
+#define DBF_PROBLEM_TRANSACTION 0x0008
+/** deletion flags other than blank and '*' */
+#define DBF_PROBLEM_FLAGS 0x0010
+/** fields whose contents do not fit their type */
+#define DBF_PROBLEM_FIELDS 0x0020
+//@}
+
+/*! \struct DBF_VERIFY
+	\brief Result of \ref dbf_Verify
+*/
+typedef struct {
+	/*! DBF_PROBLEM_* flags, 0 if the table is fine */
+	int problems;
+	/*! size of the file in bytes */
+	u_int64_t file_size;
+	/*! size given by the header, without end marker */
+	u_int64_t expected_size;
+	/*! number of complete records in the file */
+	u_int64_t records_in_file;
+	/*! 1 if the records are followed by the end marker 0x1A */
+	int eof_marker;
+	/*! number of records with a bad deletion flag */
+	u_int64_t bad_flags;
+	/*! number of fields not fitting their type */
+	u_int64_t bad_fields;
+	/*! the first record with a bad flag or field, counting from 0, or -1 */
+	int64_t first_bad;
+} DBF_VERIFY;
+
 /*
  *	FUNCTIONS
  */
@@ -119,10 +386,40 @@ int dbf_GetVersion(P_DBF *p_dbf);
 	Opens a dBASE file and returns the object handle.
 	Additional information from the dBASE header are read and stored
 	internally.
+
+	Files compressed with gzip or zstd are recognized by their magic
+	number and decompressed while reading. An index built on the first
+	pass, or the seek table of the zstd seekable format, allows to
+	access records in any order without decompressing the whole file.
+	Compressed files cannot be opened for writing.
 	\return NULL in case of an error.
 */
 P_DBF *dbf_Open (const char *file);
 
+/*! \fn P_DBF *dbf_OpenFlags (const char *file, int flags)
+	\brief dbf_OpenFlags opens a dBASE \a file with additional options
+	\param file the filename of the dBASE file
+	\param flags a combination of the DBF_OPEN_* flags or 0
+
+	Works like \ref dbf_Open. With DBF_OPEN_METADATA only the header
+	and the field descriptors are read and the file is closed again right
+	away. All functions returning information about the table and its
+	columns can be used, but reading records fails.
+
+	DBF_OPEN_RDWR opens the file for writing as well, which is needed
+	by \ref dbf_UpdateRecord and \ref dbf_UpdateField. With
+	DBF_OPEN_MMAP the file is mapped into memory and records are copied
+	from the map instead of being read with system calls; together with
+	DBF_OPEN_RDWR updates are written into the map. Records appended
+	after opening are read from the file. The file must not be truncated
+	by other processes while it is mapped.
+
+	If a batch of \ref dbf_BeginBatch was interrupted, the records
+	written by it stay behind the table until \ref dbf_Repair is called.
+	\return NULL in case of an error.
+*/
+P_DBF *dbf_OpenFlags (const char *file, int flags);
+
 /*! \fn P_DBF *dbf_CreateFH (int fh, DB_FIELD *fields, int numfields)
 	\brief dbf_Create opens a new dBASE \a file and returns the object handle
 	\param fh file handle of already open file
@@ -164,6 +461,15 @@ int dbf_Close (P_DBF *p_dbf);
 */
 int dbf_NumRows (P_DBF *p_dbf);
 
+/*! \fn u_int64_t dbf_NumRows64(P_DBF *p_dbf)
+	\brief dbf_NumRows64 returns the number of records
+	\param *p_dbf the object handle of the opened file
+
+	Unlike \ref dbf_NumRows the result is not limited to the range of an
+	int and 0 is returned for an empty table.
+*/
+u_int64_t dbf_NumRows64(P_DBF *p_dbf);
+
 /*! \fn int dbf_NumCols (P_DBF *p_dbf)
 	\brief dbf_NumCols returns the number of attributes/columns
 	\param *p_dbf the object handle of the opened file
@@ -312,6 +618,39 @@ int dbf_SetRecordOffset(P_DBF *p_dbf, int offset);
 */
 int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len);
 
+/*! \fn int dbf_SeekRecord64(P_DBF *p_dbf, u_int64_t recno)
+	\brief dbf_SeekRecord64 sets the internal record counter
+	\param *p_dbf the object handle of the opened file
+	\param recno the number of the next record read, counting from 0
+
+	Like \ref dbf_SetRecordOffset for tables with more records than an
+	int can count.
+
+	\return 0 if successful, -1 if there is no such record
+*/
+int dbf_SeekRecord64(P_DBF *p_dbf, u_int64_t recno);
+
+/*! \fn u_int64_t dbf_TellRecord64(P_DBF *p_dbf)
+	\brief dbf_TellRecord64 returns the number of the next record read,
+	counting from 0
+*/
+u_int64_t dbf_TellRecord64(P_DBF *p_dbf);
+
+/*! \fn int dbf_ReadRecord64(P_DBF *p_dbf, char *record, int len, u_int64_t *recno)
+	\brief dbf_ReadRecord64 reads the current record
+	\param *p_dbf the object handle of the opened file
+	\param *record a memory block large enough to contain a record
+	\param len the length of the record block
+	\param *recno receives the number of the record read, counting from 0,
+	may be NULL
+
+	Like \ref dbf_ReadRecord, but the record number is not returned as
+	an int, which is negative beyond 2^31 records.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_ReadRecord64(P_DBF *p_dbf, char *record, int len, u_int64_t *recno);
+
 /*! \fn int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len)
 	\brief dbf_WriteRecord writes a record
 	\param *p_dbf the object handle of the opened file
@@ -337,3 +676,811 @@ int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len);
 */
 int dbf_IsMemo(P_DBF *p_dbf);
 
+/*! \fn int dbf_GetStats(P_DBF *p_dbf, DBF_STATS *stats)
+	\brief dbf_GetStats returns the I/O statistics of a handle
+	\param *p_dbf the object handle of the opened file
+	\param *stats structure which receives the counters
+
+	Copies the counters collected since the file was opened or
+	\ref dbf_ResetStats was called. If libdbf was built without
+	statistics, all counters are set to 0.
+
+	\return 0 if successful, -1 if statistics are not available
+*/
+int dbf_GetStats(P_DBF *p_dbf, DBF_STATS *stats);
+
+/*! \fn int dbf_ResetStats(P_DBF *p_dbf)
+	\brief dbf_ResetStats sets all statistics of a handle to 0
+	\param *p_dbf the object handle of the opened file
+
+	\return 0 if successful, -1 if statistics are not available
+*/
+int dbf_ResetStats(P_DBF *p_dbf);
+
+/*! \fn int dbf_SchemaCacheEnable(int enable)
+	\brief dbf_SchemaCacheEnable switches the schema cache on or off
+	\param enable 1 to use the cache, 0 to bypass it
+
+	With the cache enabled, \ref dbf_Open keeps the parsed header and
+	field descriptors of every regular file it opens, keyed by device,
+	inode, size and modification time. Opening an unchanged file again
+	takes them from the cache instead of reading the header. Handles
+	opened from the cache share the field descriptors read-only.
+	Lookups may be done from any thread.
+
+	\return 0 if successful, -1 if the platform does not support the cache
+*/
+int dbf_SchemaCacheEnable(int enable);
+
+/*! \fn int dbf_SchemaCacheFlush(void)
+	\brief dbf_SchemaCacheFlush empties the schema cache
+
+	Removes all entries from the cache and frees those which are not
+	used by an open handle anymore. Entries still in use are freed by
+	a later call. dbf_SchemaCacheFlush may run while other threads
+	open files.
+
+	\return 0 if successful, -1 if the platform does not support the cache
+*/
+int dbf_SchemaCacheFlush(void);
+
+/*! \fn int dbf_SampleRecords(P_DBF *p_dbf, u_int32_t k, unsigned int seed, char *records, u_int32_t *recnos)
+	\brief dbf_SampleRecords reads a uniform random sample of records
+	\param *p_dbf the object handle of the opened file
+	\param k the number of records in the sample
+	\param seed seed of the random number generator
+	\param *records memory large enough for k records
+	\param *recnos memory for k record numbers or NULL
+
+	Picks k distinct records at random, each record with the same
+	probability, and stores them one after the other in \a records.
+	The records are read in the order of their position in the file and
+	neighbouring records are fetched together. If \a recnos is not NULL,
+	it receives the record numbers in ascending order, counting from 0
+	like the return value of \ref dbf_ReadRecord. The same seed always
+	yields the same sample. If the table has less than k records,
+	all of them are returned.
+
+	\return number of records in the sample or -1 on error
+*/
+int dbf_SampleRecords(P_DBF *p_dbf, u_int32_t k, unsigned int seed, char *records, u_int32_t *recnos);
+
+/*! \fn int dbf_SampleBernoulli(P_DBF *p_dbf, double percent, unsigned int seed, char **records, u_int32_t **recnos)
+	\brief dbf_SampleBernoulli reads each record with a given probability
+	\param *p_dbf the object handle of the opened file
+	\param percent the probability in percent (0 to 100)
+	\param seed seed of the random number generator
+	\param **records receives the records of the sample
+	\param **recnos receives the record numbers of the sample or NULL
+
+	Selects each record independently with a probability of
+	\a percent, like TABLESAMPLE BERNOULLI in SQL. The records are read
+	as in \ref dbf_SampleRecords. The memory for \a records and
+	\a recnos is allocated by libdbf and must be freed with free().
+
+	\return number of records in the sample or -1 on error
+*/
+int dbf_SampleBernoulli(P_DBF *p_dbf, double percent, unsigned int seed, char **records, u_int32_t **recnos);
+
+/*! \fn int dbf_FetchRecords(P_DBF *p_dbf, const u_int32_t *recnos, size_t n, char *records)
+	\brief dbf_FetchRecords reads a list of records
+	\param *p_dbf the object handle of the opened file
+	\param *recnos the numbers of the records to read
+	\param n the number of entries in \a recnos
+	\param *records memory large enough for n records
+
+	Reads the records with the given numbers, counting from 0 like the
+	return value of \ref dbf_ReadRecord. The i-th record in \a records
+	is the one requested by recnos[i]. The list may be in any order and
+	contain duplicates. The records are read in the order of their
+	position in the file, each of them only once, and records close to
+	each other are fetched with a single system call. The maximum distance
+	can be changed with \ref dbf_SetFetchGap. The internal record counter
+	is not changed.
+
+	\return n if successful, -1 on error
+*/
+int dbf_FetchRecords(P_DBF *p_dbf, const u_int32_t *recnos, size_t n, char *records);
+
+/*! \fn int dbf_SetFetchGap(P_DBF *p_dbf, int gap)
+	\brief dbf_SetFetchGap sets the largest hole read over
+	\param *p_dbf the object handle of the opened file
+	\param gap number of bytes
+
+	Records which are at most \a gap bytes apart are read together
+	by \ref dbf_FetchRecords and the sampling functions. Reading over
+	a small hole is usually cheaper than an additional system call.
+	A gap of 0 only merges adjacent records. The default is 64 KiB.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_SetFetchGap(P_DBF *p_dbf, int gap);
+
+/*! \fn int dbf_ReadRecords(P_DBF *p_dbf, u_int32_t first, u_int32_t n, char *records)
+	\brief dbf_ReadRecords reads consecutive records
+	\param *p_dbf the object handle of the opened file
+	\param first the number of the first record, counting from 0
+	\param n the number of records to read
+	\param *records memory large enough for n records
+
+	Reads up to \a n records starting at \a first with a single
+	positional read. The internal record counter is neither used nor
+	changed, so different ranges of the same file can be read by
+	several threads at once as long as the table is not updated. Reads
+	of compressed files are safe as well, but done one after the other.
+
+	\return number of records read, 0 behind the last record, -1 on error
+*/
+int dbf_ReadRecords(P_DBF *p_dbf, u_int32_t first, u_int32_t n, char *records);
+
+/*! \fn int dbf_Refresh(P_DBF *p_dbf)
+	\brief dbf_Refresh checks a table for new records
+	\param *p_dbf the object handle of the opened file
+
+	Reads the header and the field descriptors of the file again and
+	compares them with those read before. If records were appended, the
+	internal record counter is left where it is, so \ref dbf_ReadRecord
+	returns the new records after those not read yet. If the number of
+	records went down, DBF_CHANGE_REWRITTEN is returned and the counter
+	is set to the first record. If the header or record length or any
+	field descriptor changed, the handle is left untouched and
+	DBF_CHANGE_LAYOUT is added; the file has to be opened again. DBF_CHANGE_UPDATED means that the date of the last update
+	changed while the number of records did not, so existing records may
+	have been modified.
+
+	\return a combination of the DBF_CHANGE_* flags or -1 on error
+*/
+int dbf_Refresh(P_DBF *p_dbf);
+
+/*! \fn int dbf_GetCheckpoint(P_DBF *p_dbf, DBF_CHECKPOINT *checkpoint)
+	\brief dbf_GetCheckpoint saves the state of a table
+	\param *p_dbf the object handle of the opened file
+	\param *checkpoint receives the state
+
+	\return 0
+*/
+int dbf_GetCheckpoint(P_DBF *p_dbf, DBF_CHECKPOINT *checkpoint);
+
+/*! \fn int dbf_ResumeCheckpoint(P_DBF *p_dbf, const DBF_CHECKPOINT *checkpoint)
+	\brief dbf_ResumeCheckpoint continues reading where a checkpoint was taken
+	\param *p_dbf the object handle of the opened file
+	\param *checkpoint state saved by \ref dbf_GetCheckpoint
+
+	Compares the freshly opened table with the checkpoint, including the
+	field descriptors, and sets the internal record counter behind the
+	records already seen. If the table was rewritten, the counter is set
+	to the first record. See \ref dbf_Refresh for the returned flags.
+
+	\return a combination of the DBF_CHANGE_* flags
+*/
+int dbf_ResumeCheckpoint(P_DBF *p_dbf, const DBF_CHECKPOINT *checkpoint);
+
+/*! \fn DBF_FOLLOW *dbf_FollowCreate(void)
+	\brief dbf_FollowCreate creates a set of followed tables
+	
+	Like tail -f, a set of followed tables delivers records as soon as
+	other processes append them. It is based on inotify and therefore only
+	available on Linux. Use \ref dbf_FollowFD to wait for changes with
+	poll, select or epoll and call \ref dbf_FollowDispatch whenever the
+	descriptor becomes readable. A single thread can follow many files.
+
+	\return NULL in case of an error or if not supported
+*/
+DBF_FOLLOW *dbf_FollowCreate(void);
+
+/*! \fn int dbf_FollowAdd(DBF_FOLLOW *follow, const char *file, P_DBF *p_dbf, DBF_FOLLOW_CALLBACK callback, void *data)
+	\brief dbf_FollowAdd adds a table to a set of followed tables
+	\param *follow the set created by \ref dbf_FollowCreate
+	\param file the filename the table was opened from
+	\param *p_dbf the object handle of the opened file
+	\param callback function receiving the new records
+	\param *data passed to the callback
+
+	Records appended after the next call of \ref dbf_ReadRecord or
+	\ref dbf_Refresh are passed to the callback. Records not read yet
+	are passed with the first change. May be called from within a
+	callback; the new table is followed from the next event read.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_FollowAdd(DBF_FOLLOW *follow, const char *file, P_DBF *p_dbf, DBF_FOLLOW_CALLBACK callback, void *data);
+
+/*! \fn int dbf_FollowRemove(DBF_FOLLOW *follow, P_DBF *p_dbf)
+	\brief dbf_FollowRemove stops following a table
+	\param *follow the set created by \ref dbf_FollowCreate
+	\param *p_dbf the object handle passed to \ref dbf_FollowAdd
+
+	Must not be called from within a callback.
+
+	\return 0 if successful, -1 if the table was not followed
+*/
+int dbf_FollowRemove(DBF_FOLLOW *follow, P_DBF *p_dbf);
+
+/*! \fn int dbf_FollowFD(DBF_FOLLOW *follow)
+	\brief dbf_FollowFD returns a descriptor to wait for changes
+	\param *follow the set created by \ref dbf_FollowCreate
+
+	The descriptor becomes readable when one of the files was modified.
+
+	\return the descriptor
+*/
+int dbf_FollowFD(DBF_FOLLOW *follow);
+
+/*! \fn int dbf_FollowDispatch(DBF_FOLLOW *follow)
+	\brief dbf_FollowDispatch delivers new records to the callbacks
+	\param *follow the set created by \ref dbf_FollowCreate
+
+	Handles all pending file events without blocking. For each modified
+	file the header is read again with \ref dbf_Refresh and the new
+	records are passed to the callback.
+
+	\return the number of changes delivered or -1 on error
+*/
+int dbf_FollowDispatch(DBF_FOLLOW *follow);
+
+/*! \fn int dbf_FollowClose(DBF_FOLLOW *follow)
+	\brief dbf_FollowClose frees a set of followed tables
+	\param *follow the set created by \ref dbf_FollowCreate
+
+	The handles of the tables are not closed.
+
+	\return 0 if successful, -1 if not supported
+*/
+int dbf_FollowClose(DBF_FOLLOW *follow);
+
+/*! \fn int dbf_SetLockScheme(P_DBF *p_dbf, int scheme)
+	\brief dbf_SetLockScheme enables locking compatible with other applications
+	\param *p_dbf the object handle of the opened file
+	\param scheme DBF_LOCK_NONE, DBF_LOCK_FOXPRO or DBF_LOCK_CLIPPER
+
+	Selects where the byte-range locks for the header and the records
+	are placed. Like FoxPro and Clipper, libdbf locks single bytes far
+	behind the data: FoxPro uses 0x7FFFFFFE for the header and
+	0x7FFFFFFE - n for record n, Clipper 1000000000 for the header and
+	1000000000 + n for record n (n counting from 1).
+
+	With a lock scheme, \ref dbf_WriteRecord takes an exclusive header
+	lock, reads the current number of records and appends behind the
+	records written by other processes, and \ref dbf_Refresh reads the
+	header under a shared lock. The file must then be open for reading
+	and writing.
+
+	Locks are fcntl() locks and belong to the process: closing any
+	descriptor of the file releases all of them.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_SetLockScheme(P_DBF *p_dbf, int scheme);
+
+/*! \fn int dbf_LockHeader(P_DBF *p_dbf, int mode)
+	\brief dbf_LockHeader locks the header of a table
+	\param *p_dbf the object handle of the opened file
+	\param mode DBF_LOCK_SHARED or DBF_LOCK_EXCLUSIVE, optionally with DBF_LOCK_WAIT
+
+	While a shared header lock is held, no other process following the
+	same lock scheme can append records, so the number of records stays
+	consistent. An exclusive lock requires the file to be open for writing.
+	Without DBF_LOCK_WAIT the function fails if the lock is held by
+	another process.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_LockHeader(P_DBF *p_dbf, int mode);
+
+/*! \fn int dbf_UnlockHeader(P_DBF *p_dbf)
+	\brief dbf_UnlockHeader releases the header lock
+	\param *p_dbf the object handle of the opened file
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_UnlockHeader(P_DBF *p_dbf);
+
+/*! \fn int dbf_LockRecord(P_DBF *p_dbf, u_int32_t recno, int mode)
+	\brief dbf_LockRecord locks a single record
+	\param *p_dbf the object handle of the opened file
+	\param recno the number of the record, counting from 0
+	\param mode DBF_LOCK_SHARED or DBF_LOCK_EXCLUSIVE, optionally with DBF_LOCK_WAIT
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_LockRecord(P_DBF *p_dbf, u_int32_t recno, int mode);
+
+/*! \fn int dbf_UnlockRecord(P_DBF *p_dbf, u_int32_t recno)
+	\brief dbf_UnlockRecord releases the lock of a record
+	\param *p_dbf the object handle of the opened file
+	\param recno the number of the record, counting from 0
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_UnlockRecord(P_DBF *p_dbf, u_int32_t recno);
+
+/*! \fn int dbf_UpdateRecord(P_DBF *p_dbf, u_int32_t recno, const char *record, int len)
+	\brief dbf_UpdateRecord overwrites an existing record
+	\param *p_dbf the object handle of the opened file
+	\param recno the number of the record, counting from 0
+	\param *record record data as for \ref dbf_WriteRecord
+	\param len the length of the record block
+
+	Replaces the data of a record in place. Like for \ref dbf_WriteRecord,
+	the data does not contain the deletion flag, which is kept unchanged,
+	and len must be \ref dbf_RecordLength() - 1. The change is kept in a
+	small cache of file blocks and written back when the cache is full,
+	by \ref dbf_Flush or by \ref dbf_Close. \ref dbf_ReadRecord already
+	returns the changed data.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_UpdateRecord(P_DBF *p_dbf, u_int32_t recno, const char *record, int len);
+
+/*! \fn int dbf_UpdateField(P_DBF *p_dbf, u_int32_t recno, int column, const char *data, int len)
+	\brief dbf_UpdateField overwrites a single field of an existing record
+	\param *p_dbf the object handle of the opened file
+	\param recno the number of the record, counting from 0
+	\param column the number of the column
+	\param *data the new value
+	\param len the length of the value, at most \ref dbf_ColumnSize
+
+	Values shorter than the field are padded with blanks. See
+	\ref dbf_UpdateRecord.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_UpdateField(P_DBF *p_dbf, u_int32_t recno, int column, const char *data, int len);
+
+/*! \fn int dbf_Flush(P_DBF *p_dbf)
+	\brief dbf_Flush writes pending updates into the file
+	\param *p_dbf the object handle of the opened file
+
+	Writes the blocks changed by \ref dbf_UpdateRecord and
+	\ref dbf_UpdateField in the order of their position in the file
+	and updates the date of the last change in the header once.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_Flush(P_DBF *p_dbf);
+
+/*! \fn int dbf_BeginBatch(P_DBF *p_dbf)
+	\brief dbf_BeginBatch starts appending a batch of records
+	\param *p_dbf the object handle of the opened file
+
+	Marks the table as being in a transaction. Until \ref dbf_CommitBatch
+	is called, \ref dbf_WriteRecord collects the records in a buffer and
+	writes them in large blocks without touching the header, so the table
+	seen by other readers does not change. If the writing process dies,
+	the records of the batch are ignored by readers and removed by
+	\ref dbf_Repair. When a lock scheme is set, the header stays locked
+	exclusively until the batch is committed. Records of the batch cannot
+	be read before the commit.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_BeginBatch(P_DBF *p_dbf);
+
+/*! \fn int dbf_CommitBatch(P_DBF *p_dbf)
+	\brief dbf_CommitBatch adds the records of a batch to the table
+	\param *p_dbf the object handle of the opened file
+
+	Writes the remaining records, syncs them to disk and then writes the
+	header with the new number of records and the transaction flag
+	cleared. \ref dbf_Close commits an open batch.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_CommitBatch(P_DBF *p_dbf);
+
+/*! \fn int dbf_BeginAppend(P_DBF *p_dbf)
+	\brief dbf_BeginAppend starts appending records from several threads
+	\param *p_dbf the object handle of the opened file
+
+	Marks the table as being in a transaction like \ref dbf_BeginBatch.
+	Until \ref dbf_EndAppend is called, any number of threads may append
+	records with \ref dbf_AppendRecord, \ref dbf_AppendRecords or
+	\ref dbf_WriteRecord at the same time. Every call takes the next free
+	record numbers without waiting for other threads and writes the
+	records right at their place in the file. No other function may be
+	called on the handle meanwhile.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_BeginAppend(P_DBF *p_dbf);
+
+/*! \fn int dbf_AppendRecord(P_DBF *p_dbf, const char *record, int len, u_int64_t *recno)
+	\brief dbf_AppendRecord appends a record, may be called from several threads
+	\param *p_dbf the object handle of the opened file
+	\param *record record data as for \ref dbf_WriteRecord
+	\param len the length of the record, \ref dbf_RecordLength() - 1
+	\param *recno receives the number of the record, counting from 0, or NULL
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_AppendRecord(P_DBF *p_dbf, const char *record, int len, u_int64_t *recno);
+
+/*! \fn int dbf_AppendRecords(P_DBF *p_dbf, const char *records, u_int32_t n, u_int64_t *first)
+	\brief dbf_AppendRecords appends consecutive records, may be called from several threads
+	\param *p_dbf the object handle of the opened file
+	\param *records n complete records, each starting with its deletion flag
+	\param n the number of records
+	\param *first receives the number of the first record, counting from 0, or NULL
+
+	The records are written with a single system call and get
+	consecutive numbers.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_AppendRecords(P_DBF *p_dbf, const char *records, u_int32_t n, u_int64_t *first);
+
+/*! \fn int dbf_EndAppend(P_DBF *p_dbf)
+	\brief dbf_EndAppend adds the records appended by all threads to the table
+	\param *p_dbf the object handle of the opened file
+
+	Must be called once, after all appending threads are done. Syncs the
+	records to disk and then writes the header with the new number of
+	records and the transaction flag cleared. If any append failed, all
+	records appended since \ref dbf_BeginAppend are removed again.
+	\ref dbf_Close ends open appends.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_EndAppend(P_DBF *p_dbf);
+
+/*! \fn DBF_DATASET *dbf_DatasetOpen(const char *path, int threads)
+	\brief dbf_DatasetOpen opens many tables with the same layout as one
+	\param *path a directory or a pattern like "data/2024-*.dbf"
+	\param threads the number of threads reading the headers, 0 for the default
+
+	Takes all files of the directory ending in .dbf (also compressed
+	with .gz or .zst) or all files matching the pattern as understood
+	by glob(3), sorted by name. The headers of the files are read in
+	parallel and the field descriptors of every file must match those
+	of the first file in name, type, length and decimals. No descriptor
+	is kept open. The records of all files form one table in the order
+	of the files; records appended after opening the dataset are not
+	part of it.
+
+	\return the dataset or NULL if no file was found, a file could not
+	be read or the layouts differ
+*/
+DBF_DATASET *dbf_DatasetOpen(const char *path, int threads);
+
+/*! \fn int dbf_DatasetNumFiles(DBF_DATASET *ds)
+	\brief dbf_DatasetNumFiles returns the number of files of the dataset
+*/
+int dbf_DatasetNumFiles(DBF_DATASET *ds);
+
+/*! \fn const char *dbf_DatasetFile(DBF_DATASET *ds, int file)
+	\brief dbf_DatasetFile returns the path of a file of the dataset
+
+	\return the path or NULL if there is no such file
+*/
+const char *dbf_DatasetFile(DBF_DATASET *ds, int file);
+
+/*! \fn u_int64_t dbf_DatasetNumRows(DBF_DATASET *ds)
+	\brief dbf_DatasetNumRows returns the number of records of all files
+*/
+u_int64_t dbf_DatasetNumRows(DBF_DATASET *ds);
+
+/*! \fn u_int64_t dbf_DatasetFirstRecord(DBF_DATASET *ds, int file)
+	\brief dbf_DatasetFirstRecord returns the number of the first record
+	of a file within the dataset, counting from 0
+
+	Adding the record number passed to a \ref DBF_DATASET_CALLBACK gives
+	the number of the record in the dataset.
+*/
+u_int64_t dbf_DatasetFirstRecord(DBF_DATASET *ds, int file);
+
+/*! \fn P_DBF *dbf_DatasetSchema(DBF_DATASET *ds)
+	\brief dbf_DatasetSchema returns the layout of the dataset
+
+	The handle is opened with DBF_OPEN_METADATA and can be used with
+	\ref dbf_NumCols, \ref dbf_ColumnName and the other functions
+	describing columns. It belongs to the dataset and must not be closed.
+*/
+P_DBF *dbf_DatasetSchema(DBF_DATASET *ds);
+
+/*! \fn int dbf_DatasetScan(DBF_DATASET *ds, int threads, DBF_DATASET_CALLBACK callback, void *data)
+	\brief dbf_DatasetScan passes all records of a dataset to a callback
+	\param *ds the dataset
+	\param threads the number of files read at once, 0 for the default
+	\param callback called with the records in chunks of about 1 MB
+	\param *data passed to the callback
+
+	The files are read in parallel by \a threads threads, each holding a
+	single file open, so no more than \a threads descriptors are used.
+	While a thread reads a file, the beginning of the file it takes next
+	is already read ahead. Within a file the records are passed in order.
+
+	\return 0 if all records were passed, the value returned by the
+	callback if it stopped the scan and -1 on error
+*/
+int dbf_DatasetScan(DBF_DATASET *ds, int threads, DBF_DATASET_CALLBACK callback, void *data);
+
+/*! \fn int dbf_DatasetClose(DBF_DATASET *ds)
+	\brief dbf_DatasetClose frees a dataset
+*/
+int dbf_DatasetClose(DBF_DATASET *ds);
+
+/*! \fn int dbf_Aggregate(P_DBF *p_dbf, const int *columns, int numcolumns, int group_column, int threads, DBF_GROUP **groups)
+	\brief dbf_Aggregate computes count, sum, minimum, maximum and mean of columns
+	\param *p_dbf the object handle of the opened file
+	\param *columns the numbers of the columns, all of type N or F
+	\param numcolumns the number of entries in \a columns
+	\param group_column the column to group by or -1 for a single group
+	\param threads the number of threads scanning parts of the table
+	\param **groups receives the groups
+
+	Reads all records once in large blocks and parses the fields right
+	in the blocks with '.' as decimal point, whatever the locale.
+	Deleted records are skipped, blank fields and fields holding more
+	than a number are not counted. Records are grouped by the raw
+	contents of \a group_column, so values differing only in blanks
+	form different groups. With several threads every thread aggregates
+	a part of the table, the results are merged at the end. Compressed
+	files are read by a single thread.
+
+	The groups are sorted by their keys. All results are in a single
+	block of memory that must be freed with free().
+
+	\return the number of groups or -1 on error
+*/
+int dbf_Aggregate(P_DBF *p_dbf, const int *columns, int numcolumns, int group_column, int threads, DBF_GROUP **groups);
+
+/*! \fn int dbf_ZoneMapBuild(P_DBF *p_dbf, const char *file, u_int32_t block)
+	\brief dbf_ZoneMapBuild writes the zone map of a table
+	\param *p_dbf the object handle of the opened file
+	\param *file the name the table was opened with
+	\param block the number of records in a block, e.g. 65536
+
+	Reads all records once and stores, for every block of records and
+	every column of type C, D, N or F, the smallest and the largest value
+	and the number of blank fields in the file \a file with .zmap
+	appended. The zone map is only used as long as the number of records,
+	the date of the last update, the fields and the size and modification
+	time of the file do not change.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_ZoneMapBuild(P_DBF *p_dbf, const char *file, u_int32_t block);
+
+/*! \fn DBF_ZONEMAP *dbf_ZoneMapOpen(P_DBF *p_dbf, const char *file)
+	\brief dbf_ZoneMapOpen reads the zone map of a table
+	\param *p_dbf the object handle of the opened file
+	\param *file the name the table was opened with
+
+	\return the zone map or NULL if there is none or it does not belong
+	to the table as it is now
+*/
+DBF_ZONEMAP *dbf_ZoneMapOpen(P_DBF *p_dbf, const char *file);
+
+/*! \fn void dbf_ZoneMapClose(DBF_ZONEMAP *zm)
+	\brief dbf_ZoneMapClose frees a zone map
+*/
+void dbf_ZoneMapClose(DBF_ZONEMAP *zm);
+
+/*! \fn int dbf_ScanRange(P_DBF *p_dbf, DBF_ZONEMAP *zm, int column, const char *low, const char *high, DBF_RECORD_CALLBACK callback, void *data)
+	\brief dbf_ScanRange passes all records with a field in a range to a callback
+	\param *p_dbf the object handle of the opened file
+	\param *zm the zone map of the table or NULL
+	\param column the number of a column of type C, D, N or F
+	\param *low the smallest value or NULL
+	\param *high the largest value or NULL
+	\param callback called for every matching record, may be NULL
+	\param *data passed to the callback
+
+	Passes the records whose field lies between \a low and \a high,
+	both included, in the order of the file. Character and date fields
+	are compared byte by byte with the bounds padded with blanks to the
+	length of the field, so dates are given as "YYYYMMDD"; numeric
+	fields are compared as numbers. Blank fields and deleted records
+	never match. Blocks whose minimum and maximum in the zone map lie
+	outside the range are not read at all. Without a zone map, or for
+	records appended after it was built, all records are read. For
+	numeric fields the bounds must be numbers with '.' as decimal point;
+	fields holding more than a number are treated like blank ones.
+
+	\return the number of matching records or -1 on error
+*/
+int dbf_ScanRange(P_DBF *p_dbf, DBF_ZONEMAP *zm, int column, const char *low, const char *high,
+	DBF_RECORD_CALLBACK callback, void *data);
+
+/*! \fn int dbf_Sort(P_DBF *p_dbf, const char *file, const DBF_SORT_KEY *keys, int numkeys, size_t memory_limit)
+	\brief dbf_Sort writes the records of a table sorted into a new file
+	\param *p_dbf the object handle of the opened file
+	\param *file the file to create, must not be the table itself
+	\param *keys the columns to sort by, the first one first
+	\param numkeys the number of entries in \a keys
+	\param memory_limit the number of bytes used at most, at least 4 MB are used
+
+	Character, date and logical fields are compared byte by byte,
+	numeric fields as numbers with blank fields before all others.
+	Records with equal keys keep their order. Deleted records are not
+	copied. Tables larger than \a memory_limit are sorted in runs which
+	are kept in temporary files next to \a file and merged afterwards.
+	The new file has the fields of the table.
+
+	\return the number of records written or -1 on error
+*/
+int dbf_Sort(P_DBF *p_dbf, const char *file, const DBF_SORT_KEY *keys, int numkeys, size_t memory_limit);
+
+/*! \fn int dbf_Join(P_DBF *left, const int *left_keys, P_DBF *right, const int *right_keys, int numkeys, int flags, DBF_JOIN_PAIR **pairs)
+	\brief dbf_Join finds the records of two tables with equal keys
+	\param *left the object handle of the left table
+	\param *left_keys the numbers of the key columns of the left table
+	\param *right the object handle of the right table
+	\param *right_keys the numbers of the key columns of the right table
+	\param numkeys the number of entries in \a left_keys and \a right_keys
+	\param flags 0 or any of DBF_JOIN_TRIM and DBF_JOIN_NOCASE
+	\param **pairs receives the pairs of record numbers
+
+	The table with fewer records is read into a hash table, the other
+	one is read once in large blocks. The key fields are compared byte
+	by byte, the n-th key column of one table with the n-th of the
+	other, so with different lengths or alignments DBF_JOIN_TRIM is
+	needed. Deleted records and records whose key fields are all blank
+	never match. The memory used grows with the smaller table only.
+
+	The pairs come in the order of the larger table and, for every one
+	of its records, in the order of the smaller table. They must be
+	freed with free().
+
+	\return the number of pairs or -1 on error
+*/
+int dbf_Join(P_DBF *left, const int *left_keys, P_DBF *right, const int *right_keys, int numkeys, int flags,
+	DBF_JOIN_PAIR **pairs);
+
+/*! \fn int dbf_JoinTable(P_DBF *left, const int *left_keys, P_DBF *right, const int *right_keys, int numkeys, int flags, const char *file, const DBF_JOIN_COLUMN *columns, int numcolumns)
+	\brief dbf_JoinTable writes the matching records of two tables into a new file
+	\param *left the object handle of the left table
+	\param *left_keys the numbers of the key columns of the left table
+	\param *right the object handle of the right table
+	\param *right_keys the numbers of the key columns of the right table
+	\param numkeys the number of entries in \a left_keys and \a right_keys
+	\param flags 0 or any of DBF_JOIN_TRIM and DBF_JOIN_NOCASE
+	\param *file the file to create
+	\param *columns the columns of the new file
+	\param numcolumns the number of entries in \a columns
+
+	Matches the records like \ref dbf_Join and writes one record for
+	every pair, in the same order. The fields of the new file are copied
+	from the tables, names included unless another name is given. The
+	names must be unique regardless of case, so a column present in both
+	tables needs a new name on one side. The fields of the smaller table
+	needed in the output are kept in memory, so neither table is read
+	twice.
+
+	\return the number of records written or -1 on error
+*/
+int dbf_JoinTable(P_DBF *left, const int *left_keys, P_DBF *right, const int *right_keys, int numkeys, int flags,
+	const char *file, const DBF_JOIN_COLUMN *columns, int numcolumns);
+
+/*! \fn int dbf_Alter(P_DBF *p_dbf, const char *file, const DB_FIELD *fields, int numfields, int threads)
+	\brief dbf_Alter writes the records of a table with other fields into a new file
+	\param *p_dbf the object handle of the opened file
+	\param *file the file to create, must not be the table itself
+	\param *fields the fields of the new file, filled by \ref dbf_SetField
+	\param numfields the number of entries in \a fields
+	\param threads the number of threads converting parts of the table
+
+	A field of the new file takes the data of the field with the same
+	name, regardless of case, so fields can be moved, dropped, added and
+	resized in a single pass. New fields are blank. Longer fields are
+	padded with blanks, shorter ones cut off; numbers stay aligned to the
+	right and a number that does not fit any more fails the whole
+	operation. The type can only change between N and F, the number of
+	decimals not at all. Deleted records stay deleted.
+
+	The table is read and the new file written in large blocks. The
+	header of the new file gets the number of records last, so an
+	interrupted conversion leaves an empty table.
+
+	\return the number of records written or -1 on error
+*/
+int dbf_Alter(P_DBF *p_dbf, const char *file, const DB_FIELD *fields, int numfields, int threads);
+
+/*! \fn int dbf_DecodeDictionary(P_DBF *p_dbf, const int *columns, int numcolumns, DBF_DICTIONARY **dictionaries)
+	\brief dbf_DecodeDictionary reads columns as codes into dictionaries of their values
+	\param *p_dbf the object handle of the opened file
+	\param *columns the numbers of the columns
+	\param numcolumns the number of entries in \a columns
+	\param **dictionaries receives one dictionary for every column
+
+	Reads all records once in large blocks. Every distinct value of a
+	column, without its trailing blanks, is stored once, and every record
+	gets the number of its value in the dictionary. Meant for character
+	columns with few distinct values, like codes and states, which take
+	four bytes per record this way.
+
+	The dictionaries must be freed with \ref dbf_FreeDictionary.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_DecodeDictionary(P_DBF *p_dbf, const int *columns, int numcolumns, DBF_DICTIONARY **dictionaries);
+
+/*! \fn void dbf_FreeDictionary(DBF_DICTIONARY *dictionaries, int numcolumns)
+	\brief dbf_FreeDictionary frees the dictionaries of \ref dbf_DecodeDictionary
+*/
+void dbf_FreeDictionary(DBF_DICTIONARY *dictionaries, int numcolumns);
+
+/*! \fn int dbf_Verify(P_DBF *p_dbf, int flags, int threads, DBF_VERIFY *verify)
+	\brief dbf_Verify checks the integrity of a table
+	\param *p_dbf the object handle of the opened file
+	\param flags 0 or DBF_VERIFY_FIELDS
+	\param threads the number of threads reading parts of the table
+	\param *verify receives what was found
+
+	Compares the size of the file with header length, number of records
+	and record length, allowing a single end marker 0x1A after the last
+	record, and the header with the field descriptors. Then reads all
+	records present in the file in large blocks and checks their deletion
+	flags and, with DBF_VERIFY_FIELDS, whether numeric, float, date,
+	logical and memo fields hold what their type allows. Blank fields are
+	always fine. The size of compressed files is not checked.
+
+	\return 0 if the table could be checked, even if it has problems,
+	-1 on error
+*/
+int dbf_Verify(P_DBF *p_dbf, int flags, int threads, DBF_VERIFY *verify);
+
+/*! \fn int dbf_Repair(P_DBF *p_dbf)
+	\brief dbf_Repair fixes the header of a table after a crash
+	\param *p_dbf the object handle of the file opened with DBF_OPEN_RDWR
+
+	Removes the records of an interrupted batch, cuts off a partly
+	written record at the end of the file and sets the number of records
+	in the header to the number of complete records in the file. Tables
+	whose header and field descriptors do not agree, as well as bad
+	flags and fields, are not repaired.
+
+	The transaction flag is set as well while a batch or concurrent
+	appends of another process are running. Without a lock scheme the
+	function must only be called when no other process writes to the
+	table; with one it waits until the batch is committed.
+
+	\return the DBF_PROBLEM_* flags of the problems repaired, 0 if there
+	were none, -1 on error
+*/
+int dbf_Repair(P_DBF *p_dbf);
+
+/*! \fn P_DBF *dbf_OpenShared(const char *file)
+	\brief dbf_OpenShared opens a table kept in shared memory
+	\param *file the filename of the .dbf file
+
+	The first process opening a table copies header, field descriptors
+	and records into a segment in /dev/shm, named after the device and
+	inode of the file and its size and modification time. All other
+	processes of the host, and later handles of the same process, map
+	that segment and read the records from it, without opening the file,
+	parsing its header or reading it through the page cache themselves.
+	Compressed tables are kept uncompressed.
+
+	The handle is a snapshot that can only be read. Once the file changes,
+	the next dbf_OpenShared() loads a new segment, while handles opened
+	before keep reading the old one. Every handle holds a read lock on
+	its segment, and a segment is only removed while nobody holds one:
+	the last handle of an outdated segment removes it when closed with
+	dbf_Close(), and loading a new version removes the old ones no longer
+	in use, also those of processes that died without closing their
+	handles. The segment of the current version stays until the table
+	changes, see dbf_SharedRemove().
+
+	\return the object handle, or NULL if the table cannot be opened, does
+	not fit into the shared memory left or the system has none
+*/
+P_DBF *dbf_OpenShared(const char *file);
+
+/*! \fn int dbf_SharedRemove(const char *file)
+	\brief dbf_SharedRemove removes the unused shared memory segments of a table
+	\param *file the filename of the .dbf file
+
+	Removes all segments of the table, including the one of its current
+	version, that no handle of \ref dbf_OpenShared in any process is
+	attached to, e.g. to free the memory once a table is not read anymore.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_SharedRemove(const char *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,9 +17,12 @@
  ****************************************************************************/
 
 
+#include "config.h"
 #include <time.h>
+#include <errno.h>
 #include "../include/libdbf/libdbf.h"
 #include "dbf.h"
+#include "dbf_io.h"
 
 /* get_db_version() {{{
  * Convert version field of header into human readable string.
@@ -57,33 +60,139 @@ const char *get_db_version(int version) {
 }
 /* }}} */
 
+static int dbf_ReadFieldInfo(P_DBF *p_dbf, const unsigned char *region, size_t len);
+
+/* dbf_DecodeHeader() {{{
+ * Copies the raw header as found in the file into header and converts
+ * the integers to host byte order.
+ */
+void dbf_DecodeHeader(DB_HEADER *header, const unsigned char *raw)
+{
+	memcpy(header, raw, sizeof(DB_HEADER));
+	/* Endian Swapping */
+	header->header_length = rotate2b(header->header_length);
+	header->record_length = rotate2b(header->record_length);
+	header->records = rotate4b(header->records);
+}
+/* }}} */
+
+/* dbf_ReadRecordCount() {{{
+ * Updates the number of records and the transaction flag from the header
+ * in the file
+ */
+int dbf_ReadRecordCount(P_DBF *p_dbf)
+{
+	unsigned char raw[sizeof(DB_HEADER)];
+	DB_HEADER now;
+
+	if (dbf_io_pread(p_dbf, raw, sizeof(DB_HEADER), 0) != sizeof(DB_HEADER)) {
+		return -1;
+	}
+	dbf_DecodeHeader(&now, raw);
+	p_dbf->header->records = now.records;
+	p_dbf->header->transaction = now.transaction;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_ReadRegion() {{{
+ * Reads len bytes at offset into buf. Regular files are read with pread(),
+ * pipes can only be read sequentially from their current position.
+ */
+static int dbf_ReadRegion(P_DBF *p_dbf, unsigned char *buf, size_t len, off_t offset)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if (p_dbf->flags & DBF_FLAG_SEQUENTIAL)
+			n = dbf_io_read(p_dbf, buf, len);
+		else
+			n = dbf_io_pread(p_dbf, buf, len, offset);
+		if (n <= 0) {
+			return -1;
+		}
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+
+	return 0;
+}
+/* }}} */
+
 /* static dbf_ReadHeaderInfo() {{{
- * Reads header from file into struct
+ * Reads the header and the field descriptors into memory. The first
+ * DBF_HEADER_PREFETCH bytes are fetched with a single pread(), which covers
+ * the complete header region of all but very wide tables.
  */
 static int dbf_ReadHeaderInfo(P_DBF *p_dbf)
 {
 	DB_HEADER *header;
-	if(NULL == (header = malloc(sizeof(DB_HEADER)))) {
+	unsigned char *region, *tmp;
+	size_t header_length;
+	ssize_t n;
+	int ret;
+
+	if(NULL == (region = malloc(DBF_HEADER_PREFETCH))) {
 		return -1;
 	}
-	if ((read( p_dbf->dbf_fh, header, sizeof(DB_HEADER))) == -1 ) {
+	n = dbf_io_pread(p_dbf, region, DBF_HEADER_PREFETCH, 0);
+	if (n == -1 && errno == ESPIPE) {
+		/* Pipes must not be read beyond the header */
+		p_dbf->flags |= DBF_FLAG_SEQUENTIAL;
+		if (0 > dbf_ReadRegion(p_dbf, region, sizeof(DB_HEADER), 0)) {
+			free(region);
+			return -1;
+		}
+		n = sizeof(DB_HEADER);
+	}
+	if (n < (ssize_t) sizeof(DB_HEADER)) {
+		free(region);
 		return -1;
 	}
 
-	/* Endian Swapping */
-	header->header_length = rotate2b(header->header_length);
-	header->record_length = rotate2b(header->record_length);
-	header->records = rotate4b(header->records);
+	header_length = region[8] | (region[9] << 8);
+	if (header_length <= sizeof(DB_HEADER)) {
+		free(region);
+		return -1;
+	}
+	if (header_length > (size_t) n) {
+		if(NULL == (tmp = realloc(region, header_length))) {
+			free(region);
+			return -1;
+		}
+		region = tmp;
+		if (0 > dbf_ReadRegion(p_dbf, region + n, header_length - n, n)) {
+			free(region);
+			return -1;
+		}
+	}
+
+	if(NULL == (header = malloc(sizeof(DB_HEADER)))) {
+		free(region);
+		return -1;
+	}
+
+	DBF_STAT_START(t);
+	dbf_DecodeHeader(header, region);
 	p_dbf->header = header;
+	DBF_STAT_STOP(p_dbf, decode_nsec, t);
 
-	return 0;
+	ret = dbf_ReadFieldInfo(p_dbf, region, header_length);
+	free(region);
+	if (0 > ret) {
+		free(header);
+		p_dbf->header = NULL;
+	}
+
+	return ret;
 }
 /* }}} */
 
-/* static dbf_WriteHeaderInfo() {{{
+/* dbf_WriteHeaderInfo() {{{
  * Write header into file
  */
-static int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header)
+int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header)
 {
 	time_t ps_calendar_time;
 	struct tm *ps_local_tm;
@@ -110,37 +219,43 @@ static int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header)
 	 * because this function is also called after each record has
 	 * been written.
 	 */
-	lseek(p_dbf->dbf_fh, 0, SEEK_SET);
-	if ((write( p_dbf->dbf_fh, newheader, sizeof(DB_HEADER))) == -1 ) {
+	dbf_io_lseek(p_dbf, 0, SEEK_SET);
+	if ((dbf_io_write( p_dbf, newheader, sizeof(DB_HEADER))) == -1 ) {
 		free(newheader);
 		return -1;
 	}
 	free(newheader);
+	DBF_STAT_ADD(p_dbf, header_writes, 1);
 	return 0;
 }
 /* }}} */
 
 /* static dbf_ReadFieldInfo() {{{
  * Sets p_dbf->fields to an array of DB_FIELD containing the specification
- * for all columns.
+ * for all columns. The descriptors are taken from the header region read
+ * by dbf_ReadHeaderInfo(). The number of columns is determined by the
+ * terminating 0x0D, so a backlink following the descriptors does not matter.
  */
-static int dbf_ReadFieldInfo(P_DBF *p_dbf)
+static int dbf_ReadFieldInfo(P_DBF *p_dbf, const unsigned char *region, size_t len)
 {
 	int columns, i, offset;
+	size_t pos;
 	DB_FIELD *fields;
 
-	columns = dbf_NumCols(p_dbf);
-
-	if(NULL == (fields = malloc(columns * sizeof(DB_FIELD)))) {
+	DBF_STAT_START(t);
+	columns = 0;
+	for (pos = sizeof(DB_HEADER); pos + sizeof(DB_FIELD) <= len && region[pos] != 0x0D; pos += sizeof(DB_FIELD)) {
+		columns++;
+	}
+	if (columns == 0) {
 		return -1;
 	}
 
-	lseek(p_dbf->dbf_fh, sizeof(DB_HEADER), SEEK_SET);
-
-	if ((read( p_dbf->dbf_fh, fields, columns * sizeof(DB_FIELD))) == -1 ) {
-		perror(_("In function dbf_ReadFieldInfo(): "));
+	if(NULL == (fields = malloc(columns * sizeof(DB_FIELD)))) {
 		return -1;
 	}
+	memcpy(fields, region + sizeof(DB_HEADER), columns * sizeof(DB_FIELD));
+
 	p_dbf->fields = fields;
 	p_dbf->columns = columns;
 	/* The first byte of a record indicates whether it is deleted or not. */
@@ -149,6 +264,7 @@ static int dbf_ReadFieldInfo(P_DBF *p_dbf)
 		fields[i].field_offset = offset;
 		offset += fields[i].field_length;
 	}
+	DBF_STAT_STOP(p_dbf, decode_nsec, t);
 
 	return 0;
 }
@@ -159,14 +275,14 @@ static int dbf_ReadFieldInfo(P_DBF *p_dbf)
  */
 static int dbf_WriteFieldInfo(P_DBF *p_dbf, DB_FIELD *fields, int numfields)
 {
-	lseek(p_dbf->dbf_fh, sizeof(DB_HEADER), SEEK_SET);
+	dbf_io_lseek(p_dbf, sizeof(DB_HEADER), SEEK_SET);
 
-	if ((write( p_dbf->dbf_fh, fields, numfields * sizeof(DB_FIELD))) == -1 ) {
+	if ((dbf_io_write( p_dbf, fields, numfields * sizeof(DB_FIELD))) == -1 ) {
 		perror(_("In function dbf_WriteFieldInfo(): "));
 		return -1;
 	}
 
-	write(p_dbf->dbf_fh, "\r\0", 2);
+	dbf_io_write(p_dbf, "\r\0", 2);
 
 	return 0;
 }
@@ -176,33 +292,66 @@ static int dbf_WriteFieldInfo(P_DBF *p_dbf, DB_FIELD *fields, int numfields)
  * Open the a dbf file and returns file handler
  */
 P_DBF *dbf_Open(const char *file)
+{
+	return dbf_OpenFlags(file, 0);
+}
+/* }}} */
+
+/* dbf_OpenFlags() {{{
+ * Open the a dbf file with the given DBF_OPEN_* flags
+ */
+P_DBF *dbf_OpenFlags(const char *file, int flags)
 {
 	P_DBF *p_dbf;
-	if(NULL == (p_dbf = malloc(sizeof(P_DBF)))) {
+	if(NULL == (p_dbf = calloc(1, sizeof(P_DBF)))) {
 		return NULL;
 	}
 
 	if (file[0] == '-' && file[1] == '\0') {
 		p_dbf->dbf_fh = fileno(stdin);
-	} else if ((p_dbf->dbf_fh = open(file, O_RDONLY|O_BINARY)) == -1) {
+	} else if ((p_dbf->dbf_fh = open(file, ((flags & DBF_OPEN_RDWR) ? O_RDWR : O_RDONLY)|O_BINARY|O_LARGEFILE)) == -1) {
 		free(p_dbf);
 		return NULL;
 	}
 
 	p_dbf->header = NULL;
-	if(0 > dbf_ReadHeaderInfo(p_dbf)) {
+	p_dbf->fields = NULL;
+	/* compressed files can only be read */
+	if (p_dbf->dbf_fh != fileno(stdin)
+	 && (0 > dbf_StreamOpen(p_dbf) || (p_dbf->stream && (flags & DBF_OPEN_RDWR)))) {
+		if (p_dbf->stream)
+			dbf_StreamClose(p_dbf);
+		close(p_dbf->dbf_fh);
 		free(p_dbf);
 		return NULL;
 	}
+	if(0 > dbf_SchemaLookup(p_dbf)) {
+		if(0 > dbf_ReadHeaderInfo(p_dbf)) {
+			if (p_dbf->stream)
+				dbf_StreamClose(p_dbf);
+			if (p_dbf->dbf_fh != fileno(stdin))
+				close(p_dbf->dbf_fh);
+			free(p_dbf);
+			return NULL;
+		}
+		dbf_SchemaInsert(p_dbf);
+	}
 
-	p_dbf->fields = NULL;
-	if(0 > dbf_ReadFieldInfo(p_dbf)) {
-		free(p_dbf->header);
-		free(p_dbf);
-		return NULL;
+	if ((flags & DBF_OPEN_RDWR) && !(flags & DBF_OPEN_METADATA) && p_dbf->dbf_fh != fileno(stdin)) {
+		p_dbf->flags |= DBF_FLAG_WRITABLE;
+	}
+
+	/* Nothing but the header is needed, so give back the descriptor */
+	if ((flags & DBF_OPEN_METADATA) && p_dbf->dbf_fh != fileno(stdin)) {
+		close(p_dbf->dbf_fh);
+		p_dbf->dbf_fh = -1;
+	} else if ((flags & DBF_OPEN_MMAP) && !p_dbf->stream) {
+		/* without a map all reads and writes simply use the descriptor */
+		dbf_io_map(p_dbf, flags & DBF_OPEN_RDWR);
 	}
 
 	p_dbf->cur_record = 0;
+	p_dbf->fetch_gap = DBF_FETCH_GAP;
 
 	return p_dbf;
 }
@@ -217,7 +366,7 @@ P_DBF *dbf_CreateFH(int fh, DB_FIELD *fields, int numfields)
 	DB_HEADER *header;
 	int reclen, i;
 
-	if(NULL == (p_dbf = malloc(sizeof(P_DBF)))) {
+	if(NULL == (p_dbf = calloc(1, sizeof(P_DBF)))) {
 		return NULL;
 	}
 
@@ -247,8 +396,11 @@ P_DBF *dbf_CreateFH(int fh, DB_FIELD *fields, int numfields)
 		return NULL;
 	}
 	p_dbf->fields = fields;
+	p_dbf->columns = numfields;
+	p_dbf->flags |= DBF_FLAG_WRITABLE;
 
 	p_dbf->cur_record = 0;
+	p_dbf->fetch_gap = DBF_FETCH_GAP;
 
 	return p_dbf;
 }
@@ -263,7 +415,7 @@ P_DBF *dbf_Create(const char *file, DB_FIELD *fields, int numfields)
 
 	if (file[0] == '-' && file[1] == '\0') {
 		fh = fileno(stdout);
-	} else if ((fh = open(file, O_WRONLY|O_BINARY)) == -1) {
+	} else if ((fh = open(file, O_WRONLY|O_BINARY|O_LARGEFILE)) == -1) {
 		return NULL;
 	}
 
@@ -276,14 +428,40 @@ P_DBF *dbf_Create(const char *file, DB_FIELD *fields, int numfields)
  */
 int dbf_Close(P_DBF *p_dbf)
 {
+	int ret = 0;
+
+	if((p_dbf->flags & DBF_FLAG_BATCH) && 0 > dbf_CommitBatch(p_dbf)) {
+		dbf_AbortBatch(p_dbf);
+		ret = -1;
+	}
+	if((p_dbf->flags & DBF_FLAG_APPEND) && 0 > dbf_EndAppend(p_dbf))
+		ret = -1;
+	if(0 > dbf_Flush(p_dbf))
+		ret = -1;
+	if(p_dbf->blocks)
+		free(p_dbf->blocks);
+	if(p_dbf->map)
+		dbf_io_unmap(p_dbf);
+	if(p_dbf->stream)
+		dbf_StreamClose(p_dbf);
+
 	if(p_dbf->header)
 		free(p_dbf->header);
 
-	if(p_dbf->fields)
+	if(p_dbf->shared)
+		dbf_SharedDetach(p_dbf);
+	else if(p_dbf->schema)
+		dbf_SchemaRelease(p_dbf);
+	else if(p_dbf->fields)
 		free(p_dbf->fields);
 
 	if ( p_dbf->dbf_fh == fileno(stdin) )
-		return 0;
+		return ret;
+
+	if ( p_dbf->dbf_fh == -1 ) {
+		free(p_dbf);
+		return ret;
+	}
 
 	if( (close(p_dbf->dbf_fh)) == -1 ) {
 		return -1;
@@ -291,7 +469,7 @@ int dbf_Close(P_DBF *p_dbf)
 
 	free(p_dbf);
 
-	return 0;
+	return ret;
 }
 /* }}} */
 
@@ -317,15 +495,22 @@ int dbf_NumRows(P_DBF *p_dbf)
 }
 /* }}} */
 
+/* dbf_NumRows64() {{{
+ * Returns the number of records without the limit of an int
+ */
+u_int64_t dbf_NumRows64(P_DBF *p_dbf)
+{
+	return p_dbf->header->records;
+}
+/* }}} */
+
 /* dbf_NumCols() {{{
  * Returns the number of fields.
  */
 int dbf_NumCols(P_DBF *p_dbf)
 {
-	if ( p_dbf->header->header_length > 0) {
-		// TODO: Backlink muss noch eingerechnet werden
-		return ((p_dbf->header->header_length - sizeof(DB_HEADER) -1)
-					 / sizeof(DB_FIELD));
+	if ( p_dbf->columns > 0) {
+		return p_dbf->columns;
 	} else {
 		perror(_("In function dbf_NumCols(): "));
 		return -1;
@@ -526,56 +711,135 @@ int dbf_IsMemo(P_DBF *p_dbf)
 int dbf_SetRecordOffset(P_DBF *p_dbf, int offset) {
 	if(offset == 0)
 		return -3;
-	if(offset > (int) p_dbf->header->records)
+	if((offset > 0) && ((u_int32_t) offset > p_dbf->header->records))
 		return -1;
-	if((offset < 0) && (abs(offset) > p_dbf->header->records))
+	/* -(offset + 1) cannot overflow */
+	if((offset < 0) && ((u_int32_t) -(offset + 1) >= p_dbf->header->records))
 		return -2;
 	if(offset < 0)
-		p_dbf->cur_record = (int) p_dbf->header->records + offset;
+		p_dbf->cur_record = p_dbf->header->records - (u_int32_t) -(offset + 1) - 1;
 	else
 		p_dbf->cur_record = offset-1;
 	return p_dbf->cur_record;
 }
 /* }}} */
 
-/* dbf_ReadRecord() {{{
+/* dbf_SeekRecord64() {{{
  */
-int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len) {
+int dbf_SeekRecord64(P_DBF *p_dbf, u_int64_t recno) {
+	if(recno >= p_dbf->header->records)
+		return -1;
+	p_dbf->cur_record = (u_int32_t) recno;
+	return 0;
+}
+/* }}} */
+
+/* dbf_TellRecord64() {{{
+ */
+u_int64_t dbf_TellRecord64(P_DBF *p_dbf) {
+	return p_dbf->cur_record;
+}
+/* }}} */
+
+/* static dbf_ReadCurrent() {{{
+ * Reads the record the counter points to and advances the counter
+ */
+static int dbf_ReadCurrent(P_DBF *p_dbf, char *record) {
 	off_t offset;
 
 	if(p_dbf->cur_record >= p_dbf->header->records)
 		return -1;
 
-	offset = lseek(p_dbf->dbf_fh, p_dbf->header->header_length + p_dbf->cur_record * (p_dbf->header->record_length), SEEK_SET);
-//	fprintf(stdout, "Offset = %d, Record length = %d\n", offset, p_dbf->header->record_length);
-	if (read( p_dbf->dbf_fh, record, p_dbf->header->record_length) == -1 ) {
+	/* opened with DBF_OPEN_METADATA */
+	if(p_dbf->dbf_fh == -1)
 		return -1;
-	}
+
+	offset = DBF_RECORD_OFFSET(p_dbf, p_dbf->cur_record);
+	if (p_dbf->flags & DBF_FLAG_SEQUENTIAL) {
+		dbf_io_lseek(p_dbf, offset, SEEK_SET);
+		if (dbf_io_read( p_dbf, record, p_dbf->header->record_length) == -1 ) {
+			return -1;
+		}
+	} else {
+		if (dbf_io_pread( p_dbf, record, p_dbf->header->record_length, offset) == -1 ) {
+			return -1;
+		}
+		/* updates not written back yet */
+		if (p_dbf->numblocks)
+			dbf_CacheOverlay(p_dbf, record, offset, p_dbf->header->record_length);
+	}
+	DBF_STAT_ADD(p_dbf, records_decoded, 1);
 	p_dbf->cur_record++;
+	return 0;
+}
+/* }}} */
+
+/* dbf_ReadRecord() {{{
+ */
+int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len) {
+	if(0 > dbf_ReadCurrent(p_dbf, record))
+		return -1;
 	return p_dbf->cur_record-1;
 }
 /* }}} */
 
+/* dbf_ReadRecord64() {{{
+ */
+int dbf_ReadRecord64(P_DBF *p_dbf, char *record, int len, u_int64_t *recno) {
+	if(0 > dbf_ReadCurrent(p_dbf, record))
+		return -1;
+	if(recno)
+		*recno = p_dbf->cur_record-1;
+	return 0;
+}
+/* }}} */
+
 /* dbf_WriteRecord() {{{
  */
 int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len) {
+	u_int64_t slot;
+	int locked;
 
 	if(len != p_dbf->header->record_length-1) {
 		fprintf(stderr, _("Length of record mismatches expected length (%d != %d)."), len, p_dbf->header->record_length);
 		fprintf(stderr, "\n");
 		return -1;
 	}
-	lseek(p_dbf->dbf_fh, 0, SEEK_END);
-	if (write( p_dbf->dbf_fh, " ", 1) == -1 ) {
+	/* no header update until the batch is committed */
+	if(p_dbf->flags & DBF_FLAG_BATCH) {
+		return dbf_BatchAppend(p_dbf, record);
+	}
+	/* safe to call from several threads while appends are open */
+	if(p_dbf->flags & DBF_FLAG_APPEND) {
+		return dbf_AppendRecord(p_dbf, record, len, &slot) < 0 ? -1 : (int) (slot + 1);
+	}
+	if(0 > (locked = dbf_AutoLock(p_dbf, DBF_LOCK_EXCLUSIVE))) {
+		return -1;
+	}
+	if (p_dbf->lock_scheme != DBF_LOCK_NONE) {
+		/* Other processes may have appended records in the meantime */
+		if(0 > dbf_ReadRecordCount(p_dbf)) {
+			dbf_AutoUnlock(p_dbf, locked);
+			return -1;
+		}
+		dbf_io_lseek(p_dbf, DBF_RECORD_OFFSET(p_dbf, p_dbf->header->records), SEEK_SET);
+	} else {
+		dbf_io_lseek(p_dbf, 0, SEEK_END);
+	}
+	if (dbf_io_write( p_dbf, " ", 1) == -1 ) {
+		dbf_AutoUnlock(p_dbf, locked);
 		return -1;
 	}
-	if (write( p_dbf->dbf_fh, record, p_dbf->header->record_length-1) == -1 ) {
+	if (dbf_io_write( p_dbf, record, p_dbf->header->record_length-1) == -1 ) {
+		dbf_AutoUnlock(p_dbf, locked);
 		return -1;
 	}
 	p_dbf->header->records++;
 	if(0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header)) {
+		dbf_AutoUnlock(p_dbf, locked);
 		return -1;
 	}
+	dbf_AutoUnlock(p_dbf, locked);
 	return p_dbf->header->records;
 }
 /* }}} */
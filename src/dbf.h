@@ -20,6 +20,8 @@
 #ifndef __DBF_CORE__
 #define __DBF_CORE__
 
+/* config.h comes first in every source file, so large file support
+ * applies to all system headers */
 #include "config.h"
 
 #ifdef ENABLE_NLS
@@ -60,6 +62,9 @@
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
+#ifndef O_LARGEFILE
+#define O_LARGEFILE 0
+#endif
 
 #include <stdio.h>
 #include <fcntl.h>
@@ -73,6 +78,44 @@
  */
 #include "dbf_endian.h"
 
+/** Number of bytes fetched at once when the header region is read */
+#define DBF_HEADER_PREFETCH 4096
+
+/** Default for the holes read over when fetching lists of records */
+#define DBF_FETCH_GAP 65536
+/** Maximum number of bytes fetched with a single read from a list of records */
+#define DBF_FETCH_MAX (1024 * 1024)
+
+/** File offset of the record with the 0-based number recno */
+#define DBF_RECORD_OFFSET(p_dbf, recno) \
+	((off_t) (p_dbf)->header->header_length + (off_t) (recno) * (p_dbf)->header->record_length)
+
+/** Size of the blocks kept in the cache for updates */
+#define DBF_BLOCK_SIZE 4096
+/** Number of blocks in the cache for updates */
+#define DBF_CACHE_BLOCKS 64
+
+/** Size of the buffer collecting the records appended in a batch */
+#define DBF_BATCH_SIZE (1024 * 1024)
+
+//@{
+/** Internal flags of P_DBF */
+/** the file can only be read sequentially */
+#define DBF_FLAG_SEQUENTIAL 0x0001
+/** there are updates not written yet */
+#define DBF_FLAG_DIRTY 0x0002
+/** the file is mapped writable */
+#define DBF_FLAG_MAP_WRITE 0x0004
+/** the file was opened for writing */
+#define DBF_FLAG_WRITABLE 0x0008
+/** a batch is open, see dbf_batch.c */
+#define DBF_FLAG_BATCH 0x0010
+/** concurrent appends are open, see dbf_batch.c */
+#define DBF_FLAG_APPEND 0x0020
+/** the table is read from shared memory, see dbf_shared.c */
+#define DBF_FLAG_SHARED 0x0040
+//@}
+
 //@{
 /** These defines are used to distinguish between types in the dbf fields. */
 #define IS_STRING 1
@@ -141,6 +184,54 @@ struct _DB_FIELD {
 	unsigned char mdx;
 };
 
+/*! \struct DBF_BLOCK
+	\brief Block of the file changed by updates
+*/
+typedef struct {
+	/*! offset in the file, a multiple of DBF_BLOCK_SIZE */
+	off_t offset;
+	/*! number of valid bytes, less than DBF_BLOCK_SIZE at the end of the file */
+	size_t len;
+	char data[DBF_BLOCK_SIZE];
+} DBF_BLOCK;
+
+/*! \struct DBF_SCHEMA
+	\brief Entry of the schema cache
+
+	Holds the parsed header and field descriptors of a file identified
+	by device, inode, size and modification time. The fields are shared
+	read-only by all handles referencing the entry.
+*/
+typedef struct _DBF_SCHEMA {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	long mtime_nsec;
+	/*! header as found in the file, already endian swapped */
+	DB_HEADER header;
+	/*! array of field specification */
+	DB_FIELD *fields;
+	/*! number of fields */
+	u_int32_t columns;
+	/*! number of handles using the entry plus one for the cache itself */
+	int refcount;
+	/*! next entry on the retire list */
+	struct _DBF_SCHEMA *retired_next;
+} DBF_SCHEMA;
+
+/*! \struct DBF_STREAM
+	\brief Decompressor and access point index of a compressed file,
+	see dbf_stream.c
+*/
+typedef struct _DBF_STREAM DBF_STREAM;
+
+/*! \struct DBF_SHARED
+	\brief Segment in shared memory a table is read from,
+	see dbf_shared.c
+*/
+typedef struct _DBF_SHARED DBF_SHARED;
+
 /*! \struct P_DBF
 	\brief P_DBF is a global file handler
 
@@ -153,9 +244,9 @@ struct _P_DBF {
 	/*! filehandler of memo */
 	int dbt_fh;
 	/*! the pysical size of the file, as stated from filesystem */
-	u_int32_t real_filesize;
+	off_t real_filesize;
 	/*! the calculated filesize */
-	u_int32_t calc_filesize;
+	off_t calc_filesize;
 	/*! header of .dbf file */
 	DB_HEADER *header;
 	/*! array of field specification */
@@ -163,15 +254,113 @@ struct _P_DBF {
 	/*! number of fields */
 	u_int32_t columns;
 	/*! integrity could be: valid, invalid */
-	unsigned char integrity[7];
-	/*! record counter */
-	int cur_record;
+	unsigned char integrity[8];
+	/*! record counter, the number of the next record read counting from 0 */
+	u_int32_t cur_record;
+	/*! DBF_FLAG_* */
+	int flags;
+	/*! cache entry owning header and fields, or NULL */
+	DBF_SCHEMA *schema;
+	/*! largest hole in bytes read over when fetching lists of records */
+	size_t fetch_gap;
+	/*! DBF_LOCK_NONE, DBF_LOCK_FOXPRO or DBF_LOCK_CLIPPER */
+	int lock_scheme;
+	/*! header lock held by the caller: 0 none, 1 shared, 2 exclusive */
+	int header_lock;
+	/*! blocks changed by updates, see dbf_update.c */
+	DBF_BLOCK *blocks;
+	/*! number of blocks in use */
+	int numblocks;
+	/*! memory map of the file or NULL */
+	char *map;
+	/*! size of the memory map */
+	size_t map_size;
+	/*! records appended in a batch and not written yet */
+	char *batch;
+	/*! bytes used in the batch buffer */
+	size_t batch_len;
+	/*! number of the first record in the batch buffer */
+	u_int32_t batch_first;
+	/*! result of dbf_AutoLock() when the batch was begun */
+	int batch_lock;
+	/*! next free record slot while appending concurrently */
+	u_int64_t append_next;
+	/*! number of concurrent appends that failed */
+	int append_errors;
+	/*! result of dbf_AutoLock() when the appends were begun */
+	int append_lock;
+	/*! decompressor of a compressed file or NULL */
+	DBF_STREAM *stream;
+	/*! shared memory segment or NULL */
+	DBF_SHARED *shared;
 	/*! errorhandler, maximum of 254 characters */
 	char errmsg[254];
+#ifdef WITH_STATS
+	/*! I/O statistics, see dbf_GetStats() */
+	DBF_STATS stats;
+#endif
 };
 
 
 
+/*
+ * header handling, see dbf.c
+ */
+void dbf_DecodeHeader(DB_HEADER *header, const unsigned char *raw);
+int dbf_ReadRecordCount(P_DBF *p_dbf);
+int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header);
+
+/*
+ * refreshing, see dbf_refresh.c
+ */
+u_int32_t dbf_LayoutHash(P_DBF *p_dbf);
+
+/*
+ * aggregation, see dbf_aggregate.c
+ */
+int dbf_ParseNumber(const char *p, int width, double *value);
+
+/*
+ * updates, see dbf_update.c
+ */
+void dbf_CacheOverlay(P_DBF *p_dbf, char *buf, off_t offset, size_t len);
+
+/*
+ * batches, see dbf_batch.c
+ */
+int dbf_BatchAppend(P_DBF *p_dbf, const char *record);
+void dbf_AbortBatch(P_DBF *p_dbf);
+
+/*
+ * compressed files, see dbf_stream.c
+ */
+int dbf_StreamOpen(P_DBF *p_dbf);
+ssize_t dbf_StreamPread(P_DBF *p_dbf, void *buf, size_t len, off_t offset);
+void dbf_StreamClose(P_DBF *p_dbf);
+
+/*
+ * shared memory, see dbf_shared.c
+ */
+void dbf_SharedDetach(P_DBF *p_dbf);
+
+/*
+ * locking, see dbf_lock.c
+ */
+int dbf_AutoLock(P_DBF *p_dbf, int mode);
+void dbf_AutoUnlock(P_DBF *p_dbf, int taken);
+
+/*
+ * schema cache, see dbf_cache.c
+ */
+int dbf_SchemaLookup(P_DBF *p_dbf);
+int dbf_SchemaInsert(P_DBF *p_dbf);
+void dbf_SchemaRelease(P_DBF *p_dbf);
+
+/*
+ * reading lists of records, see dbf_fetch.c
+ */
+int dbf_ReadRecordList(P_DBF *p_dbf, const u_int32_t *recnos, size_t n, char *records, const size_t *slots, size_t max_gap);
+
 /* Memo File Structure (.FPT)
  * Memo files contain one header record and any number of block structures.
  * The header record contains a pointer to the next free block and the size
@@ -0,0 +1,517 @@
+/*****************************************************************************
+ * dbf_aggregate.c
+ *****************************************************************************
+ * Counts, sums, minimum and maximum of numeric columns computed while scanning
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * The records are read in large blocks and the fields are parsed right
+ * in the block, no record is copied. Groups are found in an open
+ * addressed hash table keyed by the raw bytes of the group-by field.
+ * With several threads every thread scans its own range of records
+ * into its own table, and the tables are merged at the end.
+ */
+
+/* Bytes of records read at once */
+#define DBF_AGGREGATE_CHUNK (1024 * 1024)
+/* Largest number of threads */
+#define DBF_AGGREGATE_THREADS 64
+
+/* Groups found by one thread */
+typedef struct {
+	/*! bytes of the group-by field, 0 without grouping */
+	int keylen;
+	int numcolumns;
+	size_t numgroups;
+	size_t maxgroups;
+	/*! group number + 1 for every slot, 0 if the slot is free */
+	size_t *slots;
+	size_t numslots;
+	unsigned int *hashes;
+	char *keys;
+	u_int64_t *records;
+	DBF_AGGREGATE *aggregates;
+} DBF_AGGREGATE_TABLE;
+
+/* Work of one thread */
+typedef struct {
+	P_DBF *p_dbf;
+	const int *columns;
+	int numcolumns;
+	int group_column;
+	u_int32_t first;
+	u_int32_t last;
+	DBF_AGGREGATE_TABLE table;
+	int ret;
+} DBF_AGGREGATE_JOB;
+
+/* static dbf_AggregateHash() {{{
+ * FNV-1a over the raw key
+ */
+static unsigned int dbf_AggregateHash(const char *key, int len)
+{
+	unsigned int h = 2166136261U;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		h = (h ^ (unsigned char) key[i]) * 16777619U;
+	}
+	return h;
+}
+/* }}} */
+
+/* static dbf_AggregateGrow() {{{
+ * Makes room for one more group
+ */
+static int dbf_AggregateGrow(DBF_AGGREGATE_TABLE *t)
+{
+	size_t max, i, j;
+	void *tmp;
+
+	if (t->numgroups == t->maxgroups) {
+		max = t->maxgroups ? 2 * t->maxgroups : 64;
+		if (NULL == (tmp = realloc(t->hashes, max * sizeof(unsigned int)))) {
+			return -1;
+		}
+		t->hashes = tmp;
+		if (NULL == (tmp = realloc(t->keys, max * t->keylen + 1))) {
+			return -1;
+		}
+		t->keys = tmp;
+		if (NULL == (tmp = realloc(t->records, max * sizeof(u_int64_t)))) {
+			return -1;
+		}
+		t->records = tmp;
+		if (NULL == (tmp = realloc(t->aggregates, max * t->numcolumns * sizeof(DBF_AGGREGATE) + 1))) {
+			return -1;
+		}
+		t->aggregates = tmp;
+		t->maxgroups = max;
+	}
+
+	/* at most half of the slots are used */
+	if (2 * (t->numgroups + 1) > t->numslots) {
+		free(t->slots);
+		t->numslots = t->numslots ? 2 * t->numslots : 128;
+		if (NULL == (t->slots = calloc(t->numslots, sizeof(size_t)))) {
+			t->numslots = 0;
+			return -1;
+		}
+		for (i = 0; i < t->numgroups; i++) {
+			for (j = t->hashes[i] & (t->numslots - 1); t->slots[j]; j = (j + 1) & (t->numslots - 1))
+				;
+			t->slots[j] = i + 1;
+		}
+	}
+	return 0;
+}
+/* }}} */
+
+/* static dbf_AggregateGroup() {{{
+ * Returns the number of the group of key, adding it if necessary
+ */
+static ssize_t dbf_AggregateGroup(DBF_AGGREGATE_TABLE *t, const char *key, unsigned int hash)
+{
+	size_t i, g;
+
+	if (t->numslots) {
+		for (i = hash & (t->numslots - 1); t->slots[i]; i = (i + 1) & (t->numslots - 1)) {
+			g = t->slots[i] - 1;
+			if (t->hashes[g] == hash && !memcmp(t->keys + g * t->keylen, key, t->keylen)) {
+				return g;
+			}
+		}
+	}
+
+	if (0 > dbf_AggregateGrow(t)) {
+		return -1;
+	}
+	g = t->numgroups++;
+	t->hashes[g] = hash;
+	memcpy(t->keys + g * t->keylen, key, t->keylen);
+	t->records[g] = 0;
+	memset(&t->aggregates[g * t->numcolumns], 0, t->numcolumns * sizeof(DBF_AGGREGATE));
+	for (i = hash & (t->numslots - 1); t->slots[i]; i = (i + 1) & (t->numslots - 1))
+		;
+	t->slots[i] = g + 1;
+	return g;
+}
+/* }}} */
+
+/* Powers of ten a double holds exactly */
+static const double dbf_Pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* dbf_ParseNumber() {{{
+ * Parses a numeric field like dbf_SchemaDouble, but with an exponent and
+ * strictly: returns 0 if the field is blank or anything but padding is
+ * left around the number. The decimal point is always '.', whatever the
+ * locale.
+ */
+int dbf_ParseNumber(const char *p, int width, double *value)
+{
+	unsigned long long mantissa = 0;
+	double v;
+	int i = 0, digits = 0, significant = 0, negative = 0, point = 0;
+	int exponent = 0, e = 0, enegative = 0, edigits = 0;
+
+	while (i < width && p[i] == ' ')
+		i++;
+	if (i < width && (p[i] == '-' || p[i] == '+'))
+		negative = p[i++] == '-';
+	for (; i < width; i++) {
+		if (p[i] >= '0' && p[i] <= '9') {
+			digits++;
+			if (significant < 19) {
+				/* 19 digits always fit into the mantissa */
+				mantissa = 10 * mantissa + (p[i] - '0');
+				if (mantissa)
+					significant++;
+				if (point)
+					exponent--;
+			} else if (!point) {
+				exponent++;
+			}
+		} else if (p[i] == '.' && !point) {
+			point = 1;
+		} else {
+			break;
+		}
+	}
+	if (digits && i < width && (p[i] == 'e' || p[i] == 'E')) {
+		i++;
+		if (i < width && (p[i] == '-' || p[i] == '+'))
+			enegative = p[i++] == '-';
+		for (; i < width && p[i] >= '0' && p[i] <= '9'; i++, edigits++) {
+			if (e < 10000)
+				e = 10 * e + (p[i] - '0');
+		}
+		if (!edigits)
+			return 0;
+		exponent += enegative ? -e : e;
+	}
+	/* some programs pad with NUL instead of blanks */
+	while (i < width && (p[i] == ' ' || p[i] == '\0'))
+		i++;
+	if (i < width || !digits)
+		return 0;
+
+	v = (double) mantissa;
+	for (; exponent > 22; exponent -= 22)
+		v *= 1e22;
+	for (; exponent < -22; exponent += 22)
+		v /= 1e22;
+	v = exponent < 0 ? v / dbf_Pow10[-exponent] : v * dbf_Pow10[exponent];
+	*value = negative ? -v : v;
+	return 1;
+}
+/* }}} */
+
+/* static dbf_AggregateScan() {{{
+ * Aggregates the records of a job, runs in its own thread
+ */
+static void *dbf_AggregateScan(void *arg)
+{
+	DBF_AGGREGATE_JOB *job = arg;
+	DBF_AGGREGATE_TABLE *t = &job->table;
+	DBF_AGGREGATE *a;
+	DB_FIELD *fields = job->p_dbf->fields;
+	int reclen = job->p_dbf->header->record_length;
+	u_int32_t first, chunk;
+	const char *rec, *key = "";
+	char *buf;
+	double value;
+	ssize_t g;
+	int i, n, c, keyoffset = 0;
+
+	chunk = DBF_AGGREGATE_CHUNK / reclen ? DBF_AGGREGATE_CHUNK / reclen : 1;
+	if (NULL == (buf = malloc((size_t) chunk * reclen))) {
+		job->ret = -1;
+		return NULL;
+	}
+	if (job->group_column >= 0) {
+		keyoffset = fields[job->group_column].field_offset;
+	}
+
+	job->ret = 0;
+	for (first = job->first; first < job->last; first += n) {
+		n = dbf_ReadRecords(job->p_dbf, first, job->last - first < chunk ? job->last - first : chunk, buf);
+		if (n <= 0) {
+			job->ret = -1;
+			break;
+		}
+		for (i = 0, rec = buf; i < n; i++, rec += reclen) {
+			if (rec[0] == '*') {
+				continue;
+			}
+			if (t->keylen) {
+				key = rec + keyoffset;
+			}
+			if (t->keylen || t->numgroups == 0) {
+				if (0 > (g = dbf_AggregateGroup(t, key, dbf_AggregateHash(key, t->keylen)))) {
+					job->ret = -1;
+					break;
+				}
+			} else {
+				g = 0;
+			}
+			t->records[g]++;
+			a = &t->aggregates[g * t->numcolumns];
+			for (c = 0; c < t->numcolumns; c++, a++) {
+				if (!dbf_ParseNumber(rec + fields[job->columns[c]].field_offset,
+						fields[job->columns[c]].field_length, &value)) {
+					continue;
+				}
+				if (a->count == 0 || value < a->min)
+					a->min = value;
+				if (a->count == 0 || value > a->max)
+					a->max = value;
+				a->sum += value;
+				a->count++;
+			}
+		}
+		if (job->ret) {
+			break;
+		}
+	}
+	free(buf);
+	return NULL;
+}
+/* }}} */
+
+/* static dbf_AggregateMerge() {{{
+ * Adds the groups of src to dst
+ */
+static int dbf_AggregateMerge(DBF_AGGREGATE_TABLE *dst, DBF_AGGREGATE_TABLE *src)
+{
+	DBF_AGGREGATE *a, *b;
+	ssize_t g;
+	size_t i;
+	int c;
+
+	for (i = 0; i < src->numgroups; i++) {
+		if (0 > (g = dbf_AggregateGroup(dst, src->keys + i * src->keylen, src->hashes[i]))) {
+			return -1;
+		}
+		dst->records[g] += src->records[i];
+		a = &dst->aggregates[g * dst->numcolumns];
+		b = &src->aggregates[i * src->numcolumns];
+		for (c = 0; c < dst->numcolumns; c++, a++, b++) {
+			if (b->count == 0)
+				continue;
+			if (a->count == 0 || b->min < a->min)
+				a->min = b->min;
+			if (a->count == 0 || b->max > a->max)
+				a->max = b->max;
+			a->sum += b->sum;
+			a->count += b->count;
+		}
+	}
+	return 0;
+}
+/* }}} */
+
+/* static dbf_AggregateFree() {{{
+ */
+static void dbf_AggregateFree(DBF_AGGREGATE_TABLE *t)
+{
+	free(t->slots);
+	free(t->hashes);
+	free(t->keys);
+	free(t->records);
+	free(t->aggregates);
+}
+/* }}} */
+
+/* Position of a group in the sorted result */
+typedef struct {
+	const char *key;
+	int keylen;
+	size_t group;
+} DBF_AGGREGATE_ORDER;
+
+/* static dbf_CompareGroup() {{{
+ * Orders the groups by their keys
+ */
+static int dbf_CompareGroup(const void *a, const void *b)
+{
+	const DBF_AGGREGATE_ORDER *x = a, *y = b;
+
+	return memcmp(x->key, y->key, x->keylen);
+}
+/* }}} */
+
+/* static dbf_AggregateResult() {{{
+ * Copies the groups of t, sorted by their keys, into a single block of
+ * memory
+ */
+static int dbf_AggregateResult(DBF_AGGREGATE_TABLE *t, DBF_GROUP **groups)
+{
+	DBF_AGGREGATE_ORDER *order;
+	DBF_GROUP *res;
+	DBF_AGGREGATE *aggregates;
+	char *keys;
+	size_t i, j, g, n;
+
+	n = t->numgroups;
+	if (NULL == (order = malloc(n * sizeof(DBF_AGGREGATE_ORDER) + 1))) {
+		return -1;
+	}
+	res = malloc(n * sizeof(DBF_GROUP) + n * t->numcolumns * sizeof(DBF_AGGREGATE) + n * t->keylen + 1);
+	if (res == NULL) {
+		free(order);
+		return -1;
+	}
+	aggregates = (DBF_AGGREGATE *) (res + n);
+	keys = (char *) (aggregates + n * t->numcolumns);
+
+	for (i = 0; i < n; i++) {
+		order[i].key = t->keys + i * t->keylen;
+		order[i].keylen = t->keylen;
+		order[i].group = i;
+	}
+	if (t->keylen && n > 1) {
+		qsort(order, n, sizeof(DBF_AGGREGATE_ORDER), dbf_CompareGroup);
+	}
+
+	for (i = 0; i < n; i++) {
+		g = order[i].group;
+		res[i].key = t->keylen ? keys + i * t->keylen : NULL;
+		res[i].records = t->records[g];
+		res[i].columns = aggregates + i * t->numcolumns;
+		memcpy(keys + i * t->keylen, t->keys + g * t->keylen, t->keylen);
+		memcpy(res[i].columns, t->aggregates + g * t->numcolumns, t->numcolumns * sizeof(DBF_AGGREGATE));
+		for (j = 0; j < (size_t) t->numcolumns; j++) {
+			res[i].columns[j].mean = res[i].columns[j].count
+				? res[i].columns[j].sum / res[i].columns[j].count : 0.0;
+		}
+	}
+	free(order);
+
+	*groups = res;
+	return (int) n;
+}
+/* }}} */
+
+/* dbf_Aggregate() {{{
+ */
+int dbf_Aggregate(P_DBF *p_dbf, const int *columns, int numcolumns, int group_column, int threads, DBF_GROUP **groups)
+{
+	DBF_AGGREGATE_JOB *jobs;
+	u_int32_t records;
+	int i, ret = 0;
+#ifdef HAVE_PTHREAD_H
+	pthread_t tids[DBF_AGGREGATE_THREADS];
+	int started[DBF_AGGREGATE_THREADS];
+#endif
+
+	*groups = NULL;
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL) || numcolumns < 0
+	 || group_column >= (int) p_dbf->columns) {
+		return -1;
+	}
+	for (i = 0; i < numcolumns; i++) {
+		if (columns[i] < 0 || columns[i] >= (int) p_dbf->columns
+		 || (p_dbf->fields[columns[i]].field_type != 'N' && p_dbf->fields[columns[i]].field_type != 'F')) {
+			return -1;
+		}
+	}
+
+	records = p_dbf->header->records;
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (threads > DBF_AGGREGATE_THREADS) {
+		threads = DBF_AGGREGATE_THREADS;
+	}
+	/* reads of a compressed file take turns, and tiny tables gain nothing */
+	if (p_dbf->stream || records < 4096 * (u_int32_t) threads) {
+		threads = 1;
+	}
+	if (NULL == (jobs = calloc(threads, sizeof(DBF_AGGREGATE_JOB)))) {
+		return -1;
+	}
+	for (i = 0; i < threads; i++) {
+		jobs[i].p_dbf = p_dbf;
+		jobs[i].columns = columns;
+		jobs[i].numcolumns = numcolumns;
+		jobs[i].group_column = group_column;
+		jobs[i].first = (u_int32_t) ((u_int64_t) records * i / threads);
+		jobs[i].last = (u_int32_t) ((u_int64_t) records * (i + 1) / threads);
+		jobs[i].table.keylen = group_column >= 0 ? p_dbf->fields[group_column].field_length : 0;
+		jobs[i].table.numcolumns = numcolumns;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	for (i = 1; i < threads; i++) {
+		started[i] = pthread_create(&tids[i], NULL, dbf_AggregateScan, &jobs[i]) == 0;
+	}
+#endif
+	dbf_AggregateScan(&jobs[0]);
+#ifdef HAVE_PTHREAD_H
+	for (i = 1; i < threads; i++) {
+		if (started[i]) {
+			pthread_join(tids[i], NULL);
+		} else {
+			dbf_AggregateScan(&jobs[i]);
+		}
+	}
+#else
+	for (i = 1; i < threads; i++) {
+		dbf_AggregateScan(&jobs[i]);
+	}
+#endif
+
+	for (i = 0; i < threads; i++) {
+		if (jobs[i].ret) {
+			ret = -1;
+		} else if (ret == 0 && i > 0 && 0 > dbf_AggregateMerge(&jobs[0].table, &jobs[i].table)) {
+			ret = -1;
+		}
+	}
+	if (ret == 0) {
+		/* a table without records still has the group of all records */
+		if (group_column < 0 && jobs[0].table.numgroups == 0
+		 && 0 > dbf_AggregateGroup(&jobs[0].table, "", dbf_AggregateHash("", 0))) {
+			ret = -1;
+		} else {
+			ret = dbf_AggregateResult(&jobs[0].table, groups);
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		dbf_AggregateFree(&jobs[i].table);
+	}
+	free(jobs);
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
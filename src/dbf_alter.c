@@ -0,0 +1,341 @@
+/*****************************************************************************
+ * dbf_alter.c
+ *****************************************************************************
+ * Rewriting a table with different fields
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * The new record is described once by a list of operations on byte
+ * ranges: copying a range of the old record, filling a range with
+ * blanks or, for a shortened number, checking that the digits cut off
+ * are blanks before copying the rest. Neighbouring copies are merged,
+ * so unchanged runs of fields cost a single memcpy(). The records are
+ * read and written in large blocks, with several threads each one
+ * converting its own range of records. The header gets the number of
+ * records only after all records were written.
+ */
+
+/* Bytes of records read at once */
+#define DBF_ALTER_CHUNK (1024 * 1024)
+/* Largest number of threads */
+#define DBF_ALTER_THREADS 64
+
+#define DBF_ALTER_COPY 0
+#define DBF_ALTER_BLANK 1
+#define DBF_ALTER_NUMBER 2
+
+/* Operation building a part of the new record */
+typedef struct {
+	int type;
+	int dst;
+	int src;
+	int len;
+	/*! leading bytes of a number that must be blank */
+	int cut;
+	/*! field of the new record, for messages */
+	int column;
+} DBF_ALTER_OP;
+
+/* Work of one thread */
+typedef struct {
+	P_DBF *p_dbf;
+	P_DBF *out;
+	const DBF_ALTER_OP *ops;
+	int numops;
+	u_int32_t first;
+	u_int32_t last;
+	int ret;
+} DBF_ALTER_JOB;
+
+/* static dbf_AlterAdd() {{{
+ * Appends an operation, merging it with the previous one if possible
+ */
+static void dbf_AlterAdd(DBF_ALTER_OP *ops, int *numops, int type, int dst, int src, int len, int cut, int column)
+{
+	DBF_ALTER_OP *prev = *numops ? &ops[*numops - 1] : NULL;
+
+	if (len <= 0) {
+		return;
+	}
+	if (prev && prev->type == type && type != DBF_ALTER_NUMBER && prev->dst + prev->len == dst
+	 && (type == DBF_ALTER_BLANK || prev->src + prev->len == src)) {
+		prev->len += len;
+		return;
+	}
+	ops[*numops].type = type;
+	ops[*numops].dst = dst;
+	ops[*numops].src = src;
+	ops[*numops].len = len;
+	ops[*numops].cut = cut;
+	ops[*numops].column = column;
+	(*numops)++;
+}
+/* }}} */
+
+/* static dbf_AlterPlan() {{{
+ * Builds the operations turning an old record into a new one, returns
+ * their number or -1 if a field cannot be converted
+ */
+static int dbf_AlterPlan(P_DBF *p_dbf, const DB_FIELD *fields, int numfields, DBF_ALTER_OP *ops)
+{
+	const DB_FIELD *old;
+	int i, c, dst, numops = 0, numeric, oldlen, newlen;
+
+	/* the deletion flag is kept */
+	dbf_AlterAdd(ops, &numops, DBF_ALTER_COPY, 0, 0, 1, 0, -1);
+	for (i = 0, dst = 1; i < numfields; dst += fields[i++].field_length) {
+		newlen = fields[i].field_length;
+		for (c = 0, old = NULL; c < (int) p_dbf->columns; c++) {
+			if (!strncasecmp((char *) p_dbf->fields[c].field_name, (char *) fields[i].field_name, 11)) {
+				old = &p_dbf->fields[c];
+				break;
+			}
+		}
+		/* new fields are blank */
+		if (old == NULL) {
+			dbf_AlterAdd(ops, &numops, DBF_ALTER_BLANK, dst, 0, newlen, 0, i);
+			continue;
+		}
+
+		oldlen = old->field_length;
+		numeric = (old->field_type == 'N' || old->field_type == 'F')
+			&& (fields[i].field_type == 'N' || fields[i].field_type == 'F');
+		if (old->field_type != fields[i].field_type && !numeric) {
+			fprintf(stderr, _("Type of field %.11s cannot be changed."), fields[i].field_name);
+			fprintf(stderr, "\n");
+			return -1;
+		}
+		if (numeric && old->field_decimals != fields[i].field_decimals) {
+			fprintf(stderr, _("Decimals of field %.11s cannot be changed."), fields[i].field_name);
+			fprintf(stderr, "\n");
+			return -1;
+		}
+
+		if (numeric) {
+			/* numbers are aligned to the right */
+			if (newlen >= oldlen) {
+				dbf_AlterAdd(ops, &numops, DBF_ALTER_BLANK, dst, 0, newlen - oldlen, 0, i);
+				dbf_AlterAdd(ops, &numops, DBF_ALTER_COPY, dst + newlen - oldlen, old->field_offset, oldlen, 0, i);
+			} else {
+				dbf_AlterAdd(ops, &numops, DBF_ALTER_NUMBER, dst, old->field_offset, newlen, oldlen - newlen, i);
+			}
+		} else {
+			/* everything else to the left */
+			dbf_AlterAdd(ops, &numops, DBF_ALTER_COPY, dst, old->field_offset, newlen < oldlen ? newlen : oldlen, 0, i);
+			dbf_AlterAdd(ops, &numops, DBF_ALTER_BLANK, dst + oldlen, 0, newlen - oldlen, 0, i);
+		}
+	}
+	return numops;
+}
+/* }}} */
+
+/* static dbf_AlterRecords() {{{
+ * Converts the records of a job, runs in its own thread
+ */
+static void *dbf_AlterRecords(void *arg)
+{
+	DBF_ALTER_JOB *job = arg;
+	const DBF_ALTER_OP *op, *end = job->ops + job->numops;
+	int reclen = job->p_dbf->header->record_length;
+	int newlen = job->out->header->record_length;
+	u_int32_t first, chunk;
+	const char *rec;
+	char *buf, *outbuf, *dst;
+	int i, k, n;
+
+	job->ret = -1;
+	chunk = DBF_ALTER_CHUNK / reclen ? DBF_ALTER_CHUNK / reclen : 1;
+	buf = malloc((size_t) chunk * reclen);
+	outbuf = malloc((size_t) chunk * newlen);
+	if (buf == NULL || outbuf == NULL) {
+		goto out;
+	}
+
+	for (first = job->first; first < job->last; first += n) {
+		n = dbf_ReadRecords(job->p_dbf, first, job->last - first < chunk ? job->last - first : chunk, buf);
+		if (n <= 0) {
+			goto out;
+		}
+		for (i = 0, rec = buf, dst = outbuf; i < n; i++, rec += reclen, dst += newlen) {
+			for (op = job->ops; op < end; op++) {
+				switch (op->type) {
+					case DBF_ALTER_COPY:
+						memcpy(dst + op->dst, rec + op->src, op->len);
+						break;
+					case DBF_ALTER_BLANK:
+						memset(dst + op->dst, ' ', op->len);
+						break;
+					case DBF_ALTER_NUMBER:
+						for (k = 0; k < op->cut; k++) {
+							if (rec[op->src + k] != ' ') {
+								fprintf(stderr, _("Value of field %.11s in record %u does not fit."),
+									job->out->fields[op->column].field_name, first + i + 1);
+								fprintf(stderr, "\n");
+								goto out;
+							}
+						}
+						memcpy(dst + op->dst, rec + op->src + op->cut, op->len);
+						break;
+				}
+			}
+		}
+		if (dbf_io_pwrite(job->out, outbuf, (size_t) n * newlen, DBF_RECORD_OFFSET(job->out, first))
+				!= (ssize_t) n * newlen) {
+			goto out;
+		}
+	}
+	job->ret = 0;
+
+out:
+	free(outbuf);
+	free(buf);
+	return NULL;
+}
+/* }}} */
+
+/* dbf_Alter() {{{
+ */
+int dbf_Alter(P_DBF *p_dbf, const char *file, const DB_FIELD *fields, int numfields, int threads)
+{
+	DBF_ALTER_JOB *jobs = NULL;
+	DBF_ALTER_OP *ops = NULL;
+	DB_FIELD *newfields = NULL;
+	P_DBF *out = NULL;
+	u_int32_t records;
+	int i, fh = -1, numops, offset, ret = -1;
+#ifdef HAVE_PTHREAD_H
+	pthread_t tids[DBF_ALTER_THREADS];
+	int started[DBF_ALTER_THREADS];
+#endif
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL) || numfields < 1) {
+		return -1;
+	}
+	/* one more operation for the deletion flag and one per field split
+	 * into a copy and blanks */
+	if (NULL == (ops = malloc((2 * numfields + 1) * sizeof(DBF_ALTER_OP)))) {
+		return -1;
+	}
+	if (0 > (numops = dbf_AlterPlan(p_dbf, fields, numfields, ops))) {
+		goto out;
+	}
+
+	if (NULL == (newfields = malloc(numfields * sizeof(DB_FIELD)))) {
+		goto out;
+	}
+	memcpy(newfields, fields, numfields * sizeof(DB_FIELD));
+	for (i = 0, offset = 1; i < numfields; i++) {
+		newfields[i].field_offset = offset;
+		offset += newfields[i].field_length;
+	}
+	if (offset > 0xffff) {
+		fprintf(stderr, _("Record of the new table is too long."));
+		fprintf(stderr, "\n");
+		goto out;
+	}
+	if ((fh = open(file, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY|O_LARGEFILE, 0644)) == -1) {
+		goto out;
+	}
+	if (NULL == (out = dbf_CreateFH(fh, newfields, numfields))) {
+		close(fh);
+		goto out;
+	}
+	/* owned by the output from now on */
+	newfields = NULL;
+
+	records = p_dbf->header->records;
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (threads > DBF_ALTER_THREADS) {
+		threads = DBF_ALTER_THREADS;
+	}
+	/* reads of a compressed file take turns, and tiny tables gain nothing */
+	if (p_dbf->stream || records < 4096 * (u_int32_t) threads) {
+		threads = 1;
+	}
+	if (NULL == (jobs = calloc(threads, sizeof(DBF_ALTER_JOB)))) {
+		goto out;
+	}
+	for (i = 0; i < threads; i++) {
+		jobs[i].p_dbf = p_dbf;
+		jobs[i].out = out;
+		jobs[i].ops = ops;
+		jobs[i].numops = numops;
+		jobs[i].first = (u_int32_t) ((u_int64_t) records * i / threads);
+		jobs[i].last = (u_int32_t) ((u_int64_t) records * (i + 1) / threads);
+	}
+
+#ifdef HAVE_PTHREAD_H
+	for (i = 1; i < threads; i++) {
+		started[i] = pthread_create(&tids[i], NULL, dbf_AlterRecords, &jobs[i]) == 0;
+	}
+#endif
+	dbf_AlterRecords(&jobs[0]);
+#ifdef HAVE_PTHREAD_H
+	for (i = 1; i < threads; i++) {
+		if (started[i]) {
+			pthread_join(tids[i], NULL);
+		} else {
+			dbf_AlterRecords(&jobs[i]);
+		}
+	}
+#else
+	for (i = 1; i < threads; i++) {
+		dbf_AlterRecords(&jobs[i]);
+	}
+#endif
+	for (i = 0; i < threads; i++) {
+		if (jobs[i].ret) {
+			goto out;
+		}
+	}
+
+	/* the records are complete, now they become part of the table */
+	out->header->records = records;
+	if (0 > dbf_WriteHeaderInfo(out, out->header)) {
+		goto out;
+	}
+	ret = (int) records;
+
+out:
+	if (out && 0 > dbf_Close(out)) {
+		ret = -1;
+	}
+	/* no half written output is left behind */
+	if (ret < 0 && fh != -1) {
+		unlink(file);
+	}
+	free(jobs);
+	free(newfields);
+	free(ops);
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,365 @@
+/*****************************************************************************
+ * dbf_batch.c
+ *****************************************************************************
+ * Appending many records at once with a single header update
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_PWRITEV
+#include <sys/uio.h>
+#endif
+
+#if !defined(HAVE_SYNC_FETCH_AND_ADD) && defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+
+/* guards the slot counters if the compiler has no atomic operations */
+static pthread_mutex_t dbf_append_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*
+ * While a batch is open the header on disk keeps the number of records
+ * committed before and has the transaction flag set. Records are
+ * collected in a buffer and written behind the committed ones. On commit
+ * the data is synced first and only then the header is written with the
+ * new number of records and the flag cleared. After a crash the header
+ * still describes the old table, and everything behind it is cut off
+ * by dbf_Repair(). Opening the file does not do that on its own, since
+ * the flag is just as well set while another process is in a batch.
+ *
+ * Concurrent appends work the same way, except that nothing is
+ * buffered: every producer takes the next free record slots from an
+ * atomic counter and writes its records straight to their offsets with
+ * a positional write, so producers never wait for each other. The
+ * header is only written by dbf_EndAppend(), once all producers are
+ * done.
+ */
+
+/* static dbf_BatchWrite() {{{
+ * Writes the buffered records behind the ones already written
+ */
+static int dbf_BatchWrite(P_DBF *p_dbf)
+{
+	off_t offset;
+
+	if (p_dbf->batch_len == 0) {
+		return 0;
+	}
+	offset = DBF_RECORD_OFFSET(p_dbf, p_dbf->batch_first);
+	if (dbf_io_pwrite(p_dbf, p_dbf->batch, p_dbf->batch_len, offset) != (ssize_t) p_dbf->batch_len) {
+		return -1;
+	}
+	p_dbf->batch_first += p_dbf->batch_len / p_dbf->header->record_length;
+	p_dbf->batch_len = 0;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SyncData() {{{
+ */
+static int dbf_SyncData(P_DBF *p_dbf)
+{
+#ifdef HAVE_FDATASYNC
+	return fdatasync(p_dbf->dbf_fh);
+#else
+	return fsync(p_dbf->dbf_fh);
+#endif
+}
+/* }}} */
+
+/* dbf_BeginBatch() {{{
+ */
+int dbf_BeginBatch(P_DBF *p_dbf)
+{
+	if (!(p_dbf->flags & DBF_FLAG_WRITABLE) || (p_dbf->flags & DBF_FLAG_BATCH)) {
+		return -1;
+	}
+	if (NULL == (p_dbf->batch = malloc(DBF_BATCH_SIZE))) {
+		return -1;
+	}
+	/* The lock is held until the batch is committed */
+	if (0 > (p_dbf->batch_lock = dbf_AutoLock(p_dbf, DBF_LOCK_EXCLUSIVE))) {
+		free(p_dbf->batch);
+		p_dbf->batch = NULL;
+		return -1;
+	}
+	if (p_dbf->lock_scheme != DBF_LOCK_NONE && 0 > dbf_ReadRecordCount(p_dbf)) {
+		goto fail;
+	}
+
+	p_dbf->header->transaction = 1;
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header)) {
+		p_dbf->header->transaction = 0;
+		goto fail;
+	}
+	p_dbf->batch_len = 0;
+	p_dbf->batch_first = p_dbf->header->records;
+	p_dbf->flags |= DBF_FLAG_BATCH;
+	return 0;
+
+fail:
+	dbf_AutoUnlock(p_dbf, p_dbf->batch_lock);
+	free(p_dbf->batch);
+	p_dbf->batch = NULL;
+	return -1;
+}
+/* }}} */
+
+/* dbf_BatchAppend() {{{
+ * Called by dbf_WriteRecord() while a batch is open, record is the data
+ * without the deletion flag
+ */
+int dbf_BatchAppend(P_DBF *p_dbf, const char *record)
+{
+	size_t reclen = p_dbf->header->record_length;
+
+	if (p_dbf->batch_len + reclen > DBF_BATCH_SIZE && 0 > dbf_BatchWrite(p_dbf)) {
+		return -1;
+	}
+	p_dbf->batch[p_dbf->batch_len] = ' ';
+	memcpy(p_dbf->batch + p_dbf->batch_len + 1, record, reclen - 1);
+	p_dbf->batch_len += reclen;
+	p_dbf->header->records++;
+	return p_dbf->header->records;
+}
+/* }}} */
+
+/* dbf_CommitBatch() {{{
+ */
+int dbf_CommitBatch(P_DBF *p_dbf)
+{
+	if (!(p_dbf->flags & DBF_FLAG_BATCH)) {
+		return -1;
+	}
+	if (0 > dbf_BatchWrite(p_dbf) || 0 > dbf_SyncData(p_dbf)) {
+		return -1;
+	}
+
+	/* the records are on disk, now they become part of the table */
+	p_dbf->header->transaction = 0;
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header)) {
+		p_dbf->header->transaction = 1;
+		return -1;
+	}
+
+	dbf_AutoUnlock(p_dbf, p_dbf->batch_lock);
+	free(p_dbf->batch);
+	p_dbf->batch = NULL;
+	p_dbf->flags &= ~DBF_FLAG_BATCH;
+	return 0;
+}
+/* }}} */
+
+/* dbf_AbortBatch() {{{
+ * Gives up a batch that could not be committed, called by dbf_Close().
+ * The header on disk keeps the transaction flag, so the records written
+ * are left for dbf_Repair().
+ */
+void dbf_AbortBatch(P_DBF *p_dbf)
+{
+	dbf_AutoUnlock(p_dbf, p_dbf->batch_lock);
+	free(p_dbf->batch);
+	p_dbf->batch = NULL;
+	p_dbf->batch_len = 0;
+	p_dbf->flags &= ~DBF_FLAG_BATCH;
+}
+/* }}} */
+
+/* static dbf_AppendReserve() {{{
+ * Takes n record slots, returns the first one
+ */
+static u_int64_t dbf_AppendReserve(P_DBF *p_dbf, u_int32_t n)
+{
+	u_int64_t first;
+
+#ifdef HAVE_SYNC_FETCH_AND_ADD
+	first = __sync_fetch_and_add(&p_dbf->append_next, (u_int64_t) n);
+#else
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&dbf_append_mutex);
+#endif
+	first = p_dbf->append_next;
+	p_dbf->append_next += n;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&dbf_append_mutex);
+#endif
+#endif
+	return first;
+}
+/* }}} */
+
+/* static dbf_AppendFail() {{{
+ * Notes that a record could not be written
+ */
+static int dbf_AppendFail(P_DBF *p_dbf)
+{
+#ifdef HAVE_SYNC_FETCH_AND_ADD
+	__sync_fetch_and_add(&p_dbf->append_errors, 1);
+#else
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&dbf_append_mutex);
+#endif
+	p_dbf->append_errors++;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&dbf_append_mutex);
+#endif
+#endif
+	return -1;
+}
+/* }}} */
+
+/* dbf_BeginAppend() {{{
+ */
+int dbf_BeginAppend(P_DBF *p_dbf)
+{
+	if (!(p_dbf->flags & DBF_FLAG_WRITABLE) || (p_dbf->flags & (DBF_FLAG_BATCH | DBF_FLAG_APPEND))) {
+		return -1;
+	}
+	/* The lock is held until the appends are ended */
+	if (0 > (p_dbf->append_lock = dbf_AutoLock(p_dbf, DBF_LOCK_EXCLUSIVE))) {
+		return -1;
+	}
+	if (p_dbf->lock_scheme != DBF_LOCK_NONE && 0 > dbf_ReadRecordCount(p_dbf)) {
+		goto fail;
+	}
+
+	p_dbf->header->transaction = 1;
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header)) {
+		p_dbf->header->transaction = 0;
+		goto fail;
+	}
+	p_dbf->append_next = p_dbf->header->records;
+	p_dbf->append_errors = 0;
+	p_dbf->flags |= DBF_FLAG_APPEND;
+	return 0;
+
+fail:
+	dbf_AutoUnlock(p_dbf, p_dbf->append_lock);
+	return -1;
+}
+/* }}} */
+
+/* dbf_AppendRecord() {{{
+ */
+int dbf_AppendRecord(P_DBF *p_dbf, const char *record, int len, u_int64_t *recno)
+{
+	int reclen = p_dbf->header->record_length;
+	u_int64_t slot;
+#ifdef HAVE_PWRITEV
+	struct iovec iov[2];
+#else
+	char *buf;
+	ssize_t n;
+#endif
+
+	if (!(p_dbf->flags & DBF_FLAG_APPEND) || len != reclen - 1) {
+		return -1;
+	}
+	if ((slot = dbf_AppendReserve(p_dbf, 1)) >= 0xffffffffULL) {
+		return dbf_AppendFail(p_dbf);
+	}
+#ifdef HAVE_PWRITEV
+	iov[0].iov_base = " ";
+	iov[0].iov_len = 1;
+	iov[1].iov_base = (char *) record;
+	iov[1].iov_len = len;
+	if (dbf_io_pwritev(p_dbf, iov, 2, DBF_RECORD_OFFSET(p_dbf, slot)) != reclen) {
+		return dbf_AppendFail(p_dbf);
+	}
+#else
+	if (NULL == (buf = malloc(reclen))) {
+		return dbf_AppendFail(p_dbf);
+	}
+	buf[0] = ' ';
+	memcpy(buf + 1, record, len);
+	n = dbf_io_pwrite(p_dbf, buf, reclen, DBF_RECORD_OFFSET(p_dbf, slot));
+	free(buf);
+	if (n != reclen) {
+		return dbf_AppendFail(p_dbf);
+	}
+#endif
+	if (recno) {
+		*recno = slot;
+	}
+	return 0;
+}
+/* }}} */
+
+/* dbf_AppendRecords() {{{
+ */
+int dbf_AppendRecords(P_DBF *p_dbf, const char *records, u_int32_t n, u_int64_t *first)
+{
+	size_t len = (size_t) n * p_dbf->header->record_length;
+	u_int64_t slot;
+
+	if (!(p_dbf->flags & DBF_FLAG_APPEND)) {
+		return -1;
+	}
+	if ((slot = dbf_AppendReserve(p_dbf, n)) + n >= 0xffffffffULL) {
+		return dbf_AppendFail(p_dbf);
+	}
+	if (n && dbf_io_pwrite(p_dbf, records, len, DBF_RECORD_OFFSET(p_dbf, slot)) != (ssize_t) len) {
+		return dbf_AppendFail(p_dbf);
+	}
+	if (first) {
+		*first = slot;
+	}
+	return 0;
+}
+/* }}} */
+
+/* dbf_EndAppend() {{{
+ */
+int dbf_EndAppend(P_DBF *p_dbf)
+{
+	int ret = -1;
+
+	if (!(p_dbf->flags & DBF_FLAG_APPEND)) {
+		return -1;
+	}
+
+	if (p_dbf->append_errors) {
+		/* some slots may be empty, none of the records is kept */
+		if (0 > ftruncate(p_dbf->dbf_fh, DBF_RECORD_OFFSET(p_dbf, p_dbf->header->records))) {
+			goto out;
+		}
+	} else {
+		if (0 > dbf_SyncData(p_dbf)) {
+			goto out;
+		}
+		/* the records are on disk, now they become part of the table */
+		p_dbf->header->records = (u_int32_t) p_dbf->append_next;
+		ret = 0;
+	}
+	p_dbf->header->transaction = 0;
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header)) {
+		ret = -1;
+	}
+
+out:
+	dbf_AutoUnlock(p_dbf, p_dbf->append_lock);
+	p_dbf->flags &= ~DBF_FLAG_APPEND;
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,308 @@
+/*****************************************************************************
+ * dbf_cache.c
+ *****************************************************************************
+ * Process wide cache of parsed headers and field descriptors
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+/*
+ * The cache is an open addressed table of pointers to immutable entries.
+ * Lookups load a slot and bump the reference counter of the entry,
+ * inserts swap a slot with a compare-and-swap. Entries pushed out of the
+ * table are put on a retire list and are only freed by
+ * dbf_SchemaCacheFlush(). Lookups hold dbf_schema_lock for reading from
+ * loading the slot until the counter is bumped, and the flush holds it
+ * for writing while it frees, so an entry found in the table is never
+ * freed before its counter counts the new handle.
+ */
+#if defined(__GNUC__) && defined(HAVE_PTHREAD_H)
+
+#include <pthread.h>
+
+#define DBF_SCHEMA_SLOTS 1024
+#define DBF_SCHEMA_PROBES 8
+
+static DBF_SCHEMA *dbf_schema_table[DBF_SCHEMA_SLOTS];
+static DBF_SCHEMA *dbf_schema_retired;
+static int dbf_schema_enabled;
+static pthread_rwlock_t dbf_schema_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* static dbf_SchemaKey() {{{
+ * Fills the identity of the file from fstat()
+ */
+static int dbf_SchemaKey(int fh, DBF_SCHEMA *key)
+{
+	struct stat st;
+
+	if (0 > fstat(fh, &st) || !S_ISREG(st.st_mode)) {
+		return -1;
+	}
+	key->dev = st.st_dev;
+	key->ino = st.st_ino;
+	key->size = st.st_size;
+	key->mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+#else
+	key->mtime_nsec = 0;
+#endif
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SchemaSlot() {{{
+ * Returns the first slot to probe for a file
+ */
+static unsigned int dbf_SchemaSlot(const DBF_SCHEMA *key)
+{
+	unsigned long long h;
+
+	h = ((unsigned long long) key->ino * 0x9E3779B97F4A7C15ULL) ^ (unsigned long long) key->dev;
+	return (unsigned int) (h >> 32) % DBF_SCHEMA_SLOTS;
+}
+/* }}} */
+
+/* static dbf_SchemaPush() {{{
+ * Puts an entry on the retire list
+ */
+static void dbf_SchemaPush(DBF_SCHEMA *entry)
+{
+	DBF_SCHEMA *head;
+
+	head = __atomic_load_n(&dbf_schema_retired, __ATOMIC_ACQUIRE);
+	do {
+		entry->retired_next = head;
+	} while (!__atomic_compare_exchange_n(&dbf_schema_retired, &head, entry, 0,
+			__ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+/* }}} */
+
+/* static dbf_SchemaRetire() {{{
+ * Retires an entry removed from the table
+ */
+static void dbf_SchemaRetire(DBF_SCHEMA *entry)
+{
+	dbf_SchemaPush(entry);
+	/* drop the reference held by the table */
+	__atomic_sub_fetch(&entry->refcount, 1, __ATOMIC_ACQ_REL);
+}
+/* }}} */
+
+/* dbf_SchemaLookup() {{{
+ * Attaches the cached header and fields to p_dbf. Returns 0 on a hit
+ * and -1 if the file has to be parsed.
+ */
+int dbf_SchemaLookup(P_DBF *p_dbf)
+{
+	DBF_SCHEMA key, *entry, *found = NULL;
+	DB_HEADER *header;
+	unsigned int slot, i;
+
+	if (!__atomic_load_n(&dbf_schema_enabled, __ATOMIC_RELAXED)) {
+		return -1;
+	}
+	if (0 > dbf_SchemaKey(p_dbf->dbf_fh, &key)) {
+		return -1;
+	}
+	if (NULL == (header = malloc(sizeof(DB_HEADER)))) {
+		return -1;
+	}
+
+	slot = dbf_SchemaSlot(&key);
+	pthread_rwlock_rdlock(&dbf_schema_lock);
+	for (i = 0; i < DBF_SCHEMA_PROBES; i++) {
+		entry = __atomic_load_n(&dbf_schema_table[(slot + i) % DBF_SCHEMA_SLOTS], __ATOMIC_ACQUIRE);
+		if (entry == NULL) {
+			break;
+		}
+		if (entry->dev == key.dev && entry->ino == key.ino
+		 && entry->size == key.size && entry->mtime == key.mtime
+		 && entry->mtime_nsec == key.mtime_nsec) {
+			__atomic_add_fetch(&entry->refcount, 1, __ATOMIC_ACQ_REL);
+			found = entry;
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&dbf_schema_lock);
+
+	if (found == NULL) {
+		free(header);
+		DBF_STAT_ADD(p_dbf, cache_misses, 1);
+		return -1;
+	}
+	/* the reference keeps the entry alive from here on */
+	memcpy(header, &found->header, sizeof(DB_HEADER));
+	p_dbf->header = header;
+	p_dbf->fields = found->fields;
+	p_dbf->columns = found->columns;
+	p_dbf->schema = found;
+	DBF_STAT_ADD(p_dbf, cache_hits, 1);
+	return 0;
+}
+/* }}} */
+
+/* dbf_SchemaInsert() {{{
+ * Stores the header and fields just read by p_dbf in the cache. The
+ * fields of p_dbf are replaced by the shared copy.
+ */
+int dbf_SchemaInsert(P_DBF *p_dbf)
+{
+	DBF_SCHEMA *entry, *old, *victim;
+	DBF_SCHEMA **slotp, **victimp;
+	unsigned int slot, i;
+
+	if (!__atomic_load_n(&dbf_schema_enabled, __ATOMIC_RELAXED) || p_dbf->schema) {
+		return -1;
+	}
+	if (NULL == (entry = calloc(1, sizeof(DBF_SCHEMA)))) {
+		return -1;
+	}
+	if (0 > dbf_SchemaKey(p_dbf->dbf_fh, entry)) {
+		free(entry);
+		return -1;
+	}
+	memcpy(&entry->header, p_dbf->header, sizeof(DB_HEADER));
+	entry->fields = p_dbf->fields;
+	entry->columns = p_dbf->columns;
+	/* one reference for the table and one for p_dbf */
+	entry->refcount = 2;
+
+	/* Take a free slot, an outdated entry of the same file, or
+	 * evict the last slot of the probe sequence.
+	 */
+	slot = dbf_SchemaSlot(entry);
+	victimp = &dbf_schema_table[(slot + DBF_SCHEMA_PROBES - 1) % DBF_SCHEMA_SLOTS];
+	for (i = 0; i < DBF_SCHEMA_PROBES; i++) {
+		slotp = &dbf_schema_table[(slot + i) % DBF_SCHEMA_SLOTS];
+		old = __atomic_load_n(slotp, __ATOMIC_ACQUIRE);
+		if (old == NULL || (old->dev == entry->dev && old->ino == entry->ino)) {
+			victimp = slotp;
+			break;
+		}
+	}
+
+	victim = __atomic_load_n(victimp, __ATOMIC_ACQUIRE);
+	if (!__atomic_compare_exchange_n(victimp, &victim, entry, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* somebody else was faster, p_dbf keeps its private copy */
+		free(entry);
+		return -1;
+	}
+	if (victim) {
+		dbf_SchemaRetire(victim);
+	}
+
+	p_dbf->schema = entry;
+	return 0;
+}
+/* }}} */
+
+/* dbf_SchemaRelease() {{{
+ * Drops the reference p_dbf holds on its cache entry
+ */
+void dbf_SchemaRelease(P_DBF *p_dbf)
+{
+	__atomic_sub_fetch(&p_dbf->schema->refcount, 1, __ATOMIC_ACQ_REL);
+	p_dbf->schema = NULL;
+	p_dbf->fields = NULL;
+}
+/* }}} */
+
+/* dbf_SchemaCacheEnable() {{{
+ */
+int dbf_SchemaCacheEnable(int enable)
+{
+	__atomic_store_n(&dbf_schema_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+	return 0;
+}
+/* }}} */
+
+/* dbf_SchemaCacheFlush() {{{
+ * Empties the cache and frees all entries no longer used by any handle
+ */
+int dbf_SchemaCacheFlush(void)
+{
+	DBF_SCHEMA *entry, *next;
+	int i;
+
+	for (i = 0; i < DBF_SCHEMA_SLOTS; i++) {
+		entry = __atomic_exchange_n(&dbf_schema_table[i], NULL, __ATOMIC_ACQ_REL);
+		if (entry) {
+			dbf_SchemaRetire(entry);
+		}
+	}
+
+	/* entries still in use are checked again by the next flush; waiting
+	 * for the lock lets lookups which found an entry before it left the
+	 * table count their reference first */
+	pthread_rwlock_wrlock(&dbf_schema_lock);
+	entry = __atomic_exchange_n(&dbf_schema_retired, NULL, __ATOMIC_ACQ_REL);
+	while (entry) {
+		next = entry->retired_next;
+		if (__atomic_load_n(&entry->refcount, __ATOMIC_ACQUIRE) == 0) {
+			free(entry->fields);
+			free(entry);
+		} else {
+			dbf_SchemaPush(entry);
+		}
+		entry = next;
+	}
+	pthread_rwlock_unlock(&dbf_schema_lock);
+
+	return 0;
+}
+/* }}} */
+
+#else
+
+int dbf_SchemaLookup(P_DBF *p_dbf)
+{
+	(void) p_dbf;
+	return -1;
+}
+
+int dbf_SchemaInsert(P_DBF *p_dbf)
+{
+	(void) p_dbf;
+	return -1;
+}
+
+void dbf_SchemaRelease(P_DBF *p_dbf)
+{
+	(void) p_dbf;
+}
+
+int dbf_SchemaCacheEnable(int enable)
+{
+	(void) enable;
+	return -1;
+}
+
+int dbf_SchemaCacheFlush(void)
+{
+	return -1;
+}
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,525 @@
+/*****************************************************************************
+ * dbf_dataset.c
+ *****************************************************************************
+ * Many tables with the same layout read as one
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#include <strings.h>
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+#ifdef HAVE_GLOB_H
+#include <glob.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * The files of a dataset are checked once when it is opened: every file
+ * is opened for its metadata only, so the descriptor is given back at
+ * once, and its field descriptors are compared with those of the first
+ * file. Scans hand the files to a fixed number of threads. Each thread
+ * holds a single file open and, before reading it, asks the kernel to
+ * read ahead the beginning of the file it will take next, so the header
+ * of the next file is usually in the page cache when it is opened.
+ */
+
+/* Bytes of records passed to the callback at once */
+#define DBF_DATASET_CHUNK (1024 * 1024)
+/* Bytes read ahead from the beginning of the next file */
+#define DBF_DATASET_PREFETCH 65536
+/* Threads used if the caller does not choose */
+#define DBF_DATASET_THREADS 4
+
+struct _DBF_DATASET {
+	/*! paths of the files, sorted */
+	char **files;
+	int numfiles;
+	/*! number of records of every file when the dataset was opened */
+	u_int32_t *records;
+	/*! number of the first record of every file within the dataset */
+	u_int64_t *first;
+	u_int64_t rows;
+	/*! metadata of the first file */
+	P_DBF *schema;
+};
+
+/* State shared by the threads opening or scanning a dataset */
+typedef struct {
+	DBF_DATASET *ds;
+	int next;
+	int ret;
+	DBF_DATASET_CALLBACK callback;
+	void *data;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+#endif
+} DBF_DATASET_RUN;
+
+/* static dbf_DatasetClaim() {{{
+ * Returns the number of the next file to work on or -1 when all files
+ * are taken or the run was stopped
+ */
+static int dbf_DatasetClaim(DBF_DATASET_RUN *run)
+{
+	int i = -1;
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&run->lock);
+#endif
+	if (run->ret == 0 && run->next < run->ds->numfiles) {
+		i = run->next++;
+	}
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&run->lock);
+#endif
+	return i;
+}
+/* }}} */
+
+/* static dbf_DatasetStop() {{{
+ * Stops the run, the first result different from 0 is kept
+ */
+static void dbf_DatasetStop(DBF_DATASET_RUN *run, int ret)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&run->lock);
+#endif
+	if (run->ret == 0) {
+		run->ret = ret;
+	}
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&run->lock);
+#endif
+}
+/* }}} */
+
+/* static dbf_DatasetRun() {{{
+ * Runs worker in the given number of threads, or in the calling thread
+ * if no thread can be started
+ */
+static int dbf_DatasetRun(DBF_DATASET_RUN *run, int threads, void *(*worker)(void *))
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_t *tids;
+	int i, started = 0;
+
+	if (threads > run->ds->numfiles - run->next) {
+		threads = run->ds->numfiles - run->next;
+	}
+	pthread_mutex_init(&run->lock, NULL);
+	if (threads > 1 && NULL != (tids = malloc(threads * sizeof(pthread_t)))) {
+		for (i = 0; i < threads; i++) {
+			if (pthread_create(&tids[started], NULL, worker, run) == 0) {
+				started++;
+			}
+		}
+		for (i = 0; i < started; i++) {
+			pthread_join(tids[i], NULL);
+		}
+		free(tids);
+	}
+	/* nothing started, or files left by a failed pthread_create() */
+	worker(run);
+	pthread_mutex_destroy(&run->lock);
+#else
+	(void) threads;
+	worker(run);
+#endif
+	return run->ret;
+}
+/* }}} */
+
+/* static dbf_DatasetMatch() {{{
+ * Returns 0 if both tables have the same fields
+ */
+static int dbf_DatasetMatch(P_DBF *a, P_DBF *b)
+{
+	int i;
+
+	if (a->columns != b->columns || a->header->record_length != b->header->record_length) {
+		return -1;
+	}
+	for (i = 0; i < (int) a->columns; i++) {
+		if (strncmp((char *) a->fields[i].field_name, (char *) b->fields[i].field_name, 11)
+		 || a->fields[i].field_type != b->fields[i].field_type
+		 || a->fields[i].field_length != b->fields[i].field_length
+		 || a->fields[i].field_decimals != b->fields[i].field_decimals) {
+			return -1;
+		}
+	}
+	return 0;
+}
+/* }}} */
+
+/* static dbf_DatasetCheck() {{{
+ * Thread reading the metadata of the files
+ */
+static void *dbf_DatasetCheck(void *arg)
+{
+	DBF_DATASET_RUN *run = arg;
+	DBF_DATASET *ds = run->ds;
+	P_DBF *p_dbf;
+	int i;
+
+	while ((i = dbf_DatasetClaim(run)) >= 0) {
+		if (NULL == (p_dbf = dbf_OpenFlags(ds->files[i], DBF_OPEN_METADATA))) {
+			fprintf(stderr, _("Could not open %s."), ds->files[i]);
+			fprintf(stderr, "\n");
+			dbf_DatasetStop(run, -1);
+			break;
+		}
+		if (0 > dbf_DatasetMatch(ds->schema, p_dbf)) {
+			fprintf(stderr, _("Fields of %s do not match those of %s."), ds->files[i], ds->files[0]);
+			fprintf(stderr, "\n");
+			dbf_DatasetStop(run, -1);
+		}
+		ds->records[i] = p_dbf->header->records;
+		dbf_Close(p_dbf);
+	}
+	return NULL;
+}
+/* }}} */
+
+/* static dbf_DatasetAdd() {{{
+ */
+static int dbf_DatasetAdd(DBF_DATASET *ds, const char *file, int *max)
+{
+	char **tmp;
+
+	if (ds->numfiles == *max) {
+		*max = *max ? 2 * *max : 64;
+		if (NULL == (tmp = realloc(ds->files, *max * sizeof(char *)))) {
+			return -1;
+		}
+		ds->files = tmp;
+	}
+	if (NULL == (ds->files[ds->numfiles] = strdup(file))) {
+		return -1;
+	}
+	ds->numfiles++;
+	return 0;
+}
+/* }}} */
+
+#ifdef HAVE_DIRENT_H
+/* static dbf_DatasetIsTable() {{{
+ * Files of a directory taken into a dataset, compressed ones included
+ */
+static int dbf_DatasetIsTable(const char *name)
+{
+	const char *ext;
+
+	if (name[0] == '.' || NULL == (ext = strrchr(name, '.'))) {
+		return 0;
+	}
+	if (!strcmp(ext, ".gz") || !strcmp(ext, ".zst")) {
+		while (ext > name && *--ext != '.')
+			;
+	}
+	return !strncasecmp(ext, ".dbf", 4) && (ext[4] == '\0' || ext[4] == '.');
+}
+/* }}} */
+#endif
+
+/* static dbf_CompareName() {{{
+ */
+static int dbf_CompareName(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+/* }}} */
+
+/* static dbf_DatasetList() {{{
+ * Collects the tables of a directory or the files matching a pattern
+ */
+static int dbf_DatasetList(DBF_DATASET *ds, const char *path)
+{
+	struct stat st;
+	int max = 0, ret = 0;
+#ifdef HAVE_DIRENT_H
+	char *file;
+	DIR *dir;
+	struct dirent *entry;
+#endif
+#ifdef HAVE_GLOB_H
+	glob_t g;
+	size_t i;
+#endif
+
+	if (0 == stat(path, &st) && S_ISDIR(st.st_mode)) {
+#ifdef HAVE_DIRENT_H
+		if (NULL == (dir = opendir(path))) {
+			return -1;
+		}
+		while (ret == 0 && NULL != (entry = readdir(dir))) {
+			if (!dbf_DatasetIsTable(entry->d_name)) {
+				continue;
+			}
+			if (NULL == (file = malloc(strlen(path) + strlen(entry->d_name) + 2))) {
+				ret = -1;
+				break;
+			}
+			sprintf(file, "%s/%s", path, entry->d_name);
+			ret = dbf_DatasetAdd(ds, file, &max);
+			free(file);
+		}
+		closedir(dir);
+#else
+		return -1;
+#endif
+	} else {
+#ifdef HAVE_GLOB_H
+		if (0 != glob(path, 0, NULL, &g)) {
+			return -1;
+		}
+		for (i = 0; ret == 0 && i < g.gl_pathc; i++) {
+			ret = dbf_DatasetAdd(ds, g.gl_pathv[i], &max);
+		}
+		globfree(&g);
+#else
+		ret = dbf_DatasetAdd(ds, path, &max);
+#endif
+	}
+
+	/* the same order on every run */
+	qsort(ds->files, ds->numfiles, sizeof(char *), dbf_CompareName);
+	return ret;
+}
+/* }}} */
+
+/* dbf_DatasetOpen() {{{
+ */
+DBF_DATASET *dbf_DatasetOpen(const char *path, int threads)
+{
+	DBF_DATASET *ds;
+	DBF_DATASET_RUN run;
+	int i;
+
+	if (NULL == (ds = calloc(1, sizeof(DBF_DATASET)))) {
+		return NULL;
+	}
+	if (0 > dbf_DatasetList(ds, path) || ds->numfiles == 0
+	 || NULL == (ds->records = malloc(ds->numfiles * sizeof(u_int32_t)))
+	 || NULL == (ds->first = malloc(ds->numfiles * sizeof(u_int64_t)))) {
+		dbf_DatasetClose(ds);
+		return NULL;
+	}
+
+	/* the first file defines the layout */
+	if (NULL == (ds->schema = dbf_OpenFlags(ds->files[0], DBF_OPEN_METADATA))) {
+		fprintf(stderr, _("Could not open %s."), ds->files[0]);
+		fprintf(stderr, "\n");
+		dbf_DatasetClose(ds);
+		return NULL;
+	}
+	ds->records[0] = ds->schema->header->records;
+
+	memset(&run, 0, sizeof(run));
+	run.ds = ds;
+	run.next = 1;
+	if (0 != dbf_DatasetRun(&run, threads > 0 ? threads : DBF_DATASET_THREADS, dbf_DatasetCheck)) {
+		dbf_DatasetClose(ds);
+		return NULL;
+	}
+
+	for (i = 0; i < ds->numfiles; i++) {
+		ds->first[i] = ds->rows;
+		ds->rows += ds->records[i];
+	}
+	return ds;
+}
+/* }}} */
+
+/* dbf_DatasetNumFiles() {{{
+ */
+int dbf_DatasetNumFiles(DBF_DATASET *ds)
+{
+	return ds->numfiles;
+}
+/* }}} */
+
+/* dbf_DatasetFile() {{{
+ */
+const char *dbf_DatasetFile(DBF_DATASET *ds, int file)
+{
+	if (file < 0 || file >= ds->numfiles) {
+		return NULL;
+	}
+	return ds->files[file];
+}
+/* }}} */
+
+/* dbf_DatasetNumRows() {{{
+ */
+u_int64_t dbf_DatasetNumRows(DBF_DATASET *ds)
+{
+	return ds->rows;
+}
+/* }}} */
+
+/* dbf_DatasetFirstRecord() {{{
+ */
+u_int64_t dbf_DatasetFirstRecord(DBF_DATASET *ds, int file)
+{
+	if (file < 0 || file >= ds->numfiles) {
+		return ds->rows;
+	}
+	return ds->first[file];
+}
+/* }}} */
+
+/* dbf_DatasetSchema() {{{
+ */
+P_DBF *dbf_DatasetSchema(DBF_DATASET *ds)
+{
+	return ds->schema;
+}
+/* }}} */
+
+/* static dbf_DatasetPrefetch() {{{
+ * Starts reading the beginning of a file into the page cache
+ */
+static void dbf_DatasetPrefetch(const char *file)
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+	int fh;
+
+	if ((fh = open(file, O_RDONLY|O_BINARY|O_LARGEFILE)) != -1) {
+		posix_fadvise(fh, 0, DBF_DATASET_PREFETCH, POSIX_FADV_WILLNEED);
+		close(fh);
+	}
+#else
+	(void) file;
+#endif
+}
+/* }}} */
+
+/* static dbf_DatasetRead() {{{
+ * Passes the records of a file to the callback in chunks
+ */
+static int dbf_DatasetRead(DBF_DATASET_RUN *run, int i, char *buf, u_int32_t chunk)
+{
+	DBF_DATASET *ds = run->ds;
+	P_DBF *p_dbf;
+	u_int32_t first;
+	int n, ret = 0;
+
+	if (NULL == (p_dbf = dbf_Open(ds->files[i]))) {
+		return -1;
+	}
+	/* the file may have been rewritten since the dataset was opened,
+	 * and buf only holds records of the layout checked then */
+	if (0 > dbf_DatasetMatch(ds->schema, p_dbf)) {
+		fprintf(stderr, _("Fields of %s do not match those of %s."), ds->files[i], ds->files[0]);
+		fprintf(stderr, "\n");
+		dbf_Close(p_dbf);
+		return -1;
+	}
+	/* records appended later are not part of the dataset */
+	for (first = 0; first < ds->records[i]; first += n) {
+		n = dbf_ReadRecords(p_dbf, first, ds->records[i] - first < chunk ? ds->records[i] - first : chunk, buf);
+		if (n <= 0) {
+			ret = -1;
+			break;
+		}
+		if (0 != (ret = run->callback(p_dbf, i, buf, first, n, run->data))) {
+			break;
+		}
+	}
+	dbf_Close(p_dbf);
+	return ret;
+}
+/* }}} */
+
+/* static dbf_DatasetScanner() {{{
+ * Thread scanning files
+ */
+static void *dbf_DatasetScanner(void *arg)
+{
+	DBF_DATASET_RUN *run = arg;
+	DBF_DATASET *ds = run->ds;
+	u_int32_t chunk;
+	char *buf;
+	int i, next, ret;
+
+	chunk = DBF_DATASET_CHUNK / ds->schema->header->record_length;
+	if (chunk == 0) {
+		chunk = 1;
+	}
+	if (NULL == (buf = malloc((size_t) chunk * ds->schema->header->record_length))) {
+		dbf_DatasetStop(run, -1);
+		return NULL;
+	}
+
+	for (i = dbf_DatasetClaim(run); i >= 0; i = next) {
+		if ((next = dbf_DatasetClaim(run)) >= 0) {
+			dbf_DatasetPrefetch(ds->files[next]);
+		}
+		if (0 != (ret = dbf_DatasetRead(run, i, buf, chunk))) {
+			dbf_DatasetStop(run, ret);
+			break;
+		}
+	}
+	free(buf);
+	return NULL;
+}
+/* }}} */
+
+/* dbf_DatasetScan() {{{
+ */
+int dbf_DatasetScan(DBF_DATASET *ds, int threads, DBF_DATASET_CALLBACK callback, void *data)
+{
+	DBF_DATASET_RUN run;
+
+	memset(&run, 0, sizeof(run));
+	run.ds = ds;
+	run.callback = callback;
+	run.data = data;
+	return dbf_DatasetRun(&run, threads > 0 ? threads : DBF_DATASET_THREADS, dbf_DatasetScanner);
+}
+/* }}} */
+
+/* dbf_DatasetClose() {{{
+ */
+int dbf_DatasetClose(DBF_DATASET *ds)
+{
+	int i;
+
+	if (ds->schema) {
+		dbf_Close(ds->schema);
+	}
+	for (i = 0; i < ds->numfiles; i++) {
+		free(ds->files[i]);
+	}
+	free(ds->files);
+	free(ds->records);
+	free(ds->first);
+	free(ds);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
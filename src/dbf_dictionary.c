@@ -0,0 +1,284 @@
+/*****************************************************************************
+ * dbf_dictionary.c
+ *****************************************************************************
+ * Dictionary encoded columns
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+/*
+ * Every column gets an open addressed hash table of its distinct
+ * values, keyed by the bytes of the field without the trailing blanks.
+ * The values themselves are collected in one growing buffer, each one
+ * terminated, and only turned into pointers when the table was read,
+ * since the buffer moves while it grows. A record costs a hash and,
+ * for a value seen before, a single memcmp() per column.
+ */
+
+/* Bytes of records read at once */
+#define DBF_DICTIONARY_CHUNK (1024 * 1024)
+
+/* Distinct values of one column while reading */
+typedef struct {
+	int offset;
+	int length;
+	/*! code + 1 for every slot, 0 if the slot is free */
+	u_int32_t *slots;
+	u_int32_t numslots;
+	u_int32_t *hashes;
+	/*! start of every value in strings */
+	size_t *starts;
+	/*! length of every value, values may hold NUL bytes */
+	int *lengths;
+	u_int32_t numvalues;
+	u_int32_t maxvalues;
+	char *strings;
+	size_t used;
+	size_t size;
+} DBF_DICTIONARY_TABLE;
+
+/* static dbf_DictionaryHash() {{{
+ * FNV-1a over the value
+ */
+static u_int32_t dbf_DictionaryHash(const char *value, int len)
+{
+	u_int32_t h = 2166136261U;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		h = (h ^ (unsigned char) value[i]) * 16777619U;
+	}
+	return h;
+}
+/* }}} */
+
+/* static dbf_DictionaryGrow() {{{
+ * Makes room for one more value of len bytes
+ */
+static int dbf_DictionaryGrow(DBF_DICTIONARY_TABLE *t, int len)
+{
+	u_int32_t max, i, j;
+	size_t size;
+	void *tmp;
+
+	if (t->numvalues == t->maxvalues) {
+		if (t->maxvalues >= 0x40000000U) {
+			return -1;
+		}
+		max = t->maxvalues ? 2 * t->maxvalues : 64;
+		if (NULL == (tmp = realloc(t->hashes, max * sizeof(u_int32_t)))) {
+			return -1;
+		}
+		t->hashes = tmp;
+		if (NULL == (tmp = realloc(t->starts, max * sizeof(size_t)))) {
+			return -1;
+		}
+		t->starts = tmp;
+		if (NULL == (tmp = realloc(t->lengths, max * sizeof(int)))) {
+			return -1;
+		}
+		t->lengths = tmp;
+		t->maxvalues = max;
+	}
+	if (t->used + len + 1 > t->size) {
+		for (size = t->size ? 2 * t->size : 4096; size < t->used + len + 1; size *= 2)
+			;
+		if (NULL == (tmp = realloc(t->strings, size))) {
+			return -1;
+		}
+		t->strings = tmp;
+		t->size = size;
+	}
+
+	/* at most half of the slots are used */
+	if (2 * (t->numvalues + 1) > t->numslots) {
+		free(t->slots);
+		t->numslots = t->numslots ? 2 * t->numslots : 128;
+		if (NULL == (t->slots = calloc(t->numslots, sizeof(u_int32_t)))) {
+			t->numslots = 0;
+			return -1;
+		}
+		for (i = 0; i < t->numvalues; i++) {
+			for (j = t->hashes[i] & (t->numslots - 1); t->slots[j]; j = (j + 1) & (t->numslots - 1))
+				;
+			t->slots[j] = i + 1;
+		}
+	}
+	return 0;
+}
+/* }}} */
+
+/* static dbf_DictionaryCode() {{{
+ * Returns the code of a value, adding it if necessary
+ */
+static int32_t dbf_DictionaryCode(DBF_DICTIONARY_TABLE *t, const char *field)
+{
+	const char *value;
+	u_int32_t i, c, hash;
+	int len = t->length;
+
+	while (len > 0 && (field[len - 1] == ' ' || field[len - 1] == '\0'))
+		len--;
+	hash = dbf_DictionaryHash(field, len);
+
+	if (t->numslots) {
+		for (i = hash & (t->numslots - 1); t->slots[i]; i = (i + 1) & (t->numslots - 1)) {
+			c = t->slots[i] - 1;
+			value = t->strings + t->starts[c];
+			if (t->hashes[c] == hash && t->lengths[c] == len && !memcmp(value, field, len)) {
+				return c;
+			}
+		}
+	}
+
+	if (0 > dbf_DictionaryGrow(t, len)) {
+		return -1;
+	}
+	c = t->numvalues++;
+	t->hashes[c] = hash;
+	t->starts[c] = t->used;
+	t->lengths[c] = len;
+	memcpy(t->strings + t->used, field, len);
+	t->strings[t->used + len] = '\0';
+	t->used += len + 1;
+	for (i = hash & (t->numslots - 1); t->slots[i]; i = (i + 1) & (t->numslots - 1))
+		;
+	t->slots[i] = c + 1;
+	return c;
+}
+/* }}} */
+
+/* dbf_DecodeDictionary() {{{
+ */
+int dbf_DecodeDictionary(P_DBF *p_dbf, const int *columns, int numcolumns, DBF_DICTIONARY **dictionaries)
+{
+	DBF_DICTIONARY_TABLE *tables = NULL;
+	DBF_DICTIONARY *res = NULL;
+	u_int32_t records, first, chunk, v;
+	const char *rec;
+	char *buf = NULL, *strings;
+	int32_t code;
+	int i, c, n, reclen, ret = -1;
+
+	*dictionaries = NULL;
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL) || numcolumns < 1) {
+		return -1;
+	}
+	for (c = 0; c < numcolumns; c++) {
+		if (columns[c] < 0 || columns[c] >= (int) p_dbf->columns) {
+			return -1;
+		}
+	}
+
+	records = p_dbf->header->records;
+	reclen = p_dbf->header->record_length;
+	chunk = DBF_DICTIONARY_CHUNK / reclen ? DBF_DICTIONARY_CHUNK / reclen : 1;
+	if (NULL == (tables = calloc(numcolumns, sizeof(DBF_DICTIONARY_TABLE)))
+	 || NULL == (res = calloc(numcolumns, sizeof(DBF_DICTIONARY)))
+	 || NULL == (buf = malloc((size_t) chunk * reclen))) {
+		goto out;
+	}
+	for (c = 0; c < numcolumns; c++) {
+		tables[c].offset = p_dbf->fields[columns[c]].field_offset;
+		tables[c].length = p_dbf->fields[columns[c]].field_length;
+		res[c].column = columns[c];
+		res[c].numcodes = records;
+		if (NULL == (res[c].codes = malloc((size_t) records * sizeof(int32_t) + 1))) {
+			goto out;
+		}
+	}
+
+	for (first = 0; first < records; first += n) {
+		n = dbf_ReadRecords(p_dbf, first, records - first < chunk ? records - first : chunk, buf);
+		if (n <= 0) {
+			goto out;
+		}
+		for (i = 0, rec = buf; i < n; i++, rec += reclen) {
+			for (c = 0; c < numcolumns; c++) {
+				/* deleted records have no value */
+				if (rec[0] == '*') {
+					code = -1;
+				} else if (0 > (code = dbf_DictionaryCode(&tables[c], rec + tables[c].offset))) {
+					goto out;
+				}
+				res[c].codes[first + i] = code;
+			}
+		}
+	}
+
+	/* the values of a column, the pointers to them and their lengths in
+	 * one block */
+	for (c = 0; c < numcolumns; c++) {
+		res[c].values = malloc(tables[c].numvalues * (sizeof(char *) + sizeof(int)) + tables[c].used + 1);
+		if (res[c].values == NULL) {
+			goto out;
+		}
+		res[c].numvalues = tables[c].numvalues;
+		res[c].lengths = (int *) (res[c].values + tables[c].numvalues);
+		strings = (char *) (res[c].lengths + tables[c].numvalues);
+		memcpy(strings, tables[c].strings, tables[c].used);
+		for (v = 0; v < tables[c].numvalues; v++) {
+			res[c].values[v] = strings + tables[c].starts[v];
+			res[c].lengths[v] = tables[c].lengths[v];
+		}
+	}
+	*dictionaries = res;
+	res = NULL;
+	ret = 0;
+
+out:
+	if (tables) {
+		for (c = 0; c < numcolumns; c++) {
+			free(tables[c].slots);
+			free(tables[c].hashes);
+			free(tables[c].starts);
+			free(tables[c].lengths);
+			free(tables[c].strings);
+		}
+		free(tables);
+	}
+	if (res) {
+		dbf_FreeDictionary(res, numcolumns);
+	}
+	free(buf);
+	return ret;
+}
+/* }}} */
+
+/* dbf_FreeDictionary() {{{
+ */
+void dbf_FreeDictionary(DBF_DICTIONARY *dictionaries, int numcolumns)
+{
+	int c;
+
+	if (dictionaries == NULL) {
+		return;
+	}
+	for (c = 0; c < numcolumns; c++) {
+		free(dictionaries[c].values);
+		free(dictionaries[c].codes);
+	}
+	free(dictionaries);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
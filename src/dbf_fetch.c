@@ -0,0 +1,270 @@
+/*****************************************************************************
+ * dbf_fetch.c
+ *****************************************************************************
+ * Reading lists of records with coalesced I/O
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_PREADV
+#include <sys/uio.h>
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
+/* dbf_ReadRecordList() {{{
+ * Reads the records with the given numbers into records. The i-th record
+ * goes into slot slots[i], or slot i if slots is NULL. recnos must be
+ * sorted in ascending order. Records which are at most max_gap bytes apart
+ * are fetched with a single read, so a sorted list hits the disk nearly
+ * sequentially. With preadv() the records are read directly into their
+ * slots and the holes into a scratch buffer.
+ */
+int dbf_ReadRecordList(P_DBF *p_dbf, const u_int32_t *recnos, size_t n, char *records, const size_t *slots, size_t max_gap)
+{
+	size_t reclen, first, last, i;
+	off_t start, end, next;
+#ifdef HAVE_PREADV
+	struct iovec iov[IOV_MAX];
+	int iovcnt;
+	char *gap = NULL;
+#else
+	char *buf = NULL;
+	size_t bufsize = 0;
+#endif
+	int ret = -1;
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL)) {
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		if (recnos[i] >= p_dbf->header->records) {
+			return -1;
+		}
+	}
+
+	reclen = p_dbf->header->record_length;
+#ifdef HAVE_PREADV
+	if (max_gap > 0 && NULL == (gap = malloc(max_gap))) {
+		return -1;
+	}
+#endif
+	for (first = 0; first < n; first = last + 1) {
+		start = DBF_RECORD_OFFSET(p_dbf, recnos[first]);
+		end = start + reclen;
+#ifdef HAVE_PREADV
+		iov[0].iov_base = records + (slots ? slots[first] : first) * reclen;
+		iov[0].iov_len = reclen;
+		iovcnt = 1;
+#endif
+
+		/* extend the range as long as the holes are small enough */
+		for (last = first; last + 1 < n; last++) {
+			next = DBF_RECORD_OFFSET(p_dbf, recnos[last + 1]);
+			if (next - end > (off_t) max_gap || next + reclen - start > DBF_FETCH_MAX) {
+				break;
+			}
+#ifdef HAVE_PREADV
+			if (iovcnt + 2 > IOV_MAX) {
+				break;
+			}
+			if (next > end) {
+				iov[iovcnt].iov_base = gap;
+				iov[iovcnt].iov_len = next - end;
+				iovcnt++;
+			}
+			iov[iovcnt].iov_base = records + (slots ? slots[last + 1] : last + 1) * reclen;
+			iov[iovcnt].iov_len = reclen;
+			iovcnt++;
+#endif
+			end = next + reclen;
+		}
+
+#ifdef HAVE_PREADV
+		if (dbf_io_preadv(p_dbf, iov, iovcnt, start) != (ssize_t) (end - start)) {
+			goto out;
+		}
+#else
+		if ((size_t) (end - start) > bufsize) {
+			free(buf);
+			bufsize = end - start;
+			if (NULL == (buf = malloc(bufsize))) {
+				return -1;
+			}
+		}
+		if (dbf_io_pread(p_dbf, buf, end - start, start) != (ssize_t) (end - start)) {
+			goto out;
+		}
+		for (i = first; i <= last; i++) {
+			memcpy(records + (slots ? slots[i] : i) * reclen,
+				buf + (DBF_RECORD_OFFSET(p_dbf, recnos[i]) - start), reclen);
+		}
+#endif
+		/* updates not written back yet */
+		for (i = first; p_dbf->numblocks && i <= last; i++) {
+			dbf_CacheOverlay(p_dbf, records + (slots ? slots[i] : i) * reclen,
+				DBF_RECORD_OFFSET(p_dbf, recnos[i]), reclen);
+		}
+	}
+
+	DBF_STAT_ADD(p_dbf, records_decoded, n);
+	ret = 0;
+out:
+#ifdef HAVE_PREADV
+	free(gap);
+#else
+	free(buf);
+#endif
+	return ret;
+}
+/* }}} */
+
+/* static dbf_CompareRequest() {{{
+ * Orders requests by record number and keeps the original order of
+ * requests for the same record.
+ */
+typedef struct {
+	u_int32_t recno;
+	size_t pos;
+} DBF_REQUEST;
+
+static int dbf_CompareRequest(const void *a, const void *b)
+{
+	const DBF_REQUEST *x = a, *y = b;
+
+	if (x->recno != y->recno)
+		return x->recno < y->recno ? -1 : 1;
+	return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+/* }}} */
+
+/* dbf_FetchRecords() {{{
+ * Sorts and deduplicates the requested record numbers, reads each record
+ * once and puts it into the slots of all requests for it.
+ */
+int dbf_FetchRecords(P_DBF *p_dbf, const u_int32_t *recnos, size_t n, char *records)
+{
+	DBF_REQUEST *req;
+	u_int32_t *unique;
+	size_t *slots, i, nunique, reclen;
+
+	if (n == 0) {
+		return 0;
+	}
+	if (NULL == (req = malloc(n * sizeof(DBF_REQUEST)))) {
+		return -1;
+	}
+	if (NULL == (unique = malloc(n * sizeof(u_int32_t)))) {
+		free(req);
+		return -1;
+	}
+	if (NULL == (slots = malloc(n * sizeof(size_t)))) {
+		free(unique);
+		free(req);
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		req[i].recno = recnos[i];
+		req[i].pos = i;
+	}
+	qsort(req, n, sizeof(DBF_REQUEST), dbf_CompareRequest);
+
+	/* each record is read into the slot of its first request */
+	nunique = 0;
+	for (i = 0; i < n; i++) {
+		if (i == 0 || req[i].recno != req[i - 1].recno) {
+			unique[nunique] = req[i].recno;
+			slots[nunique] = req[i].pos;
+			nunique++;
+		}
+	}
+
+	if (0 > dbf_ReadRecordList(p_dbf, unique, nunique, records, slots, p_dbf->fetch_gap)) {
+		free(slots);
+		free(unique);
+		free(req);
+		return -1;
+	}
+
+	/* copy the record to the slots of repeated requests */
+	reclen = p_dbf->header->record_length;
+	for (i = 1; i < n; i++) {
+		if (req[i].recno == req[i - 1].recno) {
+			memcpy(records + req[i].pos * reclen, records + req[i - 1].pos * reclen, reclen);
+		}
+	}
+
+	free(slots);
+	free(unique);
+	free(req);
+	return n;
+}
+/* }}} */
+
+/* dbf_SetFetchGap() {{{
+ */
+int dbf_SetFetchGap(P_DBF *p_dbf, int gap)
+{
+	if (gap < 0) {
+		return -1;
+	}
+	p_dbf->fetch_gap = gap;
+	return 0;
+}
+/* }}} */
+
+/* dbf_ReadRecords() {{{
+ * Reads a range of records with a single pread() without using the
+ * record counter
+ */
+int dbf_ReadRecords(P_DBF *p_dbf, u_int32_t first, u_int32_t n, char *records)
+{
+	size_t len;
+	off_t offset;
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL)) {
+		return -1;
+	}
+	if (first >= p_dbf->header->records) {
+		return 0;
+	}
+	if (n > p_dbf->header->records - first) {
+		n = p_dbf->header->records - first;
+	}
+
+	len = (size_t) n * p_dbf->header->record_length;
+	offset = DBF_RECORD_OFFSET(p_dbf, first);
+	if (dbf_io_pread(p_dbf, records, len, offset) != (ssize_t) len) {
+		return -1;
+	}
+	/* updates not written back yet */
+	if (p_dbf->numblocks) {
+		dbf_CacheOverlay(p_dbf, records, offset, len);
+	}
+	DBF_STAT_ADD(p_dbf, records_decoded, n);
+	return n;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,286 @@
+/*****************************************************************************
+ * dbf_follow.c
+ *****************************************************************************
+ * Following tables which are appended to by other processes
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include <errno.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+
+/* Bytes of new records handed to the callback at once */
+#define DBF_FOLLOW_CHUNK 65536
+
+typedef struct {
+	int wd;
+	P_DBF *p_dbf;
+	DBF_FOLLOW_CALLBACK callback;
+	void *data;
+} DBF_WATCH;
+
+struct _DBF_FOLLOW {
+	/*! inotify instance */
+	int fd;
+	/*! followed files */
+	DBF_WATCH *watches;
+	int numwatches;
+	int maxwatches;
+};
+
+/* dbf_FollowCreate() {{{
+ */
+DBF_FOLLOW *dbf_FollowCreate(void)
+{
+	DBF_FOLLOW *follow;
+
+	if (NULL == (follow = calloc(1, sizeof(DBF_FOLLOW)))) {
+		return NULL;
+	}
+	if ((follow->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+		free(follow);
+		return NULL;
+	}
+	return follow;
+}
+/* }}} */
+
+/* dbf_FollowAdd() {{{
+ */
+int dbf_FollowAdd(DBF_FOLLOW *follow, const char *file, P_DBF *p_dbf, DBF_FOLLOW_CALLBACK callback, void *data)
+{
+	DBF_WATCH *tmp;
+	int wd;
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL)) {
+		return -1;
+	}
+	if (follow->numwatches == follow->maxwatches) {
+		follow->maxwatches = follow->maxwatches ? 2 * follow->maxwatches : 16;
+		if (NULL == (tmp = realloc(follow->watches, follow->maxwatches * sizeof(DBF_WATCH)))) {
+			return -1;
+		}
+		follow->watches = tmp;
+	}
+	wd = inotify_add_watch(follow->fd, file, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (wd == -1) {
+		return -1;
+	}
+
+	follow->watches[follow->numwatches].wd = wd;
+	follow->watches[follow->numwatches].p_dbf = p_dbf;
+	follow->watches[follow->numwatches].callback = callback;
+	follow->watches[follow->numwatches].data = data;
+	follow->numwatches++;
+	return 0;
+}
+/* }}} */
+
+/* dbf_FollowRemove() {{{
+ */
+int dbf_FollowRemove(DBF_FOLLOW *follow, P_DBF *p_dbf)
+{
+	int i;
+
+	for (i = 0; i < follow->numwatches; i++) {
+		if (follow->watches[i].p_dbf == p_dbf) {
+			inotify_rm_watch(follow->fd, follow->watches[i].wd);
+			follow->watches[i] = follow->watches[--follow->numwatches];
+			return 0;
+		}
+	}
+	return -1;
+}
+/* }}} */
+
+/* dbf_FollowFD() {{{
+ */
+int dbf_FollowFD(DBF_FOLLOW *follow)
+{
+	return follow->fd;
+}
+/* }}} */
+
+/* static dbf_FollowDeliver() {{{
+ * Refreshes a table and passes the new records to the callback in chunks
+ */
+static int dbf_FollowDeliver(DBF_WATCH *watch, char **buf, size_t *bufsize)
+{
+	P_DBF *p_dbf = watch->p_dbf;
+	u_int32_t first, from, n, chunk;
+	size_t reclen;
+	int change;
+
+	/* the records not read yet are passed along with the new ones */
+	from = p_dbf->cur_record;
+	change = dbf_Refresh(p_dbf);
+	if (change <= 0) {
+		return change;
+	}
+	if ((change & (DBF_CHANGE_REWRITTEN | DBF_CHANGE_LAYOUT)) || from >= p_dbf->header->records) {
+		watch->callback(p_dbf, NULL, 0, 0, change, watch->data);
+		return change;
+	}
+
+	reclen = p_dbf->header->record_length;
+	chunk = DBF_FOLLOW_CHUNK / reclen;
+	if (chunk == 0) {
+		chunk = 1;
+	}
+	if (*bufsize < chunk * reclen) {
+		free(*buf);
+		*bufsize = chunk * reclen;
+		if (NULL == (*buf = malloc(*bufsize))) {
+			*bufsize = 0;
+			return -1;
+		}
+	}
+
+	for (first = from; first < p_dbf->header->records; first += n) {
+		n = p_dbf->header->records - first;
+		if (n > chunk) {
+			n = chunk;
+		}
+		if (dbf_io_pread(p_dbf, *buf, n * reclen, DBF_RECORD_OFFSET(p_dbf, first)) != (ssize_t) (n * reclen)) {
+			return -1;
+		}
+		DBF_STAT_ADD(p_dbf, records_decoded, n);
+		p_dbf->cur_record = first + n;
+		watch->callback(p_dbf, *buf, first, n, change, watch->data);
+	}
+	return change;
+}
+/* }}} */
+
+/* dbf_FollowDispatch() {{{
+ * Reads all pending events without blocking and delivers the changes
+ */
+int dbf_FollowDispatch(DBF_FOLLOW *follow)
+{
+	char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	DBF_WATCH watch;
+	char *buf = NULL;
+	size_t bufsize = 0;
+	ssize_t len;
+	char *ptr;
+	struct stat st;
+	int i, handled = 0;
+
+	for (;;) {
+		len = read(follow->fd, events, sizeof(events));
+		if (len == -1 && errno == EINTR) {
+			continue;
+		}
+		if (len <= 0) {
+			break;
+		}
+		for (ptr = events; ptr < events + len; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *) ptr;
+			for (i = 0; i < follow->numwatches; i++) {
+				if (follow->watches[i].wd == event->wd) {
+					break;
+				}
+			}
+			if (i == follow->numwatches) {
+				continue;
+			}
+			/* a copy, since callbacks may add tables and so move the array */
+			watch = follow->watches[i];
+			/* unlinking a file still open only changes its link count */
+			if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+			 || ((event->mask & IN_ATTRIB) && fstat(watch.p_dbf->dbf_fh, &st) == 0 && st.st_nlink == 0)) {
+				watch.callback(watch.p_dbf, NULL, 0, 0, DBF_CHANGE_REMOVED, watch.data);
+				handled++;
+			} else if (event->mask & IN_MODIFY) {
+				if (dbf_FollowDeliver(&watch, &buf, &bufsize) > 0) {
+					handled++;
+				}
+			}
+		}
+	}
+	free(buf);
+
+	if (len == -1 && errno != EAGAIN) {
+		return -1;
+	}
+	return handled;
+}
+/* }}} */
+
+/* dbf_FollowClose() {{{
+ */
+int dbf_FollowClose(DBF_FOLLOW *follow)
+{
+	close(follow->fd);
+	free(follow->watches);
+	free(follow);
+	return 0;
+}
+/* }}} */
+
+#else
+
+DBF_FOLLOW *dbf_FollowCreate(void)
+{
+	return NULL;
+}
+
+int dbf_FollowAdd(DBF_FOLLOW *follow, const char *file, P_DBF *p_dbf, DBF_FOLLOW_CALLBACK callback, void *data)
+{
+	(void) follow;
+	(void) file;
+	(void) p_dbf;
+	(void) callback;
+	(void) data;
+	return -1;
+}
+
+int dbf_FollowRemove(DBF_FOLLOW *follow, P_DBF *p_dbf)
+{
+	(void) follow;
+	(void) p_dbf;
+	return -1;
+}
+
+int dbf_FollowFD(DBF_FOLLOW *follow)
+{
+	(void) follow;
+	return -1;
+}
+
+int dbf_FollowDispatch(DBF_FOLLOW *follow)
+{
+	(void) follow;
+	return -1;
+}
+
+int dbf_FollowClose(DBF_FOLLOW *follow)
+{
+	(void) follow;
+	return -1;
+}
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,325 @@
+/*****************************************************************************
+ * dbf_io.c
+ *****************************************************************************
+ * Low level I/O routines of libdbf
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#if defined(HAVE_PREADV) || defined(HAVE_PWRITEV)
+#include <sys/uio.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+/* DBF_IN_MAP() {{{
+ * True if the range lies completely within the memory map
+ */
+#define DBF_IN_MAP(p_dbf, offset, len) \
+	((p_dbf)->map && (offset) >= 0 && (off_t) ((offset) + (len)) <= (off_t) (p_dbf)->map_size)
+/* }}} */
+
+#ifdef WITH_STATS
+/* dbf_stats_now() {{{
+ * Takes a timestamp from a monotonic clock
+ */
+void dbf_stats_now(DBF_STAT_TIME *t)
+{
+	clock_gettime(CLOCK_MONOTONIC, t);
+}
+/* }}} */
+
+/* dbf_stats_since() {{{
+ * Returns the nanoseconds passed since t
+ */
+unsigned long long dbf_stats_since(const DBF_STAT_TIME *t)
+{
+	DBF_STAT_TIME now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long) (now.tv_sec - t->tv_sec) * 1000000000ULL
+		+ now.tv_nsec - t->tv_nsec;
+}
+/* }}} */
+#endif
+
+/* dbf_io_read() {{{
+ * read(2) on the dbf file
+ */
+ssize_t dbf_io_read(P_DBF *p_dbf, void *buf, size_t len)
+{
+	ssize_t ret;
+	DBF_STAT_START(t);
+
+	ret = read(p_dbf->dbf_fh, buf, len);
+
+	DBF_STAT_STOP(p_dbf, io_nsec, t);
+	DBF_STAT_ADD(p_dbf, reads, 1);
+	if (ret > 0)
+		DBF_STAT_ADD(p_dbf, bytes_read, ret);
+	return ret;
+}
+/* }}} */
+
+/* dbf_io_write() {{{
+ * write(2) on the dbf file
+ */
+ssize_t dbf_io_write(P_DBF *p_dbf, const void *buf, size_t len)
+{
+	ssize_t ret;
+	DBF_STAT_START(t);
+
+	ret = write(p_dbf->dbf_fh, buf, len);
+
+	DBF_STAT_STOP(p_dbf, io_nsec, t);
+	DBF_STAT_ADD(p_dbf, writes, 1);
+	if (ret > 0)
+		DBF_STAT_ADD(p_dbf, bytes_written, ret);
+	return ret;
+}
+/* }}} */
+
+/* dbf_io_lseek() {{{
+ * lseek(2) on the dbf file
+ */
+off_t dbf_io_lseek(P_DBF *p_dbf, off_t offset, int whence)
+{
+	off_t ret;
+	DBF_STAT_START(t);
+
+	ret = lseek(p_dbf->dbf_fh, offset, whence);
+
+	DBF_STAT_STOP(p_dbf, io_nsec, t);
+	DBF_STAT_ADD(p_dbf, seeks, 1);
+	return ret;
+}
+/* }}} */
+
+/* dbf_io_pread() {{{
+ * pread(2) on the dbf file
+ */
+ssize_t dbf_io_pread(P_DBF *p_dbf, void *buf, size_t len, off_t offset)
+{
+	ssize_t ret;
+
+	if (DBF_IN_MAP(p_dbf, offset, len)) {
+		memcpy(buf, p_dbf->map + offset, len);
+		DBF_STAT_ADD(p_dbf, bytes_read, len);
+		return len;
+	}
+
+	DBF_STAT_START(t);
+	if (p_dbf->stream)
+		ret = dbf_StreamPread(p_dbf, buf, len, offset);
+	else
+		ret = pread(p_dbf->dbf_fh, buf, len, offset);
+
+	DBF_STAT_STOP(p_dbf, io_nsec, t);
+	DBF_STAT_ADD(p_dbf, reads, 1);
+	if (ret > 0)
+		DBF_STAT_ADD(p_dbf, bytes_read, ret);
+	return ret;
+}
+/* }}} */
+
+#ifdef HAVE_PREADV
+/* dbf_io_preadv() {{{
+ * preadv(2) on the dbf file
+ */
+ssize_t dbf_io_preadv(P_DBF *p_dbf, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	ssize_t ret;
+	size_t len;
+	int i;
+
+	for (len = 0, i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	if (DBF_IN_MAP(p_dbf, offset, len)) {
+		for (i = 0; i < iovcnt; i++) {
+			memcpy(iov[i].iov_base, p_dbf->map + offset, iov[i].iov_len);
+			offset += iov[i].iov_len;
+		}
+		DBF_STAT_ADD(p_dbf, bytes_read, len);
+		return len;
+	}
+	if (p_dbf->stream) {
+		for (len = 0, i = 0; i < iovcnt; i++) {
+			if ((ret = dbf_io_pread(p_dbf, iov[i].iov_base, iov[i].iov_len, offset + len)) < 0)
+				return -1;
+			len += ret;
+			if ((size_t) ret < iov[i].iov_len)
+				break;
+		}
+		return len;
+	}
+
+	DBF_STAT_START(t);
+	ret = preadv(p_dbf->dbf_fh, iov, iovcnt, offset);
+
+	DBF_STAT_STOP(p_dbf, io_nsec, t);
+	DBF_STAT_ADD(p_dbf, reads, 1);
+	if (ret > 0)
+		DBF_STAT_ADD(p_dbf, bytes_read, ret);
+	return ret;
+}
+/* }}} */
+#endif
+
+/* dbf_io_pwrite() {{{
+ * pwrite(2) on the dbf file
+ */
+ssize_t dbf_io_pwrite(P_DBF *p_dbf, const void *buf, size_t len, off_t offset)
+{
+	ssize_t ret;
+
+	if ((p_dbf->flags & DBF_FLAG_MAP_WRITE) && DBF_IN_MAP(p_dbf, offset, len)) {
+		memcpy(p_dbf->map + offset, buf, len);
+		DBF_STAT_ADD(p_dbf, bytes_written, len);
+		return len;
+	}
+
+	DBF_STAT_START(t);
+	ret = pwrite(p_dbf->dbf_fh, buf, len, offset);
+
+	DBF_STAT_STOP(p_dbf, io_nsec, t);
+	DBF_STAT_ADD(p_dbf, writes, 1);
+	if (ret > 0)
+		DBF_STAT_ADD(p_dbf, bytes_written, ret);
+	return ret;
+}
+/* }}} */
+
+#ifdef HAVE_PWRITEV
+/* dbf_io_pwritev() {{{
+ * pwritev(2) on the dbf file
+ */
+ssize_t dbf_io_pwritev(P_DBF *p_dbf, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	ssize_t ret;
+	DBF_STAT_START(t);
+
+	ret = pwritev(p_dbf->dbf_fh, iov, iovcnt, offset);
+
+	DBF_STAT_STOP(p_dbf, io_nsec, t);
+	DBF_STAT_ADD(p_dbf, writes, 1);
+	if (ret > 0)
+		DBF_STAT_ADD(p_dbf, bytes_written, ret);
+	return ret;
+}
+/* }}} */
+#endif
+
+/* dbf_io_map() {{{
+ * Maps the complete dbf file into memory
+ */
+int dbf_io_map(P_DBF *p_dbf, int writable)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct stat st;
+	void *map;
+
+	if (0 > fstat(p_dbf->dbf_fh, &st) || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		return -1;
+	}
+	/* files larger than the address space are read with pread() */
+	if ((unsigned long long) st.st_size > (size_t) -1) {
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, p_dbf->dbf_fh, 0);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	p_dbf->map = map;
+	p_dbf->map_size = st.st_size;
+	if (writable) {
+		p_dbf->flags |= DBF_FLAG_MAP_WRITE;
+	}
+	return 0;
+#else
+	(void) p_dbf;
+	(void) writable;
+	return -1;
+#endif
+}
+/* }}} */
+
+/* dbf_io_sync_map() {{{
+ * Schedules the changed pages of the map for writing
+ */
+int dbf_io_sync_map(P_DBF *p_dbf)
+{
+#ifdef HAVE_SYS_MMAN_H
+	return msync(p_dbf->map, p_dbf->map_size, MS_ASYNC);
+#else
+	(void) p_dbf;
+	return -1;
+#endif
+}
+/* }}} */
+
+/* dbf_io_unmap() {{{
+ */
+void dbf_io_unmap(P_DBF *p_dbf)
+{
+#ifdef HAVE_SYS_MMAN_H
+	munmap(p_dbf->map, p_dbf->map_size);
+#endif
+	p_dbf->map = NULL;
+	p_dbf->map_size = 0;
+	p_dbf->flags &= ~DBF_FLAG_MAP_WRITE;
+}
+/* }}} */
+
+/* dbf_GetStats() {{{
+ * Copies the statistics of the handle
+ */
+int dbf_GetStats(P_DBF *p_dbf, DBF_STATS *stats)
+{
+#ifdef WITH_STATS
+	memcpy(stats, &p_dbf->stats, sizeof(DBF_STATS));
+	return 0;
+#else
+	(void) p_dbf;
+	memset(stats, 0, sizeof(DBF_STATS));
+	return -1;
+#endif
+}
+/* }}} */
+
+/* dbf_ResetStats() {{{
+ * Sets all statistics of the handle back to zero
+ */
+int dbf_ResetStats(P_DBF *p_dbf)
+{
+#ifdef WITH_STATS
+	memset(&p_dbf->stats, 0, sizeof(DBF_STATS));
+	return 0;
+#else
+	(void) p_dbf;
+	return -1;
+#endif
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,74 @@
+/*****************************************************************************
+ * dbf_io.h
+ *****************************************************************************
+ * Low level I/O routines of libdbf
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#ifndef __DBF_IO__
+#define __DBF_IO__
+
+#include "dbf.h"
+
+/*
+ * All access to the file descriptor of a P_DBF goes through these
+ * functions, which keeps the statistics in one place.
+ */
+ssize_t dbf_io_read(P_DBF *p_dbf, void *buf, size_t len);
+ssize_t dbf_io_write(P_DBF *p_dbf, const void *buf, size_t len);
+off_t dbf_io_lseek(P_DBF *p_dbf, off_t offset, int whence);
+ssize_t dbf_io_pread(P_DBF *p_dbf, void *buf, size_t len, off_t offset);
+ssize_t dbf_io_pwrite(P_DBF *p_dbf, const void *buf, size_t len, off_t offset);
+struct iovec;
+#ifdef HAVE_PREADV
+ssize_t dbf_io_preadv(P_DBF *p_dbf, const struct iovec *iov, int iovcnt, off_t offset);
+#endif
+#ifdef HAVE_PWRITEV
+ssize_t dbf_io_pwritev(P_DBF *p_dbf, const struct iovec *iov, int iovcnt, off_t offset);
+#endif
+
+/*
+ * Memory mapping of the dbf file. While a file is mapped, the positional
+ * reads and writes above are served from the map where possible.
+ */
+int dbf_io_map(P_DBF *p_dbf, int writable);
+int dbf_io_sync_map(P_DBF *p_dbf);
+void dbf_io_unmap(P_DBF *p_dbf);
+
+/*
+ * Statistics helpers. Without WITH_STATS all of them expand to no-ops,
+ * so the counters cost neither time nor space. The counters are added to
+ * atomically where the compiler can, as threads share a handle for
+ * reading.
+ */
+#ifdef WITH_STATS
+#include <time.h>
+
+typedef struct timespec DBF_STAT_TIME;
+
+void dbf_stats_now(DBF_STAT_TIME *t);
+unsigned long long dbf_stats_since(const DBF_STAT_TIME *t);
+
+#ifdef HAVE_SYNC_FETCH_AND_ADD
+#define DBF_STAT_ADD(p_dbf, counter, n) \
+	((void) __sync_fetch_and_add(&(p_dbf)->stats.counter, (n)))
+#else
+#define DBF_STAT_ADD(p_dbf, counter, n) ((void) ((p_dbf)->stats.counter += (n)))
+#endif
+#define DBF_STAT_START(t) DBF_STAT_TIME t; dbf_stats_now(&t)
+#define DBF_STAT_STOP(p_dbf, counter, t) DBF_STAT_ADD(p_dbf, counter, dbf_stats_since(&t))
+#else
+#define DBF_STAT_ADD(p_dbf, counter, n) ((void) 0)
+#define DBF_STAT_START(t) ((void) 0)
+#define DBF_STAT_STOP(p_dbf, counter, t) ((void) 0)
+#endif
+
+#endif
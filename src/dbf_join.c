@@ -0,0 +1,525 @@
+/*****************************************************************************
+ * dbf_join.c
+ *****************************************************************************
+ * Joining two tables on equal key columns
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include <stddef.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+/*
+ * The table with fewer records is read once into a hash table, the
+ * other one is read in large blocks and every record is looked up.
+ * The key of a record is built from its key fields, each one preceded
+ * by its length, so keys of several fields cannot run into each other.
+ *
+ * The entries of the hash table are allocated from an arena of large
+ * blocks, an entry holding the key and, when a table is written, the
+ * fields of the record needed in the output. The bucket array is sized
+ * once from the number of records, so the memory used depends only on
+ * the size of the smaller table.
+ */
+
+/* Bytes of records read at once */
+#define DBF_JOIN_CHUNK (1024 * 1024)
+/* Bytes of an arena block */
+#define DBF_JOIN_BLOCK (1024 * 1024)
+
+/* Record of the smaller table in the hash table */
+typedef struct _DBF_JOIN_ENTRY {
+	struct _DBF_JOIN_ENTRY *next;
+	u_int32_t hash;
+	u_int32_t recno;
+	u_int32_t keylen;
+	/*! key followed by the output fields of the record */
+	char data[1];
+} DBF_JOIN_ENTRY;
+
+/* Block of the arena */
+typedef struct _DBF_JOIN_ARENA {
+	struct _DBF_JOIN_ARENA *next;
+	size_t used;
+	size_t size;
+} DBF_JOIN_ARENA;
+
+/* Field of the output table */
+typedef struct {
+	/*! 1 if the field is taken from the entry of the smaller table */
+	int build;
+	/*! offset in the record or in the data of the entry after the key */
+	int offset;
+	int length;
+} DBF_JOIN_OUTPUT;
+
+typedef struct {
+	/* the smaller table is read into the hash table */
+	P_DBF *build;
+	const int *build_keys;
+	/* the larger table is looked up record by record */
+	P_DBF *probe;
+	const int *probe_keys;
+	int numkeys;
+	int flags;
+	/*! 1 if the smaller table is the left one */
+	int swapped;
+	DBF_JOIN_ENTRY **buckets;
+	u_int32_t numbuckets;
+	DBF_JOIN_ARENA *arena;
+	/* pairs of record numbers */
+	DBF_JOIN_PAIR *pairs;
+	size_t numpairs;
+	size_t maxpairs;
+	/* output table */
+	P_DBF *out;
+	DBF_JOIN_OUTPUT *output;
+	int numoutput;
+	/*! bytes of the fields of the smaller table kept in an entry */
+	int payload;
+	char *outrec;
+	int outlen;
+} DBF_JOIN;
+
+/* static dbf_JoinHash() {{{
+ * FNV-1a over the key
+ */
+static u_int32_t dbf_JoinHash(const unsigned char *key, u_int32_t len)
+{
+	u_int32_t h = 2166136261U, i;
+
+	for (i = 0; i < len; i++) {
+		h = (h ^ key[i]) * 16777619U;
+	}
+	return h;
+}
+/* }}} */
+
+/* static dbf_JoinKey() {{{
+ * Builds the key of a record, returns its length or 0 if all key
+ * fields are blank
+ */
+static u_int32_t dbf_JoinKey(P_DBF *p_dbf, const int *keys, int numkeys, int flags,
+	const char *rec, unsigned char *key)
+{
+	const unsigned char *p;
+	u_int32_t len = 0;
+	int i, j, n, blank = 1;
+
+	for (i = 0; i < numkeys; i++) {
+		p = (const unsigned char *) rec + p_dbf->fields[keys[i]].field_offset;
+		n = p_dbf->fields[keys[i]].field_length;
+		if (flags & DBF_JOIN_TRIM) {
+			while (n > 0 && (p[n - 1] == ' ' || p[n - 1] == '\0'))
+				n--;
+			while (n > 0 && p[0] == ' ') {
+				p++;
+				n--;
+			}
+		}
+		key[len++] = (unsigned char) n;
+		for (j = 0; j < n; j++) {
+			if (p[j] != ' ')
+				blank = 0;
+			key[len++] = ((flags & DBF_JOIN_NOCASE) && p[j] >= 'a' && p[j] <= 'z') ? p[j] - 'a' + 'A' : p[j];
+		}
+	}
+	return blank ? 0 : len;
+}
+/* }}} */
+
+/* static dbf_JoinAlloc() {{{
+ * Takes size bytes from the arena
+ */
+static void *dbf_JoinAlloc(DBF_JOIN *j, size_t size)
+{
+	DBF_JOIN_ARENA *a = j->arena;
+	size_t blocksize;
+
+	/* entries are kept aligned for their pointers */
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if (a == NULL || a->size - a->used < size) {
+		blocksize = size > DBF_JOIN_BLOCK ? size : DBF_JOIN_BLOCK;
+		if (NULL == (a = malloc(sizeof(DBF_JOIN_ARENA) + blocksize))) {
+			return NULL;
+		}
+		a->next = j->arena;
+		a->used = 0;
+		a->size = blocksize;
+		j->arena = a;
+	}
+	a->used += size;
+	return (char *) (a + 1) + a->used - size;
+}
+/* }}} */
+
+/* static dbf_JoinBuild() {{{
+ * Reads the smaller table into the hash table
+ */
+static int dbf_JoinBuild(DBF_JOIN *j)
+{
+	P_DBF *p_dbf = j->build;
+	DBF_JOIN_ENTRY *e, **bucket;
+	unsigned char *key = NULL;
+	char *buf = NULL, *payload;
+	const char *rec;
+	u_int32_t records, end, first, want, chunk, keylen;
+	int i, k, n, reclen, ret = -1;
+
+	records = p_dbf->header->records;
+	for (j->numbuckets = 64; j->numbuckets < records && j->numbuckets < 0x80000000U; j->numbuckets *= 2)
+		;
+	if (NULL == (j->buckets = calloc(j->numbuckets, sizeof(DBF_JOIN_ENTRY *)))) {
+		return -1;
+	}
+
+	reclen = p_dbf->header->record_length;
+	chunk = DBF_JOIN_CHUNK / reclen ? DBF_JOIN_CHUNK / reclen : 1;
+	if (NULL == (buf = malloc((size_t) chunk * reclen)) || NULL == (key = malloc(256 * j->numkeys))) {
+		goto out;
+	}
+
+	/* entries are put in front of their bucket, so the table is read
+	 * backwards to keep equal keys in the order of the records */
+	for (end = records; end > 0; end = first) {
+		want = end < chunk ? end : chunk;
+		first = end - want;
+		if ((u_int32_t) (n = dbf_ReadRecords(p_dbf, first, want, buf)) != want) {
+			goto out;
+		}
+		for (i = n - 1; i >= 0; i--) {
+			rec = buf + (size_t) i * reclen;
+			if (rec[0] == '*') {
+				continue;
+			}
+			if (0 == (keylen = dbf_JoinKey(p_dbf, j->build_keys, j->numkeys, j->flags, rec, key))) {
+				continue;
+			}
+			if (NULL == (e = dbf_JoinAlloc(j, offsetof(DBF_JOIN_ENTRY, data) + keylen + j->payload))) {
+				goto out;
+			}
+			e->hash = dbf_JoinHash(key, keylen);
+			e->recno = first + i;
+			e->keylen = keylen;
+			memcpy(e->data, key, keylen);
+			payload = e->data + keylen;
+			for (k = 0; k < j->numoutput; k++) {
+				if (j->output[k].build) {
+					memcpy(payload, rec + p_dbf->fields[j->output[k].offset].field_offset, j->output[k].length);
+					payload += j->output[k].length;
+				}
+			}
+			bucket = &j->buckets[e->hash & (j->numbuckets - 1)];
+			e->next = *bucket;
+			*bucket = e;
+		}
+	}
+	ret = 0;
+
+out:
+	free(key);
+	free(buf);
+	return ret;
+}
+/* }}} */
+
+/* static dbf_JoinMatch() {{{
+ * Hands out a pair of matching records
+ */
+static int dbf_JoinMatch(DBF_JOIN *j, const char *rec, u_int32_t recno, DBF_JOIN_ENTRY *e)
+{
+	DBF_JOIN_PAIR *tmp;
+	const char *payload;
+	size_t max;
+	int k, pos;
+
+	if (j->out == NULL) {
+		if (j->numpairs == j->maxpairs) {
+			max = j->maxpairs ? 2 * j->maxpairs : 1024;
+			if (NULL == (tmp = realloc(j->pairs, max * sizeof(DBF_JOIN_PAIR)))) {
+				return -1;
+			}
+			j->pairs = tmp;
+			j->maxpairs = max;
+		}
+		j->pairs[j->numpairs].left = j->swapped ? e->recno : recno;
+		j->pairs[j->numpairs].right = j->swapped ? recno : e->recno;
+		j->numpairs++;
+		return 0;
+	}
+
+	payload = e->data + e->keylen;
+	for (k = 0, pos = 0; k < j->numoutput; pos += j->output[k++].length) {
+		memcpy(j->outrec + pos, j->output[k].build ? payload + j->output[k].offset : rec + j->output[k].offset,
+			j->output[k].length);
+	}
+	j->numpairs++;
+	return dbf_WriteRecord(j->out, j->outrec, j->outlen) < 0 ? -1 : 0;
+}
+/* }}} */
+
+/* static dbf_JoinProbe() {{{
+ * Looks up every record of the larger table
+ */
+static int dbf_JoinProbe(DBF_JOIN *j)
+{
+	P_DBF *p_dbf = j->probe;
+	DBF_JOIN_ENTRY *e;
+	unsigned char *key = NULL;
+	char *buf = NULL;
+	const char *rec;
+	u_int32_t records, first, chunk, keylen, hash;
+	int i, n, reclen, ret = -1;
+
+	reclen = p_dbf->header->record_length;
+	chunk = DBF_JOIN_CHUNK / reclen ? DBF_JOIN_CHUNK / reclen : 1;
+	if (NULL == (buf = malloc((size_t) chunk * reclen)) || NULL == (key = malloc(256 * j->numkeys))) {
+		goto out;
+	}
+
+	records = p_dbf->header->records;
+	for (first = 0; first < records; first += n) {
+		n = dbf_ReadRecords(p_dbf, first, records - first < chunk ? records - first : chunk, buf);
+		if (n <= 0) {
+			goto out;
+		}
+		for (i = 0, rec = buf; i < n; i++, rec += reclen) {
+			if (rec[0] == '*') {
+				continue;
+			}
+			if (0 == (keylen = dbf_JoinKey(p_dbf, j->probe_keys, j->numkeys, j->flags, rec, key))) {
+				continue;
+			}
+			hash = dbf_JoinHash(key, keylen);
+			for (e = j->buckets[hash & (j->numbuckets - 1)]; e; e = e->next) {
+				if (e->hash == hash && e->keylen == keylen && !memcmp(e->data, key, keylen)
+				 && 0 > dbf_JoinMatch(j, rec, first + i, e)) {
+					goto out;
+				}
+			}
+		}
+	}
+	ret = 0;
+
+out:
+	free(key);
+	free(buf);
+	return ret;
+}
+/* }}} */
+
+/* static dbf_JoinInit() {{{
+ * Checks the key columns and decides which table is read into memory
+ */
+static int dbf_JoinInit(DBF_JOIN *j, P_DBF *left, const int *left_keys,
+	P_DBF *right, const int *right_keys, int numkeys, int flags)
+{
+	int i;
+
+	memset(j, 0, sizeof(DBF_JOIN));
+	if (left->dbf_fh == -1 || (left->flags & DBF_FLAG_SEQUENTIAL)
+	 || right->dbf_fh == -1 || (right->flags & DBF_FLAG_SEQUENTIAL) || numkeys < 1) {
+		return -1;
+	}
+	for (i = 0; i < numkeys; i++) {
+		if (left_keys[i] < 0 || left_keys[i] >= (int) left->columns
+		 || right_keys[i] < 0 || right_keys[i] >= (int) right->columns) {
+			return -1;
+		}
+	}
+
+	j->numkeys = numkeys;
+	j->flags = flags;
+	j->swapped = left->header->records < right->header->records;
+	j->build = j->swapped ? left : right;
+	j->build_keys = j->swapped ? left_keys : right_keys;
+	j->probe = j->swapped ? right : left;
+	j->probe_keys = j->swapped ? right_keys : left_keys;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_JoinFree() {{{
+ */
+static void dbf_JoinFree(DBF_JOIN *j)
+{
+	DBF_JOIN_ARENA *a;
+
+	while ((a = j->arena)) {
+		j->arena = a->next;
+		free(a);
+	}
+	free(j->buckets);
+	free(j->pairs);
+	free(j->output);
+	free(j->outrec);
+}
+/* }}} */
+
+/* dbf_Join() {{{
+ */
+int dbf_Join(P_DBF *left, const int *left_keys, P_DBF *right, const int *right_keys, int numkeys, int flags,
+	DBF_JOIN_PAIR **pairs)
+{
+	DBF_JOIN j;
+	int ret = -1;
+
+	*pairs = NULL;
+	if (0 > dbf_JoinInit(&j, left, left_keys, right, right_keys, numkeys, flags)) {
+		return -1;
+	}
+	if (0 > dbf_JoinBuild(&j) || 0 > dbf_JoinProbe(&j)) {
+		goto out;
+	}
+	if (j.numpairs > 0x7fffffff) {
+		fprintf(stderr, _("Too many matching records."));
+		fprintf(stderr, "\n");
+		goto out;
+	}
+	*pairs = j.pairs;
+	ret = (int) j.numpairs;
+	j.pairs = NULL;
+
+out:
+	dbf_JoinFree(&j);
+	return ret;
+}
+/* }}} */
+
+/* dbf_JoinTable() {{{
+ */
+int dbf_JoinTable(P_DBF *left, const int *left_keys, P_DBF *right, const int *right_keys, int numkeys, int flags,
+	const char *file, const DBF_JOIN_COLUMN *columns, int numcolumns)
+{
+	DBF_JOIN j;
+	DB_FIELD *fields = NULL;
+	P_DBF *p_dbf;
+	size_t len;
+	int i, k, fh = -1, offset = 1, ret = -1;
+
+	if (numcolumns < 1) {
+		return -1;
+	}
+	if (0 > dbf_JoinInit(&j, left, left_keys, right, right_keys, numkeys, flags)) {
+		return -1;
+	}
+	if (NULL == (j.output = malloc(numcolumns * sizeof(DBF_JOIN_OUTPUT)))
+	 || NULL == (fields = malloc(numcolumns * sizeof(DB_FIELD)))) {
+		goto out;
+	}
+	j.numoutput = numcolumns;
+
+	/* the fields of the output are those of the tables, in the order
+	 * given; fields of the smaller table are kept in the entries */
+	for (i = 0; i < numcolumns; i++) {
+		p_dbf = columns[i].table == DBF_JOIN_LEFT ? left : right;
+		if ((columns[i].table != DBF_JOIN_LEFT && columns[i].table != DBF_JOIN_RIGHT)
+		 || columns[i].column < 0 || columns[i].column >= (int) p_dbf->columns) {
+			goto out;
+		}
+		memcpy(&fields[i], &p_dbf->fields[columns[i].column], sizeof(DB_FIELD));
+		if (columns[i].name) {
+			if ((len = strlen(columns[i].name)) < 1 || len > 10) {
+				fprintf(stderr, _("Column name '%s' is not 1 to 10 characters long."), columns[i].name);
+				fprintf(stderr, "\n");
+				goto out;
+			}
+			memset(fields[i].field_name, 0, sizeof(fields[i].field_name));
+			memcpy(fields[i].field_name, columns[i].name, len);
+		}
+		/* names are compared regardless of case, like dbf_Alter does */
+		for (k = 0; k < i; k++) {
+			if (!strncasecmp((char *) fields[k].field_name, (char *) fields[i].field_name, 11)) {
+				fprintf(stderr, _("Column name '%.11s' is used twice in the joined table."), fields[i].field_name);
+				fprintf(stderr, "\n");
+				goto out;
+			}
+		}
+		fields[i].field_offset = offset;
+		offset += fields[i].field_length;
+		/* not p_dbf == j.build, both sides are the same table in a self join */
+		j.output[i].build = (columns[i].table == DBF_JOIN_LEFT) == j.swapped;
+		j.output[i].length = fields[i].field_length;
+		if (j.output[i].build) {
+			/* the column number until the entry is filled */
+			j.output[i].offset = columns[i].column;
+			j.payload += j.output[i].length;
+		} else {
+			j.output[i].offset = p_dbf->fields[columns[i].column].field_offset;
+		}
+	}
+	if (offset > 0xffff) {
+		fprintf(stderr, _("Record of the joined table is too long."));
+		fprintf(stderr, "\n");
+		goto out;
+	}
+	j.outlen = offset - 1;
+	if (NULL == (j.outrec = malloc(j.outlen))) {
+		goto out;
+	}
+
+	if (0 > dbf_JoinBuild(&j)) {
+		goto out;
+	}
+	/* from now on the offsets of the smaller table are in the entries */
+	for (i = 0, offset = 0; i < numcolumns; i++) {
+		if (j.output[i].build) {
+			j.output[i].offset = offset;
+			offset += j.output[i].length;
+		}
+	}
+
+	if ((fh = open(file, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY|O_LARGEFILE, 0644)) == -1) {
+		goto out;
+	}
+	if (NULL == (j.out = dbf_CreateFH(fh, fields, numcolumns))) {
+		close(fh);
+		goto out;
+	}
+	/* owned by the output from now on */
+	fields = NULL;
+	if (0 > dbf_BeginBatch(j.out) || 0 > dbf_JoinProbe(&j)) {
+		goto out;
+	}
+	if (j.numpairs > 0x7fffffff) {
+		fprintf(stderr, _("Too many matching records."));
+		fprintf(stderr, "\n");
+		goto out;
+	}
+	if (0 > dbf_CommitBatch(j.out)) {
+		goto out;
+	}
+	ret = (int) j.numpairs;
+
+out:
+	if (j.out && 0 > dbf_Close(j.out)) {
+		ret = -1;
+	}
+	/* no half written output is left behind */
+	if (ret < 0 && fh != -1) {
+		unlink(file);
+	}
+	free(fields);
+	dbf_JoinFree(&j);
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,215 @@
+/*****************************************************************************
+ * dbf_lock.c
+ *****************************************************************************
+ * Record and header locking compatible with FoxPro and Clipper
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include <errno.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+/*
+ * Legacy applications do not lock the bytes they access but single
+ * bytes far behind the end of the file, which are never read or written.
+ *
+ * FoxPro: header at 0x7FFFFFFE, record n (counting from 1) at
+ *         0x7FFFFFFE - n
+ * Clipper/dBASE III (NTX): header at 1000000000, record n at
+ *         1000000000 + n
+ */
+#define DBF_FOXPRO_LOCK_BASE 0x7FFFFFFEL
+#define DBF_CLIPPER_LOCK_BASE 1000000000L
+
+#ifdef F_SETLK
+
+/* static dbf_LockOffset() {{{
+ * Returns the byte to lock for the header (recno -1) or a record
+ */
+static off_t dbf_LockOffset(P_DBF *p_dbf, long long recno)
+{
+	switch (p_dbf->lock_scheme) {
+		case DBF_LOCK_FOXPRO:
+			return DBF_FOXPRO_LOCK_BASE - (off_t) (recno + 1);
+		case DBF_LOCK_CLIPPER:
+			return DBF_CLIPPER_LOCK_BASE + (off_t) (recno + 1);
+		default:
+			return -1;
+	}
+}
+/* }}} */
+
+/* static dbf_LockByte() {{{
+ * Sets or releases a fcntl() lock on a single byte
+ */
+static int dbf_LockByte(P_DBF *p_dbf, off_t offset, int type, int mode)
+{
+	struct flock lock;
+	int ret;
+
+	if (p_dbf->dbf_fh == -1 || offset < 0) {
+		return -1;
+	}
+
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type = type;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = offset;
+	lock.l_len = 1;
+	do {
+		ret = fcntl(p_dbf->dbf_fh, (mode & DBF_LOCK_WAIT) ? F_SETLKW : F_SETLK, &lock);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret;
+}
+/* }}} */
+
+/* dbf_LockHeader() {{{
+ */
+int dbf_LockHeader(P_DBF *p_dbf, int mode)
+{
+	int type = (mode & DBF_LOCK_EXCLUSIVE) ? F_WRLCK : F_RDLCK;
+
+	if (0 > dbf_LockByte(p_dbf, dbf_LockOffset(p_dbf, -1), type, mode)) {
+		return -1;
+	}
+	p_dbf->header_lock = type == F_WRLCK ? 2 : 1;
+	return 0;
+}
+/* }}} */
+
+/* dbf_UnlockHeader() {{{
+ */
+int dbf_UnlockHeader(P_DBF *p_dbf)
+{
+	if (0 > dbf_LockByte(p_dbf, dbf_LockOffset(p_dbf, -1), F_UNLCK, 0)) {
+		return -1;
+	}
+	p_dbf->header_lock = 0;
+	return 0;
+}
+/* }}} */
+
+/* dbf_LockRecord() {{{
+ */
+int dbf_LockRecord(P_DBF *p_dbf, u_int32_t recno, int mode)
+{
+	int type = (mode & DBF_LOCK_EXCLUSIVE) ? F_WRLCK : F_RDLCK;
+
+	return dbf_LockByte(p_dbf, dbf_LockOffset(p_dbf, recno), type, mode);
+}
+/* }}} */
+
+/* dbf_UnlockRecord() {{{
+ */
+int dbf_UnlockRecord(P_DBF *p_dbf, u_int32_t recno)
+{
+	return dbf_LockByte(p_dbf, dbf_LockOffset(p_dbf, recno), F_UNLCK, 0);
+}
+/* }}} */
+
+/* dbf_AutoLock() {{{
+ * Takes the header lock needed by an internal operation, unless locking
+ * is off or the caller already holds a sufficient lock. Returns 1 if the
+ * lock must be released with dbf_AutoUnlock(), 2 if a shared lock of the
+ * caller was made exclusive and has to be made shared again, 0 if nothing
+ * was locked and -1 on error.
+ */
+int dbf_AutoLock(P_DBF *p_dbf, int mode)
+{
+	if (p_dbf->lock_scheme == DBF_LOCK_NONE) {
+		return 0;
+	}
+	if (p_dbf->header_lock == 2 || (p_dbf->header_lock == 1 && !(mode & DBF_LOCK_EXCLUSIVE))) {
+		return 0;
+	}
+	if (p_dbf->header_lock == 1) {
+		return 0 > dbf_LockHeader(p_dbf, mode | DBF_LOCK_WAIT) ? -1 : 2;
+	}
+	if (0 > dbf_LockHeader(p_dbf, mode | DBF_LOCK_WAIT)) {
+		return -1;
+	}
+	return 1;
+}
+/* }}} */
+
+/* dbf_AutoUnlock() {{{
+ */
+void dbf_AutoUnlock(P_DBF *p_dbf, int taken)
+{
+	/* the caller keeps its shared lock, turning a lock into a shared
+	 * one never waits */
+	if (taken == 2) {
+		dbf_LockHeader(p_dbf, DBF_LOCK_SHARED);
+	} else if (taken > 0) {
+		dbf_UnlockHeader(p_dbf);
+	}
+}
+/* }}} */
+
+#else
+
+int dbf_LockHeader(P_DBF *p_dbf, int mode)
+{
+	return -1;
+}
+
+int dbf_UnlockHeader(P_DBF *p_dbf)
+{
+	return -1;
+}
+
+int dbf_LockRecord(P_DBF *p_dbf, u_int32_t recno, int mode)
+{
+	return -1;
+}
+
+int dbf_UnlockRecord(P_DBF *p_dbf, u_int32_t recno)
+{
+	return -1;
+}
+
+int dbf_AutoLock(P_DBF *p_dbf, int mode)
+{
+	return p_dbf->lock_scheme == DBF_LOCK_NONE ? 0 : -1;
+}
+
+void dbf_AutoUnlock(P_DBF *p_dbf, int taken)
+{
+}
+
+#endif
+
+/* dbf_SetLockScheme() {{{
+ */
+int dbf_SetLockScheme(P_DBF *p_dbf, int scheme)
+{
+	if (scheme != DBF_LOCK_NONE && scheme != DBF_LOCK_FOXPRO && scheme != DBF_LOCK_CLIPPER) {
+		return -1;
+	}
+	if (p_dbf->header_lock) {
+		dbf_UnlockHeader(p_dbf);
+	}
+	p_dbf->lock_scheme = scheme;
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
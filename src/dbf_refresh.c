@@ -0,0 +1,184 @@
+/*****************************************************************************
+ * dbf_refresh.c
+ *****************************************************************************
+ * Picking up records appended to a table since it was last read
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+/* static dbf_FieldsHash() {{{
+ * FNV-1a hash over name, type, length and decimals of the columns
+ */
+static u_int32_t dbf_FieldsHash(const DB_FIELD *fields, u_int32_t columns)
+{
+	u_int32_t hash = 2166136261U;
+	u_int32_t i;
+	int j;
+
+	for (i = 0; i < columns; i++) {
+		for (j = 0; j < 11; j++) {
+			hash = (hash ^ fields[i].field_name[j]) * 16777619U;
+		}
+		hash = (hash ^ fields[i].field_type) * 16777619U;
+		hash = (hash ^ fields[i].field_length) * 16777619U;
+		hash = (hash ^ fields[i].field_decimals) * 16777619U;
+	}
+	return hash;
+}
+/* }}} */
+
+/* dbf_LayoutHash() {{{
+ * Hash of the field layout of a handle
+ */
+u_int32_t dbf_LayoutHash(P_DBF *p_dbf)
+{
+	return dbf_FieldsHash(p_dbf->fields, p_dbf->columns);
+}
+/* }}} */
+
+/* static dbf_CompareHeader() {{{
+ * Classifies the difference between the header seen last and the
+ * current one
+ */
+static int dbf_CompareHeader(u_int32_t records, const unsigned char *last_update, const DB_HEADER *now)
+{
+	if (now->records < records) {
+		return DBF_CHANGE_REWRITTEN;
+	}
+	if (now->records > records) {
+		return DBF_CHANGE_APPENDED;
+	}
+	if (memcmp(now->last_update, last_update, 3)) {
+		return DBF_CHANGE_UPDATED;
+	}
+	return DBF_CHANGE_NONE;
+}
+/* }}} */
+
+/* dbf_Refresh() {{{
+ * Reads the header and the field descriptors again. The record counter
+ * stays at the first record not read yet, so new records follow those
+ * not read before.
+ */
+int dbf_Refresh(P_DBF *p_dbf)
+{
+	unsigned char *raw;
+	DB_HEADER now;
+	size_t len, end;
+	u_int32_t seen;
+	int change, locked, layout;
+	ssize_t n;
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL)) {
+		return -1;
+	}
+	/* the region this handle was opened with, a longer header of the
+	 * file is told apart by its header length */
+	len = p_dbf->header->header_length;
+	end = sizeof(DB_HEADER) + p_dbf->columns * sizeof(DB_FIELD);
+	if (NULL == (raw = malloc(len))) {
+		return -1;
+	}
+	/* Writers following the lock protocol update the header under an
+	 * exclusive lock, so the number of records read here is consistent.
+	 */
+	if (0 > (locked = dbf_AutoLock(p_dbf, DBF_LOCK_SHARED))) {
+		free(raw);
+		return -1;
+	}
+	n = dbf_io_pread(p_dbf, raw, len, 0);
+	dbf_AutoUnlock(p_dbf, locked);
+	if (n < (ssize_t) sizeof(DB_HEADER)) {
+		free(raw);
+		return -1;
+	}
+	dbf_DecodeHeader(&now, raw);
+
+	/* The field descriptors of this handle do not fit the file anymore.
+	 * Descriptors of the same lengths are compared with the hash
+	 * dbf_ResumeCheckpoint() uses. */
+	layout = now.header_length != p_dbf->header->header_length
+	 || now.record_length != p_dbf->header->record_length
+	 || (size_t) n < len || end >= len || raw[end] != 0x0D
+	 || dbf_FieldsHash((const DB_FIELD *) (raw + sizeof(DB_HEADER)), p_dbf->columns) != dbf_LayoutHash(p_dbf);
+	free(raw);
+	if (layout) {
+		return DBF_CHANGE_REWRITTEN | DBF_CHANGE_LAYOUT;
+	}
+
+	seen = p_dbf->header->records;
+	change = dbf_CompareHeader(seen, p_dbf->header->last_update, &now);
+	memcpy(p_dbf->header, &now, sizeof(DB_HEADER));
+	if (change & DBF_CHANGE_APPENDED) {
+		/* records the caller has not read yet are not skipped */
+		if (p_dbf->cur_record > seen) {
+			p_dbf->cur_record = seen;
+		}
+	} else if (change & DBF_CHANGE_REWRITTEN) {
+		p_dbf->cur_record = 0;
+	}
+
+	return change;
+}
+/* }}} */
+
+/* dbf_GetCheckpoint() {{{
+ */
+int dbf_GetCheckpoint(P_DBF *p_dbf, DBF_CHECKPOINT *checkpoint)
+{
+	memset(checkpoint, 0, sizeof(DBF_CHECKPOINT));
+	checkpoint->records = p_dbf->header->records;
+	memcpy(checkpoint->last_update, p_dbf->header->last_update, 3);
+	checkpoint->header_length = p_dbf->header->header_length;
+	checkpoint->record_length = p_dbf->header->record_length;
+	checkpoint->layout = dbf_LayoutHash(p_dbf);
+	return 0;
+}
+/* }}} */
+
+/* dbf_ResumeCheckpoint() {{{
+ * Compares a freshly opened table with a checkpoint and positions the
+ * record counter behind the records already seen
+ */
+int dbf_ResumeCheckpoint(P_DBF *p_dbf, const DBF_CHECKPOINT *checkpoint)
+{
+	int change;
+
+	if (checkpoint->header_length != p_dbf->header->header_length
+	 || checkpoint->record_length != p_dbf->header->record_length
+	 || checkpoint->layout != dbf_LayoutHash(p_dbf)) {
+		p_dbf->cur_record = 0;
+		return DBF_CHANGE_REWRITTEN | DBF_CHANGE_LAYOUT;
+	}
+
+	change = dbf_CompareHeader(checkpoint->records, checkpoint->last_update, p_dbf->header);
+	if (change & DBF_CHANGE_REWRITTEN) {
+		p_dbf->cur_record = 0;
+	} else {
+		p_dbf->cur_record = checkpoint->records;
+	}
+
+	return change;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
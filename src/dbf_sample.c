@@ -0,0 +1,215 @@
+/*****************************************************************************
+ * dbf_sample.c
+ *****************************************************************************
+ * Random samples of the records of a table
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include <math.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+/* static dbf_Random() {{{
+ * xorshift64* generator, state must not be 0
+ */
+static unsigned long long dbf_Random(unsigned long long *state)
+{
+	unsigned long long x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+/* }}} */
+
+/* static dbf_RandomSeed() {{{
+ * Spreads the bits of a user supplied seed over the state
+ */
+static unsigned long long dbf_RandomSeed(unsigned int seed)
+{
+	unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+/* }}} */
+
+/* static dbf_CompareRecno() {{{
+ */
+static int dbf_CompareRecno(const void *a, const void *b)
+{
+	u_int32_t x = *(const u_int32_t *) a, y = *(const u_int32_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+/* }}} */
+
+/* dbf_SampleRecords() {{{
+ * Draws k distinct record numbers with Floyd's algorithm and reads them
+ * in ascending order.
+ */
+int dbf_SampleRecords(P_DBF *p_dbf, u_int32_t k, unsigned int seed, char *records, u_int32_t *recnos)
+{
+	unsigned long long state;
+	u_int32_t *set, *picked, numrecords, j, t, mask;
+	size_t size, h, n;
+
+	numrecords = p_dbf->header->records;
+	if (k > numrecords) {
+		k = numrecords;
+	}
+	if (k == 0) {
+		return 0;
+	}
+
+	/* open addressed set of the numbers drawn so far, (u_int32_t)-1 is empty */
+	for (size = 2; size < 2 * (size_t) k; size <<= 1)
+		;
+	mask = size - 1;
+	if (NULL == (set = malloc(size * sizeof(u_int32_t)))) {
+		return -1;
+	}
+	memset(set, 0xFF, size * sizeof(u_int32_t));
+	picked = recnos;
+	if (picked == NULL && NULL == (picked = malloc(k * sizeof(u_int32_t)))) {
+		free(set);
+		return -1;
+	}
+
+	state = dbf_RandomSeed(seed);
+	n = 0;
+	for (j = numrecords - k; j < numrecords; j++) {
+		t = dbf_Random(&state) % ((unsigned long long) j + 1);
+		for (h = (t * 0x9E3779B1U) & mask; set[h] != (u_int32_t) -1; h = (h + 1) & mask) {
+			if (set[h] == t) {
+				t = j;
+				break;
+			}
+		}
+		/* j has never been drawn before, so it can always be added */
+		if (t == j) {
+			for (h = (t * 0x9E3779B1U) & mask; set[h] != (u_int32_t) -1; h = (h + 1) & mask)
+				;
+		}
+		set[h] = t;
+		picked[n++] = t;
+	}
+	free(set);
+
+	qsort(picked, k, sizeof(u_int32_t), dbf_CompareRecno);
+	if (0 > dbf_ReadRecordList(p_dbf, picked, k, records, NULL, p_dbf->fetch_gap)) {
+		if (picked != recnos)
+			free(picked);
+		return -1;
+	}
+	if (picked != recnos)
+		free(picked);
+
+	return k;
+}
+/* }}} */
+
+/* dbf_SampleBernoulli() {{{
+ * Selects every record with the given probability. Instead of drawing a
+ * random number for each record the distance to the next selected record
+ * is drawn from the geometric distribution.
+ */
+int dbf_SampleBernoulli(P_DBF *p_dbf, double percent, unsigned int seed, char **records, u_int32_t **recnos)
+{
+	unsigned long long state;
+	u_int32_t *picked, *tmp, numrecords;
+	size_t n, alloc;
+	double p, u, logq, skip, next;
+
+	*records = NULL;
+	if (recnos)
+		*recnos = NULL;
+	if (percent < 0.0 || percent > 100.0) {
+		return -1;
+	}
+
+	numrecords = p_dbf->header->records;
+	p = percent / 100.0;
+	alloc = (size_t) (numrecords * p * 1.1) + 16;
+	if (NULL == (picked = malloc(alloc * sizeof(u_int32_t)))) {
+		return -1;
+	}
+
+	state = dbf_RandomSeed(seed);
+	n = 0;
+	if (p > 0.0) {
+		/* log(1 - p) would round to 0 for tiny p */
+		logq = p < 1.0 ? log1p(-p) : 0.0;
+		next = -1.0;
+		for (;;) {
+			if (p < 1.0) {
+				/* uniform number in (0, 1] */
+				u = ((dbf_Random(&state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+				skip = floor(log(u) / logq);
+				/* not compared with next, as the sum may be inf */
+				if (!(skip < numrecords)) {
+					break;
+				}
+				next += skip + 1.0;
+			} else {
+				next += 1.0;
+			}
+			if (next >= numrecords) {
+				break;
+			}
+			if (n == alloc) {
+				alloc *= 2;
+				if (NULL == (tmp = realloc(picked, alloc * sizeof(u_int32_t)))) {
+					free(picked);
+					return -1;
+				}
+				picked = tmp;
+			}
+			picked[n++] = (u_int32_t) next;
+		}
+	}
+
+	if (n > 0) {
+		if (NULL == (*records = malloc((size_t) n * p_dbf->header->record_length))) {
+			free(picked);
+			return -1;
+		}
+		if (0 > dbf_ReadRecordList(p_dbf, picked, n, *records, NULL, p_dbf->fetch_gap)) {
+			free(*records);
+			*records = NULL;
+			free(picked);
+			return -1;
+		}
+	}
+
+	if (recnos)
+		*recnos = picked;
+	else
+		free(picked);
+
+	return n;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,559 @@
+/*****************************************************************************
+ * dbf_shared.c
+ *****************************************************************************
+ * Tables loaded once into shared memory and read by many processes
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+/* for F_OFD_SETLK */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "config.h"
+#include <errno.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+/*
+ * A segment is a file in shared memory holding a copy of the table,
+ * header and records exactly as in the file, followed on the next page
+ * by a trailer with the parsed header and the field descriptors. The
+ * name of the segment is made from the device and inode of the table
+ * and from its size and modification time, so a changed table gets a
+ * new segment while processes still attached to the old one keep
+ * reading it.
+ *
+ * The first process to open a table builds the segment under a
+ * temporary name and links it to the real name, so others never see a
+ * half loaded segment. A handle reads the records from a read only map
+ * of the copy and holds a read lock on the whole segment as long as it
+ * is open; the loader holds a write lock on the temporary file. A
+ * segment is only removed by whoever can take a write lock on it, so
+ * segments in use stay, while the locks of processes that died vanish
+ * with them. The last handle of an outdated segment removes it, and
+ * loading a new version removes the unused old ones.
+ *
+ * Open file description locks belong to the handle. Where they are
+ * missing, plain fcntl() locks belong to the process and closing any
+ * descriptor of a segment drops all of them, so a process may remove a
+ * segment its other handles still read. Those keep reading it, as an
+ * unlinked segment lives on while mapped, but later handles load anew.
+ */
+#if defined(HAVE_SYS_MMAN_H) && defined(F_SETLK)
+
+/* Directory of the segments, the first one existing */
+#define DBF_SHARED_DIR "/dev/shm"
+#define DBF_SHARED_DIR_FALLBACK "/tmp"
+/* Bytes of records copied at once while loading */
+#define DBF_SHARED_CHUNK (1024 * 1024)
+/* Attempts to attach while other processes load or remove segments */
+#define DBF_SHARED_TRIES 3
+
+/* Trailer of a segment, followed by the field descriptors */
+typedef struct {
+	char magic[8];
+	u_int32_t columns;
+	/*! identity and version of the table */
+	u_int64_t dev;
+	u_int64_t ino;
+	u_int64_t size;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	/*! header of the table in host byte order */
+	DB_HEADER header;
+} DBF_SHARED_HEADER;
+
+struct _DBF_SHARED {
+	/*! trailer of the segment */
+	DBF_SHARED_HEADER *trailer;
+	size_t trailer_size;
+	/*! name of the segment */
+	char *segment;
+	/*! name of the table */
+	char *file;
+};
+
+static const char dbf_shared_magic[8] = "DBFSHM2";
+
+/* static dbf_SharedKey() {{{
+ * Fills identity and version of a table from stat()
+ */
+static int dbf_SharedKey(const char *file, DBF_SHARED_HEADER *key)
+{
+	struct stat st;
+
+	if (0 > stat(file, &st) || !S_ISREG(st.st_mode)) {
+		return -1;
+	}
+	memset(key, 0, sizeof(DBF_SHARED_HEADER));
+	key->dev = st.st_dev;
+	key->ino = st.st_ino;
+	key->size = st.st_size;
+	key->mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SharedSameKey() {{{
+ */
+static int dbf_SharedSameKey(const DBF_SHARED_HEADER *a, const DBF_SHARED_HEADER *b)
+{
+	return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+		&& a->mtime == b->mtime && a->mtime_nsec == b->mtime_nsec;
+}
+/* }}} */
+
+/* static dbf_SharedDir() {{{
+ */
+static const char *dbf_SharedDir(void)
+{
+	struct stat st;
+
+	return (0 == stat(DBF_SHARED_DIR, &st) && S_ISDIR(st.st_mode)) ? DBF_SHARED_DIR : DBF_SHARED_DIR_FALLBACK;
+}
+/* }}} */
+
+/* static dbf_SharedPrefix() {{{
+ * Writes the beginning of the names of all segments of a table
+ */
+static void dbf_SharedPrefix(const DBF_SHARED_HEADER *key, char *prefix, size_t len)
+{
+	snprintf(prefix, len, "libdbf-%016llx-",
+		(unsigned long long) ((key->ino * 0x9E3779B97F4A7C15ULL) ^ key->dev));
+}
+/* }}} */
+
+/* static dbf_SharedName() {{{
+ * Returns the name of the segment of a version of a table
+ */
+static char *dbf_SharedName(const DBF_SHARED_HEADER *key)
+{
+	const char *dir = dbf_SharedDir();
+	char prefix[64], *name;
+	u_int64_t version;
+
+	dbf_SharedPrefix(key, prefix, sizeof(prefix));
+	version = ((key->size * 0x9E3779B97F4A7C15ULL) ^ (u_int64_t) key->mtime) * 0x100000001B3ULL
+		^ (u_int64_t) key->mtime_nsec;
+	if (NULL == (name = malloc(strlen(dir) + strlen(prefix) + 18))) {
+		return NULL;
+	}
+	sprintf(name, "%s/%s%016llx", dir, prefix, (unsigned long long) version);
+	return name;
+}
+/* }}} */
+
+/* static dbf_SharedTrailer() {{{
+ * Returns the offset of the trailer, the first page after the copy of
+ * the table described by the raw header
+ */
+static off_t dbf_SharedTrailer(const unsigned char *raw)
+{
+	DB_HEADER header;
+	off_t image, page = sysconf(_SC_PAGESIZE);
+
+	dbf_DecodeHeader(&header, raw);
+	image = (off_t) header.header_length + (off_t) header.records * header.record_length;
+	return (image + page - 1) / page * page;
+}
+/* }}} */
+
+/* static dbf_SharedLock() {{{
+ * Sets or releases a fcntl() lock on the whole segment
+ */
+static int dbf_SharedLock(int fh, int type, int wait)
+{
+	struct flock lock;
+	int ret;
+
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type = type;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = 0;
+	lock.l_len = 0;
+	do {
+#ifdef F_OFD_SETLK
+		ret = fcntl(fh, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock);
+#else
+		ret = fcntl(fh, wait ? F_SETLKW : F_SETLK, &lock);
+#endif
+	} while (ret == -1 && errno == EINTR);
+
+	return ret;
+}
+/* }}} */
+
+/* static dbf_SharedUnlink() {{{
+ * Removes a segment of this user if no handle or loader holds it
+ */
+static void dbf_SharedUnlink(const char *path)
+{
+	struct stat st;
+	int fh;
+
+	if ((fh = open(path, O_RDWR|O_BINARY)) == -1) {
+		return;
+	}
+	if (0 == fstat(fh, &st) && st.st_uid == geteuid()
+	 && 0 == dbf_SharedLock(fh, F_WRLCK, 0)) {
+		unlink(path);
+	}
+	close(fh);
+}
+/* }}} */
+
+/* static dbf_SharedSweep() {{{
+ * Removes the segments of a table no handle is attached to, except for
+ * the one to keep
+ */
+static void dbf_SharedSweep(const DBF_SHARED_HEADER *key, const char *keep)
+{
+#ifdef HAVE_DIRENT_H
+	const char *dir = dbf_SharedDir();
+	struct dirent *entry;
+	char prefix[64], path[PATH_MAX];
+	DIR *d;
+
+	dbf_SharedPrefix(key, prefix, sizeof(prefix));
+	if (NULL == (d = opendir(dir))) {
+		return;
+	}
+	while (NULL != (entry = readdir(d))) {
+		if (strncmp(entry->d_name, prefix, strlen(prefix))) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if (keep && !strcmp(path, keep)) {
+			continue;
+		}
+		/* includes the temporary files of loaders that died */
+		dbf_SharedUnlink(path);
+	}
+	closedir(d);
+#endif
+}
+/* }}} */
+
+/* static dbf_SharedLoad() {{{
+ * Copies a table into a new segment
+ */
+static int dbf_SharedLoad(const char *file, const DBF_SHARED_HEADER *key, const char *name)
+{
+	DBF_SHARED_HEADER *trailer;
+	DBF_SHARED_HEADER now;
+	P_DBF *p_dbf;
+	struct stat st;
+	char *tmp = NULL, *map = MAP_FAILED;
+	off_t image, offset;
+	size_t size = 0;
+	u_int32_t first, chunk, n;
+	int fh = -1, reclen, ret = -1;
+#ifdef HAVE_POSIX_FALLOCATE
+	int err;
+#endif
+
+	if (NULL == (p_dbf = dbf_OpenFlags(file, 0))) {
+		return -1;
+	}
+	/* the table must still be the one the name was made for */
+	if (0 > fstat(p_dbf->dbf_fh, &st)) {
+		goto out;
+	}
+	memcpy(&now, key, sizeof(now));
+	now.size = st.st_size;
+	now.mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	now.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+	if (!dbf_SharedSameKey(&now, key)) {
+		goto out;
+	}
+
+	image = DBF_RECORD_OFFSET(p_dbf, p_dbf->header->records);
+	offset = (image + sysconf(_SC_PAGESIZE) - 1) / sysconf(_SC_PAGESIZE) * sysconf(_SC_PAGESIZE);
+	if ((unsigned long long) offset + sizeof(DBF_SHARED_HEADER) + p_dbf->columns * sizeof(DB_FIELD) > (size_t) -1) {
+		goto out;
+	}
+	size = offset + sizeof(DBF_SHARED_HEADER) + p_dbf->columns * sizeof(DB_FIELD);
+
+	if (NULL == (tmp = malloc(strlen(name) + 8))) {
+		goto out;
+	}
+	/* unique for every thread loading the table, which may be several
+	 * of one process */
+	strcpy(tmp, name);
+	strcat(tmp, ".XXXXXX");
+	if ((fh = mkstemp(tmp)) == -1) {
+		goto out;
+	}
+	if (0 > dbf_SharedLock(fh, F_WRLCK, 0)) {
+		goto out;
+	}
+	/* the pages are allocated now, writing into a sparse segment on a
+	 * full file system would end the process with SIGBUS */
+#ifdef HAVE_POSIX_FALLOCATE
+	if (0 != (err = posix_fallocate(fh, 0, size))) {
+		if (err == ENOSPC) {
+			fprintf(stderr, _("Not enough space in %s to load the table."), dbf_SharedDir());
+			fprintf(stderr, "\n");
+		}
+		goto out;
+	}
+#else
+	if (0 > ftruncate(fh, size)) {
+		goto out;
+	}
+#endif
+	if (MAP_FAILED == (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fh, 0))) {
+		goto out;
+	}
+
+	/* header and records as in the file, read through the library so
+	 * compressed tables end up uncompressed */
+	if (dbf_io_pread(p_dbf, map, p_dbf->header->header_length, 0) != p_dbf->header->header_length) {
+		goto out;
+	}
+	reclen = p_dbf->header->record_length;
+	chunk = DBF_SHARED_CHUNK / reclen ? DBF_SHARED_CHUNK / reclen : 1;
+	for (first = 0; first < p_dbf->header->records; first += n) {
+		n = p_dbf->header->records - first < chunk ? p_dbf->header->records - first : chunk;
+		if ((int) n != dbf_ReadRecords(p_dbf, first, n, map + DBF_RECORD_OFFSET(p_dbf, first))) {
+			goto out;
+		}
+	}
+
+	trailer = (DBF_SHARED_HEADER *) (map + offset);
+	memcpy(trailer, key, sizeof(DBF_SHARED_HEADER));
+	memcpy(trailer->magic, dbf_shared_magic, sizeof(trailer->magic));
+	trailer->columns = p_dbf->columns;
+	memcpy(&trailer->header, p_dbf->header, sizeof(DB_HEADER));
+	memcpy(trailer + 1, p_dbf->fields, p_dbf->columns * sizeof(DB_FIELD));
+
+	/* another process may have been faster, its segment is just as good */
+	if (0 > link(tmp, name) && errno != EEXIST) {
+		goto out;
+	}
+	ret = 0;
+
+out:
+	if (map != MAP_FAILED)
+		munmap(map, size);
+	if (fh != -1) {
+		close(fh);
+		unlink(tmp);
+	}
+	free(tmp);
+	dbf_Close(p_dbf);
+	if (ret == 0) {
+		dbf_SharedSweep(key, name);
+	}
+	return ret;
+}
+/* }}} */
+
+/* dbf_OpenShared() {{{
+ */
+P_DBF *dbf_OpenShared(const char *file)
+{
+	DBF_SHARED_HEADER key;
+	DB_HEADER *header;
+	DBF_SHARED *s = NULL;
+	P_DBF *p_dbf = NULL;
+	unsigned char raw[sizeof(DB_HEADER)];
+	struct stat st;
+	char *name, *map = MAP_FAILED;
+	void *trailer = MAP_FAILED;
+	off_t offset = 0;
+	size_t image = 0;
+	int fh = -1, tries;
+
+	if (0 > dbf_SharedKey(file, &key) || NULL == (name = dbf_SharedName(&key))) {
+		return NULL;
+	}
+	for (tries = 0; ; tries++) {
+		if (tries == DBF_SHARED_TRIES) {
+			goto fail;
+		}
+		if ((fh = open(name, O_RDONLY|O_BINARY)) == -1) {
+			if (errno != ENOENT || 0 > dbf_SharedLoad(file, &key, name)) {
+				goto fail;
+			}
+			continue;
+		}
+		/* anybody can create files in the fallback directory */
+		if (0 > fstat(fh, &st) || st.st_uid != geteuid()) {
+			goto fail;
+		}
+		/* held until the handle is closed, waits while a segment is removed */
+		if (0 > dbf_SharedLock(fh, F_RDLCK, 1) || 0 > fstat(fh, &st)) {
+			goto fail;
+		}
+		/* removed before the lock was taken */
+		if (st.st_nlink > 0) {
+			break;
+		}
+		close(fh);
+		fh = -1;
+	}
+
+	if (pread(fh, raw, sizeof(raw), 0) != sizeof(raw)) {
+		goto fail;
+	}
+	offset = dbf_SharedTrailer(raw);
+	if (st.st_size < offset + (off_t) sizeof(DBF_SHARED_HEADER)) {
+		goto fail;
+	}
+	if (MAP_FAILED == (trailer = mmap(NULL, st.st_size - offset, PROT_READ, MAP_SHARED, fh, offset))) {
+		goto fail;
+	}
+	if (memcmp(((DBF_SHARED_HEADER *) trailer)->magic, dbf_shared_magic, sizeof(dbf_shared_magic))
+	 || !dbf_SharedSameKey(trailer, &key)
+	 || st.st_size != offset + (off_t) (sizeof(DBF_SHARED_HEADER) + ((DBF_SHARED_HEADER *) trailer)->columns * sizeof(DB_FIELD))) {
+		goto fail;
+	}
+	/* the copy of the table can only be read */
+	header = &((DBF_SHARED_HEADER *) trailer)->header;
+	image = (size_t) header->header_length + (size_t) header->records * header->record_length;
+	if (MAP_FAILED == (map = mmap(NULL, image, PROT_READ, MAP_SHARED, fh, 0))) {
+		goto fail;
+	}
+
+	if (NULL == (p_dbf = calloc(1, sizeof(P_DBF))) || NULL == (s = calloc(1, sizeof(DBF_SHARED)))
+	 || NULL == (p_dbf->header = malloc(sizeof(DB_HEADER))) || NULL == (s->file = strdup(file))) {
+		goto fail;
+	}
+	s->trailer = trailer;
+	s->trailer_size = st.st_size - offset;
+	s->segment = name;
+	memcpy(p_dbf->header, &s->trailer->header, sizeof(DB_HEADER));
+	p_dbf->fields = (DB_FIELD *) (s->trailer + 1);
+	p_dbf->columns = s->trailer->columns;
+	p_dbf->dbf_fh = fh;
+	p_dbf->dbt_fh = -1;
+	p_dbf->map = map;
+	p_dbf->map_size = image;
+	p_dbf->shared = s;
+	p_dbf->flags |= DBF_FLAG_SHARED;
+	p_dbf->cur_record = 0;
+	p_dbf->fetch_gap = DBF_FETCH_GAP;
+	return p_dbf;
+
+fail:
+	if (p_dbf) {
+		free(p_dbf->header);
+		free(p_dbf);
+	}
+	if (s) {
+		free(s->file);
+		free(s);
+	}
+	if (map != MAP_FAILED)
+		munmap(map, image);
+	if (trailer != MAP_FAILED)
+		munmap(trailer, st.st_size - offset);
+	if (fh != -1)
+		close(fh);
+	free(name);
+	return NULL;
+}
+/* }}} */
+
+/* dbf_SharedDetach() {{{
+ * Called by dbf_Close() for handles of dbf_OpenShared()
+ */
+void dbf_SharedDetach(P_DBF *p_dbf)
+{
+	DBF_SHARED *s = p_dbf->shared;
+	DBF_SHARED_HEADER now;
+	int outdated;
+
+	outdated = 0 > dbf_SharedKey(s->file, &now) || !dbf_SharedSameKey(&now, s->trailer);
+	munmap(s->trailer, s->trailer_size);
+	/* drops the read lock of the handle before looking for others */
+	close(p_dbf->dbf_fh);
+	p_dbf->dbf_fh = -1;
+	/* the last handle of an outdated table removes it */
+	if (outdated) {
+		dbf_SharedUnlink(s->segment);
+	}
+	free(s->segment);
+	free(s->file);
+	free(s);
+	p_dbf->shared = NULL;
+	p_dbf->fields = NULL;
+}
+/* }}} */
+
+/* dbf_SharedRemove() {{{
+ */
+int dbf_SharedRemove(const char *file)
+{
+	DBF_SHARED_HEADER key;
+
+	if (0 > dbf_SharedKey(file, &key)) {
+		return -1;
+	}
+	dbf_SharedSweep(&key, NULL);
+	return 0;
+}
+/* }}} */
+
+#else
+
+/* dbf_OpenShared() {{{
+ * Shared memory needs mmap() and fcntl() locks
+ */
+P_DBF *dbf_OpenShared(const char *file)
+{
+	(void) file;
+	return NULL;
+}
+/* }}} */
+
+/* dbf_SharedDetach() {{{
+ */
+void dbf_SharedDetach(P_DBF *p_dbf)
+{
+	(void) p_dbf;
+}
+/* }}} */
+
+/* dbf_SharedRemove() {{{
+ */
+int dbf_SharedRemove(const char *file)
+{
+	(void) file;
+	return -1;
+}
+/* }}} */
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,629 @@
+/*****************************************************************************
+ * dbf_sort.c
+ *****************************************************************************
+ * Sorting tables larger than the memory available
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * Every record is stored together with a key built from its sort
+ * columns, so all comparisons are a single memcmp(): character, date
+ * and logical fields are taken as they are, numbers are turned into
+ * eight bytes ordered like the values, descending columns are inverted
+ * and the record number is appended, which makes the sort stable.
+ *
+ * As many records as fit into the memory limit are read, sorted in
+ * parallel in slices and merged into a run in a spill file next to the
+ * output. If the whole table fits, the records go straight into the
+ * output. Otherwise the runs are merged, as many at a time as the
+ * memory allows, until a last merge writes the output. The output is
+ * appended in a batch, so it is written in large blocks.
+ */
+
+/* Threads sorting the slices of a run */
+#define DBF_SORT_THREADS 4
+/* The sizes below can be made smaller at compile time, the tests do so
+ * to get several merge passes out of a small table */
+#ifndef DBF_SORT_MIN_MEMORY
+/* Least memory used, whatever the caller allows */
+#define DBF_SORT_MIN_MEMORY (4 * 1024 * 1024)
+/* Bytes of records read from the table at once */
+#define DBF_SORT_READ (1024 * 1024)
+/* Least buffer of a run while merging */
+#define DBF_SORT_RUNBUF (64 * 1024)
+/* Bytes written to a spill file at once */
+#define DBF_SORT_WRITE (1024 * 1024)
+#endif
+
+typedef struct {
+	P_DBF *p_dbf;
+	const DBF_SORT_KEY *keys;
+	int numkeys;
+	/*! bytes of the key, including the record number */
+	int keylen;
+	/*! bytes of key and record */
+	size_t entry;
+	size_t memory;
+} DBF_SORT;
+
+/* A run in a spill file */
+typedef struct {
+	off_t offset;
+	u_int64_t count;
+} DBF_SORT_RUN;
+
+/* Sorted entries in memory or a run read back from a spill file */
+typedef struct {
+	char **ptrs;
+	size_t n;
+	int fh;
+	off_t offset;
+	u_int64_t left;
+	char *buf;
+	size_t buflen;
+	size_t bufpos;
+	size_t bufsize;
+	/*! current entry, NULL when the source is exhausted */
+	char *cur;
+} DBF_SORT_SOURCE;
+
+/* Destination of a merge, either a spill file or the output table */
+typedef struct {
+	P_DBF *out;
+	int fh;
+	off_t offset;
+	char *buf;
+	size_t len;
+	u_int64_t count;
+} DBF_SORT_SINK;
+
+/* Slice sorted by a thread */
+typedef struct {
+	char **ptrs;
+	char **tmp;
+	size_t n;
+	int keylen;
+} DBF_SORT_SLICE;
+
+/* static dbf_SortKeyLength() {{{
+ */
+static int dbf_SortKeyLength(P_DBF *p_dbf, const DBF_SORT_KEY *key)
+{
+	switch (p_dbf->fields[key->column].field_type) {
+		case 'N':
+		case 'F':
+			return 8;
+		default:
+			return p_dbf->fields[key->column].field_length;
+	}
+}
+/* }}} */
+
+/* static dbf_SortKey() {{{
+ * Builds the key of a record
+ */
+static void dbf_SortKey(DBF_SORT *s, const char *rec, u_int32_t recno, unsigned char *key)
+{
+	DB_FIELD *field;
+	unsigned long long bits;
+	double value;
+	int i, j, len;
+
+	for (i = 0; i < s->numkeys; i++) {
+		field = &s->p_dbf->fields[s->keys[i].column];
+		len = dbf_SortKeyLength(s->p_dbf, &s->keys[i]);
+		if (field->field_type == 'N' || field->field_type == 'F') {
+			if (!dbf_ParseNumber(rec + field->field_offset, field->field_length, &value)) {
+				/* blank fields come first */
+				memset(key, 0, 8);
+			} else {
+				memcpy(&bits, &value, 8);
+				/* negative numbers reversed, positive ones above them */
+				bits = (bits >> 63) ? ~bits : bits | (1ULL << 63);
+				for (j = 7; j >= 0; j--, bits >>= 8) {
+					key[j] = (unsigned char) bits;
+				}
+			}
+		} else {
+			memcpy(key, rec + field->field_offset, len);
+		}
+		if (s->keys[i].flags & DBF_SORT_DESCENDING) {
+			for (j = 0; j < len; j++) {
+				key[j] = ~key[j];
+			}
+		}
+		key += len;
+	}
+
+	key[0] = (unsigned char) (recno >> 24);
+	key[1] = (unsigned char) (recno >> 16);
+	key[2] = (unsigned char) (recno >> 8);
+	key[3] = (unsigned char) recno;
+}
+/* }}} */
+
+/* static dbf_SortRange() {{{
+ * Merge sort of entry pointers, tmp holds n pointers
+ */
+static void dbf_SortRange(char **a, char **tmp, size_t n, int keylen)
+{
+	size_t h, i, j, k;
+	char *p;
+
+	if (n < 16) {
+		for (i = 1; i < n; i++) {
+			p = a[i];
+			for (j = i; j > 0 && memcmp(a[j - 1], p, keylen) > 0; j--) {
+				a[j] = a[j - 1];
+			}
+			a[j] = p;
+		}
+		return;
+	}
+
+	h = n / 2;
+	dbf_SortRange(a, tmp, h, keylen);
+	dbf_SortRange(a + h, tmp + h, n - h, keylen);
+	if (memcmp(a[h - 1], a[h], keylen) < 0) {
+		return;
+	}
+	for (i = 0, j = h, k = 0; i < h && j < n; k++) {
+		tmp[k] = memcmp(a[i], a[j], keylen) < 0 ? a[i++] : a[j++];
+	}
+	while (i < h) {
+		tmp[k++] = a[i++];
+	}
+	/* the rest of the second half is already in place */
+	memcpy(a, tmp, k * sizeof(char *));
+}
+/* }}} */
+
+/* static dbf_SortSlice() {{{
+ */
+static void *dbf_SortSlice(void *arg)
+{
+	DBF_SORT_SLICE *slice = arg;
+
+	dbf_SortRange(slice->ptrs, slice->tmp, slice->n, slice->keylen);
+	return NULL;
+}
+/* }}} */
+
+/* static dbf_SourceNext() {{{
+ * Moves a source to its next entry
+ */
+static int dbf_SourceNext(DBF_SORT *s, DBF_SORT_SOURCE *src)
+{
+	size_t len;
+
+	if (src->ptrs) {
+		src->cur = src->n ? *src->ptrs++ : NULL;
+		if (src->n)
+			src->n--;
+		return 0;
+	}
+
+	if (src->bufpos < src->buflen) {
+		src->cur = src->buf + src->bufpos;
+		src->bufpos += s->entry;
+		return 0;
+	}
+	if (src->left == 0) {
+		src->cur = NULL;
+		return 0;
+	}
+	len = src->bufsize / s->entry;
+	if (len > src->left) {
+		len = src->left;
+	}
+	len *= s->entry;
+	if (pread(src->fh, src->buf, len, src->offset) != (ssize_t) len) {
+		return -1;
+	}
+	src->offset += len;
+	src->left -= len / s->entry;
+	src->buflen = len;
+	src->cur = src->buf;
+	src->bufpos = s->entry;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SinkFlush() {{{
+ */
+static int dbf_SinkFlush(DBF_SORT_SINK *sink)
+{
+	if (sink->len && pwrite(sink->fh, sink->buf, sink->len, sink->offset) != (ssize_t) sink->len) {
+		return -1;
+	}
+	sink->offset += sink->len;
+	sink->len = 0;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SinkPut() {{{
+ */
+static int dbf_SinkPut(DBF_SORT *s, DBF_SORT_SINK *sink, char *entry)
+{
+	sink->count++;
+	if (sink->out) {
+		/* the deletion flag is written by dbf_WriteRecord() */
+		return dbf_WriteRecord(sink->out, entry + s->keylen + 1, s->p_dbf->header->record_length - 1) < 0 ? -1 : 0;
+	}
+	if (sink->len + s->entry > DBF_SORT_WRITE && 0 > dbf_SinkFlush(sink)) {
+		return -1;
+	}
+	memcpy(sink->buf + sink->len, entry, s->entry);
+	sink->len += s->entry;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SortMerge() {{{
+ * k-way merge of the sources into the sink with a binary heap
+ */
+static int dbf_SortMerge(DBF_SORT *s, DBF_SORT_SOURCE *src, int k, DBF_SORT_SINK *sink)
+{
+	int *heap, n = 0, i, c, top;
+
+	if (NULL == (heap = malloc((k + 1) * sizeof(int)))) {
+		return -1;
+	}
+	for (i = 0; i < k; i++) {
+		if (0 > dbf_SourceNext(s, &src[i])) {
+			free(heap);
+			return -1;
+		}
+		if (src[i].cur == NULL) {
+			continue;
+		}
+		/* sift up */
+		for (c = n++; c > 0 && memcmp(src[heap[(c - 1) / 2]].cur, src[i].cur, s->keylen) > 0; c = (c - 1) / 2) {
+			heap[c] = heap[(c - 1) / 2];
+		}
+		heap[c] = i;
+	}
+
+	while (n > 0) {
+		top = heap[0];
+		if (0 > dbf_SinkPut(s, sink, src[top].cur) || 0 > dbf_SourceNext(s, &src[top])) {
+			free(heap);
+			return -1;
+		}
+		if (src[top].cur == NULL) {
+			top = heap[--n];
+			if (n == 0)
+				break;
+		}
+		/* sift down */
+		for (i = 0; (c = 2 * i + 1) < n; i = c) {
+			if (c + 1 < n && memcmp(src[heap[c + 1]].cur, src[heap[c]].cur, s->keylen) < 0)
+				c++;
+			if (memcmp(src[top].cur, src[heap[c]].cur, s->keylen) <= 0)
+				break;
+			heap[i] = heap[c];
+		}
+		heap[i] = top;
+	}
+	free(heap);
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SortRun() {{{
+ * Sorts n entries in slices and merges them into the sink
+ */
+static int dbf_SortRun(DBF_SORT *s, char **ptrs, char **tmp, size_t n, DBF_SORT_SINK *sink)
+{
+	DBF_SORT_SLICE slices[DBF_SORT_THREADS];
+	DBF_SORT_SOURCE src[DBF_SORT_THREADS];
+	size_t first;
+	int i, k;
+#ifdef HAVE_PTHREAD_H
+	pthread_t tids[DBF_SORT_THREADS];
+	int started[DBF_SORT_THREADS];
+#endif
+
+	k = n < 4096 ? 1 : DBF_SORT_THREADS;
+	for (i = 0; i < k; i++) {
+		first = n * i / k;
+		slices[i].ptrs = ptrs + first;
+		slices[i].tmp = tmp + first;
+		slices[i].n = n * (i + 1) / k - first;
+		slices[i].keylen = s->keylen;
+	}
+#ifdef HAVE_PTHREAD_H
+	for (i = 1; i < k; i++) {
+		started[i] = pthread_create(&tids[i], NULL, dbf_SortSlice, &slices[i]) == 0;
+	}
+	dbf_SortSlice(&slices[0]);
+	for (i = 1; i < k; i++) {
+		if (started[i])
+			pthread_join(tids[i], NULL);
+		else
+			dbf_SortSlice(&slices[i]);
+	}
+#else
+	for (i = 0; i < k; i++) {
+		dbf_SortSlice(&slices[i]);
+	}
+#endif
+
+	memset(src, 0, sizeof(src));
+	for (i = 0; i < k; i++) {
+		src[i].ptrs = slices[i].ptrs;
+		src[i].n = slices[i].n;
+	}
+	return dbf_SortMerge(s, src, k, sink);
+}
+/* }}} */
+
+/* static dbf_SpillOpen() {{{
+ * Creates an anonymous spill file next to the output
+ */
+static int dbf_SpillOpen(const char *file)
+{
+	char *name;
+	int fh;
+
+	if (NULL == (name = malloc(strlen(file) + 8))) {
+		return -1;
+	}
+	strcpy(name, file);
+	strcat(name, ".XXXXXX");
+	if ((fh = mkstemp(name)) != -1) {
+		unlink(name);
+	}
+	free(name);
+	return fh;
+}
+/* }}} */
+
+/* static dbf_SortPass() {{{
+ * Merges groups of fanin runs of one spill file into another
+ */
+static int dbf_SortPass(DBF_SORT *s, int from, int to, DBF_SORT_RUN *runs, int *numruns, int fanin, char *mem)
+{
+	DBF_SORT_SOURCE *src;
+	DBF_SORT_SINK sink;
+	int i, j, k, out = 0;
+
+	if (NULL == (src = calloc(fanin, sizeof(DBF_SORT_SOURCE)))) {
+		return -1;
+	}
+	memset(&sink, 0, sizeof(sink));
+	sink.fh = to;
+	sink.buf = mem;
+	mem += DBF_SORT_WRITE;
+
+	for (i = 0; i < *numruns; i += k) {
+		k = *numruns - i < fanin ? *numruns - i : fanin;
+		for (j = 0; j < k; j++) {
+			memset(&src[j], 0, sizeof(DBF_SORT_SOURCE));
+			src[j].fh = from;
+			src[j].offset = runs[i + j].offset;
+			src[j].left = runs[i + j].count;
+			src[j].bufsize = (s->memory - DBF_SORT_WRITE) / fanin;
+			src[j].buf = mem + j * src[j].bufsize;
+		}
+		runs[out].offset = sink.offset + sink.len;
+		sink.count = 0;
+		if (0 > dbf_SortMerge(s, src, k, &sink)) {
+			free(src);
+			return -1;
+		}
+		runs[out++].count = sink.count;
+	}
+	free(src);
+	*numruns = out;
+	return dbf_SinkFlush(&sink);
+}
+/* }}} */
+
+/* dbf_Sort() {{{
+ */
+int dbf_Sort(P_DBF *p_dbf, const char *file, const DBF_SORT_KEY *keys, int numkeys, size_t memory_limit)
+{
+	DBF_SORT s;
+	DBF_SORT_RUN *runs = NULL, *tmpruns;
+	DBF_SORT_SOURCE *src = NULL;
+	DBF_SORT_SINK sink;
+	DB_FIELD *fields = NULL;
+	P_DBF *out = NULL;
+	char *mem = NULL, *entries, *rec, **ptrs, **tmp, *readbuf;
+	u_int32_t first, records, chunk, want;
+	size_t capacity, n;
+	int i, j, m, fh = -1, reclen, numruns = 0, maxruns = 0, fanin, spill = -1, spill2 = -1, ret = -1;
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL) || numkeys < 1) {
+		return -1;
+	}
+	memset(&s, 0, sizeof(s));
+	s.p_dbf = p_dbf;
+	s.keys = keys;
+	s.numkeys = numkeys;
+	for (i = 0; i < numkeys; i++) {
+		if (keys[i].column < 0 || keys[i].column >= (int) p_dbf->columns) {
+			return -1;
+		}
+		s.keylen += dbf_SortKeyLength(p_dbf, &keys[i]);
+	}
+	s.keylen += 4;
+	reclen = p_dbf->header->record_length;
+	s.entry = s.keylen + reclen;
+	s.memory = memory_limit > DBF_SORT_MIN_MEMORY ? memory_limit : DBF_SORT_MIN_MEMORY;
+
+	/* two pointers for every entry, a buffer for reading the table and
+	 * the entries themselves */
+	capacity = (s.memory - DBF_SORT_READ) / (s.entry + 2 * sizeof(char *));
+	if (NULL == (mem = malloc(s.memory))) {
+		return -1;
+	}
+	ptrs = (char **) mem;
+	tmp = ptrs + capacity;
+	readbuf = (char *) (tmp + capacity);
+	entries = readbuf + DBF_SORT_READ;
+	memset(&sink, 0, sizeof(sink));
+
+	/* the output is created with the fields of the table */
+	if (NULL == (fields = malloc(p_dbf->columns * sizeof(DB_FIELD)))) {
+		goto out;
+	}
+	memcpy(fields, p_dbf->fields, p_dbf->columns * sizeof(DB_FIELD));
+	if ((fh = open(file, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY|O_LARGEFILE, 0644)) == -1) {
+		goto out;
+	}
+	if (NULL == (out = dbf_CreateFH(fh, fields, p_dbf->columns))) {
+		close(fh);
+		goto out;
+	}
+	/* owned by the output from now on */
+	fields = NULL;
+	if (0 > dbf_BeginBatch(out)) {
+		goto out;
+	}
+
+	records = p_dbf->header->records;
+	chunk = DBF_SORT_READ / reclen ? DBF_SORT_READ / reclen : 1;
+	first = 0;
+	do {
+		/* fill the memory with the next records */
+		for (n = 0; first < records && n < capacity; first += m) {
+			want = records - first < chunk ? records - first : chunk;
+			if (want > capacity - n) {
+				want = capacity - n;
+			}
+			if (0 >= (m = dbf_ReadRecords(p_dbf, first, want, readbuf))) {
+				goto out;
+			}
+			for (j = 0, rec = readbuf; j < m; j++, rec += reclen) {
+				/* deleted records are not copied */
+				if (rec[0] == '*') {
+					continue;
+				}
+				ptrs[n] = entries + n * s.entry;
+				dbf_SortKey(&s, rec, first + j, (unsigned char *) ptrs[n]);
+				memcpy(ptrs[n] + s.keylen, rec, reclen);
+				n++;
+			}
+		}
+
+		/* everything fits, no spill file needed */
+		if (numruns == 0 && first >= records) {
+			sink.out = out;
+			if (0 > dbf_SortRun(&s, ptrs, tmp, n, &sink)) {
+				goto out;
+			}
+			break;
+		}
+
+		if (spill == -1) {
+			if ((spill = dbf_SpillOpen(file)) == -1 || NULL == (sink.buf = malloc(DBF_SORT_WRITE))) {
+				goto out;
+			}
+			sink.fh = spill;
+		}
+		if (numruns == maxruns) {
+			maxruns = maxruns ? 2 * maxruns : 64;
+			if (NULL == (tmpruns = realloc(runs, maxruns * sizeof(DBF_SORT_RUN)))) {
+				goto out;
+			}
+			runs = tmpruns;
+		}
+		runs[numruns].offset = sink.offset + sink.len;
+		sink.count = 0;
+		if (0 > dbf_SortRun(&s, ptrs, tmp, n, &sink)) {
+			goto out;
+		}
+		runs[numruns++].count = sink.count;
+	} while (first < records);
+
+	if (spill != -1) {
+		if (0 > dbf_SinkFlush(&sink)) {
+			goto out;
+		}
+		/* the memory used for sorting now buffers the runs */
+		fanin = (s.memory - DBF_SORT_WRITE) / (DBF_SORT_RUNBUF > s.entry ? DBF_SORT_RUNBUF : s.entry);
+		if (fanin < 2) {
+			fanin = 2;
+		}
+		while (numruns > fanin) {
+			if (spill2 == -1 && (spill2 = dbf_SpillOpen(file)) == -1) {
+				goto out;
+			}
+			if (0 > dbf_SortPass(&s, spill, spill2, runs, &numruns, fanin, mem)) {
+				goto out;
+			}
+			i = spill;
+			spill = spill2;
+			spill2 = i;
+		}
+
+		if (NULL == (src = calloc(numruns, sizeof(DBF_SORT_SOURCE)))) {
+			goto out;
+		}
+		for (i = 0; i < numruns; i++) {
+			src[i].fh = spill;
+			src[i].offset = runs[i].offset;
+			src[i].left = runs[i].count;
+			src[i].bufsize = s.memory / numruns;
+			src[i].buf = mem + i * src[i].bufsize;
+		}
+		sink.out = out;
+		if (0 > dbf_SortMerge(&s, src, numruns, &sink)) {
+			goto out;
+		}
+	}
+
+	if (0 > dbf_CommitBatch(out)) {
+		goto out;
+	}
+	ret = (int) out->header->records;
+
+out:
+	if (out && 0 > dbf_Close(out)) {
+		ret = -1;
+	}
+	/* no half sorted output is left behind */
+	if (ret < 0 && fh != -1) {
+		unlink(file);
+	}
+	if (spill != -1)
+		close(spill);
+	if (spill2 != -1)
+		close(spill2);
+	free(sink.buf);
+	free(src);
+	free(runs);
+	free(fields);
+	free(mem);
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,939 @@
+/*****************************************************************************
+ * dbf_stream.c
+ *****************************************************************************
+ * Reading gzip and zstd compressed tables
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * The uncompressed data is split into chunks which can be decompressed
+ * independently. An index of access points records where each chunk
+ * starts in the compressed and in the uncompressed data, so a record is
+ * found by decompressing a single chunk instead of everything before it.
+ *
+ * gzip: the index is built while the file is read for the first time.
+ * A point is set at the first deflate block boundary after every
+ * DBF_STREAM_SPAN bytes and keeps the last 32 KiB of data as dictionary
+ * (the method of zran.c in the zlib distribution). Every member of a
+ * multi-member file starts a new chunk as well.
+ *
+ * zstd: every frame is a chunk. The seek table of the seekable format
+ * gives the complete index right away, other files are indexed frame by
+ * frame. Frames larger than DBF_STREAM_MAX_CHUNK bytes or without their
+ * size are split into chunks of DBF_STREAM_SPAN bytes, which are decoded
+ * sequentially by a single decoder: reading on continues where it
+ * stopped, going back restarts it at the beginning of the frame.
+ *
+ * Decompressed chunks are kept in a few slots. When the chunks are read
+ * in order and the following ones are already in the index, they are
+ * decompressed in parallel ahead of time, except for chunks decoded
+ * sequentially.
+ *
+ * The index and the slots belong to the handle, so reads from several
+ * threads take turns on a mutex.
+ */
+
+/** Uncompressed bytes between two access points of gzip files and of
+ *  zstd frames decoded sequentially */
+#define DBF_STREAM_SPAN (1024 * 1024)
+/* The test makes the largest frame smaller to get sequential chunks out
+ * of a small table */
+#ifndef DBF_STREAM_MAX_CHUNK
+/** Largest zstd frame decompressed at once */
+#define DBF_STREAM_MAX_CHUNK (64 * 1024 * 1024)
+#endif
+/** Number of decompressed chunks kept in memory */
+#define DBF_STREAM_SLOTS 8
+/** Number of chunks decompressed at once when reading in order */
+#define DBF_STREAM_THREADS 4
+/** Bytes of compressed data read at once */
+#define DBF_STREAM_INPUT 65536
+/** Size of the deflate dictionary */
+#define DBF_GZIP_WINDOW 32768
+
+#define DBF_STREAM_GZIP 1
+#define DBF_STREAM_ZSTD 2
+
+/* Magic number of zstd frames */
+#define DBF_ZSTD_MAGIC 0xFD2FB528U
+/* Largest zstd frame header */
+#define DBF_ZSTD_HEADER_MAX 18
+/* Magic of the seek table footer of the zstd seekable format */
+#define DBF_ZSTD_SEEKABLE_MAGIC 0x8F92EAB1U
+#define DBF_ZSTD_SKIPPABLE_MASK 0xFFFFFFF0U
+#define DBF_ZSTD_SKIPPABLE_MAGIC 0x184D2A50U
+
+typedef struct {
+	/*! start in the compressed file */
+	off_t in;
+	/*! start in the uncompressed data */
+	off_t out;
+	/*! gzip: bits of the byte before in that still belong to the chunk,
+	 *  -1 at the start of a member */
+	int bits;
+	/*! gzip: the 32 KiB of data preceding out */
+	unsigned char *window;
+	/*! zstd: compressed size of the frame */
+	size_t csize;
+	/*! zstd: the chunk is part of a frame decoded sequentially */
+	int sequential;
+	/*! zstd: start of that frame in the uncompressed data */
+	off_t base;
+} DBF_POINT;
+
+typedef struct {
+	/*! index of the access point the chunk starts at, -1 if unused */
+	int point;
+	/*! result of the decompression */
+	int ret;
+	char *data;
+	size_t len;
+	size_t size;
+	unsigned long used;
+} DBF_CHUNK;
+
+struct _DBF_STREAM {
+	int type;
+	int fd;
+	/*! size of the compressed file */
+	off_t size;
+	DBF_POINT *points;
+	int numpoints;
+	int maxpoints;
+	/*! the index covers the whole file */
+	int complete;
+	/*! size of the uncompressed data, once complete */
+	off_t total;
+	DBF_CHUNK slots[DBF_STREAM_SLOTS];
+	unsigned long clock;
+	/*! chunk decompressed last, to recognize reading in order */
+	int last;
+#ifdef HAVE_LIBZSTD
+	/*! decoder of the frame decoded sequentially */
+	ZSTD_DStream *zds;
+	/*! start of that frame in the file, -1 if the decoder is not set up */
+	off_t zframe;
+	/*! next compressed byte to read and next uncompressed byte returned */
+	off_t zin;
+	off_t zout;
+	/*! the decoder reached the end of the frame */
+	int zdone;
+	ZSTD_inBuffer zbuf;
+	unsigned char zinput[DBF_STREAM_INPUT];
+#endif
+#ifdef HAVE_PTHREAD_H
+	/*! guards index and slots */
+	pthread_mutex_t lock;
+#endif
+};
+
+/* static dbf_StreamAddPoint() {{{
+ */
+static DBF_POINT *dbf_StreamAddPoint(DBF_STREAM *s, off_t in, off_t out)
+{
+	DBF_POINT *tmp;
+
+	if (s->numpoints == s->maxpoints) {
+		s->maxpoints = s->maxpoints ? 2 * s->maxpoints : 64;
+		if (NULL == (tmp = realloc(s->points, s->maxpoints * sizeof(DBF_POINT)))) {
+			return NULL;
+		}
+		s->points = tmp;
+	}
+	tmp = &s->points[s->numpoints++];
+	memset(tmp, 0, sizeof(DBF_POINT));
+	tmp->in = in;
+	tmp->out = out;
+	return tmp;
+}
+/* }}} */
+
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD) || defined(HAVE_PTHREAD_H)
+/* static dbf_StreamEnd() {{{
+ * End of the uncompressed data of chunk i, -1 if not known yet
+ */
+static off_t dbf_StreamEnd(DBF_STREAM *s, int i)
+{
+	if (i + 1 < s->numpoints) {
+		return s->points[i + 1].out;
+	}
+	return s->complete ? s->total : -1;
+}
+/* }}} */
+#endif
+
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+/* static dbf_ChunkReserve() {{{
+ */
+static int dbf_ChunkReserve(DBF_CHUNK *c, size_t size)
+{
+	char *tmp;
+
+	if (c->size >= size) {
+		return 0;
+	}
+	if (NULL == (tmp = realloc(c->data, size))) {
+		return -1;
+	}
+	c->data = tmp;
+	c->size = size;
+	return 0;
+}
+/* }}} */
+#endif
+
+#ifdef HAVE_LIBZ
+/* static dbf_GzipMember() {{{
+ * True if a gzip member starts at offset
+ */
+static int dbf_GzipMember(DBF_STREAM *s, off_t offset)
+{
+	unsigned char magic[2];
+
+	return pread(s->fd, magic, 2, offset) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+/* }}} */
+
+/* static dbf_GzipChunk() {{{
+ * Inflates the chunk starting at point i. If the end of the chunk is not
+ * known yet, the next access point is added to the index.
+ */
+static int dbf_GzipChunk(DBF_STREAM *s, int i, DBF_CHUNK *c)
+{
+	DBF_POINT point = s->points[i], *next;
+	unsigned char input[DBF_STREAM_INPUT];
+	unsigned char prime;
+	z_stream strm;
+	off_t pos, end;
+	ssize_t n;
+	int ret;
+
+	end = dbf_StreamEnd(s, i);
+	if (0 > dbf_ChunkReserve(c, end >= 0 ? (size_t) (end - point.out) : DBF_STREAM_SPAN + DBF_STREAM_INPUT)) {
+		return -1;
+	}
+	c->len = 0;
+
+	memset(&strm, 0, sizeof(strm));
+	pos = point.in;
+	if (point.bits < 0) {
+		ret = inflateInit2(&strm, 31);
+	} else {
+		ret = inflateInit2(&strm, -15);
+		if (ret == Z_OK && point.bits) {
+			if (pread(s->fd, &prime, 1, pos - 1) != 1) {
+				inflateEnd(&strm);
+				return -1;
+			}
+			inflatePrime(&strm, point.bits, prime >> (8 - point.bits));
+		}
+		if (ret == Z_OK) {
+			inflateSetDictionary(&strm, point.window, DBF_GZIP_WINDOW);
+		}
+	}
+	if (ret != Z_OK) {
+		return -1;
+	}
+
+	for (;;) {
+		if (strm.avail_in == 0) {
+			if ((n = pread(s->fd, input, sizeof(input), pos)) <= 0) {
+				break;
+			}
+			pos += n;
+			strm.next_in = input;
+			strm.avail_in = n;
+		}
+		if (c->len == c->size && 0 > dbf_ChunkReserve(c, 2 * c->size)) {
+			break;
+		}
+		strm.next_out = (Bytef *) c->data + c->len;
+		strm.avail_out = c->size - c->len;
+		/* Z_BLOCK returns at the end of every deflate block */
+		ret = inflate(&strm, Z_BLOCK);
+		c->len = (char *) strm.next_out - c->data;
+
+		if (ret == Z_STREAM_END) {
+			if (end < 0) {
+				/* the raw stream of a chunk in the middle of a member
+				 * stops in front of the gzip trailer */
+				pos -= strm.avail_in;
+				if (point.bits >= 0) {
+					pos += 8;
+				}
+				if (dbf_GzipMember(s, pos)) {
+					if (NULL == (next = dbf_StreamAddPoint(s, pos, point.out + c->len))) {
+						break;
+					}
+					next->bits = -1;
+				} else {
+					s->complete = 1;
+					s->total = point.out + c->len;
+				}
+			}
+			inflateEnd(&strm);
+			return 0;
+		}
+		if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			break;
+		}
+		if (end >= 0) {
+			if (point.out + (off_t) c->len >= end) {
+				inflateEnd(&strm);
+				return 0;
+			}
+		} else if ((strm.data_type & 128) && !(strm.data_type & 64) && c->len >= DBF_STREAM_SPAN) {
+			/* block boundary, not behind the last block */
+			if (NULL == (next = dbf_StreamAddPoint(s, pos - strm.avail_in, point.out + c->len))) {
+				break;
+			}
+			next->bits = strm.data_type & 7;
+			if (NULL == (next->window = malloc(DBF_GZIP_WINDOW))) {
+				s->numpoints--;
+				break;
+			}
+			memcpy(next->window, c->data + c->len - DBF_GZIP_WINDOW, DBF_GZIP_WINDOW);
+			inflateEnd(&strm);
+			return 0;
+		}
+	}
+
+	/* truncated or corrupt */
+	inflateEnd(&strm);
+	return -1;
+}
+/* }}} */
+#endif
+
+/* static dbf_ZstdRead32() {{{
+ */
+static u_int32_t dbf_ZstdRead32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u_int32_t) p[3] << 24);
+}
+/* }}} */
+
+#ifdef HAVE_LIBZSTD
+/* static dbf_ZstdHeaderSize() {{{
+ * Size of a frame header, computed from the frame header descriptor
+ */
+static size_t dbf_ZstdHeaderSize(unsigned char descriptor)
+{
+	static const size_t dict_id[4] = { 0, 1, 2, 4 };
+	static const size_t content_size[4] = { 0, 2, 4, 8 };
+	int single_segment = (descriptor >> 5) & 1;
+
+	return 5 + (single_segment ? 0 : 1) + dict_id[descriptor & 3]
+		+ ((descriptor >> 6) == 0 ? single_segment : content_size[descriptor >> 6]);
+}
+/* }}} */
+
+/* static dbf_ZstdSkip() {{{
+ * Returns the offset of the next data frame at or behind offset, the
+ * size of the file if there is none and -1 on error
+ */
+static off_t dbf_ZstdSkip(DBF_STREAM *s, off_t offset)
+{
+	unsigned char buf[8];
+
+	while (offset < s->size) {
+		if (pread(s->fd, buf, 8, offset) != 8) {
+			return -1;
+		}
+		if ((dbf_ZstdRead32(buf) & DBF_ZSTD_SKIPPABLE_MASK) != DBF_ZSTD_SKIPPABLE_MAGIC) {
+			return offset;
+		}
+		offset += 8 + (off_t) dbf_ZstdRead32(buf + 4);
+	}
+	return s->size;
+}
+/* }}} */
+
+/* static dbf_ZstdFrameSize() {{{
+ * Walks the block headers of the frame at offset and returns its
+ * compressed size
+ */
+static ssize_t dbf_ZstdFrameSize(DBF_STREAM *s, off_t offset)
+{
+	unsigned char buf[5];
+	int checksum;
+	off_t pos;
+	u_int32_t block;
+
+	if (pread(s->fd, buf, 5, offset) != 5) {
+		return -1;
+	}
+	checksum = buf[4] & 4;
+	pos = offset + dbf_ZstdHeaderSize(buf[4]);
+	do {
+		if (pread(s->fd, buf, 3, pos) != 3) {
+			return -1;
+		}
+		block = buf[0] | (buf[1] << 8) | (buf[2] << 16);
+		/* RLE blocks store a single byte */
+		pos += 3 + (((block >> 1) & 3) == 1 ? 1 : (block >> 3));
+	} while (!(block & 1));
+
+	if (checksum) {
+		pos += 4;
+	}
+	return pos - offset;
+}
+/* }}} */
+
+/* static dbf_ZstdSeekTable() {{{
+ * Reads the index from the seek table of the seekable format
+ */
+static int dbf_ZstdSeekTable(DBF_STREAM *s)
+{
+	unsigned char footer[9], *table;
+	u_int32_t frames, i, entry, csize, content;
+	off_t in, out, pos;
+	size_t len;
+	DBF_POINT *point;
+
+	if (s->size < 9 || pread(s->fd, footer, 9, s->size - 9) != 9
+	 || dbf_ZstdRead32(footer + 5) != DBF_ZSTD_SEEKABLE_MAGIC) {
+		return -1;
+	}
+	frames = dbf_ZstdRead32(footer);
+	entry = (footer[4] & 0x80) ? 12 : 8;
+	len = (size_t) frames * entry;
+	if ((off_t) len + 9 > s->size || NULL == (table = malloc(len ? len : 1))) {
+		return -1;
+	}
+	if (pread(s->fd, table, len, s->size - 9 - len) != (ssize_t) len) {
+		free(table);
+		return -1;
+	}
+
+	in = 0;
+	out = 0;
+	for (i = 0; i < frames; i++) {
+		csize = dbf_ZstdRead32(table + i * entry);
+		content = dbf_ZstdRead32(table + i * entry + 4);
+		/* large frames get a point every DBF_STREAM_SPAN bytes */
+		for (pos = 0; pos == 0 || pos < content; pos += DBF_STREAM_SPAN) {
+			if (NULL == (point = dbf_StreamAddPoint(s, in, out + pos))) {
+				free(table);
+				return -1;
+			}
+			point->csize = csize;
+			point->sequential = content > DBF_STREAM_MAX_CHUNK;
+			point->base = out;
+			if (!point->sequential) {
+				break;
+			}
+		}
+		in += csize;
+		out += content;
+	}
+	free(table);
+
+	s->complete = 1;
+	s->total = out;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_ZstdSequential() {{{
+ * Decodes the chunk starting at point i of a frame that is not
+ * decompressed at once. The decoder continues from the previous chunk of
+ * the frame or restarts at its beginning. If the end of the chunk is not
+ * known yet, the next access point is added to the index.
+ */
+static int dbf_ZstdSequential(DBF_STREAM *s, int i, DBF_CHUNK *c)
+{
+	DBF_POINT point = s->points[i], *next;
+	ZSTD_outBuffer output;
+	off_t end, pos;
+	size_t want, ret;
+	ssize_t n;
+
+	end = dbf_StreamEnd(s, i);
+	want = end >= 0 ? (size_t) (end - point.out) : DBF_STREAM_SPAN;
+	if (0 > dbf_ChunkReserve(c, want ? want : 1)) {
+		return -1;
+	}
+	if (s->zframe != point.in || s->zout > point.out) {
+		if (NULL == s->zds && NULL == (s->zds = ZSTD_createDStream())) {
+			return -1;
+		}
+		ZSTD_DCtx_reset(s->zds, ZSTD_reset_session_only);
+		s->zframe = point.in;
+		s->zin = point.in;
+		s->zout = point.base;
+		s->zdone = 0;
+		s->zbuf.src = s->zinput;
+		s->zbuf.size = 0;
+		s->zbuf.pos = 0;
+	}
+
+	c->len = 0;
+	while (c->len < want && !s->zdone) {
+		if (s->zbuf.pos == s->zbuf.size) {
+			if ((n = pread(s->fd, s->zinput, DBF_STREAM_INPUT, s->zin)) <= 0) {
+				break;
+			}
+			s->zin += n;
+			s->zbuf.size = n;
+			s->zbuf.pos = 0;
+		}
+		/* the data in front of the chunk is decoded into it and dropped */
+		if (s->zout < point.out) {
+			output.dst = c->data;
+			output.size = point.out - s->zout < (off_t) c->size ? (size_t) (point.out - s->zout) : c->size;
+		} else {
+			output.dst = c->data + c->len;
+			output.size = want - c->len;
+		}
+		output.pos = 0;
+		ret = ZSTD_decompressStream(s->zds, &output, &s->zbuf);
+		if (ZSTD_isError(ret)) {
+			break;
+		}
+		if (s->zout >= point.out) {
+			c->len += output.pos;
+		}
+		s->zout += output.pos;
+		s->zdone = ret == 0;
+	}
+	if (c->len < want && (end >= 0 || !s->zdone)) {
+		/* truncated or corrupt */
+		s->zframe = -1;
+		return -1;
+	}
+
+	if (end < 0) {
+		if (!s->zdone) {
+			if (NULL == (next = dbf_StreamAddPoint(s, point.in, point.out + c->len))) {
+				return -1;
+			}
+			next->sequential = 1;
+			next->base = point.base;
+			return 0;
+		}
+		/* the decoder stops at the end of the frame */
+		if ((pos = dbf_ZstdSkip(s, s->zin - (off_t) (s->zbuf.size - s->zbuf.pos))) < 0) {
+			return -1;
+		}
+		if (pos < s->size) {
+			if (NULL == dbf_StreamAddPoint(s, pos, point.out + c->len)) {
+				return -1;
+			}
+		} else {
+			s->complete = 1;
+			s->total = point.out + c->len;
+		}
+	}
+	return 0;
+}
+/* }}} */
+
+/* static dbf_ZstdChunk() {{{
+ * Decompresses the frame starting at point i. If the frame was not
+ * indexed before, the next frame is added to the index.
+ */
+static int dbf_ZstdChunk(DBF_STREAM *s, int i, DBF_CHUNK *c)
+{
+	DBF_POINT point = s->points[i];
+	unsigned char header[DBF_ZSTD_HEADER_MAX];
+	unsigned long long content;
+	ZSTD_DCtx *dctx;
+	char *input;
+	ssize_t csize;
+	off_t end, next;
+	size_t ret;
+	int n;
+
+	if (point.sequential) {
+		return dbf_ZstdSequential(s, i, c);
+	}
+	end = dbf_StreamEnd(s, i);
+	if (end >= 0) {
+		content = end - point.out;
+		csize = point.csize;
+	} else {
+		n = pread(s->fd, header, sizeof(header), point.in);
+		content = n > 0 ? ZSTD_getFrameContentSize(header, n) : ZSTD_CONTENTSIZE_ERROR;
+		if (content == ZSTD_CONTENTSIZE_ERROR) {
+			return -1;
+		}
+		if (content == ZSTD_CONTENTSIZE_UNKNOWN || content > DBF_STREAM_MAX_CHUNK) {
+			s->points[i].sequential = 1;
+			s->points[i].base = point.out;
+			return dbf_ZstdSequential(s, i, c);
+		}
+		if ((csize = dbf_ZstdFrameSize(s, point.in)) < 0) {
+			return -1;
+		}
+	}
+	if (content > DBF_STREAM_MAX_CHUNK || 0 > dbf_ChunkReserve(c, content ? content : 1)) {
+		return -1;
+	}
+	if (NULL == (input = malloc(csize))) {
+		return -1;
+	}
+	if (pread(s->fd, input, csize, point.in) != csize || NULL == (dctx = ZSTD_createDCtx())) {
+		free(input);
+		return -1;
+	}
+	ret = ZSTD_decompressDCtx(dctx, c->data, content, input, csize);
+	ZSTD_freeDCtx(dctx);
+	free(input);
+	if (ZSTD_isError(ret) || ret != content) {
+		return -1;
+	}
+	c->len = content;
+
+	if (end < 0) {
+		s->points[i].csize = csize;
+		if ((next = dbf_ZstdSkip(s, point.in + csize)) < 0) {
+			return -1;
+		}
+		if (next < s->size) {
+			if (NULL == dbf_StreamAddPoint(s, next, point.out + content)) {
+				return -1;
+			}
+		} else {
+			s->complete = 1;
+			s->total = point.out + content;
+		}
+	}
+	return 0;
+}
+/* }}} */
+#endif
+
+/* static dbf_StreamDecode() {{{
+ */
+static int dbf_StreamDecode(DBF_STREAM *s, int i, DBF_CHUNK *c)
+{
+	switch (s->type) {
+#ifdef HAVE_LIBZ
+		case DBF_STREAM_GZIP:
+			return dbf_GzipChunk(s, i, c);
+#endif
+#ifdef HAVE_LIBZSTD
+		case DBF_STREAM_ZSTD:
+			return dbf_ZstdChunk(s, i, c);
+#endif
+		default:
+			/* only used by the decoders built in */
+			(void) i;
+			(void) c;
+			return -1;
+	}
+}
+/* }}} */
+
+#ifdef HAVE_PTHREAD_H
+typedef struct {
+	DBF_STREAM *s;
+	DBF_CHUNK *c;
+} DBF_JOB;
+
+/* static dbf_StreamWorker() {{{
+ */
+static void *dbf_StreamWorker(void *arg)
+{
+	DBF_JOB *job = arg;
+
+	job->c->ret = dbf_StreamDecode(job->s, job->c->point, job->c);
+	return NULL;
+}
+/* }}} */
+#endif
+
+/* static dbf_StreamSlot() {{{
+ * Returns the slot holding chunk i or the least recently used one
+ */
+static DBF_CHUNK *dbf_StreamSlot(DBF_STREAM *s, int i, int *hit)
+{
+	DBF_CHUNK *lru = &s->slots[0];
+	int j;
+
+	for (j = 0; j < DBF_STREAM_SLOTS; j++) {
+		if (s->slots[j].point == i) {
+			*hit = 1;
+			return &s->slots[j];
+		}
+		if (s->slots[j].used < lru->used) {
+			lru = &s->slots[j];
+		}
+	}
+	*hit = 0;
+	return lru;
+}
+/* }}} */
+
+/* static dbf_StreamLoad() {{{
+ * Makes chunk i available, decompressing the chunks following it in
+ * parallel when reading in order
+ */
+static DBF_CHUNK *dbf_StreamLoad(DBF_STREAM *s, int i)
+{
+	DBF_CHUNK *c, *ahead[DBF_STREAM_THREADS];
+	int hit, n, j;
+#ifdef HAVE_PTHREAD_H
+	DBF_JOB jobs[DBF_STREAM_THREADS];
+	pthread_t threads[DBF_STREAM_THREADS];
+	int started[DBF_STREAM_THREADS];
+#endif
+
+	c = dbf_StreamSlot(s, i, &hit);
+	c->used = ++s->clock;
+	if (hit) {
+		return c;
+	}
+	c->point = i;
+
+	/* Only chunks whose end is known can be decompressed independently,
+	 * the others extend the index and have to be read one by one. */
+	ahead[0] = c;
+	n = 1;
+#ifdef HAVE_PTHREAD_H
+	if (i == s->last + 1 && dbf_StreamEnd(s, i) >= 0) {
+		for (j = i + 1; n < DBF_STREAM_THREADS && j < s->numpoints && dbf_StreamEnd(s, j) >= 0
+		 && !s->points[j].sequential; j++) {
+			ahead[n] = dbf_StreamSlot(s, j, &hit);
+			if (hit) {
+				break;
+			}
+			ahead[n]->point = j;
+			ahead[n]->used = ++s->clock;
+			n++;
+		}
+	}
+	for (j = 1; j < n; j++) {
+		jobs[j].s = s;
+		jobs[j].c = ahead[j];
+		started[j] = pthread_create(&threads[j], NULL, dbf_StreamWorker, &jobs[j]) == 0;
+	}
+#endif
+
+	c->ret = dbf_StreamDecode(s, i, c);
+
+#ifdef HAVE_PTHREAD_H
+	for (j = 1; j < n; j++) {
+		if (started[j]) {
+			pthread_join(threads[j], NULL);
+		} else {
+			ahead[j]->ret = dbf_StreamDecode(s, ahead[j]->point, ahead[j]);
+		}
+	}
+#endif
+	for (j = 0; j < n; j++) {
+		if (ahead[j]->ret < 0) {
+			ahead[j]->point = -1;
+		}
+	}
+	if (c->ret < 0) {
+		return NULL;
+	}
+	s->last = i + n - 1;
+	return c;
+}
+/* }}} */
+
+/* static dbf_StreamFind() {{{
+ * Returns the chunk containing offset, extending the index if necessary
+ */
+static DBF_CHUNK *dbf_StreamFind(DBF_STREAM *s, off_t offset)
+{
+	DBF_CHUNK *c;
+	int lo, hi, mid;
+
+	/* extend the index in order until it covers offset */
+	while (!s->complete && s->points[s->numpoints - 1].out <= offset) {
+		if (NULL == (c = dbf_StreamLoad(s, s->numpoints - 1))) {
+			return NULL;
+		}
+		if (offset < s->points[c->point].out + (off_t) c->len) {
+			return c;
+		}
+	}
+	if (s->complete && offset >= s->total) {
+		return NULL;
+	}
+
+	lo = 0;
+	hi = s->numpoints - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (s->points[mid].out <= offset) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return dbf_StreamLoad(s, lo);
+}
+/* }}} */
+
+/* dbf_StreamOpen() {{{
+ * Sets up reading through a decompressor if the file is compressed.
+ * Returns 1 for compressed files, 0 for others and -1 on error.
+ */
+int dbf_StreamOpen(P_DBF *p_dbf)
+{
+	unsigned char magic[4];
+	struct stat st;
+	DBF_STREAM *s;
+	DBF_POINT *point;
+	int type, j;
+
+	if (pread(p_dbf->dbf_fh, magic, 4, 0) != 4) {
+		return 0;
+	}
+	if (magic[0] == 0x1f && magic[1] == 0x8b) {
+		type = DBF_STREAM_GZIP;
+	} else if (dbf_ZstdRead32(magic) == DBF_ZSTD_MAGIC) {
+		type = DBF_STREAM_ZSTD;
+	} else {
+		return 0;
+	}
+#ifndef HAVE_LIBZ
+	if (type == DBF_STREAM_GZIP) {
+		return -1;
+	}
+#endif
+#ifndef HAVE_LIBZSTD
+	if (type == DBF_STREAM_ZSTD) {
+		return -1;
+	}
+#endif
+
+	if (0 > fstat(p_dbf->dbf_fh, &st) || NULL == (s = calloc(1, sizeof(DBF_STREAM)))) {
+		return -1;
+	}
+	s->type = type;
+	s->fd = p_dbf->dbf_fh;
+	s->size = st.st_size;
+	s->last = -1;
+#ifdef HAVE_LIBZSTD
+	s->zframe = -1;
+#endif
+	for (j = 0; j < DBF_STREAM_SLOTS; j++) {
+		s->slots[j].point = -1;
+	}
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&s->lock, NULL);
+#endif
+
+#ifdef HAVE_LIBZSTD
+	if (type == DBF_STREAM_ZSTD && 0 == dbf_ZstdSeekTable(s)) {
+		p_dbf->stream = s;
+		return 1;
+	}
+#endif
+	if (NULL == (point = dbf_StreamAddPoint(s, 0, 0))) {
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_destroy(&s->lock);
+#endif
+		free(s);
+		return -1;
+	}
+	point->bits = -1;
+	p_dbf->stream = s;
+	return 1;
+}
+/* }}} */
+
+/* dbf_StreamPread() {{{
+ * pread() on the uncompressed data
+ */
+ssize_t dbf_StreamPread(P_DBF *p_dbf, void *buf, size_t len, off_t offset)
+{
+	DBF_STREAM *s = p_dbf->stream;
+	DBF_CHUNK *c;
+	size_t done = 0, n;
+	ssize_t ret;
+	off_t start;
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&s->lock);
+#endif
+	ret = 0;
+	while (done < len) {
+		if (NULL == (c = dbf_StreamFind(s, offset))) {
+			/* a short read at the end, an error for damaged files */
+			if (!s->complete || offset < s->total) {
+				ret = -1;
+			}
+			break;
+		}
+		start = s->points[c->point].out;
+		n = c->len - (offset - start);
+		if (n > len - done) {
+			n = len - done;
+		}
+		memcpy((char *) buf + done, c->data + (offset - start), n);
+		done += n;
+		offset += n;
+	}
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&s->lock);
+#endif
+	return ret < 0 ? ret : (ssize_t) done;
+}
+/* }}} */
+
+/* dbf_StreamClose() {{{
+ */
+void dbf_StreamClose(P_DBF *p_dbf)
+{
+	DBF_STREAM *s = p_dbf->stream;
+	int j;
+
+	for (j = 0; j < s->numpoints; j++) {
+		free(s->points[j].window);
+	}
+	for (j = 0; j < DBF_STREAM_SLOTS; j++) {
+		free(s->slots[j].data);
+	}
+	free(s->points);
+#ifdef HAVE_LIBZSTD
+	if (s->zds) {
+		ZSTD_freeDStream(s->zds);
+	}
+#endif
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_destroy(&s->lock);
+#endif
+	free(s);
+	p_dbf->stream = NULL;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
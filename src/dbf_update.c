@@ -0,0 +1,285 @@
+/*****************************************************************************
+ * dbf_update.c
+ *****************************************************************************
+ * Changing records in place
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_PWRITEV
+#include <sys/uio.h>
+#endif
+
+/*
+ * Updates are collected in a small cache of file blocks. A block is read
+ * when it is changed for the first time, so later updates of neighbouring
+ * records cost no I/O at all. When the cache is full, or on dbf_Flush(),
+ * the blocks are written back in the order of their offsets and runs of
+ * adjacent blocks are written with a single system call. With a writable
+ * memory map the updates go straight into the map instead.
+ */
+
+/* static dbf_CacheBlock() {{{
+ * Returns the cached block starting at offset, reading it if necessary
+ */
+static DBF_BLOCK *dbf_CacheBlock(P_DBF *p_dbf, off_t offset)
+{
+	DBF_BLOCK *block;
+	ssize_t n;
+	int i;
+
+	for (i = 0; i < p_dbf->numblocks; i++) {
+		if (p_dbf->blocks[i].offset == offset) {
+			DBF_STAT_ADD(p_dbf, cache_hits, 1);
+			return &p_dbf->blocks[i];
+		}
+	}
+
+	DBF_STAT_ADD(p_dbf, cache_misses, 1);
+	if (p_dbf->numblocks == DBF_CACHE_BLOCKS && 0 > dbf_Flush(p_dbf)) {
+		return NULL;
+	}
+	if (p_dbf->blocks == NULL
+	 && NULL == (p_dbf->blocks = malloc(DBF_CACHE_BLOCKS * sizeof(DBF_BLOCK)))) {
+		return NULL;
+	}
+
+	block = &p_dbf->blocks[p_dbf->numblocks];
+	if ((n = dbf_io_pread(p_dbf, block->data, DBF_BLOCK_SIZE, offset)) == -1) {
+		return NULL;
+	}
+	block->offset = offset;
+	block->len = n;
+	p_dbf->numblocks++;
+	return block;
+}
+/* }}} */
+
+/* static dbf_CacheWrite() {{{
+ * Puts len bytes at offset into the cache
+ */
+static int dbf_CacheWrite(P_DBF *p_dbf, off_t offset, const char *data, size_t len)
+{
+	DBF_BLOCK *blocks[DBF_CACHE_BLOCKS];
+	off_t start;
+	size_t pos, n, left;
+	int i, numblocks, cached;
+
+	if (!(p_dbf->flags & DBF_FLAG_WRITABLE)) {
+		return -1;
+	}
+	if (p_dbf->flags & DBF_FLAG_MAP_WRITE) {
+		if (dbf_io_pwrite(p_dbf, data, len, offset) != (ssize_t) len) {
+			return -1;
+		}
+		p_dbf->flags |= DBF_FLAG_DIRTY;
+		return 0;
+	}
+
+	/* All blocks are fetched before anything is changed, so a failure
+	 * leaves no half updated record behind. Room for them is made first,
+	 * as flushing in between would give the blocks back. */
+	numblocks = (offset % DBF_BLOCK_SIZE + len + DBF_BLOCK_SIZE - 1) / DBF_BLOCK_SIZE;
+	if (numblocks > DBF_CACHE_BLOCKS) {
+		return -1;
+	}
+	if (p_dbf->numblocks + numblocks > DBF_CACHE_BLOCKS && 0 > dbf_Flush(p_dbf)) {
+		return -1;
+	}
+	/* blocks read for an update which fails are given back */
+	cached = p_dbf->numblocks;
+	for (i = 0, start = offset, left = len; left > 0; i++, start += n, left -= n) {
+		if (NULL == (blocks[i] = dbf_CacheBlock(p_dbf, start - start % DBF_BLOCK_SIZE))) {
+			p_dbf->numblocks = cached;
+			return -1;
+		}
+		pos = start - blocks[i]->offset;
+		n = DBF_BLOCK_SIZE - pos < left ? DBF_BLOCK_SIZE - pos : left;
+		/* only records within the file are updated */
+		if (pos + n > blocks[i]->len) {
+			p_dbf->numblocks = cached;
+			return -1;
+		}
+	}
+
+	for (i = 0; len > 0; i++) {
+		pos = offset - blocks[i]->offset;
+		n = DBF_BLOCK_SIZE - pos < len ? DBF_BLOCK_SIZE - pos : len;
+		memcpy(blocks[i]->data + pos, data, n);
+		offset += n;
+		data += n;
+		len -= n;
+	}
+	p_dbf->flags |= DBF_FLAG_DIRTY;
+	return 0;
+}
+/* }}} */
+
+/* dbf_CacheOverlay() {{{
+ * Copies pending updates over data just read from the file
+ */
+void dbf_CacheOverlay(P_DBF *p_dbf, char *buf, off_t offset, size_t len)
+{
+	DBF_BLOCK *block;
+	off_t start, end;
+	int i;
+
+	for (i = 0; i < p_dbf->numblocks; i++) {
+		block = &p_dbf->blocks[i];
+		start = block->offset > offset ? block->offset : offset;
+		end = block->offset + (off_t) block->len < offset + (off_t) len
+			? block->offset + (off_t) block->len : offset + (off_t) len;
+		if (start < end) {
+			memcpy(buf + (start - offset), block->data + (start - block->offset), end - start);
+		}
+	}
+}
+/* }}} */
+
+/* static dbf_CompareBlock() {{{
+ */
+static int dbf_CompareBlock(const void *a, const void *b)
+{
+	const DBF_BLOCK *x = a, *y = b;
+
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+/* }}} */
+
+/* dbf_Flush() {{{
+ * Writes all cached blocks back in the order of their offsets
+ */
+int dbf_Flush(P_DBF *p_dbf)
+{
+	int first, last, locked;
+	size_t len;
+#ifdef HAVE_PWRITEV
+	struct iovec iov[DBF_CACHE_BLOCKS];
+	int i;
+#endif
+
+	if (!(p_dbf->flags & DBF_FLAG_DIRTY)) {
+		/* blocks only read hold nothing to write */
+		p_dbf->numblocks = 0;
+		return 0;
+	}
+
+	qsort(p_dbf->blocks, p_dbf->numblocks, sizeof(DBF_BLOCK), dbf_CompareBlock);
+	for (first = 0; first < p_dbf->numblocks; first = last + 1) {
+		len = p_dbf->blocks[first].len;
+		for (last = first; last + 1 < p_dbf->numblocks; last++) {
+			if (p_dbf->blocks[last].len != DBF_BLOCK_SIZE
+			 || p_dbf->blocks[last + 1].offset != p_dbf->blocks[last].offset + DBF_BLOCK_SIZE) {
+				break;
+			}
+			len += p_dbf->blocks[last + 1].len;
+		}
+#ifdef HAVE_PWRITEV
+		for (i = first; i <= last; i++) {
+			iov[i - first].iov_base = p_dbf->blocks[i].data;
+			iov[i - first].iov_len = p_dbf->blocks[i].len;
+		}
+		if (dbf_io_pwritev(p_dbf, iov, last - first + 1, p_dbf->blocks[first].offset) != (ssize_t) len) {
+			return -1;
+		}
+#else
+		for (; first < last; first++) {
+			if (dbf_io_pwrite(p_dbf, p_dbf->blocks[first].data, p_dbf->blocks[first].len,
+					p_dbf->blocks[first].offset) != (ssize_t) p_dbf->blocks[first].len) {
+				return -1;
+			}
+		}
+		if (dbf_io_pwrite(p_dbf, p_dbf->blocks[last].data, p_dbf->blocks[last].len,
+				p_dbf->blocks[last].offset) != (ssize_t) p_dbf->blocks[last].len) {
+			return -1;
+		}
+#endif
+	}
+	p_dbf->numblocks = 0;
+
+	if (p_dbf->flags & DBF_FLAG_MAP_WRITE) {
+		dbf_io_sync_map(p_dbf);
+	}
+
+	/* a single header update with the date of the last change */
+	if (0 > (locked = dbf_AutoLock(p_dbf, DBF_LOCK_EXCLUSIVE))) {
+		return -1;
+	}
+	/* Other processes may have appended records in the meantime. A batch
+	 * or appends of this handle own the count and hold the lock anyway. */
+	if (p_dbf->lock_scheme != DBF_LOCK_NONE && !(p_dbf->flags & (DBF_FLAG_BATCH | DBF_FLAG_APPEND))
+	 && 0 > dbf_ReadRecordCount(p_dbf)) {
+		dbf_AutoUnlock(p_dbf, locked);
+		return -1;
+	}
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header)) {
+		dbf_AutoUnlock(p_dbf, locked);
+		return -1;
+	}
+	dbf_AutoUnlock(p_dbf, locked);
+	p_dbf->flags &= ~DBF_FLAG_DIRTY;
+	return 0;
+}
+/* }}} */
+
+/* dbf_UpdateRecord() {{{
+ */
+int dbf_UpdateRecord(P_DBF *p_dbf, u_int32_t recno, const char *record, int len)
+{
+	if (len != p_dbf->header->record_length - 1) {
+		fprintf(stderr, _("Length of record mismatches expected length (%d != %d)."), len, p_dbf->header->record_length);
+		fprintf(stderr, "\n");
+		return -1;
+	}
+	if (recno >= p_dbf->header->records) {
+		return -1;
+	}
+
+	/* the deletion flag is kept as it is */
+	return dbf_CacheWrite(p_dbf, DBF_RECORD_OFFSET(p_dbf, recno) + 1, record, len);
+}
+/* }}} */
+
+/* dbf_UpdateField() {{{
+ */
+int dbf_UpdateField(P_DBF *p_dbf, u_int32_t recno, int column, const char *data, int len)
+{
+	char buf[256];
+	int size;
+
+	if (column < 0 || column >= (int) p_dbf->columns || recno >= p_dbf->header->records) {
+		return -1;
+	}
+	size = p_dbf->fields[column].field_length;
+	if (len < 0 || len > size) {
+		return -1;
+	}
+
+	/* shorter values are padded with blanks */
+	memcpy(buf, data, len);
+	memset(buf + len, ' ', size - len);
+
+	return dbf_CacheWrite(p_dbf, DBF_RECORD_OFFSET(p_dbf, recno) + p_dbf->fields[column].field_offset, buf, size);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,429 @@
+/*****************************************************************************
+ * dbf_verify.c
+ *****************************************************************************
+ * Checking the integrity of a table and repairing its header
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * The size of the file, the header and the field descriptors are checked
+ * first, which costs no more than a stat. Then the records are read in
+ * large blocks, by several threads each one taking a range of records,
+ * checking the deletion flags and, if asked for, every field against its
+ * type. Only records completely present in the file are read.
+ */
+
+/* Bytes of records read at once */
+#define DBF_VERIFY_CHUNK (1024 * 1024)
+/* Largest number of threads */
+#define DBF_VERIFY_THREADS 64
+
+/* Work of one thread */
+typedef struct {
+	P_DBF *p_dbf;
+	int fields;
+	u_int32_t first;
+	u_int32_t last;
+	u_int64_t bad_flags;
+	u_int64_t bad_fields;
+	int64_t first_bad;
+	int ret;
+} DBF_VERIFY_JOB;
+
+/* static dbf_VerifyNumber() {{{
+ * Returns 1 if a numeric field is blank or holds a number
+ */
+static int dbf_VerifyNumber(const char *p, int len, int exponent)
+{
+	int i = 0, digits = 0;
+
+	while (i < len && p[i] == ' ')
+		i++;
+	if (i == len)
+		return 1;
+	if (p[i] == '-' || p[i] == '+')
+		i++;
+	for (; i < len && p[i] >= '0' && p[i] <= '9'; i++)
+		digits++;
+	if (i < len && p[i] == '.') {
+		for (i++; i < len && p[i] >= '0' && p[i] <= '9'; i++)
+			digits++;
+	}
+	if (!digits)
+		return 0;
+	if (exponent && i < len && (p[i] == 'e' || p[i] == 'E')) {
+		i++;
+		if (i < len && (p[i] == '-' || p[i] == '+'))
+			i++;
+		for (digits = 0; i < len && p[i] >= '0' && p[i] <= '9'; i++)
+			digits++;
+		if (!digits)
+			return 0;
+	}
+	while (i < len && p[i] == ' ')
+		i++;
+	return i == len;
+}
+/* }}} */
+
+/* static dbf_VerifyDate() {{{
+ * Returns 1 if a date field is blank or holds a date YYYYMMDD
+ */
+static int dbf_VerifyDate(const char *p, int len)
+{
+	int i, month, day;
+
+	for (i = 0; i < len && p[i] == ' '; i++)
+		;
+	if (i == len)
+		return 1;
+	if (len != 8)
+		return 0;
+	for (i = 0; i < 8; i++) {
+		if (p[i] < '0' || p[i] > '9')
+			return 0;
+	}
+	month = 10 * (p[4] - '0') + p[5] - '0';
+	day = 10 * (p[6] - '0') + p[7] - '0';
+	return month >= 1 && month <= 12 && day >= 1 && day <= 31;
+}
+/* }}} */
+
+/* static dbf_VerifyField() {{{
+ * Returns 1 if the contents of a field fit its type
+ */
+static int dbf_VerifyField(const DB_FIELD *field, const char *p)
+{
+	int i, len = field->field_length;
+
+	switch (field->field_type) {
+		case 'N':
+			return dbf_VerifyNumber(p, len, 0);
+		case 'F':
+			return dbf_VerifyNumber(p, len, 1);
+		case 'D':
+			return dbf_VerifyDate(p, len);
+		case 'L':
+			return len == 1 && strchr(" ?YyNnTtFf", p[0]) != NULL && p[0] != '\0';
+		case 'M':
+			/* block numbers in text, binary ones are not checked */
+			if (len != 10)
+				return 1;
+			for (i = 0; i < len && p[i] == ' '; i++)
+				;
+			for (; i < len && p[i] >= '0' && p[i] <= '9'; i++)
+				;
+			return i == len;
+		default:
+			return 1;
+	}
+}
+/* }}} */
+
+/* static dbf_VerifyRecords() {{{
+ * Checks the records of a job, runs in its own thread
+ */
+static void *dbf_VerifyRecords(void *arg)
+{
+	DBF_VERIFY_JOB *job = arg;
+	P_DBF *p_dbf = job->p_dbf;
+	int reclen = p_dbf->header->record_length;
+	u_int32_t first, chunk;
+	const char *rec;
+	char *buf;
+	int i, c, n, bad;
+
+	job->first_bad = -1;
+	job->ret = -1;
+	chunk = DBF_VERIFY_CHUNK / reclen ? DBF_VERIFY_CHUNK / reclen : 1;
+	if (NULL == (buf = malloc((size_t) chunk * reclen))) {
+		return NULL;
+	}
+
+	for (first = job->first; first < job->last; first += n) {
+		n = dbf_ReadRecords(p_dbf, first, job->last - first < chunk ? job->last - first : chunk, buf);
+		if (n <= 0) {
+			free(buf);
+			return NULL;
+		}
+		for (i = 0, rec = buf; i < n; i++, rec += reclen) {
+			bad = rec[0] != ' ' && rec[0] != '*';
+			if (bad) {
+				job->bad_flags++;
+			}
+			for (c = 0; job->fields && c < (int) p_dbf->columns; c++) {
+				if (!dbf_VerifyField(&p_dbf->fields[c], rec + p_dbf->fields[c].field_offset)) {
+					job->bad_fields++;
+					bad = 1;
+				}
+			}
+			if (bad && job->first_bad < 0) {
+				job->first_bad = first + i;
+			}
+		}
+	}
+	free(buf);
+	job->ret = 0;
+	return NULL;
+}
+/* }}} */
+
+/* static dbf_VerifyLayout() {{{
+ * Returns 1 if header and field descriptors agree
+ */
+static int dbf_VerifyLayout(P_DBF *p_dbf)
+{
+	u_int32_t i, reclen = 1;
+
+	for (i = 0; i < p_dbf->columns; i++) {
+		if (p_dbf->fields[i].field_length == 0 || p_dbf->fields[i].field_type < 'A'
+		 || p_dbf->fields[i].field_type > 'Z' || p_dbf->fields[i].field_name[0] == '\0') {
+			return 0;
+		}
+		reclen += p_dbf->fields[i].field_length;
+	}
+	/* the descriptors and their terminator fit into the header */
+	return reclen == p_dbf->header->record_length
+		&& p_dbf->header->header_length >= sizeof(DB_HEADER) + p_dbf->columns * sizeof(DB_FIELD) + 1;
+}
+/* }}} */
+
+/* static dbf_VerifySize() {{{
+ * Compares the size of the file with the header
+ */
+static int dbf_VerifySize(P_DBF *p_dbf, DBF_VERIFY *v)
+{
+	struct stat st;
+	off_t data;
+	char marker;
+	int reclen = p_dbf->header->record_length;
+
+	p_dbf->calc_filesize = DBF_RECORD_OFFSET(p_dbf, p_dbf->header->records);
+	v->expected_size = p_dbf->calc_filesize;
+	/* the size of a compressed file or a shared segment says nothing */
+	if (p_dbf->stream || p_dbf->shared) {
+		v->file_size = v->expected_size;
+		v->records_in_file = p_dbf->header->records;
+		return 0;
+	}
+	if (0 > fstat(p_dbf->dbf_fh, &st)) {
+		return -1;
+	}
+	p_dbf->real_filesize = st.st_size;
+	v->file_size = st.st_size;
+
+	data = st.st_size - p_dbf->header->header_length;
+	if (data < 0) {
+		v->problems |= DBF_PROBLEM_SIZE;
+		return 0;
+	}
+	/* a single end marker after the last record is allowed */
+	if (data % reclen == 1 && dbf_io_pread(p_dbf, &marker, 1, st.st_size - 1) == 1 && marker == 0x1A) {
+		v->eof_marker = 1;
+		data--;
+	}
+	v->records_in_file = data / reclen;
+	if (data % reclen) {
+		v->problems |= DBF_PROBLEM_SIZE;
+	}
+	if (v->records_in_file != p_dbf->header->records) {
+		v->problems |= DBF_PROBLEM_COUNT;
+	}
+	return 0;
+}
+/* }}} */
+
+/* dbf_Verify() {{{
+ */
+int dbf_Verify(P_DBF *p_dbf, int flags, int threads, DBF_VERIFY *v)
+{
+	DBF_VERIFY_JOB *jobs;
+	u_int32_t records;
+	int i, ret = 0;
+#ifdef HAVE_PTHREAD_H
+	pthread_t tids[DBF_VERIFY_THREADS];
+	int started[DBF_VERIFY_THREADS];
+#endif
+
+	memset(v, 0, sizeof(DBF_VERIFY));
+	v->first_bad = -1;
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL)) {
+		return -1;
+	}
+	if (!dbf_VerifyLayout(p_dbf)) {
+		v->problems |= DBF_PROBLEM_HEADER;
+	}
+	if (p_dbf->header->transaction) {
+		v->problems |= DBF_PROBLEM_TRANSACTION;
+	}
+	if (0 > dbf_VerifySize(p_dbf, v)) {
+		return -1;
+	}
+
+	/* records are only read if the fields can be found in them */
+	if (!(v->problems & DBF_PROBLEM_HEADER)) {
+		records = v->records_in_file < p_dbf->header->records
+			? (u_int32_t) v->records_in_file : p_dbf->header->records;
+		if (threads < 1) {
+			threads = 1;
+		}
+		if (threads > DBF_VERIFY_THREADS) {
+			threads = DBF_VERIFY_THREADS;
+		}
+		/* reads of a compressed file take turns, and tiny tables gain nothing */
+		if (p_dbf->stream || records < 4096 * (u_int32_t) threads) {
+			threads = 1;
+		}
+		if (NULL == (jobs = calloc(threads, sizeof(DBF_VERIFY_JOB)))) {
+			return -1;
+		}
+		for (i = 0; i < threads; i++) {
+			jobs[i].p_dbf = p_dbf;
+			jobs[i].fields = flags & DBF_VERIFY_FIELDS;
+			jobs[i].first = (u_int32_t) ((u_int64_t) records * i / threads);
+			jobs[i].last = (u_int32_t) ((u_int64_t) records * (i + 1) / threads);
+		}
+
+#ifdef HAVE_PTHREAD_H
+		for (i = 1; i < threads; i++) {
+			started[i] = pthread_create(&tids[i], NULL, dbf_VerifyRecords, &jobs[i]) == 0;
+		}
+#endif
+		dbf_VerifyRecords(&jobs[0]);
+#ifdef HAVE_PTHREAD_H
+		for (i = 1; i < threads; i++) {
+			if (started[i]) {
+				pthread_join(tids[i], NULL);
+			} else {
+				dbf_VerifyRecords(&jobs[i]);
+			}
+		}
+#else
+		for (i = 1; i < threads; i++) {
+			dbf_VerifyRecords(&jobs[i]);
+		}
+#endif
+
+		for (i = 0; i < threads; i++) {
+			if (jobs[i].ret) {
+				ret = -1;
+			}
+			v->bad_flags += jobs[i].bad_flags;
+			v->bad_fields += jobs[i].bad_fields;
+			/* the jobs are in the order of the records */
+			if (v->first_bad < 0) {
+				v->first_bad = jobs[i].first_bad;
+			}
+		}
+		free(jobs);
+		if (v->bad_flags) {
+			v->problems |= DBF_PROBLEM_FLAGS;
+		}
+		if (v->bad_fields) {
+			v->problems |= DBF_PROBLEM_FIELDS;
+		}
+	}
+
+	if (v->problems) {
+		strcpy((char *) p_dbf->integrity, "invalid");
+	} else {
+		strcpy((char *) p_dbf->integrity, "valid");
+	}
+	return ret;
+}
+/* }}} */
+
+/* dbf_Repair() {{{
+ */
+int dbf_Repair(P_DBF *p_dbf)
+{
+	DBF_VERIFY v;
+	int locked, repaired = 0, ret = -1;
+
+	if (!(p_dbf->flags & DBF_FLAG_WRITABLE) || (p_dbf->flags & (DBF_FLAG_BATCH | DBF_FLAG_APPEND))
+	 || p_dbf->map || p_dbf->stream) {
+		return -1;
+	}
+	if (0 > (locked = dbf_AutoLock(p_dbf, DBF_LOCK_EXCLUSIVE))) {
+		return -1;
+	}
+	if (0 > dbf_Flush(p_dbf) || 0 > dbf_ReadRecordCount(p_dbf)) {
+		goto out;
+	}
+
+	/* the records of an interrupted batch are removed, the end marker
+	 * written behind the batch goes with them */
+	if (p_dbf->header->transaction) {
+		if (0 > ftruncate(p_dbf->dbf_fh, DBF_RECORD_OFFSET(p_dbf, p_dbf->header->records))
+		 || dbf_io_pwrite(p_dbf, "\x1A", 1, DBF_RECORD_OFFSET(p_dbf, p_dbf->header->records)) != 1) {
+			goto out;
+		}
+		p_dbf->header->transaction = 0;
+		repaired |= DBF_PROBLEM_TRANSACTION;
+	}
+
+	memset(&v, 0, sizeof(v));
+	if (!dbf_VerifyLayout(p_dbf)) {
+		fprintf(stderr, _("Header and field descriptors do not agree, the table cannot be repaired."));
+		fprintf(stderr, "\n");
+		goto out;
+	}
+	if (0 > dbf_VerifySize(p_dbf, &v)) {
+		goto out;
+	}
+	if (v.file_size < p_dbf->header->header_length || v.records_in_file > 0xffffffffULL) {
+		goto out;
+	}
+
+	/* a partly written record at the end is cut off */
+	if (v.problems & DBF_PROBLEM_SIZE) {
+		if (0 > ftruncate(p_dbf->dbf_fh, DBF_RECORD_OFFSET(p_dbf, v.records_in_file))
+		 || dbf_io_pwrite(p_dbf, "\x1A", 1, DBF_RECORD_OFFSET(p_dbf, v.records_in_file)) != 1) {
+			goto out;
+		}
+		v.eof_marker = 1;
+		repaired |= DBF_PROBLEM_SIZE;
+	}
+	/* the header gets the number of records found in the file */
+	if (v.problems & DBF_PROBLEM_COUNT) {
+		p_dbf->header->records = (u_int32_t) v.records_in_file;
+		repaired |= DBF_PROBLEM_COUNT;
+	}
+	if (repaired && 0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header)) {
+		goto out;
+	}
+	p_dbf->calc_filesize = DBF_RECORD_OFFSET(p_dbf, p_dbf->header->records);
+	p_dbf->real_filesize = p_dbf->calc_filesize + v.eof_marker;
+	ret = repaired;
+
+out:
+	dbf_AutoUnlock(p_dbf, locked);
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,546 @@
+/*****************************************************************************
+ * dbf_zonemap.c
+ *****************************************************************************
+ * Minimum and maximum of blocks of records for skipping them in range scans
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "config.h"
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+#include "dbf_io.h"
+
+#include <math.h>
+
+/*
+ * A zone map divides the table into blocks of a fixed number of records
+ * and keeps, for every block and every column of type C, D, N or F, the
+ * smallest and the largest value and the number of blank fields. It is
+ * stored in <table>.zmap in the byte order of the machine that wrote it:
+ *
+ *   DBF_ZONEMAP_HEADER
+ *   for every block, for every column:
+ *     u_int32_t blank fields
+ *     C, D: smallest and largest value as stored in the field
+ *     N, F: smallest and largest value as doubles
+ *
+ * Characters and dates are compared byte by byte, which orders dates
+ * stored as YYYYMMDD correctly. The zone map belongs to the table as it
+ * was when the map was built; once the number of records, the date of
+ * the last update, the fields or the size and modification time of the
+ * file change, it is not used anymore. The date alone only has a day's
+ * resolution and misses records rewritten in place on the same day.
+ */
+
+/* Bytes of records read at once */
+#define DBF_ZONEMAP_CHUNK (1024 * 1024)
+#define DBF_ZONEMAP_MAGIC "DBFZMAP2"
+#define DBF_ZONEMAP_ORDER 0x01020304
+
+typedef struct {
+	char magic[8];
+	u_int32_t order;
+	u_int32_t records;
+	u_int32_t layout;
+	u_int32_t block;
+	u_int32_t numblocks;
+	u_int32_t columns;
+	unsigned char last_update[4];
+	u_int64_t size;
+	int64_t mtime;
+	int64_t mtime_nsec;
+} DBF_ZONEMAP_HEADER;
+
+struct _DBF_ZONEMAP {
+	DBF_ZONEMAP_HEADER header;
+	/*! offset of every column within a block entry, -1 if not kept */
+	long *offsets;
+	/*! bytes of all columns of a block */
+	size_t rowsize;
+	char *data;
+};
+
+/* static dbf_ZoneMapKind() {{{
+ * 1 for columns compared as bytes, 2 for numbers, 0 for other types
+ */
+static int dbf_ZoneMapKind(const DB_FIELD *field)
+{
+	switch (field->field_type) {
+		case 'C':
+		case 'D':
+			return 1;
+		case 'N':
+		case 'F':
+			return 2;
+		default:
+			return 0;
+	}
+}
+/* }}} */
+
+/* static dbf_ZoneMapLayout() {{{
+ * Computes the position of the columns in a block entry
+ */
+static int dbf_ZoneMapLayout(P_DBF *p_dbf, DBF_ZONEMAP *zm)
+{
+	u_int32_t i;
+
+	if (NULL == (zm->offsets = malloc((p_dbf->columns + 1) * sizeof(long)))) {
+		return -1;
+	}
+	zm->rowsize = 0;
+	for (i = 0; i < p_dbf->columns; i++) {
+		switch (dbf_ZoneMapKind(&p_dbf->fields[i])) {
+			case 1:
+				zm->offsets[i] = zm->rowsize;
+				zm->rowsize += sizeof(u_int32_t) + 2 * p_dbf->fields[i].field_length;
+				break;
+			case 2:
+				zm->offsets[i] = zm->rowsize;
+				zm->rowsize += sizeof(u_int32_t) + 2 * sizeof(double);
+				break;
+			default:
+				zm->offsets[i] = -1;
+		}
+	}
+	/* keep the doubles aligned */
+	zm->rowsize = (zm->rowsize + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+	return 0;
+}
+/* }}} */
+
+/* static dbf_IsBlank() {{{
+ */
+static int dbf_IsBlank(const char *p, int len)
+{
+	while (len > 0 && p[len - 1] == ' ')
+		len--;
+	return len == 0;
+}
+/* }}} */
+
+/* static dbf_ZoneMapAdd() {{{
+ * Takes the record at position pos of its block into the entry of the block
+ */
+static void dbf_ZoneMapAdd(P_DBF *p_dbf, DBF_ZONEMAP *zm, char *entry, const char *rec, u_int32_t pos)
+{
+	const char *p;
+	char *e;
+	double value, v;
+	u_int32_t i, blank;
+	int len, first;
+
+	if (pos == 0) {
+		memset(entry, 0, zm->rowsize);
+	}
+	for (i = 0; i < p_dbf->columns; i++) {
+		if (zm->offsets[i] < 0) {
+			continue;
+		}
+		e = entry + zm->offsets[i];
+		p = rec + p_dbf->fields[i].field_offset;
+		len = p_dbf->fields[i].field_length;
+		memcpy(&blank, e, sizeof(u_int32_t));
+		/* no value in the block so far */
+		first = blank == pos;
+
+		if (dbf_ZoneMapKind(&p_dbf->fields[i]) == 1) {
+			if (dbf_IsBlank(p, len)) {
+				blank++;
+				memcpy(e, &blank, sizeof(u_int32_t));
+				continue;
+			}
+			e += sizeof(u_int32_t);
+			if (first || memcmp(p, e, len) < 0)
+				memcpy(e, p, len);
+			if (first || memcmp(p, e + len, len) > 0)
+				memcpy(e + len, p, len);
+		} else {
+			if (!dbf_ParseNumber(p, len, &value)) {
+				blank++;
+				memcpy(e, &blank, sizeof(u_int32_t));
+				continue;
+			}
+			e += sizeof(u_int32_t);
+			memcpy(&v, e, sizeof(double));
+			if (first || value < v)
+				memcpy(e, &value, sizeof(double));
+			memcpy(&v, e + sizeof(double), sizeof(double));
+			if (first || value > v)
+				memcpy(e + sizeof(double), &value, sizeof(double));
+		}
+	}
+}
+/* }}} */
+
+/* static dbf_ZoneMapStamp() {{{
+ * Fills the size and modification time of the table from fstat()
+ */
+static int dbf_ZoneMapStamp(P_DBF *p_dbf, DBF_ZONEMAP_HEADER *header)
+{
+	struct stat st;
+
+	if (0 > fstat(p_dbf->dbf_fh, &st)) {
+		return -1;
+	}
+	header->size = st.st_size;
+	header->mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	header->mtime_nsec = st.st_mtim.tv_nsec;
+#else
+	header->mtime_nsec = 0;
+#endif
+	return 0;
+}
+/* }}} */
+
+/* static dbf_ZoneMapPath() {{{
+ */
+static char *dbf_ZoneMapPath(const char *file, const char *suffix)
+{
+	char *path;
+
+	if (NULL != (path = malloc(strlen(file) + strlen(suffix) + 1))) {
+		strcpy(path, file);
+		strcat(path, suffix);
+	}
+	return path;
+}
+/* }}} */
+
+/* dbf_ZoneMapBuild() {{{
+ * Scans the table once and writes the zone map next to it
+ */
+int dbf_ZoneMapBuild(P_DBF *p_dbf, const char *file, u_int32_t block)
+{
+	DBF_ZONEMAP zm;
+	char *buf = NULL, *path = NULL, *tmp = NULL;
+	const char *rec;
+	u_int32_t first, chunk, recno;
+	size_t len;
+	int i, n, reclen, fh = -1, ret = -1;
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL) || block == 0) {
+		return -1;
+	}
+	memset(&zm, 0, sizeof(zm));
+	if (0 > dbf_ZoneMapLayout(p_dbf, &zm)) {
+		return -1;
+	}
+
+	memcpy(zm.header.magic, DBF_ZONEMAP_MAGIC, 8);
+	zm.header.order = DBF_ZONEMAP_ORDER;
+	zm.header.records = p_dbf->header->records;
+	zm.header.layout = dbf_LayoutHash(p_dbf);
+	zm.header.block = block;
+	zm.header.numblocks = (u_int32_t) (((u_int64_t) zm.header.records + block - 1) / block);
+	zm.header.columns = p_dbf->columns;
+	memcpy(zm.header.last_update, p_dbf->header->last_update, 3);
+	/* taken before the scan, a change during it outdates the map */
+	if (0 > dbf_ZoneMapStamp(p_dbf, &zm.header)) {
+		free(zm.offsets);
+		return -1;
+	}
+
+	reclen = p_dbf->header->record_length;
+	chunk = DBF_ZONEMAP_CHUNK / reclen ? DBF_ZONEMAP_CHUNK / reclen : 1;
+	len = (size_t) zm.header.numblocks * zm.rowsize;
+	if (NULL == (zm.data = malloc(len + 1)) || NULL == (buf = malloc((size_t) chunk * reclen))) {
+		goto out;
+	}
+
+	for (first = 0; first < zm.header.records; first += n) {
+		n = dbf_ReadRecords(p_dbf, first, zm.header.records - first < chunk ? zm.header.records - first : chunk, buf);
+		if (n <= 0) {
+			goto out;
+		}
+		for (i = 0, rec = buf; i < n; i++, rec += reclen) {
+			recno = first + i;
+			dbf_ZoneMapAdd(p_dbf, &zm, zm.data + (size_t) (recno / block) * zm.rowsize, rec, recno % block);
+		}
+	}
+
+	/* written under another name and renamed, readers never see half a map */
+	if (NULL == (path = dbf_ZoneMapPath(file, ".zmap")) || NULL == (tmp = dbf_ZoneMapPath(file, ".zmap.tmp"))) {
+		goto out;
+	}
+	if ((fh = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0644)) == -1) {
+		goto out;
+	}
+	if (write(fh, &zm.header, sizeof(zm.header)) != (ssize_t) sizeof(zm.header)
+	 || (len && write(fh, zm.data, len) != (ssize_t) len)
+	 || close(fh) != 0) {
+		if (fh != -1)
+			close(fh);
+		unlink(tmp);
+		goto out;
+	}
+	if (rename(tmp, path) != 0) {
+		unlink(tmp);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	free(tmp);
+	free(path);
+	free(buf);
+	free(zm.data);
+	free(zm.offsets);
+	return ret;
+}
+/* }}} */
+
+/* dbf_ZoneMapOpen() {{{
+ * Reads the zone map of a table, NULL if there is none or it is outdated
+ */
+DBF_ZONEMAP *dbf_ZoneMapOpen(P_DBF *p_dbf, const char *file)
+{
+	DBF_ZONEMAP *zm;
+	DBF_ZONEMAP_HEADER now;
+	char *path;
+	size_t len;
+	int fh;
+
+	if (0 > dbf_ZoneMapStamp(p_dbf, &now)) {
+		return NULL;
+	}
+
+	if (NULL == (path = dbf_ZoneMapPath(file, ".zmap"))) {
+		return NULL;
+	}
+	fh = open(path, O_RDONLY|O_BINARY);
+	free(path);
+	if (fh == -1) {
+		return NULL;
+	}
+	if (NULL == (zm = calloc(1, sizeof(DBF_ZONEMAP)))) {
+		close(fh);
+		return NULL;
+	}
+
+	if (read(fh, &zm->header, sizeof(zm->header)) != (ssize_t) sizeof(zm->header)
+	 || memcmp(zm->header.magic, DBF_ZONEMAP_MAGIC, 8)
+	 || zm->header.order != DBF_ZONEMAP_ORDER
+	 || zm->header.records != p_dbf->header->records
+	 || memcmp(zm->header.last_update, p_dbf->header->last_update, 3)
+	 || zm->header.size != now.size
+	 || zm->header.mtime != now.mtime
+	 || zm->header.mtime_nsec != now.mtime_nsec
+	 || zm->header.columns != p_dbf->columns
+	 || zm->header.layout != dbf_LayoutHash(p_dbf)
+	 || zm->header.block == 0
+	 || zm->header.numblocks != (u_int32_t) (((u_int64_t) zm->header.records + zm->header.block - 1) / zm->header.block)
+	 || 0 > dbf_ZoneMapLayout(p_dbf, zm)) {
+		goto fail;
+	}
+	len = (size_t) zm->header.numblocks * zm->rowsize;
+	if (NULL == (zm->data = malloc(len + 1))
+	 || (len && read(fh, zm->data, len) != (ssize_t) len)) {
+		goto fail;
+	}
+	close(fh);
+	return zm;
+
+fail:
+	close(fh);
+	dbf_ZoneMapClose(zm);
+	return NULL;
+}
+/* }}} */
+
+/* dbf_ZoneMapClose() {{{
+ */
+void dbf_ZoneMapClose(DBF_ZONEMAP *zm)
+{
+	free(zm->offsets);
+	free(zm->data);
+	free(zm);
+}
+/* }}} */
+
+/* Bounds of a range scan prepared for the type of the column */
+typedef struct {
+	int kind;
+	int len;
+	char *low;
+	char *high;
+	double nlow;
+	double nhigh;
+} DBF_RANGE;
+
+/* static dbf_RangeBound() {{{
+ * A bound padded with blanks or cut to the length of the field
+ */
+static char *dbf_RangeBound(const char *value, int len)
+{
+	char *bound;
+	int n;
+
+	if (value == NULL || NULL == (bound = malloc(len + 1))) {
+		return NULL;
+	}
+	n = strlen(value) < (size_t) len ? (int) strlen(value) : len;
+	memcpy(bound, value, n);
+	memset(bound + n, ' ', len - n);
+	return bound;
+}
+/* }}} */
+
+/* static dbf_RangeNumber() {{{
+ * Parses a numeric bound, -1 unless the whole string is a number
+ */
+static int dbf_RangeNumber(const char *value, double *number)
+{
+	return dbf_ParseNumber(value, strlen(value), number) ? 0 : -1;
+}
+/* }}} */
+
+/* static dbf_RangeValue() {{{
+ * True if the field lies within the range
+ */
+static int dbf_RangeValue(const DBF_RANGE *r, const char *p)
+{
+	double value;
+
+	if (r->kind == 1) {
+		if (dbf_IsBlank(p, r->len))
+			return 0;
+		return (!r->low || memcmp(p, r->low, r->len) >= 0)
+			&& (!r->high || memcmp(p, r->high, r->len) <= 0);
+	}
+	if (!dbf_ParseNumber(p, r->len, &value))
+		return 0;
+	return value >= r->nlow && value <= r->nhigh;
+}
+/* }}} */
+
+/* static dbf_RangeBlock() {{{
+ * True if the block may hold records within the range
+ */
+static int dbf_RangeBlock(const DBF_RANGE *r, const char *e, u_int32_t records)
+{
+	double min, max;
+	u_int32_t blank;
+
+	memcpy(&blank, e, sizeof(u_int32_t));
+	if (blank >= records) {
+		return 0;
+	}
+	e += sizeof(u_int32_t);
+	if (r->kind == 1) {
+		return (!r->high || memcmp(e, r->high, r->len) <= 0)
+			&& (!r->low || memcmp(e + r->len, r->low, r->len) >= 0);
+	}
+	memcpy(&min, e, sizeof(double));
+	memcpy(&max, e + sizeof(double), sizeof(double));
+	return min <= r->nhigh && max >= r->nlow;
+}
+/* }}} */
+
+/* dbf_ScanRange() {{{
+ */
+int dbf_ScanRange(P_DBF *p_dbf, DBF_ZONEMAP *zm, int column, const char *low, const char *high,
+	DBF_RECORD_CALLBACK callback, void *data)
+{
+	DBF_RANGE r;
+	char *buf = NULL;
+	const char *rec;
+	u_int32_t records, first, end, chunk, b, block;
+	int i, n, reclen, offset, found = 0;
+
+	if (p_dbf->dbf_fh == -1 || (p_dbf->flags & DBF_FLAG_SEQUENTIAL)
+	 || column < 0 || column >= (int) p_dbf->columns) {
+		return -1;
+	}
+	memset(&r, 0, sizeof(r));
+	if (0 == (r.kind = dbf_ZoneMapKind(&p_dbf->fields[column]))) {
+		return -1;
+	}
+	r.len = p_dbf->fields[column].field_length;
+	offset = p_dbf->fields[column].field_offset;
+	if (r.kind == 1) {
+		if ((low && NULL == (r.low = dbf_RangeBound(low, r.len)))
+		 || (high && NULL == (r.high = dbf_RangeBound(high, r.len)))) {
+			found = -1;
+			goto out;
+		}
+	} else {
+		r.nlow = -HUGE_VAL;
+		r.nhigh = HUGE_VAL;
+		if ((low && 0 > dbf_RangeNumber(low, &r.nlow))
+		 || (high && 0 > dbf_RangeNumber(high, &r.nhigh))) {
+			fprintf(stderr, _("Bound is not a number"));
+			fprintf(stderr, "\n");
+			found = -1;
+			goto out;
+		}
+	}
+
+	reclen = p_dbf->header->record_length;
+	chunk = DBF_ZONEMAP_CHUNK / reclen ? DBF_ZONEMAP_CHUNK / reclen : 1;
+	if (NULL == (buf = malloc((size_t) chunk * reclen))) {
+		found = -1;
+		goto out;
+	}
+
+	records = p_dbf->header->records;
+	block = zm ? zm->header.block : records;
+	for (first = 0; first < records; first = end) {
+		/* records appended after the zone map was built are all read */
+		if (zm && first / block < zm->header.numblocks) {
+			b = first / block;
+			end = b + 1 < zm->header.numblocks ? (b + 1) * block : zm->header.records;
+			if (end > records) {
+				end = records;
+			}
+			if (!dbf_RangeBlock(&r, zm->data + (size_t) b * zm->rowsize + zm->offsets[column], end - first)) {
+				DBF_STAT_ADD(p_dbf, blocks_skipped, 1);
+				continue;
+			}
+		} else {
+			end = records;
+		}
+
+		for (; first < end; first += n) {
+			n = dbf_ReadRecords(p_dbf, first, end - first < chunk ? end - first : chunk, buf);
+			if (n <= 0) {
+				found = -1;
+				goto out;
+			}
+			for (i = 0, rec = buf; i < n; i++, rec += reclen) {
+				if (rec[0] == '*' || !dbf_RangeValue(&r, rec + offset)) {
+					continue;
+				}
+				found++;
+				if (callback && callback(p_dbf, rec, first + i, data)) {
+					goto out;
+				}
+			}
+		}
+	}
+
+out:
+	free(buf);
+	free(r.low);
+	free(r.high);
+	return found;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,111 @@
+/*****************************************************************************
+ * test.h
+ *****************************************************************************
+ * Helpers of the tests run by make check, also included by the C++ tests
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include "config.h"
+#include "libdbf/libdbf.h"
+/* the tests build fields, which needs the size of DB_FIELD */
+#include "dbf.h"
+
+/* Exit code telling the test driver that a test was skipped */
+#define TEST_SKIP 77
+
+/* Fails the test with the location of the condition */
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+/* Fills a record without the deletion flag */
+typedef void (*TEST_FILL)(char *record, u_int32_t recno, void *data);
+
+/* test_Random() {{{
+ * Small generator, the same numbers on every system
+ */
+static inline u_int32_t test_Random(u_int32_t *state)
+{
+	*state = *state * 1103515245U + 12345U;
+	return *state >> 8;
+}
+/* }}} */
+
+/* test_Create() {{{
+ * Writes a table with the given fields and records
+ */
+static inline void test_Create(const char *file, DB_FIELD *fields, int numfields, u_int32_t records,
+	TEST_FILL fill, void *data)
+{
+	P_DBF *p_dbf;
+	DB_FIELD *copy;
+	char *record;
+	u_int32_t i;
+	int fh, len;
+
+	/* the handle owns its fields */
+	CHECK(NULL != (copy = (DB_FIELD *) malloc(numfields * sizeof(DB_FIELD))));
+	memcpy(copy, fields, numfields * sizeof(DB_FIELD));
+	CHECK(-1 != (fh = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0644)));
+	CHECK(NULL != (p_dbf = dbf_CreateFH(fh, copy, numfields)));
+	len = dbf_RecordLength(p_dbf) - 1;
+	CHECK(NULL != (record = (char *) malloc(len)));
+	CHECK(0 == dbf_BeginBatch(p_dbf));
+	for (i = 0; i < records; i++) {
+		memset(record, ' ', len);
+		fill(record, i, data);
+		CHECK(0 <= dbf_WriteRecord(p_dbf, record, len));
+	}
+	CHECK(0 == dbf_CommitBatch(p_dbf));
+	CHECK(0 == dbf_Close(p_dbf));
+	free(record);
+}
+/* }}} */
+
+/* test_Put() {{{
+ * Writes a value into a field without its terminating NUL
+ */
+static inline void test_Put(char *field, const char *value)
+{
+	memcpy(field, value, strlen(value));
+}
+/* }}} */
+
+/* test_Field() {{{
+ * Returns the offset of a column in a record with its deletion flag
+ */
+static inline int test_Field(P_DBF *p_dbf, int column)
+{
+	int i, offset = 1;
+
+	for (i = 0; i < column; i++) {
+		offset += dbf_ColumnSize(p_dbf, i);
+	}
+	return offset;
+}
+/* }}} */
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
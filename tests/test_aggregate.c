@@ -0,0 +1,181 @@
+/*****************************************************************************
+ * test_aggregate.c
+ *****************************************************************************
+ * Aggregates numeric columns by groups and checks the parsing of numbers
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include <locale.h>
+#include <math.h>
+
+#include "test.h"
+
+#define TEST_TABLE "test_aggregate.dbf"
+#define TEST_RECORDS 100000
+#define TEST_GROUPS 7
+
+/* static test_Fill() {{{
+ * A group, an amount in cents and a float that is garbage in every
+ * hundredth record
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[64];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "G%u", recno % TEST_GROUPS);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "%12.2f", ((int) recno - 50000) / 100.0);
+	test_Put(record + 4, buf);
+	if (recno % 100 == 0) {
+		test_Put(record + 16, "  12abc");
+	} else if (recno % 100 == 1) {
+		/* blank */
+	} else {
+		snprintf(buf, sizeof(buf), "%10.3e", recno * 1.5);
+		test_Put(record + 16, buf);
+	}
+}
+/* }}} */
+
+/* static test_Number() {{{
+ * Parses a string as a field of its length
+ */
+static int test_Number(const char *s, double *value)
+{
+	return dbf_ParseNumber(s, strlen(s), value);
+}
+/* }}} */
+
+/* static test_Parse() {{{
+ */
+static void test_Parse(void)
+{
+	double v;
+
+	CHECK(test_Number("   12.50", &v) && v == 12.5);
+	CHECK(test_Number("-0.25   ", &v) && v == -0.25);
+	CHECK(test_Number("+7", &v) && v == 7.0);
+	CHECK(test_Number("  .5", &v) && v == 0.5);
+	CHECK(test_Number("3.", &v) && v == 3.0);
+	CHECK(test_Number("1.5E+03", &v) && v == 1500.0);
+	CHECK(test_Number(" 2.5e-2 ", &v) && v == 0.025);
+	CHECK(test_Number("1234567890123456789012", &v) && v == 1234567890123456789012.0);
+	CHECK(test_Number("0.000000000000000000000000123", &v) && fabs(v - 1.23e-25) < 1e-38);
+	CHECK(dbf_ParseNumber("42\0\0", 4, &v) && v == 42.0);
+
+	/* blank or more than a number */
+	CHECK(!test_Number("", &v));
+	CHECK(!test_Number("     ", &v));
+	CHECK(!test_Number("  -  ", &v));
+	CHECK(!test_Number(".", &v));
+	CHECK(!test_Number("12abc", &v));
+	CHECK(!test_Number("1.5.3", &v));
+	CHECK(!test_Number("1 2", &v));
+	CHECK(!test_Number("1,5", &v));
+	CHECK(!test_Number("1e", &v));
+	CHECK(!test_Number("e5", &v));
+	CHECK(!test_Number("*****", &v));
+	CHECK(!test_Number("0x10", &v));
+	CHECK(!test_Number("inf", &v));
+}
+/* }}} */
+
+/* static test_Aggregate() {{{
+ * Compares the groups with the sums computed here
+ */
+static void test_Aggregate(P_DBF *p_dbf, int threads)
+{
+	DBF_GROUP *groups;
+	double sum, min, max, fsum;
+	u_int64_t count, fcount;
+	int columns[2] = { 1, 2 }, g;
+	u_int32_t i;
+	char key[8], buf[32];
+
+	CHECK(TEST_GROUPS == dbf_Aggregate(p_dbf, columns, 2, 0, threads, &groups));
+	for (g = 0; g < TEST_GROUPS; g++) {
+		snprintf(key, sizeof(key), "G%-3d", g);
+		CHECK(0 == memcmp(groups[g].key, key, 4));
+		count = fcount = 0;
+		sum = fsum = min = max = 0.0;
+		for (i = g; i < TEST_RECORDS; i += TEST_GROUPS) {
+			double v = ((int) i - 50000) / 100.0;
+			if (count == 0 || v < min)
+				min = v;
+			if (count == 0 || v > max)
+				max = v;
+			sum += v;
+			count++;
+			if (i % 100 > 1) {
+				/* the value as rounded by test_Fill */
+				snprintf(buf, sizeof(buf), "%10.3e", i * 1.5);
+				fsum += strtod(buf, NULL);
+				fcount++;
+			}
+		}
+		CHECK(groups[g].records == count);
+		CHECK(groups[g].columns[0].count == count);
+		CHECK(groups[g].columns[0].min == min && groups[g].columns[0].max == max);
+		CHECK(fabs(groups[g].columns[0].sum - sum) < 1e-6);
+		/* the garbage and the blank fields are not counted */
+		CHECK(groups[g].columns[1].count == fcount);
+		CHECK(fabs(groups[g].columns[1].sum - fsum) < 1e-9 * fsum);
+	}
+	free(groups);
+
+	CHECK(1 == dbf_Aggregate(p_dbf, columns, 1, -1, threads, &groups));
+	CHECK(NULL == groups[0].key);
+	CHECK(groups[0].records == TEST_RECORDS);
+	CHECK(groups[0].columns[0].min == -500.0 && groups[0].columns[0].max == 499.99);
+	CHECK(fabs(groups[0].columns[0].mean - (-0.005)) < 1e-9);
+	free(groups);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[3];
+	P_DBF *p_dbf;
+
+	test_Parse();
+
+	dbf_SetField(&fields[0], 'C', "GROUP", 4, 0);
+	dbf_SetField(&fields[1], 'N', "AMOUNT", 12, 2);
+	dbf_SetField(&fields[2], 'F', "RATE", 10, 3);
+	test_Create(TEST_TABLE, fields, 3, TEST_RECORDS, test_Fill, NULL);
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	test_Aggregate(p_dbf, 1);
+	test_Aggregate(p_dbf, 4);
+
+	/* a decimal comma of the locale changes nothing */
+	if (setlocale(LC_NUMERIC, "de_DE.UTF-8") || setlocale(LC_NUMERIC, "fr_FR.UTF-8")) {
+		test_Parse();
+		test_Aggregate(p_dbf, 3);
+		setlocale(LC_NUMERIC, "C");
+	}
+
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
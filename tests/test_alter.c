@@ -0,0 +1,139 @@
+/*****************************************************************************
+ * test_alter.c
+ *****************************************************************************
+ * Moves, drops, adds and resizes fields of a table in one pass
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_alter.dbf"
+#define TEST_OUTPUT "test_alter.out.dbf"
+/* enough records for several threads */
+#define TEST_RECORDS 20000
+
+/* static test_Fill() {{{
+ * ID, NAME, AMOUNT, CODE and ACTIVE
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[64];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%6u", recno % 10000);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "name%06u", recno);
+	test_Put(record + 6, buf);
+	snprintf(buf, sizeof(buf), "%8.2f", ((int) recno - 10000) / 4.0);
+	test_Put(record + 16, buf);
+	test_Put(record + 24, "CODE");
+	record[28] = recno % 2 ? 'T' : 'F';
+}
+/* }}} */
+
+/* static test_Check() {{{
+ * Compares every record of the output with the one it came from
+ */
+static void test_Check(void)
+{
+	P_DBF *p_dbf;
+	char *records, *rec, want[64], name[16];
+	u_int32_t i;
+	int reclen;
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_OUTPUT)));
+	CHECK(dbf_NumRows(p_dbf) == TEST_RECORDS);
+	CHECK(5 == dbf_NumCols(p_dbf));
+	CHECK(0 == strcmp(dbf_ColumnName(p_dbf, 0), "amount"));
+	CHECK('F' == dbf_ColumnType(p_dbf, 0));
+	CHECK(0 == strcmp(dbf_ColumnName(p_dbf, 2), "NOTE"));
+	reclen = dbf_RecordLength(p_dbf);
+	CHECK(1 + 10 + 6 + 5 + 4 + 1 == reclen);
+	CHECK(NULL != (records = malloc((size_t) TEST_RECORDS * reclen)));
+	CHECK(TEST_RECORDS == dbf_ReadRecords(p_dbf, 0, TEST_RECORDS, records));
+
+	for (i = 0, rec = records; i < TEST_RECORDS; i++, rec += reclen) {
+		snprintf(name, sizeof(name), "name%06u", i);
+		/* every 1000th record was deleted */
+		snprintf(want, sizeof(want), "%c%10.2f%.6s%5s%4u%c", i % 1000 ? ' ' : '*',
+			((int) i - 10000) / 4.0, name, "", i % 10000, i % 2 ? 'T' : 'F');
+		CHECK(0 == memcmp(rec, want, reclen));
+	}
+
+	free(records);
+	CHECK(0 == dbf_Close(p_dbf));
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[5], altered[5];
+	P_DBF *p_dbf;
+	struct stat st;
+	u_int32_t i;
+	int fh;
+
+	dbf_SetField(&fields[0], 'N', "ID", 6, 0);
+	dbf_SetField(&fields[1], 'C', "NAME", 10, 0);
+	dbf_SetField(&fields[2], 'N', "AMOUNT", 8, 2);
+	dbf_SetField(&fields[3], 'C', "CODE", 4, 0);
+	dbf_SetField(&fields[4], 'L', "ACTIVE", 1, 0);
+	test_Create(TEST_TABLE, fields, 5, TEST_RECORDS, test_Fill, NULL);
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(-1 != (fh = open(TEST_TABLE, O_WRONLY)));
+	for (i = 0; i < TEST_RECORDS; i += 1000) {
+		CHECK(1 == pwrite(fh, "*", 1, DBF_RECORD_OFFSET(p_dbf, i)));
+	}
+	CHECK(0 == close(fh));
+
+	/* AMOUNT moved to the front, wider and as F, NAME cut, NOTE added,
+	 * ID narrower, CODE dropped */
+	dbf_SetField(&altered[0], 'F', "amount", 10, 2);
+	dbf_SetField(&altered[1], 'C', "NAME", 6, 0);
+	dbf_SetField(&altered[2], 'C', "NOTE", 5, 0);
+	dbf_SetField(&altered[3], 'N', "ID", 4, 0);
+	dbf_SetField(&altered[4], 'L', "ACTIVE", 1, 0);
+	CHECK(TEST_RECORDS == dbf_Alter(p_dbf, TEST_OUTPUT, altered, 5, 1));
+	test_Check();
+	CHECK(TEST_RECORDS == dbf_Alter(p_dbf, TEST_OUTPUT, altered, 5, 4));
+	test_Check();
+
+	/* an ID of four digits does not fit into three */
+	dbf_SetField(&altered[3], 'N', "ID", 3, 0);
+	CHECK(-1 == dbf_Alter(p_dbf, TEST_OUTPUT, altered, 5, 4));
+	CHECK(0 > stat(TEST_OUTPUT, &st));
+	dbf_SetField(&altered[3], 'N', "ID", 4, 0);
+
+	/* other types and decimals are refused */
+	dbf_SetField(&altered[1], 'N', "NAME", 6, 0);
+	CHECK(-1 == dbf_Alter(p_dbf, TEST_OUTPUT, altered, 5, 1));
+	dbf_SetField(&altered[1], 'C', "NAME", 6, 0);
+	dbf_SetField(&altered[0], 'N', "AMOUNT", 10, 3);
+	CHECK(-1 == dbf_Alter(p_dbf, TEST_OUTPUT, altered, 5, 1));
+	CHECK(0 > stat(TEST_OUTPUT, &st));
+
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
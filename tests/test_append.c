@@ -0,0 +1,177 @@
+/*****************************************************************************
+ * test_append.c
+ *****************************************************************************
+ * Appends records from several threads at once
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include "test.h"
+
+#define TEST_TABLE "test_append.dbf"
+#define TEST_RECORDS 100
+#define TEST_THREADS 4
+/* records every thread appends, one at a time and in groups */
+#define TEST_APPENDS 6000
+#define TEST_GROUP 7
+/* record length with the deletion flag */
+#define TEST_RECLEN 13
+
+typedef struct {
+	P_DBF *p_dbf;
+	int thread;
+	/* the number each record of the thread got */
+	u_int64_t recno[TEST_APPENDS];
+} TEST_THREAD;
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[16];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "-%11u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Append() {{{
+ * Appends records carrying the thread and their number in it with
+ * dbf_AppendRecord, dbf_WriteRecord and dbf_AppendRecords
+ */
+static void *test_Append(void *arg)
+{
+	TEST_THREAD *t = arg;
+	char records[TEST_GROUP * TEST_RECLEN + 1];
+	u_int64_t first;
+	int i, k, n;
+
+	for (i = 0; i < TEST_APPENDS; i += n) {
+		n = i % 3 == 2 && i + TEST_GROUP <= TEST_APPENDS ? TEST_GROUP : 1;
+		for (k = 0; k < n; k++) {
+			snprintf(records + k * TEST_RECLEN, TEST_RECLEN + 1, " %1d%10d", t->thread, i + k);
+		}
+		if (n > 1) {
+			CHECK(0 == dbf_AppendRecords(t->p_dbf, records, n, &first));
+			for (k = 0; k < n; k++) {
+				t->recno[i + k] = first + k;
+			}
+		} else if (i % 3 == 0) {
+			CHECK(0 == dbf_AppendRecord(t->p_dbf, records + 1, TEST_RECLEN - 1, &t->recno[i]));
+		} else {
+			CHECK(0 < (k = dbf_WriteRecord(t->p_dbf, records + 1, TEST_RECLEN - 1)));
+			t->recno[i] = k - 1;
+		}
+	}
+	return NULL;
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	TEST_THREAD *threads;
+	pthread_t tids[TEST_THREADS];
+	P_DBF *p_dbf;
+	struct rlimit limit, old;
+	char *records, *rec, want[TEST_RECLEN + 1];
+	unsigned char *seen;
+	u_int32_t total = TEST_RECORDS + TEST_THREADS * TEST_APPENDS;
+	int i, j;
+
+	dbf_SetField(&fields[0], 'N', "THREAD", 2, 0);
+	dbf_SetField(&fields[1], 'N', "SEQ", 10, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, NULL);
+
+	CHECK(NULL != (threads = calloc(TEST_THREADS, sizeof(TEST_THREAD))));
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(TEST_RECLEN == dbf_RecordLength(p_dbf));
+	/* only between dbf_BeginAppend and dbf_EndAppend */
+	CHECK(-1 == dbf_AppendRecord(p_dbf, "x", 1, NULL));
+	CHECK(0 == dbf_BeginAppend(p_dbf));
+	CHECK(-1 == dbf_AppendRecord(p_dbf, "short", 5, NULL));
+	for (i = 0; i < TEST_THREADS; i++) {
+		threads[i].p_dbf = p_dbf;
+		threads[i].thread = i;
+		CHECK(0 == pthread_create(&tids[i], NULL, test_Append, &threads[i]));
+	}
+	for (i = 0; i < TEST_THREADS; i++) {
+		CHECK(0 == pthread_join(tids[i], NULL));
+	}
+	CHECK(0 == dbf_EndAppend(p_dbf));
+	CHECK(-1 == dbf_EndAppend(p_dbf));
+	CHECK(0 == dbf_Close(p_dbf));
+
+	/* every record at the number its append returned, each number once */
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(dbf_NumRows64(p_dbf) == total);
+	CHECK(NULL != (records = malloc((size_t) total * TEST_RECLEN)));
+	CHECK(NULL != (seen = calloc(total, 1)));
+	CHECK((int) total == dbf_ReadRecords(p_dbf, 0, total, records));
+	for (i = 0; i < TEST_THREADS; i++) {
+		for (j = 0; j < TEST_APPENDS; j++) {
+			CHECK(threads[i].recno[j] >= TEST_RECORDS && threads[i].recno[j] < total);
+			CHECK(!seen[threads[i].recno[j]]);
+			seen[threads[i].recno[j]] = 1;
+			rec = records + (size_t) threads[i].recno[j] * TEST_RECLEN;
+			snprintf(want, sizeof(want), " %1d%10d", i, j);
+			CHECK(0 == memcmp(rec, want, TEST_RECLEN));
+		}
+	}
+	/* the records of the table before stay */
+	snprintf(want, sizeof(want), " -%11u", TEST_RECORDS - 1);
+	CHECK(0 == memcmp(records + (TEST_RECORDS - 1) * TEST_RECLEN, want, TEST_RECLEN));
+	free(seen);
+	free(records);
+	CHECK(0 == dbf_Close(p_dbf));
+
+	/* a write failing for the file size limit drops all records of the
+	 * appends */
+	signal(SIGXFSZ, SIG_IGN);
+	CHECK(0 == getrlimit(RLIMIT_FSIZE, &old));
+	limit = old;
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	limit.rlim_cur = DBF_RECORD_OFFSET(p_dbf, total + 10);
+	CHECK(0 == dbf_BeginAppend(p_dbf));
+	CHECK(0 == setrlimit(RLIMIT_FSIZE, &limit));
+	for (i = 0; i < 20; i++) {
+		snprintf(want, sizeof(want), " %1d%10d", 9, i);
+		j = dbf_AppendRecord(p_dbf, want + 1, TEST_RECLEN - 1, NULL);
+		CHECK(i < 10 ? j == 0 : j == -1);
+	}
+	CHECK(0 == setrlimit(RLIMIT_FSIZE, &old));
+	CHECK(-1 == dbf_EndAppend(p_dbf));
+	CHECK(dbf_NumRows64(p_dbf) == total);
+	CHECK(0 == dbf_Close(p_dbf));
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(dbf_NumRows64(p_dbf) == total);
+	CHECK(0 == dbf_Close(p_dbf));
+
+	free(threads);
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * test_async.cpp
+ *****************************************************************************
+ * Scans tables from coroutines with the C++20 interface of dbf_async.hpp
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "test.h"
+#include "libdbf/dbf_async.hpp"
+
+#define TEST_TABLE "test_async.dbf"
+#define TEST_RECORDS 10000
+#define TEST_SCANS 4
+
+/* Coroutine started at once and not waited for */
+struct test_task {
+	struct promise_type {
+		test_task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+/* Event loop resuming coroutines on the thread of main */
+static struct {
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::coroutine_handle<>> ready;
+	std::thread::id thread;
+} test_loop;
+
+/* scans not finished yet, guarded by the mutex of the loop */
+static int test_running;
+
+/* static test_Post() {{{
+ * Resume function of the streams
+ */
+static void test_Post(std::coroutine_handle<> h)
+{
+	{
+		std::lock_guard<std::mutex> lock(test_loop.mutex);
+		test_loop.ready.push_back(h);
+	}
+	test_loop.cond.notify_one();
+}
+/* }}} */
+
+/* static test_Done() {{{
+ * Counts a finished scan, which may run on a pool thread
+ */
+static void test_Done(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(test_loop.mutex);
+		test_running--;
+	}
+	test_loop.cond.notify_one();
+}
+/* }}} */
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Scan() {{{
+ * Reads the whole table in batches and checks that every record comes in
+ * order on the loop thread
+ */
+static test_task test_Scan(dbf::table &t, dbf::thread_pool &pool, std::size_t batch_records)
+{
+	auto scan = dbf::async_scan(t, pool, batch_records, test_Post);
+	u_int32_t next = 0;
+
+	while (auto batch = co_await scan.next()) {
+		CHECK(std::this_thread::get_id() == test_loop.thread);
+		CHECK(batch->first() == next);
+		CHECK(!batch->empty() && batch->size() <= batch_records);
+		for (std::size_t i = 0; i < batch->size(); i++) {
+			CHECK((*batch)[i].get<u_int32_t>(0) == next);
+			next++;
+		}
+	}
+	CHECK(next == TEST_RECORDS);
+	test_Done();
+}
+/* }}} */
+
+/* static test_Pool() {{{
+ * Without a resume function the scan continues on the pool thread
+ */
+static test_task test_Pool(dbf::table &t, dbf::thread_pool &pool, std::atomic<u_int32_t> *count)
+{
+	auto scan = dbf::async_scan(t, pool, 333);
+
+	while (auto batch = co_await scan.next()) {
+		CHECK(std::this_thread::get_id() != test_loop.thread);
+		*count += batch->size();
+	}
+	test_Done();
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[1];
+	std::atomic<u_int32_t> count(0);
+	int i;
+
+	dbf_SetField(&fields[0], 'N', "RECNO", 8, 0);
+	test_Create(TEST_TABLE, fields, 1, TEST_RECORDS, test_Fill, NULL);
+	test_loop.thread = std::this_thread::get_id();
+
+	{
+		dbf::thread_pool pool(3);
+		dbf::table tables[TEST_SCANS];
+
+		/* streams of one table and of different tables at the same time */
+		test_running = TEST_SCANS + 2;
+		for (i = 0; i < TEST_SCANS; i++) {
+			tables[i] = dbf::table(TEST_TABLE);
+			test_Scan(tables[i], pool, 100 + i * 997);
+		}
+		test_Scan(tables[0], pool, 1);
+		test_Pool(tables[1], pool, &count);
+
+		for (;;) {
+			std::coroutine_handle<> h;
+			{
+				std::unique_lock<std::mutex> lock(test_loop.mutex);
+				test_loop.cond.wait(lock, [] { return test_running == 0 || !test_loop.ready.empty(); });
+				if (test_loop.ready.empty())
+					break;
+				h = test_loop.ready.front();
+				test_loop.ready.pop_front();
+			}
+			h.resume();
+		}
+		CHECK(count == TEST_RECORDS);
+	}
+
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
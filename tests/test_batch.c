@@ -0,0 +1,153 @@
+/*****************************************************************************
+ * test_batch.c
+ *****************************************************************************
+ * Readers see the records of a batch only after the commit, and a batch
+ * of a process which died is left out
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define TEST_TABLE "test_batch.dbf"
+#define TEST_RECORDS 10
+/* More than the batch buffer holds */
+#define TEST_BATCH 80000
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[40];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u%24u", recno, recno * 7);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Write() {{{
+ * Writes a batch of records following those of the table
+ */
+static void test_Write(P_DBF *p_dbf, u_int32_t first, u_int32_t n)
+{
+	char record[40];
+	u_int32_t i;
+
+	CHECK(0 == dbf_BeginBatch(p_dbf));
+	for (i = first; i < first + n; i++) {
+		memset(record, ' ', 32);
+		test_Fill(record, i, NULL);
+		CHECK(0 <= dbf_WriteRecord(p_dbf, record, 32));
+	}
+}
+/* }}} */
+
+/* static test_Check() {{{
+ * Checks the number of records and every record of the table
+ */
+static void test_Check(u_int32_t records)
+{
+	P_DBF *p_dbf;
+	char *data, record[40];
+	u_int32_t i;
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK((int) records == dbf_NumRows(p_dbf));
+	CHECK(NULL != (data = malloc((size_t) records * 33)));
+	CHECK((int) records == dbf_ReadRecords(p_dbf, 0, records, data));
+	for (i = 0; i < records; i++) {
+		memset(record, ' ', 33);
+		test_Fill(record + 1, i, NULL);
+		CHECK(0 == memcmp(data + (size_t) i * 33, record, 33));
+	}
+	free(data);
+	CHECK(0 == dbf_Close(p_dbf));
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	P_DBF *p_dbf, *reader;
+	struct stat st;
+	pid_t pid;
+	int status, total;
+
+	dbf_SetField(&fields[0], 'N', "ID", 8, 0);
+	dbf_SetField(&fields[1], 'C', "VALUE", 24, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, NULL);
+	total = TEST_RECORDS;
+
+	/* nothing of the batch is visible before the commit */
+	CHECK(NULL != (reader = dbf_Open(TEST_TABLE)));
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	test_Write(p_dbf, total, TEST_BATCH);
+	CHECK(0 <= dbf_Refresh(reader) && total == dbf_NumRows(reader));
+	test_Check(total);
+	CHECK(0 == dbf_CommitBatch(p_dbf));
+	total += TEST_BATCH;
+	CHECK(DBF_CHANGE_APPENDED & dbf_Refresh(reader));
+	CHECK(total == dbf_NumRows(reader));
+	test_Check(total);
+
+	/* closing commits */
+	test_Write(p_dbf, total, 100);
+	CHECK(0 == dbf_Close(p_dbf));
+	total += 100;
+	test_Check(total);
+
+	/* a writer dying in a batch leaves records behind the table */
+	CHECK(-1 != (pid = fork()));
+	if (pid == 0) {
+		CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+		test_Write(p_dbf, total, TEST_BATCH);
+		_exit(0);
+	}
+	CHECK(pid == waitpid(pid, &status, 0));
+	CHECK(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+	test_Check(total);
+
+	/* opening for writing keeps them, the repair cuts them off */
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(0 == stat(TEST_TABLE, &st));
+	CHECK(st.st_size > dbf_HeaderSize(p_dbf) + (off_t) total * 33 + 1);
+	CHECK(0 < dbf_Repair(p_dbf));
+	CHECK(0 == stat(TEST_TABLE, &st));
+	CHECK(st.st_size == dbf_HeaderSize(p_dbf) + (off_t) total * 33 + 1);
+	CHECK(0 == dbf_Close(p_dbf));
+	test_Check(total);
+
+	/* and the table takes new batches again */
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	test_Write(p_dbf, total, 5);
+	CHECK(0 == dbf_CommitBatch(p_dbf));
+	CHECK(0 == dbf_Close(p_dbf));
+	test_Check(total + 5);
+
+	CHECK(0 == dbf_Close(reader));
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
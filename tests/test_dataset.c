@@ -0,0 +1,173 @@
+/*****************************************************************************
+ * test_dataset.c
+ *****************************************************************************
+ * Scans a directory of tables as one dataset from several threads
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_DIR "test_dataset.d"
+#define TEST_FILES 6
+/* The third file is larger than a chunk passed to the callback, the
+ * fifth one is empty */
+static const u_int32_t test_records[TEST_FILES] = { 1000, 1, 70000, 2500, 0, 333 };
+
+typedef struct {
+	DBF_DATASET *ds;
+	/* next record expected of every file */
+	u_int32_t next[TEST_FILES];
+	/* number of times every record was passed */
+	unsigned char *seen;
+	u_int64_t stop;
+} TEST_SCAN;
+
+/* static test_Fill() {{{
+ * The number of the record in the dataset
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	u_int64_t *first = data;
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%10llu", (unsigned long long) (*first + recno));
+	test_Put(record, buf);
+	test_Put(record + 10, recno % 2 ? "odd" : "even");
+}
+/* }}} */
+
+/* static test_Callback() {{{
+ * Checks that the records come in order within their file and carry
+ * their number in the dataset
+ */
+static int test_Callback(P_DBF *p_dbf, int file, const char *records, u_int32_t first, u_int32_t n, void *data)
+{
+	TEST_SCAN *scan = data;
+	u_int64_t recno;
+	char buf[16];
+	u_int32_t i;
+	int reclen = dbf_RecordLength(p_dbf);
+
+	CHECK(file >= 0 && file < TEST_FILES);
+	CHECK(first == scan->next[file]);
+	CHECK(first + n <= test_records[file]);
+	for (i = 0; i < n; i++) {
+		memcpy(buf, records + (size_t) i * reclen + 1, 10);
+		buf[10] = '\0';
+		recno = strtoull(buf, NULL, 10);
+		CHECK(recno == dbf_DatasetFirstRecord(scan->ds, file) + first + i);
+		/* the threads write the counters of different records */
+		scan->seen[recno]++;
+		if (scan->stop && recno == scan->stop) {
+			return 42;
+		}
+	}
+	scan->next[file] = first + n;
+	return 0;
+}
+/* }}} */
+
+/* static test_Scan() {{{
+ */
+static void test_Scan(DBF_DATASET *ds, int threads)
+{
+	TEST_SCAN scan;
+	u_int64_t i, total = dbf_DatasetNumRows(ds);
+
+	memset(&scan, 0, sizeof(scan));
+	scan.ds = ds;
+	CHECK(NULL != (scan.seen = calloc(total, 1)));
+	CHECK(0 == dbf_DatasetScan(ds, threads, test_Callback, &scan));
+	for (i = 0; i < TEST_FILES; i++) {
+		CHECK(scan.next[i] == test_records[i]);
+	}
+	for (i = 0; i < total; i++) {
+		CHECK(scan.seen[i] == 1);
+	}
+
+	/* the value of a callback stopping the scan is returned */
+	memset(scan.next, 0, sizeof(scan.next));
+	scan.stop = total / 2;
+	CHECK(42 == dbf_DatasetScan(ds, threads, test_Callback, &scan));
+	free(scan.seen);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2], other[2];
+	DBF_DATASET *ds;
+	P_DBF *schema;
+	char file[64];
+	u_int64_t first = 0;
+	int i;
+
+	mkdir(TEST_DIR, 0755);
+	dbf_SetField(&fields[0], 'N', "RECNO", 10, 0);
+	dbf_SetField(&fields[1], 'C', "PARITY", 4, 0);
+	for (i = 0; i < TEST_FILES; i++) {
+		snprintf(file, sizeof(file), TEST_DIR "/part-%02d.dbf", i);
+		test_Create(file, fields, 2, test_records[i], test_Fill, &first);
+		first += test_records[i];
+	}
+	/* not a table of the directory */
+	CHECK(0 == close(open(TEST_DIR "/notes.txt", O_WRONLY|O_CREAT|O_TRUNC, 0644)));
+
+	CHECK(NULL != (ds = dbf_DatasetOpen(TEST_DIR, 3)));
+	CHECK(dbf_DatasetNumFiles(ds) == TEST_FILES);
+	CHECK(dbf_DatasetNumRows(ds) == first);
+	CHECK(0 == strcmp(dbf_DatasetFile(ds, 2), TEST_DIR "/part-02.dbf"));
+	CHECK(NULL == dbf_DatasetFile(ds, TEST_FILES));
+	CHECK(dbf_DatasetFirstRecord(ds, 0) == 0);
+	CHECK(dbf_DatasetFirstRecord(ds, 3) == 71001);
+	CHECK(dbf_DatasetFirstRecord(ds, 5) == 73501);
+	CHECK(NULL != (schema = dbf_DatasetSchema(ds)));
+	CHECK(2 == dbf_NumCols(schema));
+	CHECK(0 == strcmp(dbf_ColumnName(schema, 1), "PARITY"));
+	test_Scan(ds, 1);
+	test_Scan(ds, 4);
+	test_Scan(ds, 0);
+	CHECK(0 == dbf_DatasetClose(ds));
+
+	/* a pattern takes only the matching files */
+	CHECK(NULL != (ds = dbf_DatasetOpen(TEST_DIR "/part-0[0-2].dbf", 0)));
+	CHECK(dbf_DatasetNumFiles(ds) == 3);
+	CHECK(dbf_DatasetNumRows(ds) == 71001);
+	CHECK(0 == dbf_DatasetClose(ds));
+	CHECK(NULL == dbf_DatasetOpen(TEST_DIR "/missing-*.dbf", 0));
+
+	/* a file with another layout fails the whole dataset */
+	dbf_SetField(&other[0], 'N', "RECNO", 10, 0);
+	dbf_SetField(&other[1], 'C', "PARITY", 5, 0);
+	test_Create(TEST_DIR "/part-99.dbf", other, 2, 10, test_Fill, &first);
+	CHECK(NULL == dbf_DatasetOpen(TEST_DIR, 2));
+
+	for (i = 0; i < TEST_FILES; i++) {
+		snprintf(file, sizeof(file), TEST_DIR "/part-%02d.dbf", i);
+		unlink(file);
+	}
+	unlink(TEST_DIR "/part-99.dbf");
+	unlink(TEST_DIR "/notes.txt");
+	rmdir(TEST_DIR);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
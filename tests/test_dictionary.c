@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * test_dictionary.c
+ *****************************************************************************
+ * Decodes columns into dictionaries, with values holding NUL bytes
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_dictionary.dbf"
+#define TEST_RECORDS 50000
+#define TEST_STATES 5
+
+/* Values of the second column, the first three differ only behind a NUL */
+static const struct {
+	const char *value;
+	int length;
+} test_codes[TEST_STATES] = {
+	{ "A\0B", 3 }, { "A\0C", 3 }, { "A", 1 }, { "", 0 }, { "LONG CODE", 9 }
+};
+
+/* static test_Fill() {{{
+ * A state out of 50 and a code out of test_codes
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[16];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "S%02u", recno * 7 % 50);
+	test_Put(record, buf);
+	memcpy(record + 3, test_codes[recno % TEST_STATES].value, test_codes[recno % TEST_STATES].length);
+	/* some writers pad with NUL bytes, which are cut off like blanks */
+	if (recno % 10 == 8) {
+		memset(record + 3, '\0', 10);
+	}
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	DBF_DICTIONARY *dict;
+	P_DBF *p_dbf;
+	char buf[16];
+	int columns[2] = { 1, 0 }, fh;
+	u_int32_t i;
+	int32_t code;
+
+	dbf_SetField(&fields[0], 'C', "STATE", 3, 0);
+	dbf_SetField(&fields[1], 'C', "CODE", 10, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, NULL);
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(-1 != (fh = open(TEST_TABLE, O_WRONLY)));
+	CHECK(1 == pwrite(fh, "*", 1, DBF_RECORD_OFFSET(p_dbf, 12345)));
+	CHECK(0 == close(fh));
+
+	CHECK(0 == dbf_DecodeDictionary(p_dbf, columns, 2, &dict));
+	CHECK(dict[0].column == 1 && dict[1].column == 0);
+	CHECK(dict[0].numcodes == TEST_RECORDS && dict[1].numcodes == TEST_RECORDS);
+
+	/* in the order of the first occurrence */
+	CHECK(TEST_STATES == dict[0].numvalues);
+	for (i = 0; i < TEST_STATES; i++) {
+		CHECK(dict[0].lengths[i] == test_codes[i].length);
+		CHECK(0 == memcmp(dict[0].values[i], test_codes[i].value, test_codes[i].length));
+		CHECK(dict[0].values[i][dict[0].lengths[i]] == '\0');
+	}
+	CHECK(50 == dict[1].numvalues);
+
+	for (i = 0; i < TEST_RECORDS; i++) {
+		if (i == 12345) {
+			CHECK(dict[0].codes[i] == -1 && dict[1].codes[i] == -1);
+			continue;
+		}
+		/* the empty values padded with NUL bytes and with blanks are one */
+		CHECK(dict[0].codes[i] == (int32_t) (i % TEST_STATES));
+		snprintf(buf, sizeof(buf), "S%02u", i * 7 % 50);
+		code = dict[1].codes[i];
+		CHECK(code >= 0 && (u_int32_t) code < dict[1].numvalues);
+		CHECK(dict[1].lengths[code] == 3 && 0 == strcmp(dict[1].values[code], buf));
+	}
+	dbf_FreeDictionary(dict, 2);
+
+	columns[0] = 2;
+	CHECK(-1 == dbf_DecodeDictionary(p_dbf, columns, 1, &dict));
+	CHECK(NULL == dict);
+
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,107 @@
+/*****************************************************************************
+ * test_fetch.c
+ *****************************************************************************
+ * Lists of records in any order are fetched like single reads
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_fetch.dbf"
+#define TEST_RECORDS 50000
+#define TEST_FETCH 3000
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u%20u", recno, recno * 2654435761U);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Fetch() {{{
+ * Fetches random records, some of them twice and some of them close
+ * to each other, and compares them with records read one by one
+ */
+static void test_Fetch(P_DBF *p_dbf, u_int32_t *state)
+{
+	u_int32_t recnos[TEST_FETCH];
+	char *records, *one;
+	int i, reclen = dbf_RecordLength(p_dbf);
+
+	for (i = 0; i < TEST_FETCH; i++) {
+		if (i > 0 && test_Random(state) % 4 == 0) {
+			recnos[i] = recnos[test_Random(state) % i];
+		} else if (i > 0 && test_Random(state) % 3 == 0) {
+			recnos[i] = (recnos[i - 1] + 1 + test_Random(state) % 8) % TEST_RECORDS;
+		} else {
+			recnos[i] = test_Random(state) % TEST_RECORDS;
+		}
+	}
+	recnos[TEST_FETCH - 1] = TEST_RECORDS - 1;
+
+	CHECK(NULL != (records = malloc((size_t) TEST_FETCH * reclen)));
+	CHECK(NULL != (one = malloc(reclen)));
+	CHECK(TEST_FETCH == dbf_FetchRecords(p_dbf, recnos, TEST_FETCH, records));
+	for (i = 0; i < TEST_FETCH; i++) {
+		CHECK(1 == dbf_ReadRecords(p_dbf, recnos[i], 1, one));
+		CHECK(0 == memcmp(one, records + (size_t) i * reclen, reclen));
+	}
+	free(one);
+	free(records);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[1];
+	P_DBF *p_dbf;
+	u_int32_t state = 1, bad = TEST_RECORDS;
+	char *record;
+	int reclen;
+
+	dbf_SetField(&fields[0], 'C', "DATA", 28, 0);
+	test_Create(TEST_TABLE, fields, 1, TEST_RECORDS, test_Fill, NULL);
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	reclen = dbf_RecordLength(p_dbf);
+
+	test_Fetch(p_dbf, &state);
+	CHECK(0 == dbf_SetFetchGap(p_dbf, 0));
+	test_Fetch(p_dbf, &state);
+	CHECK(0 == dbf_SetFetchGap(p_dbf, 1 << 20));
+	test_Fetch(p_dbf, &state);
+
+	/* the counter is not moved, and records behind the table fail */
+	CHECK(NULL != (record = malloc(reclen)));
+	CHECK(0 == dbf_ReadRecord(p_dbf, record, reclen));
+	CHECK(-1 == dbf_FetchRecords(p_dbf, &bad, 1, record));
+	free(record);
+
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
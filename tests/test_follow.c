@@ -0,0 +1,146 @@
+/*****************************************************************************
+ * test_follow.c
+ *****************************************************************************
+ * Appended records reach the callback, also while it adds tables
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_follow.dbf"
+#define TEST_OTHER "test_follow.other.dbf"
+#define TEST_RECORDS 10
+/* Several chunks of records per change */
+#define TEST_APPEND 20000
+/* Enough tables added by the callback to move the watches */
+#define TEST_ADD 40
+
+typedef struct {
+	DBF_FOLLOW *follow;
+	P_DBF *other;
+	u_int32_t next;
+	int calls;
+	int removed;
+} TEST_STATE;
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Callback() {{{
+ * Checks that records arrive in order and follows the other table
+ * again and again on the first call
+ */
+static void test_Callback(P_DBF *p_dbf, const char *records, u_int32_t first, u_int32_t n, int change, void *data)
+{
+	TEST_STATE *state = data;
+	char buf[16];
+	u_int32_t i;
+	int j, reclen = dbf_RecordLength(p_dbf);
+
+	if (change & DBF_CHANGE_REMOVED) {
+		state->removed++;
+		return;
+	}
+	CHECK(change == DBF_CHANGE_APPENDED && first == state->next);
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "%8u", first + i);
+		CHECK(0 == memcmp(records + (size_t) i * reclen + 1, buf, 8));
+	}
+	state->next += n;
+	if (state->calls++ == 0) {
+		for (j = 0; j < TEST_ADD; j++) {
+			CHECK(0 == dbf_FollowAdd(state->follow, TEST_OTHER, state->other, test_Callback, state));
+		}
+	}
+}
+/* }}} */
+
+/* static test_Append() {{{
+ */
+static void test_Append(u_int32_t from, u_int32_t n)
+{
+	P_DBF *writer;
+	char record[16], buf[16];
+	u_int32_t i;
+
+	CHECK(NULL != (writer = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(0 == dbf_BeginBatch(writer));
+	for (i = from; i < from + n; i++) {
+		snprintf(buf, sizeof(buf), "%8u", i);
+		memcpy(record, buf, 8);
+		CHECK(0 <= dbf_WriteRecord(writer, record, 8));
+	}
+	CHECK(0 == dbf_CommitBatch(writer));
+	CHECK(0 == dbf_Close(writer));
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[1];
+	TEST_STATE state;
+	P_DBF *reader;
+	char record[16];
+
+	memset(&state, 0, sizeof(state));
+	if (NULL == (state.follow = dbf_FollowCreate())) {
+		return TEST_SKIP;
+	}
+	dbf_SetField(&fields[0], 'N', "ID", 8, 0);
+	test_Create(TEST_TABLE, fields, 1, TEST_RECORDS, test_Fill, NULL);
+	test_Create(TEST_OTHER, fields, 1, TEST_RECORDS, test_Fill, NULL);
+	CHECK(NULL != (reader = dbf_Open(TEST_TABLE)));
+	CHECK(NULL != (state.other = dbf_Open(TEST_OTHER)));
+	CHECK(0 == dbf_FollowAdd(state.follow, TEST_TABLE, reader, test_Callback, &state));
+	CHECK(0 == dbf_FollowDispatch(state.follow));
+
+	/* the records not read yet come with the first change */
+	CHECK(0 == dbf_ReadRecord(reader, record, sizeof(record)));
+	state.next = 1;
+	test_Append(TEST_RECORDS, TEST_APPEND);
+	CHECK(0 < dbf_FollowDispatch(state.follow));
+	CHECK(TEST_RECORDS + TEST_APPEND == state.next && state.calls > 1);
+
+	test_Append(TEST_RECORDS + TEST_APPEND, 5);
+	CHECK(0 < dbf_FollowDispatch(state.follow));
+	CHECK(TEST_RECORDS + TEST_APPEND + 5 == state.next);
+
+	unlink(TEST_TABLE);
+	CHECK(0 < dbf_FollowDispatch(state.follow));
+	CHECK(1 == state.removed);
+
+	CHECK(0 == dbf_FollowClose(state.follow));
+	CHECK(0 == dbf_Close(state.other));
+	CHECK(0 == dbf_Close(reader));
+	unlink(TEST_OTHER);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
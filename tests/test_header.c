@@ -0,0 +1,115 @@
+/*****************************************************************************
+ * test_header.c
+ *****************************************************************************
+ * Narrow and wide tables opened in full and for their metadata only
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_header.dbf"
+#define TEST_RECORDS 10
+/* More field descriptors than the first read of the header covers */
+#define TEST_WIDE 200
+
+/* static test_Fill() {{{
+ * Every field holds its column and record number
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	int *numfields = data;
+	char buf[32];
+	int i;
+
+	for (i = 0; i < *numfields; i++) {
+		snprintf(buf, sizeof(buf), "%03d%03u", i, recno);
+		test_Put(record + 6 * i, buf);
+	}
+}
+/* }}} */
+
+/* static test_Check() {{{
+ * Checks the layout seen by a handle and, unless only the metadata was
+ * read, the last record
+ */
+static void test_Check(int numfields, int flags)
+{
+	P_DBF *p_dbf;
+	char name[16], buf[16], *record;
+	int i, reclen;
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, flags)));
+	CHECK(TEST_RECORDS == dbf_NumRows(p_dbf) && numfields == dbf_NumCols(p_dbf));
+	CHECK(32 + 32 * numfields + 1 <= dbf_HeaderSize(p_dbf));
+	reclen = dbf_RecordLength(p_dbf);
+	CHECK(1 + 6 * numfields == reclen);
+	for (i = 0; i < numfields; i++) {
+		snprintf(name, sizeof(name), "F%03d", i);
+		CHECK(0 == strcmp(name, dbf_ColumnName(p_dbf, i)));
+		CHECK(6 == dbf_ColumnSize(p_dbf, i) && 'C' == dbf_ColumnType(p_dbf, i));
+	}
+
+	CHECK(NULL != (record = malloc(reclen)));
+	if (flags & DBF_OPEN_METADATA) {
+		CHECK(-1 == dbf_ReadRecord(p_dbf, record, reclen));
+	} else {
+		CHECK(0 == dbf_SeekRecord64(p_dbf, TEST_RECORDS - 1));
+		CHECK(TEST_RECORDS - 1 == dbf_ReadRecord(p_dbf, record, reclen));
+		for (i = 0; i < numfields; i++) {
+			snprintf(buf, sizeof(buf), "%03d%03d", i, TEST_RECORDS - 1);
+			CHECK(0 == memcmp(record + 1 + 6 * i, buf, 6));
+		}
+	}
+	free(record);
+	CHECK(0 == dbf_Close(p_dbf));
+}
+/* }}} */
+
+/* static test_Table() {{{
+ */
+static void test_Table(int numfields)
+{
+	DB_FIELD *fields;
+	char name[16];
+	int i;
+
+	CHECK(NULL != (fields = calloc(numfields, sizeof(DB_FIELD))));
+	for (i = 0; i < numfields; i++) {
+		snprintf(name, sizeof(name), "F%03d", i);
+		dbf_SetField(&fields[i], 'C', name, 6, 0);
+	}
+	test_Create(TEST_TABLE, fields, numfields, TEST_RECORDS, test_Fill, &numfields);
+	free(fields);
+
+	test_Check(numfields, 0);
+	test_Check(numfields, DBF_OPEN_METADATA);
+	unlink(TEST_TABLE);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	test_Table(3);
+	test_Table(TEST_WIDE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,228 @@
+/*****************************************************************************
+ * test_join.c
+ *****************************************************************************
+ * Joins two tables and a table with itself and checks every pair
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_LEFT "test_join.left.dbf"
+#define TEST_RIGHT "test_join.right.dbf"
+#define TEST_OUTPUT "test_join.out.dbf"
+#define TEST_LEFT_RECORDS 3000
+#define TEST_RIGHT_RECORDS 500
+
+/* static test_FillLeft() {{{
+ * Every key three times, every 50th key blank
+ */
+static void test_FillLeft(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	if (recno % 50) {
+		snprintf(buf, sizeof(buf), "K%05u", recno % 1000);
+		test_Put(record, buf);
+	}
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record + 6, buf);
+}
+/* }}} */
+
+/* static test_FillRight() {{{
+ * Keys of which only some are in the left table, some of them twice
+ */
+static void test_FillRight(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "K%05u", recno * 7 % 1700);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "R%09u", recno);
+	test_Put(record + 6, buf);
+}
+/* }}} */
+
+/* static test_ReadAll() {{{
+ */
+static char *test_ReadAll(P_DBF *p_dbf)
+{
+	char *records;
+	int n = dbf_NumRows(p_dbf);
+
+	CHECK(NULL != (records = malloc((size_t) n * dbf_RecordLength(p_dbf) + 1)));
+	CHECK(n == dbf_ReadRecords(p_dbf, 0, n, records));
+	return records;
+}
+/* }}} */
+
+/* static test_Pairs() {{{
+ * Joins on the first column and compares the pairs with the ones found
+ * by comparing all records of both tables
+ */
+static DBF_JOIN_PAIR *test_Pairs(P_DBF *left, P_DBF *right, int *numpairs)
+{
+	DBF_JOIN_PAIR *pairs;
+	char *lrec, *rrec, *l, *r, *found;
+	int i, j, n, want = 0, key = 0;
+	int llen = dbf_RecordLength(left), rlen = dbf_RecordLength(right);
+
+	CHECK(0 <= (n = dbf_Join(left, &key, right, &key, 1, 0, &pairs)));
+	lrec = test_ReadAll(left);
+	rrec = test_ReadAll(right);
+	CHECK(NULL != (found = calloc((size_t) dbf_NumRows(left) * dbf_NumRows(right), 1)));
+
+	for (i = 0; i < n; i++) {
+		CHECK(pairs[i].left < (u_int32_t) dbf_NumRows(left) && pairs[i].right < (u_int32_t) dbf_NumRows(right));
+		l = lrec + (size_t) pairs[i].left * llen;
+		r = rrec + (size_t) pairs[i].right * rlen;
+		CHECK(0 == memcmp(l + 1, r + 1, 6) && l[1] != ' ');
+		/* no pair twice */
+		CHECK(!found[(size_t) pairs[i].left * dbf_NumRows(right) + pairs[i].right]);
+		found[(size_t) pairs[i].left * dbf_NumRows(right) + pairs[i].right] = 1;
+	}
+	for (i = 0, l = lrec; i < dbf_NumRows(left); i++, l += llen) {
+		for (j = 0, r = rrec; j < dbf_NumRows(right); j++, r += rlen) {
+			if (l[1] != ' ' && 0 == memcmp(l + 1, r + 1, 6)) {
+				want++;
+			}
+		}
+	}
+	CHECK(n == want);
+
+	free(found);
+	free(rrec);
+	free(lrec);
+	*numpairs = n;
+	return pairs;
+}
+/* }}} */
+
+/* static test_Table() {{{
+ * Writes a column of each table for every pair and checks that every
+ * record of the output holds the fields of its pair. The columns of the
+ * same number are renamed, they have the same name in a self join.
+ */
+static void test_Table(P_DBF *left, P_DBF *right, const DBF_JOIN_PAIR *pairs, int numpairs)
+{
+	DBF_JOIN_COLUMN columns[3] = {
+		{ DBF_JOIN_RIGHT, 1, "RIGHT_VAL" }, { DBF_JOIN_LEFT, 1, "LEFT_VAL" }, { DBF_JOIN_LEFT, 0, NULL }
+	};
+	P_DBF *out;
+	char *lrec, *rrec, *orec, *o, *l, *r;
+	int i, key = 0;
+	int llen = dbf_RecordLength(left), rlen = dbf_RecordLength(right), olen;
+	int lsize = dbf_ColumnSize(left, 1), rsize = dbf_ColumnSize(right, 1);
+
+	CHECK(numpairs == dbf_JoinTable(left, &key, right, &key, 1, 0, TEST_OUTPUT, columns, 3));
+	CHECK(NULL != (out = dbf_Open(TEST_OUTPUT)));
+	CHECK(numpairs == dbf_NumRows(out) && 3 == dbf_NumCols(out));
+	CHECK(0 == strcmp(dbf_ColumnName(out, 0), "RIGHT_VAL"));
+	CHECK(0 == strcmp(dbf_ColumnName(out, 1), "LEFT_VAL"));
+	CHECK(0 == strcmp(dbf_ColumnName(out, 2), "ID"));
+	olen = dbf_RecordLength(out);
+	lrec = test_ReadAll(left);
+	rrec = test_ReadAll(right);
+	orec = test_ReadAll(out);
+
+	for (i = 0, o = orec; i < numpairs; i++, o += olen) {
+		l = lrec + (size_t) pairs[i].left * llen;
+		r = rrec + (size_t) pairs[i].right * rlen;
+		CHECK(0 == memcmp(o + test_Field(out, 0), r + test_Field(right, 1), rsize));
+		CHECK(0 == memcmp(o + test_Field(out, 1), l + test_Field(left, 1), lsize));
+		CHECK(0 == memcmp(o + test_Field(out, 2), l + 1, 6));
+	}
+
+	free(orec);
+	free(rrec);
+	free(lrec);
+	CHECK(0 == dbf_Close(out));
+}
+/* }}} */
+
+/* static test_Names() {{{
+ * Output columns with the same name are refused and leave no file
+ */
+static void test_Names(P_DBF *left, P_DBF *right)
+{
+	DBF_JOIN_COLUMN same[2] = { { DBF_JOIN_LEFT, 0, NULL }, { DBF_JOIN_RIGHT, 0, NULL } };
+	DBF_JOIN_COLUMN nocase[2] = { { DBF_JOIN_LEFT, 0, NULL }, { DBF_JOIN_RIGHT, 1, "id" } };
+	DBF_JOIN_COLUMN renamed[2] = { { DBF_JOIN_LEFT, 0, NULL }, { DBF_JOIN_RIGHT, 0, "RIGHT_ID" } };
+	DBF_JOIN_COLUMN empty[1] = { { DBF_JOIN_LEFT, 0, "" } };
+	DBF_JOIN_COLUMN longname[1] = { { DBF_JOIN_LEFT, 0, "ELEVENCHARS" } };
+	struct stat st;
+	int key = 0;
+
+	unlink(TEST_OUTPUT);
+	CHECK(-1 == dbf_JoinTable(left, &key, right, &key, 1, 0, TEST_OUTPUT, same, 2));
+	CHECK(-1 == dbf_JoinTable(left, &key, right, &key, 1, 0, TEST_OUTPUT, nocase, 2));
+	CHECK(-1 == dbf_JoinTable(left, &key, right, &key, 1, 0, TEST_OUTPUT, empty, 1));
+	CHECK(-1 == dbf_JoinTable(left, &key, right, &key, 1, 0, TEST_OUTPUT, longname, 1));
+	CHECK(0 > stat(TEST_OUTPUT, &st));
+	CHECK(0 < dbf_JoinTable(left, &key, right, &key, 1, 0, TEST_OUTPUT, renamed, 2));
+	unlink(TEST_OUTPUT);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	DBF_JOIN_PAIR *pairs;
+	P_DBF *left, *right;
+	int n;
+
+	dbf_SetField(&fields[0], 'C', "ID", 6, 0);
+	dbf_SetField(&fields[1], 'N', "VAL", 8, 0);
+	test_Create(TEST_LEFT, fields, 2, TEST_LEFT_RECORDS, test_FillLeft, NULL);
+	dbf_SetField(&fields[1], 'C', "NAME", 10, 0);
+	test_Create(TEST_RIGHT, fields, 2, TEST_RIGHT_RECORDS, test_FillRight, NULL);
+	CHECK(NULL != (left = dbf_Open(TEST_LEFT)));
+	CHECK(NULL != (right = dbf_Open(TEST_RIGHT)));
+
+	/* the smaller table on either side */
+	pairs = test_Pairs(left, right, &n);
+	CHECK(n > 0);
+	test_Table(left, right, pairs, n);
+	free(pairs);
+	pairs = test_Pairs(right, left, &n);
+	CHECK(n > 0);
+	test_Table(right, left, pairs, n);
+	free(pairs);
+
+	/* the same handle on both sides */
+	pairs = test_Pairs(left, left, &n);
+	CHECK(n == 3 * (TEST_LEFT_RECORDS - TEST_LEFT_RECORDS / 50));
+	test_Table(left, left, pairs, n);
+	free(pairs);
+
+	test_Names(left, right);
+
+	CHECK(0 == dbf_Close(right));
+	CHECK(0 == dbf_Close(left));
+	unlink(TEST_OUTPUT);
+	unlink(TEST_RIGHT);
+	unlink(TEST_LEFT);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,111 @@
+/*****************************************************************************
+ * test_large.c
+ *****************************************************************************
+ * Reads records beyond 2^31 of a sparse table with the 64-bit functions
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_large.dbf"
+/* The largest number of records of the header */
+#define TEST_RECORDS 0xFFFFFFFFULL
+
+/* Records written into the holes of the table */
+static const u_int64_t test_recno[] = { 0, 0x7FFFFFFFULL, 0x80000000ULL, 0xFFFFFFFEULL };
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	(void) data;
+	record[0] = 'a' + recno;
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[1];
+	P_DBF *p_dbf;
+	unsigned char count[4];
+	char record[2];
+	u_int64_t recno;
+	off_t offset;
+	size_t i;
+	int fh;
+
+	dbf_SetField(&fields[0], 'C', "MARK", 1, 0);
+	test_Create(TEST_TABLE, fields, 1, 1, test_Fill, NULL);
+
+	/* raise the record count of the header and make the file that long
+	 * with holes, which not every file system has */
+	CHECK(-1 != (fh = open(TEST_TABLE, O_RDWR)));
+	count[0] = count[1] = count[2] = count[3] = 0xFF;
+	CHECK(4 == pwrite(fh, count, 4, 4));
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	offset = DBF_RECORD_OFFSET(p_dbf, TEST_RECORDS);
+	CHECK(0 == dbf_Close(p_dbf));
+	if (sizeof(off_t) < 8 || 0 > ftruncate(fh, offset + 1)) {
+		close(fh);
+		unlink(TEST_TABLE);
+		return TEST_SKIP;
+	}
+	CHECK(1 == pwrite(fh, "\x1a", 1, offset));
+	for (i = 0; i < sizeof(test_recno) / sizeof(test_recno[0]); i++) {
+		record[0] = ' ';
+		record[1] = 'A' + i;
+		CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+		offset = DBF_RECORD_OFFSET(p_dbf, test_recno[i]);
+		CHECK(0 == dbf_Close(p_dbf));
+		CHECK(2 == pwrite(fh, record, 2, offset));
+	}
+	CHECK(0 == close(fh));
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(dbf_NumRows64(p_dbf) == TEST_RECORDS);
+	for (i = 0; i < sizeof(test_recno) / sizeof(test_recno[0]); i++) {
+		CHECK(0 == dbf_SeekRecord64(p_dbf, test_recno[i]));
+		CHECK(dbf_TellRecord64(p_dbf) == test_recno[i]);
+		CHECK(0 == dbf_ReadRecord64(p_dbf, record, 2, &recno));
+		CHECK(recno == test_recno[i]);
+		CHECK(record[0] == ' ' && record[1] == 'A' + (int) i);
+		CHECK(dbf_TellRecord64(p_dbf) == test_recno[i] + 1);
+	}
+	/* the record following the last one written is in a hole */
+	CHECK(0 == dbf_SeekRecord64(p_dbf, 0x80000001ULL));
+	CHECK(0 == dbf_ReadRecord64(p_dbf, record, 2, NULL));
+	CHECK(record[0] == 0 && record[1] == 0);
+
+	/* the last record, then nothing */
+	CHECK(0 == dbf_SeekRecord64(p_dbf, TEST_RECORDS - 1));
+	CHECK(0 == dbf_ReadRecord64(p_dbf, record, 2, &recno));
+	CHECK(recno == TEST_RECORDS - 1);
+	CHECK(0 > dbf_ReadRecord64(p_dbf, record, 2, &recno));
+	CHECK(0 > dbf_SeekRecord64(p_dbf, TEST_RECORDS));
+	CHECK(0 > dbf_SeekRecord64(p_dbf, 0x100000000ULL));
+	CHECK(dbf_TellRecord64(p_dbf) == TEST_RECORDS);
+	CHECK(0 == dbf_Close(p_dbf));
+
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
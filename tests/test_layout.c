@@ -0,0 +1,104 @@
+/*****************************************************************************
+ * test_layout.c
+ *****************************************************************************
+ * Records of a table viewed through a layout fixed at compile time
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+#include "libdbf/dbf_schema.h"
+
+#define TEST_TABLE "test_layout.dbf"
+#define TEST_RECORDS 1000
+
+#define CUSTOMER(F) \
+	F(NAME,   'C', 20, 0) \
+	F(AMOUNT, 'N', 10, 2) \
+	F(COUNT,  'N',  6, 0) \
+	F(ACTIVE, 'L',  1, 0)
+
+DBF_DEFINE_SCHEMA(customer, CUSTOMER)
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[64];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "name %u", recno);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "%10.2f%6d%c", (recno % 2 ? -1.0 : 1.0) * recno / 4.0,
+		(int) recno - 500, recno % 3 ? 'T' : 'f');
+	test_Put(record + 20, buf);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[4];
+	const struct customer *c;
+	P_DBF *p_dbf;
+	char record[sizeof(struct customer)], name[21], want[32];
+	int i, fh;
+
+	CHECK(38 == sizeof(struct customer));
+	CHECK(21 == DBF_FIELD_OFFSET(customer, AMOUNT));
+
+	dbf_SetField(&fields[0], 'C', "NAME", 20, 0);
+	dbf_SetField(&fields[1], 'N', "AMOUNT", 10, 2);
+	dbf_SetField(&fields[2], 'N', "COUNT", 6, 0);
+	dbf_SetField(&fields[3], 'L', "ACTIVE", 1, 0);
+	test_Create(TEST_TABLE, fields, 4, TEST_RECORDS, test_Fill, NULL);
+
+	/* mark record 7 as deleted */
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(-1 != (fh = open(TEST_TABLE, O_WRONLY)));
+	CHECK(1 == pwrite(fh, "*", 1, dbf_HeaderSize(p_dbf) + 7 * dbf_RecordLength(p_dbf)));
+	close(fh);
+	CHECK(0 == dbf_Close(p_dbf));
+
+	CHECK(NULL != (p_dbf = customer_open(TEST_TABLE)));
+	for (i = 0; i < TEST_RECORDS; i++) {
+		CHECK(i == dbf_ReadRecord(p_dbf, record, sizeof(record)));
+		c = customer_record(record);
+		CHECK(DBF_IS_DELETED(c) == (i == 7));
+		snprintf(want, sizeof(want), "name %d", i);
+		CHECK(0 == strcmp(want, DBF_GET_STRING(c, NAME, name)));
+		CHECK(DBF_GET_DOUBLE(c, AMOUNT) == (i % 2 ? -1.0 : 1.0) * i / 4.0);
+		CHECK(DBF_GET_LONG(c, COUNT) == i - 500);
+		CHECK(DBF_GET_BOOL(c, ACTIVE) == (i % 3 != 0));
+	}
+	CHECK(0 == dbf_Close(p_dbf));
+
+	/* another type of the same length does not match */
+	dbf_SetField(&fields[2], 'C', "COUNT", 6, 0);
+	test_Create(TEST_TABLE, fields, 4, 1, test_Fill, NULL);
+	CHECK(NULL == customer_open(TEST_TABLE));
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(-1 == customer_check(p_dbf));
+	CHECK(0 == dbf_Close(p_dbf));
+
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,191 @@
+/*****************************************************************************
+ * test_lock.c
+ *****************************************************************************
+ * Byte-range locks at the FoxPro and Clipper offsets and appends of two
+ * processes following the same scheme
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#include <sys/wait.h>
+
+#define TEST_TABLE "test_lock.dbf"
+#define TEST_RECORDS 10
+#define TEST_APPEND 500
+
+/* marks the records of a writer */
+static char test_writer;
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "P%7u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Held() {{{
+ * Returns whether another process holds a lock on a byte
+ */
+static int test_Held(int fh, off_t offset)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = offset;
+	fl.l_len = 1;
+	CHECK(0 == fcntl(fh, F_GETLK, &fl));
+	return fl.l_type != F_UNLCK;
+}
+/* }}} */
+
+/* static test_Child() {{{
+ * Runs a check in a process of its own, since locks of the own process
+ * never conflict
+ */
+static void test_Child(int (*check)(int scheme), int scheme)
+{
+	pid_t pid;
+	int status;
+
+	CHECK(-1 != (pid = fork()));
+	if (pid == 0) {
+		_exit(check(scheme));
+	}
+	CHECK(pid == waitpid(pid, &status, 0));
+	CHECK(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+}
+/* }}} */
+
+/* static test_Conflicts() {{{
+ * Checks the locks the parent holds on the header and record 4
+ */
+static int test_Conflicts(int scheme)
+{
+	P_DBF *p_dbf;
+	off_t header, record;
+	int fh;
+
+	header = scheme == DBF_LOCK_FOXPRO ? 0x7FFFFFFE : 1000000000;
+	record = scheme == DBF_LOCK_FOXPRO ? 0x7FFFFFFE - 5 : 1000000000 + 5;
+	CHECK(-1 != (fh = open(TEST_TABLE, O_RDONLY)));
+	CHECK(test_Held(fh, header) && test_Held(fh, record));
+	CHECK(!test_Held(fh, record + 1) && !test_Held(fh, record - 1));
+	close(fh);
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(0 == dbf_SetLockScheme(p_dbf, scheme));
+	CHECK(-1 == dbf_LockRecord(p_dbf, 4, DBF_LOCK_SHARED));
+	CHECK(0 == dbf_LockRecord(p_dbf, 5, DBF_LOCK_EXCLUSIVE));
+	CHECK(0 == dbf_UnlockRecord(p_dbf, 5));
+	CHECK(0 == dbf_LockHeader(p_dbf, DBF_LOCK_SHARED));
+	CHECK(0 == dbf_UnlockHeader(p_dbf));
+	CHECK(-1 == dbf_LockHeader(p_dbf, DBF_LOCK_EXCLUSIVE));
+	CHECK(0 == dbf_Close(p_dbf));
+	return 0;
+}
+/* }}} */
+
+/* static test_Append() {{{
+ * Appends records one by one under the header lock
+ */
+static int test_Append(int scheme)
+{
+	P_DBF *p_dbf;
+	char record[8], buf[16];
+	int i;
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(0 == dbf_SetLockScheme(p_dbf, scheme));
+	for (i = 0; i < TEST_APPEND; i++) {
+		snprintf(buf, sizeof(buf), "%c%7d", test_writer, i);
+		memcpy(record, buf, 8);
+		CHECK(0 <= dbf_WriteRecord(p_dbf, record, 8));
+	}
+	CHECK(0 == dbf_Close(p_dbf));
+	return 0;
+}
+/* }}} */
+
+/* static test_Scheme() {{{
+ */
+static void test_Scheme(int scheme)
+{
+	DB_FIELD fields[1];
+	P_DBF *p_dbf;
+	pid_t pids[2];
+	char *records;
+	int i, status, counts[2] = { 0, 0 };
+
+	dbf_SetField(&fields[0], 'C', "NAME", 8, 0);
+	test_Create(TEST_TABLE, fields, 1, TEST_RECORDS, test_Fill, NULL);
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(0 == dbf_SetLockScheme(p_dbf, scheme));
+	CHECK(0 == dbf_LockHeader(p_dbf, DBF_LOCK_SHARED));
+	CHECK(0 == dbf_LockRecord(p_dbf, 4, DBF_LOCK_EXCLUSIVE));
+	test_Child(test_Conflicts, scheme);
+	CHECK(0 == dbf_UnlockRecord(p_dbf, 4));
+	CHECK(0 == dbf_UnlockHeader(p_dbf));
+	CHECK(0 == dbf_Close(p_dbf));
+
+	/* two writers, none of them overwrites records of the other */
+	for (i = 0; i < 2; i++) {
+		test_writer = 'A' + i;
+		CHECK(-1 != (pids[i] = fork()));
+		if (pids[i] == 0) {
+			_exit(test_Append(scheme));
+		}
+	}
+	for (i = 0; i < 2; i++) {
+		CHECK(pids[i] == waitpid(pids[i], &status, 0));
+		CHECK(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+	}
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(TEST_RECORDS + 2 * TEST_APPEND == dbf_NumRows(p_dbf));
+	CHECK(NULL != (records = malloc((size_t) dbf_NumRows(p_dbf) * 9)));
+	CHECK(dbf_NumRows(p_dbf) == dbf_ReadRecords(p_dbf, 0, dbf_NumRows(p_dbf), records));
+	for (i = TEST_RECORDS; i < dbf_NumRows(p_dbf); i++) {
+		CHECK(records[i * 9 + 1] == 'A' || records[i * 9 + 1] == 'B');
+		counts[records[i * 9 + 1] - 'A']++;
+	}
+	CHECK(TEST_APPEND == counts[0] && TEST_APPEND == counts[1]);
+	free(records);
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	test_Scheme(DBF_LOCK_FOXPRO);
+	test_Scheme(DBF_LOCK_CLIPPER);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,119 @@
+/*****************************************************************************
+ * test_refresh.c
+ *****************************************************************************
+ * Appends, rewrites and layout changes seen by dbf_Refresh and checkpoints
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_refresh.dbf"
+#define TEST_RECORDS 100
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Read() {{{
+ * Reads the next record and checks its number
+ */
+static void test_Read(P_DBF *p_dbf, u_int32_t recno)
+{
+	char record[32], buf[16];
+
+	CHECK((int) recno == dbf_ReadRecord(p_dbf, record, sizeof(record)));
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	CHECK(0 == memcmp(record + 1, buf, 8));
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	DBF_CHECKPOINT checkpoint;
+	P_DBF *reader, *writer;
+	char record[32], buf[16];
+	u_int32_t i;
+
+	dbf_SetField(&fields[0], 'N', "ID", 8, 0);
+	dbf_SetField(&fields[1], 'C', "NAME", 10, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, NULL);
+	CHECK(NULL != (reader = dbf_Open(TEST_TABLE)));
+	CHECK(DBF_CHANGE_NONE == dbf_Refresh(reader));
+	for (i = 0; i < 60; i++) {
+		test_Read(reader, i);
+	}
+
+	/* appended records follow the ones not read yet */
+	CHECK(NULL != (writer = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	for (i = TEST_RECORDS; i < TEST_RECORDS + 20; i++) {
+		memset(record, ' ', 18);
+		snprintf(buf, sizeof(buf), "%8u", i);
+		test_Put(record, buf);
+		CHECK(0 <= dbf_WriteRecord(writer, record, 18));
+	}
+	CHECK(0 == dbf_Close(writer));
+	CHECK(DBF_CHANGE_APPENDED == dbf_Refresh(reader));
+	CHECK(TEST_RECORDS + 20 == dbf_NumRows(reader));
+	for (i = 60; i < TEST_RECORDS + 20; i++) {
+		test_Read(reader, i);
+	}
+	CHECK(-1 == dbf_ReadRecord(reader, record, sizeof(record)));
+
+	/* a checkpoint resumes behind the records seen */
+	CHECK(0 == dbf_GetCheckpoint(reader, &checkpoint));
+	CHECK(0 == dbf_Close(reader));
+	CHECK(NULL != (reader = dbf_Open(TEST_TABLE)));
+	CHECK(DBF_CHANGE_NONE == dbf_ResumeCheckpoint(reader, &checkpoint));
+	CHECK(-1 == dbf_ReadRecord(reader, record, sizeof(record)));
+
+	/* fewer records with the same fields start over */
+	test_Create(TEST_TABLE, fields, 2, 30, test_Fill, NULL);
+	CHECK(DBF_CHANGE_REWRITTEN == dbf_Refresh(reader));
+	test_Read(reader, 0);
+
+	/* fields of the same lengths but another type or name */
+	dbf_SetField(&fields[0], 'C', "ID", 8, 0);
+	test_Create(TEST_TABLE, fields, 2, 30, test_Fill, NULL);
+	CHECK((DBF_CHANGE_REWRITTEN | DBF_CHANGE_LAYOUT) == dbf_Refresh(reader));
+	CHECK('N' == dbf_ColumnType(reader, 0));
+	CHECK(0 == dbf_Close(reader));
+
+	CHECK(NULL != (reader = dbf_Open(TEST_TABLE)));
+	dbf_SetField(&fields[1], 'C', "LABEL", 10, 0);
+	test_Create(TEST_TABLE, fields, 2, 30, test_Fill, NULL);
+	CHECK((DBF_CHANGE_REWRITTEN | DBF_CHANGE_LAYOUT) == dbf_Refresh(reader));
+	CHECK((DBF_CHANGE_REWRITTEN | DBF_CHANGE_LAYOUT) == dbf_ResumeCheckpoint(reader, &checkpoint));
+	CHECK(0 == dbf_Close(reader));
+
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
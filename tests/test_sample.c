@@ -0,0 +1,123 @@
+/*****************************************************************************
+ * test_sample.c
+ *****************************************************************************
+ * Uniform and Bernoulli samples hold distinct records in file order
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_sample.dbf"
+#define TEST_RECORDS 10000
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Check() {{{
+ * Checks that the records of a sample are the ones named by their
+ * ascending record numbers
+ */
+static void test_Check(P_DBF *p_dbf, const char *records, const u_int32_t *recnos, int n)
+{
+	char buf[16];
+	int i, reclen = dbf_RecordLength(p_dbf);
+
+	for (i = 0; i < n; i++) {
+		CHECK(recnos[i] < TEST_RECORDS);
+		CHECK(i == 0 || recnos[i] > recnos[i - 1]);
+		snprintf(buf, sizeof(buf), "%8u", recnos[i]);
+		CHECK(0 == memcmp(records + (size_t) i * reclen + 1, buf, 8));
+	}
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[1];
+	P_DBF *p_dbf;
+	char *records, *again, *bern;
+	u_int32_t *recnos, *recnos2, *bernnos;
+	int n, reclen;
+
+	dbf_SetField(&fields[0], 'N', "ID", 8, 0);
+	test_Create(TEST_TABLE, fields, 1, TEST_RECORDS, test_Fill, NULL);
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	reclen = dbf_RecordLength(p_dbf);
+	CHECK(NULL != (records = malloc((size_t) TEST_RECORDS * reclen)));
+	CHECK(NULL != (again = malloc((size_t) TEST_RECORDS * reclen)));
+	CHECK(NULL != (recnos = malloc(TEST_RECORDS * sizeof(u_int32_t))));
+	CHECK(NULL != (recnos2 = malloc(TEST_RECORDS * sizeof(u_int32_t))));
+
+	/* the same seed gives the same sample, another seed another one */
+	CHECK(500 == dbf_SampleRecords(p_dbf, 500, 42, records, recnos));
+	test_Check(p_dbf, records, recnos, 500);
+	CHECK(500 == dbf_SampleRecords(p_dbf, 500, 42, again, recnos2));
+	CHECK(0 == memcmp(recnos, recnos2, 500 * sizeof(u_int32_t)));
+	CHECK(0 == memcmp(records, again, (size_t) 500 * reclen));
+	CHECK(500 == dbf_SampleRecords(p_dbf, 500, 43, again, recnos2));
+	CHECK(0 != memcmp(recnos, recnos2, 500 * sizeof(u_int32_t)));
+
+	/* the whole table if it is too small */
+	CHECK(TEST_RECORDS == dbf_SampleRecords(p_dbf, TEST_RECORDS + 10, 1, records, recnos));
+	test_Check(p_dbf, records, recnos, TEST_RECORDS);
+	CHECK(TEST_RECORDS - 1 == recnos[TEST_RECORDS - 1]);
+
+	/* about a tenth of the records */
+	CHECK(0 <= (n = dbf_SampleBernoulli(p_dbf, 10, 7, &bern, &bernnos)));
+	CHECK(n > 800 && n < 1200);
+	test_Check(p_dbf, bern, bernnos, n);
+	free(bern);
+	free(bernnos);
+
+	CHECK(TEST_RECORDS == dbf_SampleBernoulli(p_dbf, 100, 7, &bern, &bernnos));
+	test_Check(p_dbf, bern, bernnos, TEST_RECORDS);
+	free(bern);
+	free(bernnos);
+
+	/* tiny percentages end and rarely select anything */
+	CHECK(0 <= (n = dbf_SampleBernoulli(p_dbf, 1e-9, 7, &bern, &bernnos)));
+	CHECK(n <= 1);
+	test_Check(p_dbf, bern, bernnos, n);
+	free(bern);
+	free(bernnos);
+	CHECK(0 == dbf_SampleBernoulli(p_dbf, 0, 7, &bern, &bernnos));
+	free(bern);
+	free(bernnos);
+
+	free(recnos2);
+	free(recnos);
+	free(again);
+	free(records);
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,123 @@
+/*****************************************************************************
+ * test_schema.c
+ *****************************************************************************
+ * Handles share cached field descriptors until the file changes, also
+ * while other threads flush the cache
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <utime.h>
+
+#define TEST_TABLE "test_schema.dbf"
+#define TEST_RECORDS 100
+#define TEST_THREADS 4
+#define TEST_OPENS 2000
+
+/* threads still opening the table */
+static int test_running = TEST_THREADS;
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Open() {{{
+ * Opens the table again and again while the main thread flushes
+ */
+static void *test_Open(void *data)
+{
+	P_DBF *p_dbf;
+	int i;
+
+	(void) data;
+	for (i = 0; i < TEST_OPENS; i++) {
+		CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+		CHECK(TEST_RECORDS == dbf_NumRows(p_dbf) && 2 == dbf_NumCols(p_dbf));
+		CHECK(0 == strcmp("NAME", dbf_ColumnName(p_dbf, 1)));
+		CHECK(0 == dbf_Close(p_dbf));
+	}
+	__sync_fetch_and_sub(&test_running, 1);
+	return NULL;
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	P_DBF *first, *second;
+	pthread_t threads[TEST_THREADS];
+	struct utimbuf times;
+	int i;
+
+	dbf_SetField(&fields[0], 'N', "ID", 8, 0);
+	dbf_SetField(&fields[1], 'C', "NAME", 10, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, NULL);
+	if (0 > dbf_SchemaCacheEnable(1)) {
+		unlink(TEST_TABLE);
+		return TEST_SKIP;
+	}
+
+	/* the second handle takes the descriptors of the first */
+	CHECK(NULL != (first = dbf_Open(TEST_TABLE)));
+	CHECK(NULL != (second = dbf_Open(TEST_TABLE)));
+	CHECK(dbf_ColumnName(first, 0) == dbf_ColumnName(second, 0));
+	CHECK(0 == dbf_Close(second));
+
+	/* a changed file is read again */
+	times.actime = times.modtime = time(NULL) - 3600;
+	CHECK(0 == utime(TEST_TABLE, &times));
+	CHECK(NULL != (second = dbf_Open(TEST_TABLE)));
+	CHECK(dbf_ColumnName(first, 0) != dbf_ColumnName(second, 0));
+	CHECK(0 == strcmp("ID", dbf_ColumnName(second, 0)));
+	CHECK(0 == dbf_Close(second));
+
+	/* a flush keeps what open handles use */
+	CHECK(0 == dbf_SchemaCacheFlush());
+	CHECK(0 == strcmp("ID", dbf_ColumnName(first, 0)));
+	CHECK(0 == dbf_Close(first));
+
+	for (i = 0; i < TEST_THREADS; i++) {
+		CHECK(0 == pthread_create(&threads[i], NULL, test_Open, NULL));
+	}
+	while (__sync_fetch_and_add(&test_running, 0) > 0) {
+		CHECK(0 == dbf_SchemaCacheFlush());
+	}
+	for (i = 0; i < TEST_THREADS; i++) {
+		CHECK(0 == pthread_join(threads[i], NULL));
+	}
+	CHECK(0 == dbf_SchemaCacheFlush());
+
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
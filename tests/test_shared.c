@@ -0,0 +1,246 @@
+/*****************************************************************************
+ * test_shared.c
+ *****************************************************************************
+ * Loads a table into shared memory from several threads at once, reads
+ * it, replaces it with a new version and removes the segments
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+/* compiled into the test for the names of the segments */
+#include "../src/dbf_shared.c"
+
+#include <pthread.h>
+
+#include "test.h"
+
+#define TEST_TABLE "test_shared.dbf"
+/* large enough for the threads to load at the same time */
+#define TEST_RECORDS 200000
+#define TEST_THREADS 8
+
+#if defined(HAVE_SYS_MMAN_H) && defined(F_SETLK)
+
+typedef struct {
+	pthread_barrier_t *start;
+	P_DBF *p_dbf;
+} TEST_THREAD;
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "v%u-%u", *(u_int32_t *) data, recno % 1000);
+	test_Put(record + 8, buf);
+}
+/* }}} */
+
+/* static test_Table() {{{
+ * Writes a version of the table
+ */
+static void test_Table(u_int32_t records, u_int32_t version)
+{
+	DB_FIELD fields[2];
+
+	dbf_SetField(&fields[0], 'N', "NUM", 8, 0);
+	dbf_SetField(&fields[1], 'C', "NAME", 12, 0);
+	test_Create(TEST_TABLE, fields, 2, records, test_Fill, &version);
+}
+/* }}} */
+
+/* static test_Segment() {{{
+ * Returns the name of the segment of the current version of the table
+ */
+static char *test_Segment(void)
+{
+	DBF_SHARED_HEADER key;
+	char *name;
+
+	CHECK(0 == dbf_SharedKey(TEST_TABLE, &key));
+	CHECK(NULL != (name = dbf_SharedName(&key)));
+	return name;
+}
+/* }}} */
+
+/* static test_Exists() {{{
+ */
+static int test_Exists(const char *name)
+{
+	struct stat st;
+
+	return 0 == stat(name, &st);
+}
+/* }}} */
+
+/* static test_Segments() {{{
+ * Counts the files of the table in the segment directory, temporary
+ * files of loaders included
+ */
+static int test_Segments(void)
+{
+	DBF_SHARED_HEADER key;
+	struct dirent *entry;
+	char prefix[64];
+	DIR *d;
+	int n = 0;
+
+	CHECK(0 == dbf_SharedKey(TEST_TABLE, &key));
+	dbf_SharedPrefix(&key, prefix, sizeof(prefix));
+	CHECK(NULL != (d = opendir(dbf_SharedDir())));
+	while (NULL != (entry = readdir(d))) {
+		if (!strncmp(entry->d_name, prefix, strlen(prefix))) {
+			n++;
+		}
+	}
+	closedir(d);
+	return n;
+}
+/* }}} */
+
+/* static test_Compare() {{{
+ * Compares a shared handle with the table read from the file
+ */
+static void test_Compare(P_DBF *p_dbf, u_int32_t records)
+{
+	P_DBF *file;
+	char *a, *b;
+	int reclen;
+
+	CHECK(NULL != (file = dbf_Open(TEST_TABLE)));
+	CHECK(dbf_NumRows(p_dbf) == (int) records && dbf_NumRows(file) == (int) records);
+	CHECK(dbf_NumCols(p_dbf) == 2);
+	CHECK(0 == strcmp(dbf_ColumnName(p_dbf, 1), "NAME"));
+	reclen = dbf_RecordLength(file);
+	CHECK(reclen == dbf_RecordLength(p_dbf));
+	CHECK(NULL != (a = malloc((size_t) records * reclen)));
+	CHECK(NULL != (b = malloc((size_t) records * reclen)));
+	CHECK((int) records == dbf_ReadRecords(file, 0, records, a));
+	CHECK((int) records == dbf_ReadRecords(p_dbf, 0, records, b));
+	CHECK(0 == memcmp(a, b, (size_t) records * reclen));
+	free(b);
+	free(a);
+	CHECK(0 == dbf_Close(file));
+}
+/* }}} */
+
+/* static test_Open() {{{
+ * Thread opening the table at the same time as the others
+ */
+static void *test_Open(void *arg)
+{
+	TEST_THREAD *t = arg;
+
+	pthread_barrier_wait(t->start);
+	t->p_dbf = dbf_OpenShared(TEST_TABLE);
+	return NULL;
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	TEST_THREAD threads[TEST_THREADS];
+	pthread_t tids[TEST_THREADS];
+	pthread_barrier_t start;
+	P_DBF *old, *now;
+	char *name, *next, record[32];
+	int i;
+
+	if (0 != access(dbf_SharedDir(), W_OK)) {
+		return TEST_SKIP;
+	}
+	test_Table(TEST_RECORDS, 1);
+	CHECK(0 == dbf_SharedRemove(TEST_TABLE));
+	name = test_Segment();
+	CHECK(!test_Exists(name));
+
+	/* the threads of one process load the table at the same time, one
+	 * segment is left of it */
+	CHECK(0 == pthread_barrier_init(&start, NULL, TEST_THREADS));
+	for (i = 0; i < TEST_THREADS; i++) {
+		threads[i].start = &start;
+		CHECK(0 == pthread_create(&tids[i], NULL, test_Open, &threads[i]));
+	}
+	for (i = 0; i < TEST_THREADS; i++) {
+		CHECK(0 == pthread_join(tids[i], NULL));
+		CHECK(NULL != threads[i].p_dbf);
+	}
+	pthread_barrier_destroy(&start);
+	CHECK(test_Exists(name));
+	CHECK(1 == test_Segments());
+	for (i = 0; i < TEST_THREADS; i++) {
+		test_Compare(threads[i].p_dbf, TEST_RECORDS);
+	}
+
+#ifdef F_OFD_SETLK
+	/* segments in use stay */
+	CHECK(0 == dbf_SharedRemove(TEST_TABLE));
+	CHECK(test_Exists(name));
+	test_Compare(threads[0].p_dbf, TEST_RECORDS);
+#endif
+	for (i = 0; i < TEST_THREADS; i++) {
+		CHECK(0 == dbf_Close(threads[i].p_dbf));
+	}
+	/* the current version stays until it is removed */
+	CHECK(test_Exists(name));
+	CHECK(0 == dbf_SharedRemove(TEST_TABLE));
+	CHECK(!test_Exists(name));
+
+	/* a new version of the table gets a new segment, while the old one
+	 * is read until its last handle is closed */
+	CHECK(NULL != (old = dbf_OpenShared(TEST_TABLE)));
+	test_Table(TEST_RECORDS + 500, 2);
+	next = test_Segment();
+	CHECK(strcmp(name, next));
+	CHECK(NULL != (now = dbf_OpenShared(TEST_TABLE)));
+	test_Compare(now, TEST_RECORDS + 500);
+	CHECK(dbf_NumRows(old) == TEST_RECORDS);
+	CHECK(1 == dbf_ReadRecords(old, TEST_RECORDS - 1, 1, record));
+	CHECK(0 == memcmp(record + 9, "v1-999", 6));
+	CHECK(test_Exists(name) && test_Exists(next));
+	CHECK(0 == dbf_Close(old));
+	CHECK(!test_Exists(name));
+	CHECK(0 == dbf_Close(now));
+	CHECK(0 == dbf_SharedRemove(TEST_TABLE));
+	CHECK(0 == test_Segments());
+
+	free(next);
+	free(name);
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+#else
+
+/* main() {{{
+ * Shared memory needs mmap() and fcntl() locks
+ */
+int main(void)
+{
+	return TEST_SKIP;
+}
+/* }}} */
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,129 @@
+/*****************************************************************************
+ * test_sort.c
+ *****************************************************************************
+ * Sorts a table in several merge passes and checks the result
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+/*
+ * With these sizes a run holds 1220 records of this table and a merge
+ * reads 7 runs at a time, so the 80000 records make 66 runs, which are
+ * merged into 10 and then into 2 before the last merge writes the
+ * output. dbf_Sort is compiled into the test with them.
+ */
+#define DBF_SORT_MIN_MEMORY (64 * 1024)
+#define DBF_SORT_READ (8 * 1024)
+#define DBF_SORT_RUNBUF (8 * 1024)
+#define DBF_SORT_WRITE (8 * 1024)
+#include "../src/dbf_sort.c"
+
+#include "test.h"
+
+#define TEST_TABLE "test_sort.dbf"
+#define TEST_OUTPUT "test_sort.out.dbf"
+#define TEST_RECORDS 80000
+
+/* static test_Fill() {{{
+ * Keys with many duplicates and the record number as name
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	u_int32_t *state = data;
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%10u", test_Random(state) % 5000);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "%08u", recno);
+	test_Put(record + 10, buf);
+}
+/* }}} */
+
+/* static test_Check() {{{
+ * Checks order and stability of the output and that every record of the
+ * table is in it once
+ */
+static void test_Check(int descending)
+{
+	P_DBF *p_dbf;
+	char *records, *rec, *seen, buf[16];
+	long key, last = 0;
+	u_int32_t i, recno, lastno = 0;
+	int reclen;
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_OUTPUT)));
+	CHECK(dbf_NumRows(p_dbf) == TEST_RECORDS);
+	reclen = dbf_RecordLength(p_dbf);
+	CHECK(NULL != (records = malloc((size_t) TEST_RECORDS * reclen)));
+	CHECK(NULL != (seen = calloc(TEST_RECORDS, 1)));
+	CHECK(TEST_RECORDS == dbf_ReadRecords(p_dbf, 0, TEST_RECORDS, records));
+
+	for (i = 0, rec = records; i < TEST_RECORDS; i++, rec += reclen) {
+		memcpy(buf, rec + 1, 10);
+		buf[10] = '\0';
+		key = strtol(buf, NULL, 10);
+		memcpy(buf, rec + 11, 8);
+		buf[8] = '\0';
+		recno = strtoul(buf, NULL, 10);
+		CHECK(recno < TEST_RECORDS && !seen[recno]);
+		seen[recno] = 1;
+		if (i > 0) {
+			CHECK(descending ? key <= last : key >= last);
+			/* equal keys keep the order of the table */
+			CHECK(key != last || recno > lastno);
+		}
+		last = key;
+		lastno = recno;
+	}
+
+	free(seen);
+	free(records);
+	CHECK(0 == dbf_Close(p_dbf));
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	DBF_SORT_KEY key;
+	P_DBF *p_dbf;
+	u_int32_t state = 1;
+
+	dbf_SetField(&fields[0], 'N', "KEY", 10, 0);
+	dbf_SetField(&fields[1], 'C', "NAME", 8, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, &state);
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+
+	key.column = 0;
+	key.flags = 0;
+	CHECK(TEST_RECORDS == dbf_Sort(p_dbf, TEST_OUTPUT, &key, 1, 0));
+	test_Check(0);
+
+	key.flags = DBF_SORT_DESCENDING;
+	CHECK(TEST_RECORDS == dbf_Sort(p_dbf, TEST_OUTPUT, &key, 1, 0));
+	test_Check(1);
+
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_OUTPUT);
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * test_stats.c
+ *****************************************************************************
+ * The statistics of a handle count what reads and updates did
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_stats.dbf"
+#define TEST_RECORDS 1000
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[32];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[1];
+	DBF_STATS stats;
+	P_DBF *p_dbf;
+	char *record;
+	int i, reclen;
+
+	dbf_SetField(&fields[0], 'N', "ID", 8, 0);
+	test_Create(TEST_TABLE, fields, 1, TEST_RECORDS, test_Fill, NULL);
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	reclen = dbf_RecordLength(p_dbf);
+	CHECK(NULL != (record = malloc(reclen)));
+
+#ifdef WITH_STATS
+	CHECK(0 == dbf_ResetStats(p_dbf));
+	for (i = 0; i < TEST_RECORDS; i++) {
+		CHECK(i == dbf_ReadRecord(p_dbf, record, reclen));
+	}
+	CHECK(-1 == dbf_ReadRecord(p_dbf, record, reclen));
+	CHECK(0 == dbf_GetStats(p_dbf, &stats));
+	CHECK(TEST_RECORDS == stats.records_decoded);
+	CHECK(stats.reads > 0 && stats.bytes_read >= (unsigned long long) TEST_RECORDS * reclen);
+	CHECK(0 == stats.bytes_written && 0 == stats.header_writes);
+
+	/* an update writes the record and the header once */
+	CHECK(0 == dbf_UpdateField(p_dbf, 3, 0, "      42", 8));
+	CHECK(0 == dbf_Flush(p_dbf));
+	CHECK(0 == dbf_GetStats(p_dbf, &stats));
+	CHECK(stats.writes > 0 && stats.bytes_written >= 8);
+	CHECK(1 == stats.header_writes);
+
+	CHECK(0 == dbf_ResetStats(p_dbf));
+	CHECK(0 == dbf_GetStats(p_dbf, &stats));
+	CHECK(0 == stats.records_decoded && 0 == stats.reads && 0 == stats.io_nsec);
+#else
+	/* without statistics every counter stays 0 */
+	for (i = 0; i < TEST_RECORDS; i++) {
+		CHECK(i == dbf_ReadRecord(p_dbf, record, reclen));
+	}
+	CHECK(-1 == dbf_GetStats(p_dbf, &stats));
+	CHECK(0 == stats.records_decoded && 0 == stats.bytes_read);
+	CHECK(-1 == dbf_ResetStats(p_dbf));
+#endif
+
+	free(record);
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
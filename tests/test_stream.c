@@ -0,0 +1,242 @@
+/*****************************************************************************
+ * test_stream.c
+ *****************************************************************************
+ * Reads gzip and zstd compressed tables out of order through the index
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+/*
+ * Frames of more than 1 MiB are decoded sequentially, so the large
+ * frames of the test get there with a small table. The decoder is
+ * compiled into the test with this size.
+ */
+#define DBF_STREAM_MAX_CHUNK (1024 * 1024)
+#include "../src/dbf_stream.c"
+
+#include "test.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#define TEST_TABLE "test_stream.dbf"
+#define TEST_GZIP "test_stream.dbf.gz"
+#define TEST_ZSTD "test_stream.dbf.zst"
+/* About 2.5 MB, three access points of gzip files */
+#define TEST_RECORDS 130000
+/* Uncompressed bytes of a zstd frame */
+#define TEST_FRAME (256 * 1024)
+/* Uncompressed bytes of a zstd frame decoded sequentially */
+#define TEST_LARGE (1536 * 1024)
+
+/* Frames without their size */
+#define TEST_NOSIZE 1
+/* Seek table of the zstd seekable format at the end */
+#define TEST_SEEKABLE 2
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	u_int32_t *state = data;
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%10u", recno);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "%08x", test_Random(state));
+	test_Put(record + 10, buf);
+}
+/* }}} */
+
+/* static test_Load() {{{
+ * Reads a whole file
+ */
+static char *test_Load(const char *file, size_t *size)
+{
+	FILE *fp;
+	char *data;
+	long len;
+
+	CHECK(NULL != (fp = fopen(file, "rb")));
+	CHECK(0 == fseek(fp, 0, SEEK_END) && 0 <= (len = ftell(fp)));
+	rewind(fp);
+	CHECK(NULL != (data = malloc(len)));
+	CHECK(fread(data, 1, len, fp) == (size_t) len);
+	fclose(fp);
+	*size = len;
+	return data;
+}
+/* }}} */
+
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+/* static test_Compare() {{{
+ * Reads the compressed table in an order jumping back and forth and
+ * compares every block with the plain one
+ */
+static void test_Compare(const char *file, P_DBF *plain)
+{
+	P_DBF *p_dbf;
+	char *want, *got;
+	u_int32_t first, n, state = 7;
+	int i, reclen;
+
+	CHECK(NULL != (p_dbf = dbf_Open(file)));
+	CHECK(dbf_NumRows(p_dbf) == TEST_RECORDS);
+	reclen = dbf_RecordLength(plain);
+	CHECK(NULL != (want = malloc(1000 * reclen)) && NULL != (got = malloc(1000 * reclen)));
+
+	/* the last records first, then back to the beginning and at random */
+	for (i = 0; i < 200; i++) {
+		if (i == 0) {
+			first = TEST_RECORDS - 1000;
+		} else if (i == 1) {
+			first = 0;
+		} else {
+			first = test_Random(&state) % TEST_RECORDS;
+		}
+		n = test_Random(&state) % 1000 + 1;
+		if (n > TEST_RECORDS - first) {
+			n = TEST_RECORDS - first;
+		}
+		CHECK((int) n == dbf_ReadRecords(plain, first, n, want));
+		CHECK((int) n == dbf_ReadRecords(p_dbf, first, n, got));
+		CHECK(0 == memcmp(want, got, (size_t) n * reclen));
+	}
+
+	free(got);
+	free(want);
+	CHECK(0 == dbf_Close(p_dbf));
+}
+/* }}} */
+#endif
+
+#ifdef HAVE_LIBZSTD
+/* static test_Put32() {{{
+ */
+static void test_Put32(FILE *fp, u_int32_t value)
+{
+	unsigned char buf[4];
+
+	buf[0] = value;
+	buf[1] = value >> 8;
+	buf[2] = value >> 16;
+	buf[3] = value >> 24;
+	CHECK(fwrite(buf, 1, 4, fp) == 4);
+}
+/* }}} */
+
+/* static test_Zstd() {{{
+ * Writes data as independent zstd frames of the given size
+ */
+static void test_Zstd(const char *file, const char *data, size_t size, size_t frame, int flags)
+{
+	ZSTD_CCtx *cctx;
+	FILE *fp;
+	char *buf;
+	u_int32_t *sizes;
+	size_t offset, len, n, frames = 0, bound = ZSTD_compressBound(frame);
+
+	CHECK(NULL != (buf = malloc(bound)));
+	CHECK(NULL != (sizes = malloc((size / frame + 1) * 2 * sizeof(u_int32_t))));
+	CHECK(NULL != (cctx = ZSTD_createCCtx()));
+	CHECK(!ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, !(flags & TEST_NOSIZE))));
+	CHECK(NULL != (fp = fopen(file, "wb")));
+	for (offset = 0; offset < size; offset += n) {
+		n = size - offset < frame ? size - offset : frame;
+		len = ZSTD_compress2(cctx, buf, bound, data + offset, n);
+		CHECK(!ZSTD_isError(len));
+		CHECK(fwrite(buf, 1, len, fp) == len);
+		sizes[2 * frames] = len;
+		sizes[2 * frames + 1] = n;
+		frames++;
+	}
+	if (flags & TEST_SEEKABLE) {
+		test_Put32(fp, 0x184D2A5EU);
+		test_Put32(fp, frames * 8 + 9);
+		for (n = 0; n < 2 * frames; n++) {
+			test_Put32(fp, sizes[n]);
+		}
+		test_Put32(fp, frames);
+		CHECK(fputc(0, fp) == 0);
+		test_Put32(fp, 0x8F92EAB1U);
+	}
+	CHECK(0 == fclose(fp));
+	ZSTD_freeCCtx(cctx);
+	free(sizes);
+	free(buf);
+}
+/* }}} */
+#endif
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	P_DBF *plain;
+	char *data;
+	size_t size;
+	u_int32_t state = 1;
+	int tested = 0;
+
+	dbf_SetField(&fields[0], 'N', "ID", 10, 0);
+	dbf_SetField(&fields[1], 'C', "VALUE", 8, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, &state);
+	data = test_Load(TEST_TABLE, &size);
+	CHECK(NULL != (plain = dbf_Open(TEST_TABLE)));
+
+#ifdef HAVE_LIBZ
+	{
+		gzFile gz;
+
+		CHECK(NULL != (gz = gzopen(TEST_GZIP, "wb")));
+		CHECK(gzwrite(gz, data, size) == (int) size);
+		CHECK(Z_OK == gzclose(gz));
+		test_Compare(TEST_GZIP, plain);
+		unlink(TEST_GZIP);
+		tested = 1;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	/* independent frames, indexed one by one while reading */
+	test_Zstd(TEST_ZSTD, data, size, TEST_FRAME, 0);
+	test_Compare(TEST_ZSTD, plain);
+	test_Zstd(TEST_ZSTD, data, size, TEST_FRAME, TEST_SEEKABLE);
+	test_Compare(TEST_ZSTD, plain);
+	/* frames decoded sequentially, one of them without its size */
+	test_Zstd(TEST_ZSTD, data, size, TEST_LARGE, 0);
+	test_Compare(TEST_ZSTD, plain);
+	test_Zstd(TEST_ZSTD, data, size, size, TEST_NOSIZE);
+	test_Compare(TEST_ZSTD, plain);
+	test_Zstd(TEST_ZSTD, data, size, TEST_LARGE, TEST_SEEKABLE);
+	test_Compare(TEST_ZSTD, plain);
+	unlink(TEST_ZSTD);
+	tested = 1;
+#endif
+
+	CHECK(0 == dbf_Close(plain));
+	free(data);
+	unlink(TEST_TABLE);
+	return tested ? 0 : TEST_SKIP;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,142 @@
+/*****************************************************************************
+ * test_update.c
+ *****************************************************************************
+ * Updates through the block cache and the map, and updates of records
+ * the header counts but the file does not hold
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_update.dbf"
+#define TEST_RECORDS 20000
+/* Records left in the file cut off behind them */
+#define TEST_KEPT 100
+
+/* static test_Fill() {{{
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[40];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "%8u%24s", recno, "old");
+	test_Put(record, buf);
+}
+/* }}} */
+
+/* static test_Expect() {{{
+ * Checks the first field of a record
+ */
+static void test_Expect(P_DBF *p_dbf, u_int32_t recno, const char *value)
+{
+	char record[40];
+
+	CHECK(1 == dbf_ReadRecords(p_dbf, recno, 1, record));
+	CHECK(0 == memcmp(record + 1, value, 8));
+}
+/* }}} */
+
+/* static test_Updates() {{{
+ * Updates records spread over more blocks than the cache holds, some
+ * of them across a block boundary, and reads them back before and after
+ * the flush
+ */
+static void test_Updates(int flags)
+{
+	P_DBF *p_dbf;
+	char record[40], buf[16];
+	u_int32_t recno;
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR | flags)));
+	for (recno = 0; recno < TEST_RECORDS; recno += 97) {
+		snprintf(buf, sizeof(buf), "N%7u", recno);
+		memset(record, ' ', 32);
+		memcpy(record, buf, 8);
+		CHECK(0 == dbf_UpdateRecord(p_dbf, recno, record, 32));
+		test_Expect(p_dbf, recno, buf);
+	}
+	CHECK(0 == dbf_UpdateField(p_dbf, 124, 0, "F", 1));
+	test_Expect(p_dbf, 124, "F       ");
+	CHECK(-1 == dbf_UpdateField(p_dbf, 124, 0, "123456789", 9));
+	CHECK(-1 == dbf_UpdateRecord(p_dbf, TEST_RECORDS, record, 32));
+	CHECK(0 == dbf_Flush(p_dbf));
+	CHECK(0 == dbf_Close(p_dbf));
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	for (recno = 0; recno < TEST_RECORDS; recno += 97) {
+		snprintf(buf, sizeof(buf), "N%7u", recno);
+		test_Expect(p_dbf, recno, buf);
+	}
+	test_Expect(p_dbf, 124, "F       ");
+	test_Expect(p_dbf, 125, "     125");
+	CHECK(0 == dbf_Close(p_dbf));
+}
+/* }}} */
+
+/* static test_Truncated() {{{
+ * A table whose header counts more records than the file holds, as
+ * left behind by a writer which crashed. Updates behind the end fail
+ * without filling the cache.
+ */
+static void test_Truncated(void)
+{
+	P_DBF *p_dbf;
+	char record[40];
+	u_int32_t recno;
+	int i;
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(0 == truncate(TEST_TABLE, dbf_HeaderSize(p_dbf) + TEST_KEPT * dbf_RecordLength(p_dbf)));
+	memset(record, 'x', 32);
+	for (i = 0; i < 3; i++) {
+		for (recno = TEST_KEPT; recno < TEST_RECORDS; recno += 131) {
+			CHECK(-1 == dbf_UpdateRecord(p_dbf, recno, record, 32));
+			CHECK(-1 == dbf_UpdateField(p_dbf, recno, 0, "x", 1));
+		}
+		CHECK(0 == dbf_Flush(p_dbf));
+	}
+	CHECK(0 == dbf_UpdateField(p_dbf, TEST_KEPT - 1, 0, "LAST", 4));
+	test_Expect(p_dbf, TEST_KEPT - 1, "LAST    ");
+	CHECK(0 == dbf_Close(p_dbf));
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	test_Expect(p_dbf, TEST_KEPT - 1, "LAST    ");
+	CHECK(0 == dbf_Close(p_dbf));
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+
+	dbf_SetField(&fields[0], 'C', "KEY", 8, 0);
+	dbf_SetField(&fields[1], 'C', "VALUE", 24, 0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, NULL);
+	test_Updates(0);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, NULL);
+	test_Updates(DBF_OPEN_MMAP);
+	test_Truncated();
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,232 @@
+/*****************************************************************************
+ * test_verify.c
+ *****************************************************************************
+ * Damages a table in several ways and checks what dbf_Verify finds and
+ * what dbf_Repair fixes
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#define TEST_TABLE "test_verify.dbf"
+/* enough records for dbf_Verify to use four threads */
+#define TEST_RECORDS 20000
+
+/* static test_Fill() {{{
+ * A number, a date, a logical and a name in every record
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%8u", recno);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "2024%02u%02u", recno % 12 + 1, recno % 28 + 1);
+	test_Put(record + 8, buf);
+	test_Put(record + 16, recno % 2 ? "T" : "F");
+	snprintf(buf, sizeof(buf), "%04u", recno % 10000);
+	test_Put(record + 17, buf);
+}
+/* }}} */
+
+/* static test_Table() {{{
+ * Writes the table again
+ */
+static void test_Table(void)
+{
+	DB_FIELD fields[4];
+
+	dbf_SetField(&fields[0], 'N', "NUM", 8, 0);
+	dbf_SetField(&fields[1], 'D', "DAY", 8, 0);
+	dbf_SetField(&fields[2], 'L', "FLAG", 1, 0);
+	dbf_SetField(&fields[3], 'C', "NAME", 4, 0);
+	test_Create(TEST_TABLE, fields, 4, TEST_RECORDS, test_Fill, NULL);
+}
+/* }}} */
+
+/* static test_Offset() {{{
+ * Returns the offset of a record in the file
+ */
+static off_t test_Offset(u_int32_t recno)
+{
+	P_DBF *p_dbf;
+	off_t offset;
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	offset = DBF_RECORD_OFFSET(p_dbf, recno);
+	CHECK(0 == dbf_Close(p_dbf));
+	return offset;
+}
+/* }}} */
+
+/* static test_Write() {{{
+ * Overwrites bytes of the file behind the back of the library
+ */
+static void test_Write(off_t offset, const void *buf, size_t len)
+{
+	int fh;
+
+	CHECK(-1 != (fh = open(TEST_TABLE, O_WRONLY)));
+	CHECK((ssize_t) len == pwrite(fh, buf, len, offset));
+	CHECK(0 == close(fh));
+}
+/* }}} */
+
+/* static test_Count() {{{
+ * Sets the number of records in the header
+ */
+static void test_Count(u_int32_t records)
+{
+	unsigned char buf[4];
+
+	buf[0] = records & 0xff;
+	buf[1] = (records >> 8) & 0xff;
+	buf[2] = (records >> 16) & 0xff;
+	buf[3] = (records >> 24) & 0xff;
+	test_Write(4, buf, 4);
+}
+/* }}} */
+
+/* static test_Verify() {{{
+ * Verifies the table with one and with four threads, which must agree,
+ * and returns the problems found
+ */
+static int test_Verify(int flags, DBF_VERIFY *v)
+{
+	DBF_VERIFY other;
+	P_DBF *p_dbf;
+
+	CHECK(NULL != (p_dbf = dbf_Open(TEST_TABLE)));
+	CHECK(0 == dbf_Verify(p_dbf, flags, 1, v));
+	CHECK(0 == dbf_Verify(p_dbf, flags, 4, &other));
+	CHECK(0 == memcmp(v, &other, sizeof(DBF_VERIFY)));
+	CHECK(0 == strcmp((char *) p_dbf->integrity, v->problems ? "invalid" : "valid"));
+	CHECK(0 == dbf_Close(p_dbf));
+	return v->problems;
+}
+/* }}} */
+
+/* static test_Repair() {{{
+ * Repairs the table and returns the problems repaired
+ */
+static int test_Repair(void)
+{
+	P_DBF *p_dbf;
+	int repaired;
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	repaired = dbf_Repair(p_dbf);
+	CHECK(0 == dbf_Close(p_dbf));
+	return repaired;
+}
+/* }}} */
+
+/* static test_Size() {{{
+ * Returns the size of the table file
+ */
+static off_t test_Size(void)
+{
+	struct stat st;
+
+	CHECK(0 == stat(TEST_TABLE, &st));
+	return st.st_size;
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DBF_VERIFY v;
+	off_t end;
+	char flag = 'X';
+
+	/* a healthy table */
+	test_Table();
+	end = test_Offset(TEST_RECORDS);
+	CHECK(0 == test_Verify(DBF_VERIFY_FIELDS, &v));
+	CHECK(v.records_in_file == TEST_RECORDS);
+	CHECK(v.file_size == (u_int64_t) end + v.eof_marker && v.expected_size == (u_int64_t) end);
+	CHECK(v.first_bad == -1);
+	CHECK(0 == test_Repair());
+
+	/* fields not fitting their type are only found when asked for */
+	test_Write(test_Offset(15000) + 1, "12abc   ", 8);
+	test_Write(test_Offset(17000) + 9, "20241301", 8);
+	test_Write(test_Offset(19000) + 17, "X", 1);
+	CHECK(DBF_PROBLEM_FIELDS == test_Verify(DBF_VERIFY_FIELDS, &v));
+	CHECK(v.bad_fields == 3 && v.bad_flags == 0 && v.first_bad == 15000);
+	CHECK(0 == test_Verify(0, &v));
+	/* they are not repaired */
+	CHECK(0 == test_Repair());
+	CHECK(DBF_PROBLEM_FIELDS == test_Verify(DBF_VERIFY_FIELDS, &v));
+
+	/* bad deletion flags */
+	test_Table();
+	test_Write(test_Offset(123), &flag, 1);
+	test_Write(test_Offset(TEST_RECORDS - 1), &flag, 1);
+	CHECK(DBF_PROBLEM_FLAGS == test_Verify(0, &v));
+	CHECK(v.bad_flags == 2 && v.first_bad == 123);
+
+	/* a record written partly at the end */
+	test_Table();
+	end = test_Offset(TEST_RECORDS);
+	CHECK(0 == truncate(TEST_TABLE, end));
+	test_Write(end, " 12345", 6);
+	CHECK(DBF_PROBLEM_SIZE == test_Verify(0, &v));
+	CHECK(v.records_in_file == TEST_RECORDS && v.eof_marker == 0);
+	CHECK(DBF_PROBLEM_SIZE == test_Repair());
+	CHECK(0 == test_Verify(DBF_VERIFY_FIELDS, &v));
+	CHECK(test_Size() == end + 1);
+
+	/* a header behind the records in the file */
+	test_Table();
+	test_Count(TEST_RECORDS - 10);
+	CHECK(DBF_PROBLEM_COUNT == test_Verify(0, &v));
+	CHECK(v.records_in_file == TEST_RECORDS);
+	CHECK(DBF_PROBLEM_COUNT == test_Repair());
+	CHECK(0 == test_Verify(DBF_VERIFY_FIELDS, &v));
+	CHECK(v.records_in_file == TEST_RECORDS);
+
+	/* a header ahead of a partly written last record */
+	test_Table();
+	end = test_Offset(TEST_RECORDS);
+	CHECK(0 == truncate(TEST_TABLE, end - 3));
+	CHECK((DBF_PROBLEM_SIZE | DBF_PROBLEM_COUNT) == test_Verify(0, &v));
+	CHECK(v.records_in_file == TEST_RECORDS - 1);
+	CHECK((DBF_PROBLEM_SIZE | DBF_PROBLEM_COUNT) == test_Repair());
+	CHECK(0 == test_Verify(DBF_VERIFY_FIELDS, &v));
+	CHECK(v.records_in_file == TEST_RECORDS - 1);
+
+	/* an interrupted batch of the last 1000 records */
+	test_Table();
+	test_Count(TEST_RECORDS - 1000);
+	flag = 1;
+	test_Write(14, &flag, 1);
+	CHECK((DBF_PROBLEM_TRANSACTION | DBF_PROBLEM_COUNT) == test_Verify(0, &v));
+	CHECK(DBF_PROBLEM_TRANSACTION == test_Repair());
+	CHECK(0 == test_Verify(DBF_VERIFY_FIELDS, &v));
+	CHECK(v.records_in_file == TEST_RECORDS - 1000);
+	CHECK(test_Size() == test_Offset(TEST_RECORDS - 1000) + 1);
+
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
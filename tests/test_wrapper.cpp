@@ -0,0 +1,148 @@
+/*****************************************************************************
+ * test_wrapper.cpp
+ *****************************************************************************
+ * Reads a table through the C++17 interface of dbf.hpp
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include <string>
+
+#include "test.h"
+#include "libdbf/dbf.hpp"
+
+#define TEST_TABLE "test_wrapper.dbf"
+#define TEST_RECORDS 500
+
+/* static test_Fill() {{{
+ * Name, a signed amount with decimals, a count and a logical
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	char buf[64];
+
+	(void) data;
+	snprintf(buf, sizeof(buf), "name %u", recno);
+	test_Put(record, buf);
+	snprintf(buf, sizeof(buf), "%10.2f%6d%c", (recno % 2 ? -1.0 : 1.0) * recno / 4.0,
+		(int) recno - 250, recno % 3 ? 'T' : 'f');
+	test_Put(record + 12, buf);
+	/* every tenth count is left blank */
+	if (recno % 10 == 0)
+		memset(record + 22, ' ', 6);
+}
+/* }}} */
+
+/* static test_Scan() {{{
+ * Reads every record of t and checks its fields
+ */
+static void test_Scan(dbf::table &t)
+{
+	u_int32_t recno = 0;
+	int name = t.column("NAME"), amount = t.column("AMOUNT");
+	int count = t.column("COUNT"), active = t.column("ACTIVE");
+
+	for (auto rec : t.records()) {
+		std::string want = "name " + std::to_string(recno);
+
+		CHECK(!rec.deleted());
+		CHECK(rec.get<std::string_view>(name) == want);
+		CHECK(rec.get<std::string>(name) == want);
+		CHECK(rec.field(name).size() == 12);
+		CHECK(rec.get<double>(amount) == (recno % 2 ? -1.0 : 1.0) * recno / 4.0);
+		/* decimals are cut off for integers */
+		CHECK(rec.get<long>(amount) == (long) ((recno % 2 ? -1.0 : 1.0) * recno / 4.0));
+		CHECK(rec.get<int>(count) == (recno % 10 ? (int) recno - 250 : 0));
+		CHECK(rec.get<bool>(active) == (recno % 3 != 0));
+		recno++;
+	}
+	CHECK(recno == TEST_RECORDS);
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[4];
+	bool thrown;
+
+	dbf_SetField(&fields[0], 'C', "NAME", 12, 0);
+	dbf_SetField(&fields[1], 'N', "AMOUNT", 10, 2);
+	dbf_SetField(&fields[2], 'N', "COUNT", 6, 0);
+	dbf_SetField(&fields[3], 'L', "ACTIVE", 1, 0);
+	test_Create(TEST_TABLE, fields, 4, TEST_RECORDS, test_Fill, NULL);
+
+	dbf::table t(TEST_TABLE);
+	CHECK(t);
+	CHECK(t.rows() == TEST_RECORDS);
+	CHECK(t.columns() == 4);
+	CHECK(t.record_length() == 30);
+	CHECK(t.column("AMOUNT") == 1);
+	CHECK(t.column("MISSING") == -1);
+	CHECK(t.column_name(3) == "ACTIVE");
+	CHECK(t.column_type(1) == 'N');
+	CHECK(t.column_size(2) == 6);
+	CHECK(t.column_decimals(1) == 2);
+	test_Scan(t);
+	/* a second loop starts again at the first record */
+	test_Scan(t);
+
+	/* text is not a number */
+	thrown = false;
+	try {
+		for (auto rec : t.records()) {
+			rec.get<int>(t.column("NAME"));
+		}
+	} catch (const dbf::error &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	/* moving hands over the handle and the columns */
+	dbf::table moved(std::move(t));
+	CHECK(!t);
+	CHECK(t.columns() == 0);
+	CHECK(moved.columns() == 4);
+	test_Scan(moved);
+	t = std::move(moved);
+	CHECK(!moved);
+	test_Scan(t);
+
+	/* a handle of the C interface can be adopted and given back */
+	P_DBF *p_dbf = t.release();
+	CHECK(!t);
+	dbf::table adopted(p_dbf);
+	CHECK(adopted.get() == p_dbf);
+	test_Scan(adopted);
+	CHECK(0 == adopted.close());
+	CHECK(!adopted);
+
+	thrown = false;
+	try {
+		dbf::table missing("test_wrapper.missing.dbf");
+	} catch (const dbf::error &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ * test_zonemap.c
+ *****************************************************************************
+ * Range scans with and without a zone map must find the same records
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ ****************************************************************************/
+
+#include "test.h"
+
+#include <time.h>
+#include <utime.h>
+
+#define TEST_TABLE "test_zonemap.dbf"
+#define TEST_RECORDS 20000
+#define TEST_BLOCK 256
+
+typedef struct {
+	int column;
+	double low;
+	double high;
+	u_int32_t last;
+	int count;
+} TEST_SCAN;
+
+/* static test_Fill() {{{
+ * Dates rising with the record number, amounts rising with a little
+ * noise and every 97th amount blank, so most blocks can be skipped
+ */
+static void test_Fill(char *record, u_int32_t recno, void *data)
+{
+	u_int32_t *state = data;
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%04u%02u%02u", 2000 + recno / 336, recno / 28 % 12 + 1, recno % 28 + 1);
+	test_Put(record, buf);
+	if (recno % 97) {
+		snprintf(buf, sizeof(buf), "%10.2f", recno / 10.0 + test_Random(state) % 100 / 10.0);
+		test_Put(record + 8, buf);
+	}
+}
+/* }}} */
+
+/* static test_Match() {{{
+ * Checks every record passed by the scan
+ */
+static int test_Match(P_DBF *p_dbf, const char *record, u_int32_t recno, void *data)
+{
+	TEST_SCAN *scan = data;
+	char buf[16];
+	double value;
+	int offset = test_Field(p_dbf, scan->column);
+
+	memcpy(buf, record + offset, 10);
+	buf[10] = '\0';
+	value = strtod(buf, NULL);
+	CHECK(value >= scan->low && value <= scan->high);
+	CHECK(scan->count == 0 || recno > scan->last);
+	scan->last = recno;
+	scan->count++;
+	return 0;
+}
+/* }}} */
+
+/* static test_Count() {{{
+ * Counts the records in a range by reading all of them
+ */
+static int test_Count(P_DBF *p_dbf, double low, double high)
+{
+	char *records, *rec, buf[16];
+	int i, reclen, count = 0;
+
+	reclen = dbf_RecordLength(p_dbf);
+	CHECK(NULL != (records = malloc((size_t) TEST_RECORDS * reclen)));
+	CHECK(TEST_RECORDS == dbf_ReadRecords(p_dbf, 0, TEST_RECORDS, records));
+	for (i = 0, rec = records; i < TEST_RECORDS; i++, rec += reclen) {
+		memcpy(buf, rec + test_Field(p_dbf, 1), 10);
+		buf[10] = '\0';
+		if (strspn(buf, " ") < 10 && strtod(buf, NULL) >= low && strtod(buf, NULL) <= high) {
+			count++;
+		}
+	}
+	free(records);
+	return count;
+}
+/* }}} */
+
+/* static test_Scan() {{{
+ * Scans an amount range with and without the zone map
+ */
+static void test_Scan(P_DBF *p_dbf, DBF_ZONEMAP *zm, double low, double high)
+{
+	TEST_SCAN scan;
+	char lowbuf[32], highbuf[32];
+	int want = test_Count(p_dbf, low, high);
+
+	snprintf(lowbuf, sizeof(lowbuf), "%.2f", low);
+	snprintf(highbuf, sizeof(highbuf), "%.2f", high);
+	memset(&scan, 0, sizeof(scan));
+	scan.column = 1;
+	scan.low = low;
+	scan.high = high;
+	CHECK(want == dbf_ScanRange(p_dbf, zm, 1, lowbuf, highbuf, test_Match, &scan));
+	CHECK(want == scan.count);
+	CHECK(want == dbf_ScanRange(p_dbf, NULL, 1, lowbuf, highbuf, NULL, NULL));
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(void)
+{
+	DB_FIELD fields[2];
+	DBF_ZONEMAP *zm;
+	P_DBF *p_dbf;
+	struct utimbuf times;
+	u_int32_t state = 1;
+
+	dbf_SetField(&fields[0], 'D', "DAY", 8, 0);
+	dbf_SetField(&fields[1], 'N', "AMOUNT", 10, 2);
+	test_Create(TEST_TABLE, fields, 2, TEST_RECORDS, test_Fill, &state);
+	/* an older modification time, so the rewrite below changes it even
+	 * on file systems with a coarse clock */
+	times.actime = times.modtime = time(NULL) - 3600;
+	CHECK(0 == utime(TEST_TABLE, &times));
+
+	CHECK(NULL != (p_dbf = dbf_OpenFlags(TEST_TABLE, DBF_OPEN_RDWR)));
+	CHECK(0 == dbf_ZoneMapBuild(p_dbf, TEST_TABLE, TEST_BLOCK));
+	CHECK(NULL != (zm = dbf_ZoneMapOpen(p_dbf, TEST_TABLE)));
+
+	test_Scan(p_dbf, zm, 0, 5);
+	test_Scan(p_dbf, zm, 500, 520.5);
+	test_Scan(p_dbf, zm, 1234.5, 1300);
+	test_Scan(p_dbf, zm, 1999, 5000);
+	test_Scan(p_dbf, zm, -10, -1);
+	test_Scan(p_dbf, zm, -1e9, 1e9);
+	/* dates are compared as strings */
+	CHECK(336 == dbf_ScanRange(p_dbf, zm, 0, "20050101", "20051231", NULL, NULL));
+	/* numeric bounds must be numbers */
+	CHECK(-1 == dbf_ScanRange(p_dbf, zm, 1, "12abc", NULL, NULL, NULL));
+	dbf_ZoneMapClose(zm);
+
+	/* a record rewritten in place on the same day outdates the map */
+	CHECK(0 == dbf_UpdateField(p_dbf, 5, 1, "  99999.00", 10));
+	CHECK(0 == dbf_Flush(p_dbf));
+	CHECK(NULL == dbf_ZoneMapOpen(p_dbf, TEST_TABLE));
+	CHECK(1 == dbf_ScanRange(p_dbf, NULL, 1, "99999", NULL, NULL, NULL));
+
+	CHECK(0 == dbf_Close(p_dbf));
+	unlink(TEST_TABLE ".zmap");
+	unlink(TEST_TABLE);
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */